@@ -1,15 +1,15 @@
 #include <pangolin/pangolin.h>
+#include <pangolin/video/video_output.h>
 
-#include <pangolin/utils/posix/condition_variable.h>
-#include <pangolin/utils/posix/shared_memory_buffer.h>
-#include <pangolin/utils/timer.h>
-
+#include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <memory>
+#include <thread>
+#include <vector>
 
-// This sample acts as a soft camera. It writes a pattern of GRAY8 pixels to the
-// shared memory space. It can be seen in Pangolin's SimpleVideo sample using
-// the shmem:[size=640x480]//example video URI.
+// This sample acts as a soft camera. It publishes a pattern of GRAY8 pixels to
+// a shared memory frame ring. It can be seen in Pangolin's SimpleVideo sample
+// using the shmem://example video URI, by any number of readers at once.
 
 using namespace pangolin;
 
@@ -22,31 +22,21 @@ unsigned char generate_value(double t)
 
 int main(/*int argc, char *argv[]*/)
 {
-  std::string shmem_name = "/example";
+  const size_t w = 640;
+  const size_t h = 480;
 
-  std::shared_ptr<SharedMemoryBufferInterface> shmem_buffer =
-    create_named_shared_memory_buffer(shmem_name, 640 * 480);
-  if (!shmem_buffer) {
-    perror("Unable to create shared memory buffer");
-    exit(1);
-  }
+  VideoOutput output("shmem:[slots=4]//example");
+  output.AddStream(PixelFormatFromString("GRAY8"), w, h);
+  output.SetStreams();
 
-  std::string cond_name = shmem_name + "_cond";
-  std::shared_ptr<ConditionVariableInterface> buffer_full =
-    create_named_condition_variable(cond_name);
+  std::vector<unsigned char> image(w*h);
 
   // Sit in a loop and write gray values based on some timing pattern.
+  // Readers never block the writer: slow readers skip frames instead.
   while (true) {
-    shmem_buffer->lock();
-    unsigned char *ptr = shmem_buffer->ptr();
     unsigned char value = generate_value(std::chrono::system_clock::now().time_since_epoch().count());
-
-    for (int i = 0; i < 640*480; ++i) {
-      ptr[i] = value;
-    }
-
-    shmem_buffer->unlock();
-    buffer_full->signal();
+    std::fill(image.begin(), image.end(), value);
+    output.WriteStreams(image.data());
 
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
   }
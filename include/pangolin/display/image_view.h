@@ -53,6 +53,13 @@ class ImageView : public pangolin::View, public pangolin::ImageViewHandler
 
     void SetRenderOverlay(const bool& val);
 
+    // Fit the offset / scale to every host image as it is set, before upload.
+    // saturate_fraction of the darkest and brightest samples are ignored.
+    // Toggled with 'A'.
+    ImageView& SetAutoScale(bool enabled, float saturate_fraction = 0.0f);
+
+    bool AutoScale() const;
+
 //  private:
     // img_to_load contains image data that should be uploaded to the texture on
     // the next render cycle. The data is owned by this object and should be
@@ -67,8 +74,15 @@ class ImageView : public pangolin::View, public pangolin::ImageViewHandler
     bool mouseReleased;
     bool mousePressed;
     bool overlayRender;
+    bool auto_scale;
+    float auto_scale_saturate;
+    // Min / max of the last auto-scaled image within the region used
+    std::pair<float, float> auto_scale_range;
 
     std::mutex texlock;
+
+  protected:
+    void UpdateAutoScale(const pangolin::Image<unsigned char>& img, const pangolin::GlPixFormat& img_fmt);
 };
 
 }
@@ -41,6 +41,22 @@
 namespace pangolin
 {
 
+// Node of a spatial octree over the rows of a Geometry::Element. Nodes are
+// stored depth-first and rows are reordered so that every subtree covers the
+// contiguous range [first, first+count).
+struct GeometryOctreeNode
+{
+    float min[3];
+    float max[3];
+    uint32_t first;
+    uint32_t count;
+    // Index of the next node outside of this subtree
+    uint32_t skip;
+    bool leaf;
+};
+
+using GeometryOctree = std::vector<GeometryOctreeNode>;
+
 struct Geometry
 {
     struct Element : public ManagedImage<uint8_t> {
@@ -55,6 +71,8 @@ struct Geometry
         using Attribute = variant<Image<float>,Image<uint32_t>,Image<uint16_t>,Image<uint8_t>>;
         // "vertex", "rgb", "normal", "uv", "tris", "quads", ...
         std::map<std::string, Attribute> attributes;
+        // Optional spatial index over rows, see BuildGeometryOctree()
+        GeometryOctree octree;
     };
 
     // Store vertices and attributes
@@ -67,7 +85,17 @@ struct Geometry
 
 pangolin::Geometry::Element::Attribute MakeAttribute(uint32_t gldatatype, size_t num_items, size_t count_per_item, void* ptr, size_t pitch_bytes);
 
-pangolin::Geometry LoadGeometry(const std::string& filename);
+// If use_cache is set, a binary snapshot of the standardized geometry is
+// read from (or written to) GeometryCacheFilename(filename) to avoid
+// re-parsing on subsequent loads. See geometry_cache.h
+pangolin::Geometry LoadGeometry(const std::string& filename, bool use_cache = false);
+
+// Reorder the rows of geom so that they can be culled spatially by octree.
+// For point clouds (no objects) vertices are reordered, along with every
+// other buffer with one row per vertex, and rows within each leaf are
+// shuffled so that any prefix of a leaf is a uniform subsample.
+// For meshes the faces of each object are reordered by centroid.
+void BuildGeometryOctree(Geometry& geom, size_t max_rows_per_leaf = 1 << 15);
 
 #ifdef HAVE_EIGEN
 inline Eigen::AlignedBox3f GetAxisAlignedBox(const Geometry& geom)
@@ -0,0 +1,62 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/geometry/geometry.h>
+
+namespace pangolin {
+
+// Binary, versioned snapshot of a fully standardized Geometry. Buffer data
+// is stored uncompressed and 64 byte aligned so that loading is a handful
+// of large sequential reads with no parsing. Every other field, including
+// octree nodes, is written explicitly with a fixed width.
+//
+// A cache is only valid for the source contents it was made from: the
+// source size and a hash of its contents are stored in the header and
+// checked on load, so touching or copying the source keeps the cache
+// whilst editing it in place does not. Geometry which has been post
+// processed (e.g. reordered by BuildGeometryOctree) is cached under a
+// post_process_key naming the processing and its parameters. The key is
+// stored in the header and each key has its own file, so caches made with
+// different processing are never confused.
+
+const uint32_t GEOMETRY_CACHE_VERSION = 3;
+
+// Conventional cache filename for source, with no post processing if
+// post_process_key is empty.
+std::string GeometryCacheFilename(const std::string& source_filename, const std::string& post_process_key = std::string());
+
+void SaveGeometryCache(const Geometry& geom, const std::string& cache_filename, const std::string& source_filename, const std::string& post_process_key = std::string());
+
+// Returns false if the cache is missing, from a different version, stale
+// with respect to source_filename, made with a different post_process_key,
+// or truncated or corrupt. Never throws on bad cache contents.
+bool TryLoadGeometryCache(Geometry& geom, const std::string& cache_filename, const std::string& source_filename, const std::string& post_process_key = std::string());
+
+}
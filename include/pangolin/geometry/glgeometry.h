@@ -31,6 +31,9 @@
 #include <pangolin/gl/gl.h>
 #include <pangolin/gl/glsl.h>
 
+#include <functional>
+#include <future>
+
 namespace pangolin {
 
 struct GlGeometry
@@ -62,6 +65,8 @@ struct GlGeometry
             size_t stride_bytes;
         };
         std::map<std::string, Attribute> attributes;
+        // Spatial index over rows, copied from Geometry::Element::octree
+        GeometryOctree octree;
     };
 
     inline bool HasAttribute(const std::string& name) const
@@ -84,4 +89,69 @@ GlGeometry ToGlGeometry(const Geometry& geom);
 
 void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture *matcap);
 
+// Loads geometry on a background thread, then uploads it to the GPU
+// incrementally so that a render loop never stalls on a large model:
+//
+//   GlGeometryLoader loader(filename);
+//   while(...) {
+//       if(loader.Upload(64<<20)) GlDraw(prog, loader.GetGlGeometry(), ...);
+//   }
+class PANGOLIN_EXPORT GlGeometryLoader
+{
+public:
+    enum State { Loading, Uploading, Ready, Failed };
+
+    // post_process runs on the loading thread, e.g. BuildGeometryOctree.
+    // With use_cache, the post-processed geometry is cached (see
+    // geometry_cache.h) under post_process_key, which must name the
+    // processing and its parameters, and post_process is skipped on a
+    // cache hit. Post processed geometry without a key isn't cached.
+    GlGeometryLoader(const std::string& filename, const std::function<void(Geometry&)>& post_process = nullptr, bool use_cache = false, const std::string& post_process_key = std::string());
+
+    // Waits for background loading to finish
+    ~GlGeometryLoader();
+
+    State GetState() const;
+
+    // Fraction of bytes uploaded to the GPU, [0,1]. Zero whilst parsing.
+    float Progress() const;
+
+    // Call from the thread owning the GL context. Uploads at most
+    // max_bytes (but at least one texture or buffer slice) and returns
+    // true once the GlGeometry is complete. Rethrows any loading error.
+    bool Upload(size_t max_bytes);
+
+    // Valid once Upload() has returned true
+    GlGeometry& GetGlGeometry();
+
+    // CPU side geometry, valid once state is Uploading or Ready
+    const Geometry& GetGeometry() const;
+
+protected:
+    struct PendingUpload
+    {
+        GlBufferData* buffer;
+        const uint8_t* data;
+        size_t size_bytes;
+        size_t uploaded_bytes;
+    };
+
+    void BeginUpload();
+
+    State state;
+    std::future<Geometry> loading;
+    Geometry geom;
+    GlGeometry glgeom;
+    std::vector<PendingUpload> pending;
+    std::vector<std::string> pending_textures;
+    size_t total_bytes;
+    size_t uploaded_bytes;
+};
+
+// Draw geom, culling octree chunks (see BuildGeometryOctree) against the
+// view frustum of the clip matrix KT_cw = projection * modelview. Geometry
+// without objects is drawn as points, with at most point_budget points per
+// call distributed over visible chunks by their projected screen area.
+void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture *matcap, const OpenGlMatrix& KT_cw, size_t point_budget = 10000000);
+
 }
@@ -0,0 +1,132 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/gl/gl.h>
+#include <pangolin/gl/glsl.h>
+#include <pangolin/gl/colour.h>
+#include <pangolin/display/opengl_render_state.h>
+
+#include <array>
+#include <vector>
+
+#ifndef HAVE_GLES
+
+namespace pangolin
+{
+
+// Unit geometry shared by every instance of a primitive. Each one
+// mirrors the immediate-mode helper of the same name in gldraw.h.
+enum GlPrimitiveType
+{
+    GlPrimitiveAxis = 0,       // glDrawAxis(1)
+    GlPrimitiveFrustum,        // glDrawFrustum, canonical unit frustum
+    GlPrimitiveColouredCube,   // glDrawColouredCube(-0.5,+0.5)
+    GlPrimitiveCircle,         // glDrawCircle(0,0,1)
+    GlPrimitiveCross,          // glDrawCross(0,0,0,1)
+    GlPrimitiveCount
+};
+
+// Batches many instances of the primitives in gldraw.h and renders each
+// primitive type with a single instanced draw call. Unit geometry lives in
+// static VBOs; per instance transforms and colours are streamed once per
+// Render(). Requires an OpenGL context supporting instanced arrays
+// (OpenGL 3.3 or ARB_instanced_arrays).
+//
+// Instances are rendered relative to the current fixed-function
+// projection and modelview matrices, so a batch can replace a loop of
+// glDrawFrustum / glDrawAxis calls at an existing call site:
+//
+//   batch.Clear();
+//   for(auto& T_wc : poses) batch.AddFrustum(T_wc, Kinv, w, h, 0.1f);
+//   batch.Render();
+class PANGOLIN_EXPORT GlPrimitiveBatch
+{
+public:
+    GlPrimitiveBatch();
+
+    // Remove all instances. GPU buffers are kept for reuse next frame.
+    void Clear();
+
+    size_t NumInstances() const;
+
+    // Add an instance of unit primitive type, transformed by T_wp and
+    // modulated by colour.
+    void Add(GlPrimitiveType type, const OpenGlMatrix& T_wp, const Colour& colour = Colour::White());
+
+    void AddAxis(const OpenGlMatrix& T_wf, float scale);
+
+    void AddFrustum(const OpenGlMatrix& T_wf, GLfloat u0, GLfloat v0, GLfloat fu, GLfloat fv, int w, int h, GLfloat scale, const Colour& colour = Colour::White());
+
+    void AddColouredCube(const OpenGlMatrix& T_wf, GLfloat axis_min=-0.5f, GLfloat axis_max = +0.5f);
+
+    void AddCircle(GLfloat x, GLfloat y, GLfloat rad, const Colour& colour = Colour::White());
+
+    void AddCross(GLfloat x, GLfloat y, GLfloat z, GLfloat rad, const Colour& colour = Colour::White());
+
+#ifdef HAVE_EIGEN
+    template<typename T>
+    void AddFrustum(const Eigen::Matrix<T,4,4>& T_wf, const Eigen::Matrix<T,3,3>& Kinv, int w, int h, GLfloat scale, const Colour& colour = Colour::White())
+    {
+        AddFrustum(OpenGlMatrix(T_wf), (GLfloat)Kinv(0,2), (GLfloat)Kinv(1,2), (GLfloat)Kinv(0,0), (GLfloat)Kinv(1,1), w, h, scale, colour);
+    }
+#endif
+
+    // Draw all instances with one draw call per primitive type.
+    void Render();
+
+protected:
+    struct Instance
+    {
+        GLfloat T_wp[16];
+        GLfloat colour[4];
+    };
+
+    struct Primitive
+    {
+        GLenum mode;
+        GLsizei num_vertices;
+        bool has_vertex_colour;
+        GlBuffer vbo;
+        GlBuffer cbo;
+        GlBufferData instance_bo;
+        std::vector<Instance> instances;
+    };
+
+    void InitGlResources();
+
+    void InitPrimitive(GlPrimitiveType type, GLenum mode, const std::vector<GLfloat>& verts, const std::vector<GLfloat>& cols = std::vector<GLfloat>());
+
+    bool initialised;
+    GlSlProgram prog;
+    std::array<Primitive,GlPrimitiveCount> primitives;
+};
+
+}
+
+#endif // HAVE_GLES
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pangolin/image/managed_image.h>
+#include <pangolin/image/typed_image.h>
 #include <pangolin/utils/compontent_cast.h>
 
 namespace pangolin
@@ -28,4 +29,34 @@ ManagedImage<To> ImageConvert(const Image<T>& src, To scale = 1.0)
     return dst;
 }
 
+// Returns true if ConvertImage supports converting src_fmt to dst_fmt.
+// Any format listed in pixel_format.cpp can be read; all except YUYV422,
+// UYVY422 and packed GRAY10 / GRAY12 can be written.
+PANGOLIN_EXPORT
+bool CanConvertImage(const PixelFormat& src_fmt, const PixelFormat& dst_fmt);
+
+// Scale used by ConvertImage when none is given. Integer formats of
+// differing bit depth are rescaled (e.g. GRAY16LE -> GRAY8 is 1/256),
+// everything else is 1.
+PANGOLIN_EXPORT
+float DefaultConvertScale(const PixelFormat& src_fmt, const PixelFormat& dst_fmt);
+
+// Convert src, of format src_fmt, into dst of format dst_fmt and the same
+// dimensions. Each channel is mapped to src*scale + offset, rounded and
+// saturated for integer formats. Where colour models differ:
+//   YUYV422 / UYVY422 are decoded with BT.601 studio range coefficients
+//   RGB is reduced to GRAY with BT.601 luma weights
+//   GRAY is replicated to RGB, and absent alpha becomes opaque
+// Common pairs (YUV422 -> RGB / GRAY, channel swizzles between 8 bit
+// formats, and 8 / 16 bit / float rescaling) use SIMD kernels selected for
+// the host CPU at runtime. Throws std::runtime_error if unsupported.
+PANGOLIN_EXPORT
+void ConvertImage(Image<unsigned char>& dst, const PixelFormat& dst_fmt, const Image<unsigned char>& src, const PixelFormat& src_fmt, float scale, float offset = 0.0f);
+
+PANGOLIN_EXPORT
+void ConvertImage(Image<unsigned char>& dst, const PixelFormat& dst_fmt, const Image<unsigned char>& src, const PixelFormat& src_fmt);
+
+PANGOLIN_EXPORT
+TypedImage ConvertImage(const TypedImage& src, const PixelFormat& dst_fmt);
+
 }
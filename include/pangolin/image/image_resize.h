@@ -0,0 +1,71 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/image/image.h>
+#include <pangolin/image/pixel_format.h>
+#include <pangolin/utils/worker_pool.h>
+
+#include <string>
+
+namespace pangolin
+{
+
+enum ResizeMethod
+{
+    ResizeMethodBox = 0,  // mean of integer factor blocks, e.g. 2x2
+    ResizeMethodArea,     // mean weighted by overlap, any downscale
+    ResizeMethodBilinear  // interpolation between pixel centres
+};
+
+PANGOLIN_EXPORT
+ResizeMethod ResizeMethodFromString(const std::string& str);
+
+// Returns true if ResizeImage supports images of pixel format fmt: any
+// interleaved 8 bit, 16 bit or float format with up to 4 channels.
+PANGOLIN_EXPORT
+bool CanResizeImage(const PixelFormat& fmt);
+
+// Resize src into dst, both of pixel format fmt. Box requires
+// dst = floor(src / f) for an integer factor f, ignoring any remainder,
+// otherwise it falls back to Area. Area falls back to Bilinear when
+// enlarging.
+// 2x box reduction of 8 bit formats uses an SSSE3 kernel, and weighted
+// sums use AVX2 when available at runtime. Rows are split between the
+// threads of workers and the caller.
+// Throws std::runtime_error if fmt is unsupported.
+PANGOLIN_EXPORT
+void ResizeImage(Image<unsigned char>& dst, const Image<unsigned char>& src, const PixelFormat& fmt, ResizeMethod method, WorkerPool& workers);
+
+// As above, with rows split between up to 'threads' threads started for
+// this call. Keep a WorkerPool instead when resizing repeatedly.
+PANGOLIN_EXPORT
+void ResizeImage(Image<unsigned char>& dst, const Image<unsigned char>& src, const PixelFormat& fmt, ResizeMethod method, size_t threads = 1);
+
+}
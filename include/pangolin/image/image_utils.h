@@ -27,8 +27,10 @@
 
 #pragma once
 
+#include <cmath>
 #include <limits>
 #include <utility>
+#include <vector>
 
 #include <pangolin/image/image.h>
 #include <pangolin/plot/range.h>
@@ -81,6 +83,83 @@ std::pair<float, float> GetMinMax(const Image<T>& img, size_t channels)
     return mm;
 }
 
+// Vectorised min / max of all colour channels (alpha ignored). NaNs are skipped.
+PANGOLIN_EXPORT std::pair<float, float> GetMinMax(const Image<unsigned char>& img, size_t channels);
+PANGOLIN_EXPORT std::pair<float, float> GetMinMax(const Image<unsigned short>& img, size_t channels);
+PANGOLIN_EXPORT std::pair<float, float> GetMinMax(const Image<float>& img, size_t channels);
+
+// Accumulate colour channels (alpha ignored) into bins.size() equal width
+// bins spanning [lo, hi]. Values outside the range land in the end bins and
+// NaNs are skipped.
+template <typename T>
+void GetHistogram(const Image<T>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    if(bins.empty()) return;
+    const size_t colour_channels = std::min<size_t>(channels, 3);
+    const float max_bin = (float)(bins.size() - 1);
+    const float s = hi > lo ? bins.size() / (hi - lo) : 0.0f;
+
+    for(size_t y = 0; y < img.h; ++y)
+    {
+        const T* pix = img.RowPtr(y);
+        for(size_t x = 0; x < img.w; ++x)
+        {
+            for(size_t c = 0; c < colour_channels; ++c)
+            {
+                const float v = ((float)pix[c] - lo) * s;
+                if(v == v) {
+                    bins[(size_t)std::min(std::max(v, 0.0f), max_bin)]++;
+                }
+            }
+            pix += channels;
+        }
+    }
+}
+
+PANGOLIN_EXPORT void GetHistogram(const Image<unsigned char>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins);
+PANGOLIN_EXPORT void GetHistogram(const Image<unsigned short>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins);
+PANGOLIN_EXPORT void GetHistogram(const Image<float>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins);
+
+// Range containing all but the lo_fraction darkest and 1-hi_fraction
+// brightest samples, resolved to 1/4096 of the image's min / max range.
+template <typename T>
+std::pair<float, float> GetPercentileRange(const Image<T>& img, size_t channels, float lo_fraction, float hi_fraction)
+{
+    const std::pair<float, float> mm = GetMinMax(img, channels);
+    if(!(mm.first < mm.second) || (lo_fraction <= 0.0f && hi_fraction >= 1.0f)) {
+        return mm;
+    }
+
+    std::vector<size_t> bins(4096, 0);
+    GetHistogram(img, channels, mm.first, mm.second, bins);
+
+    size_t total = 0;
+    for(size_t n : bins) total += n;
+
+    const float bin_width = (mm.second - mm.first) / bins.size();
+    const double lo_rank = (double)std::max(0.0f, lo_fraction) * total;
+    const double hi_rank = (double)std::min(1.0f, hi_fraction) * total;
+
+    std::pair<float, float> range = mm;
+    size_t seen = 0;
+    size_t i = 0;
+    for(; i < bins.size(); ++i) {
+        seen += bins[i];
+        if(seen > lo_rank) {
+            range.first = mm.first + i * bin_width;
+            break;
+        }
+    }
+    for(; i < bins.size(); ++i) {
+        if(seen >= hi_rank) {
+            range.second = std::min(mm.second, mm.first + (i + 1) * bin_width);
+            break;
+        }
+        if(i + 1 < bins.size()) seen += bins[i + 1];
+    }
+    return range;
+}
+
 template<typename T>
 pangolin::Image<T> GetImageRoi( pangolin::Image<T> img, size_t channels, const pangolin::XYRangei& roi )
 {
@@ -91,22 +170,29 @@ pangolin::Image<T> GetImageRoi( pangolin::Image<T> img, size_t channels, const p
     );
 }
 
-template<typename T>
-std::pair<float,float> GetOffsetScale(const pangolin::Image<T>& img, size_t channels, float type_max, float format_max)
+inline std::pair<float,float> OffsetScaleFromRange(const std::pair<float,float>& mm, float type_max, float format_max)
 {
-    // Find min / max of all channels, ignoring 4th alpha channel
-    const std::pair<float,float> mm = internal::GetMinMax<T>(img,channels);
     const float type_scale = format_max / type_max;
     const float offset = -type_scale* mm.first;
     const float scale = type_max / (mm.second - mm.first);
     return std::pair<float,float>(offset, scale);
 }
 
+template<typename T>
+std::pair<float,float> GetOffsetScale(const pangolin::Image<T>& img, size_t channels, float type_max, float format_max, float saturate_fraction = 0.0f)
+{
+    // Find min / max of all channels, ignoring 4th alpha channel
+    const std::pair<float,float> mm = saturate_fraction > 0.0f ?
+        internal::GetPercentileRange(img, channels, saturate_fraction, 1.0f - saturate_fraction) :
+        internal::GetMinMax(img,channels);
+    return OffsetScaleFromRange(mm, type_max, format_max);
+}
+
 template<typename T>
 float GetScaleOnly(const pangolin::Image<T>& img, size_t channels, float type_max, float /*format_max*/)
 {
     // Find min / max of all channels, ignoring 4th alpha channel
-    const std::pair<float,float> mm = internal::GetMinMax<T>(img,channels);
+    const std::pair<float,float> mm = internal::GetMinMax(img,channels);
     const float scale = type_max / mm.second;
     return scale;
 }
@@ -136,9 +222,13 @@ inline std::pair<float, float> GetMinMax(
     }
 }
 
+// Offset and scale mapping the range of the image within iroi to the
+// display range. saturate_fraction > 0 ignores that fraction of the darkest
+// and brightest samples, which is more robust to outliers and hot pixels.
 inline std::pair<float,float> GetOffsetScale(
     const pangolin::Image<unsigned char>& img,
-    pangolin::XYRangei iroi, const pangolin::GlPixFormat& glfmt
+    pangolin::XYRangei iroi, const pangolin::GlPixFormat& glfmt,
+    float saturate_fraction = 0.0f
 ) {
     using namespace internal;
 
@@ -147,18 +237,82 @@ inline std::pair<float,float> GetOffsetScale(
     const size_t num_channels = pangolin::GlFormatChannels(glfmt.glformat);
 
     if(glfmt.gltype == GL_UNSIGNED_BYTE) {
-        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<unsigned char>(), num_channels, iroi), num_channels, 255.0f, 1.0f);
+        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<unsigned char>(), num_channels, iroi), num_channels, 255.0f, 1.0f, saturate_fraction);
     }else if(glfmt.gltype == GL_UNSIGNED_SHORT) {
-        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<unsigned short>(), num_channels, iroi), num_channels, 65535.0f, 1.0f);
+        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<unsigned short>(), num_channels, iroi), num_channels, 65535.0f, 1.0f, saturate_fraction);
     }else if(glfmt.gltype == GL_FLOAT) {
-        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<float>(), num_channels, iroi), num_channels, 1.0f, 1.0f);
+        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<float>(), num_channels, iroi), num_channels, 1.0f, 1.0f, saturate_fraction);
     }else if(glfmt.gltype == GL_DOUBLE) {
-        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<double>(), num_channels, iroi), num_channels, 1.0f, 1.0f);
+        return GetOffsetScale(GetImageRoi(img.template UnsafeReinterpret<double>(), num_channels, iroi), num_channels, 1.0f, 1.0f, saturate_fraction);
     }else{
         return std::pair<float,float>(0.0f, 1.0f);
     }
 }
 
+// Offset and scale mapping a known value range (e.g. from GetMinMax or
+// GetPercentileRange) of an image in glfmt to the display range.
+inline std::pair<float,float> GetOffsetScale(
+    const std::pair<float,float>& range, const pangolin::GlPixFormat& glfmt
+) {
+    if(glfmt.gltype == GL_UNSIGNED_BYTE) {
+        return internal::OffsetScaleFromRange(range, 255.0f, 1.0f);
+    }else if(glfmt.gltype == GL_UNSIGNED_SHORT) {
+        return internal::OffsetScaleFromRange(range, 65535.0f, 1.0f);
+    }else if(glfmt.gltype == GL_FLOAT || glfmt.gltype == GL_DOUBLE) {
+        return internal::OffsetScaleFromRange(range, 1.0f, 1.0f);
+    }else{
+        return std::pair<float,float>(0.0f, 1.0f);
+    }
+}
+
+inline std::vector<size_t> GetHistogram(
+    const pangolin::Image<unsigned char>& img,
+    pangolin::XYRangei iroi, const pangolin::GlPixFormat& glfmt,
+    float lo, float hi, size_t num_bins
+) {
+    using namespace internal;
+
+    iroi.Clamp(0, (int)img.w-1, 0, (int)img.h-1 );
+
+    const size_t num_channels = pangolin::GlFormatChannels(glfmt.glformat);
+    std::vector<size_t> bins(num_bins, 0);
+
+    if(glfmt.gltype == GL_UNSIGNED_BYTE) {
+        GetHistogram(GetImageRoi(img.template UnsafeReinterpret<unsigned char>(), num_channels, iroi), num_channels, lo, hi, bins);
+    }else if(glfmt.gltype == GL_UNSIGNED_SHORT) {
+        GetHistogram(GetImageRoi(img.template UnsafeReinterpret<unsigned short>(), num_channels, iroi), num_channels, lo, hi, bins);
+    }else if(glfmt.gltype == GL_FLOAT) {
+        GetHistogram(GetImageRoi(img.template UnsafeReinterpret<float>(), num_channels, iroi), num_channels, lo, hi, bins);
+    }else if(glfmt.gltype == GL_DOUBLE) {
+        GetHistogram(GetImageRoi(img.template UnsafeReinterpret<double>(), num_channels, iroi), num_channels, lo, hi, bins);
+    }
+    return bins;
+}
+
+inline std::pair<float, float> GetPercentileRange(
+    const pangolin::Image<unsigned char>& img,
+    pangolin::XYRangei iroi, const pangolin::GlPixFormat& glfmt,
+    float lo_fraction, float hi_fraction
+) {
+    using namespace internal;
+
+    iroi.Clamp(0, (int)img.w-1, 0, (int)img.h-1 );
+
+    const size_t num_channels = pangolin::GlFormatChannels(glfmt.glformat);
+
+    if(glfmt.gltype == GL_UNSIGNED_BYTE) {
+        return GetPercentileRange(GetImageRoi(img.template UnsafeReinterpret<unsigned char>(), num_channels, iroi), num_channels, lo_fraction, hi_fraction);
+    }else if(glfmt.gltype == GL_UNSIGNED_SHORT) {
+        return GetPercentileRange(GetImageRoi(img.template UnsafeReinterpret<unsigned short>(), num_channels, iroi), num_channels, lo_fraction, hi_fraction);
+    }else if(glfmt.gltype == GL_FLOAT) {
+        return GetPercentileRange(GetImageRoi(img.template UnsafeReinterpret<float>(), num_channels, iroi), num_channels, lo_fraction, hi_fraction);
+    }else if(glfmt.gltype == GL_DOUBLE) {
+        return GetPercentileRange(GetImageRoi(img.template UnsafeReinterpret<double>(), num_channels, iroi), num_channels, lo_fraction, hi_fraction);
+    }else{
+        return std::pair<float, float>(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    }
+}
+
 inline float GetScaleOnly(
     const pangolin::Image<unsigned char>& img,
     pangolin::XYRangei iroi, const pangolin::GlPixFormat& glfmt
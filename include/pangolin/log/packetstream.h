@@ -31,24 +31,27 @@
 
 #include <pangolin/log/packetstream_tags.h>
 #include <pangolin/utils/file_utils.h>
+#include <pangolin/utils/prefetchfilebuf.h>
 
 namespace pangolin
 {
 
-class PacketStream: public std::ifstream
+// Reads through std::filebuf, or through prefetchfilebuf when opened with
+// read_ahead_bytes > 0 (regular files only).
+class PacketStream: public std::istream
 {
 public:
     PacketStream()
-        : _is_pipe(false)
+        : Base(nullptr), _is_pipe(false), _prefetching(false)
     {
+        Base::rdbuf(&_filebuf);
         cclear();
     }
 
-    PacketStream(const std::string& filename)
-        : Base(filename.c_str(), std::ios::in | std::ios::binary),
-          _is_pipe(IsPipe(filename))
+    PacketStream(const std::string& filename, size_t read_ahead_bytes = 0)
+        : Base(nullptr), _is_pipe(false), _prefetching(false)
     {
-        cclear();
+        open(filename, read_ahead_bytes);
     }
 
     bool seekable() const
@@ -56,17 +59,39 @@ public:
         return is_open() && !_is_pipe;
     }
 
-    void open(const std::string& filename)
+    bool is_open() const
+    {
+        return _prefetching ? _prefetchbuf.is_open() : _filebuf.is_open();
+    }
+
+    void open(const std::string& filename, size_t read_ahead_bytes = 0)
     {
         close();
         _is_pipe = IsPipe(filename);
-        Base::open(filename.c_str(), std::ios::in | std::ios::binary);
+        _prefetching = read_ahead_bytes > 0 && !_is_pipe && _prefetchbuf.open(filename, read_ahead_bytes);
+        if(_prefetching) {
+            Base::rdbuf(&_prefetchbuf);
+        }else{
+            _filebuf.open(filename.c_str(), std::ios::in | std::ios::binary);
+            Base::rdbuf(&_filebuf);
+        }
+        if(!is_open()) {
+            setstate(std::ios::failbit);
+        }
     }
 
     void close()
     {
         cclear();
-        if (Base::is_open()) Base::close();
+        if (_filebuf.is_open()) _filebuf.close();
+        if (_prefetchbuf.is_open()) _prefetchbuf.close();
+        _prefetching = false;
+    }
+
+    // Hint that the bytes [pos, pos+len) will be read soon.
+    void prefetch(std::streampos pos, size_t len)
+    {
+        if(_prefetching) _prefetchbuf.prefetch(pos, len);
     }
 
     void seekg(std::streampos target);
@@ -94,9 +119,12 @@ public:
     pangoTagType syncToTag();
 
 private:
-    using Base = std::ifstream;
+    using Base = std::istream;
 
+    std::filebuf _filebuf;
+    prefetchfilebuf _prefetchbuf;
     bool _is_pipe;
+    bool _prefetching;
     pangoTagType _tag;
 
     // Amount of frame data left to read. Tracks our position within a data block.
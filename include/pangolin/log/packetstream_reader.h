@@ -43,11 +43,14 @@ class PANGOLIN_EXPORT PacketStreamReader
 public:
     PacketStreamReader();
 
-    PacketStreamReader(const std::string& filename);
+    // With read_ahead_bytes > 0, regular files are read asynchronously in
+    // large blocks, keeping up to read_ahead_bytes in flight ahead of the
+    // read position (see prefetchfilebuf).
+    PacketStreamReader(const std::string& filename, size_t read_ahead_bytes = 0);
 
     ~PacketStreamReader();
 
-    void Open(const std::string& filename);
+    void Open(const std::string& filename, size_t read_ahead_bytes = 0);
 
     void Close();
 
@@ -74,6 +77,15 @@ public:
     // Jumps to the first packet with time >= time
     size_t Seek(PacketStreamSourceId src, SyncTime::TimePoint time);
 
+    // Start reading packets [framenum, framenum+count) of src from the
+    // index ahead of time. No-op without read-ahead.
+    void Prefetch(PacketStreamSourceId src, size_t framenum, size_t count);
+
+    size_t ReadAheadBytes() const
+    {
+        return _read_ahead_bytes;
+    }
+
     void FixFileIndex();
 
 private:
@@ -95,6 +107,10 @@ private:
 
     void SkipSync();
 
+    // Keep up to read_ahead_bytes of src's packets from framenum onwards
+    // prefetched, following the index. Called as frames are read.
+    void ReadAhead(PacketStreamSourceId src, size_t framenum);
+
     void ReSync() {
         _stream.syncToTag();
     }
@@ -108,6 +124,9 @@ private:
 
     bool _is_pipe;
     int _pipe_fd;
+    size_t _read_ahead_bytes;
+    // Per source, the frame up to which reads have been started
+    std::vector<size_t> _prefetched_until;
 };
 
 
@@ -35,6 +35,46 @@
 namespace pangolin
 {
 
+// Many small packets (e.g. IMU samples), copied and held until appended to
+// a PacketStreamWriter together with WriteBatch(). The batch can be
+// cleared and reused to avoid allocation.
+class PANGOLIN_EXPORT PacketStreamBatch
+{
+public:
+    void Add(
+        PacketStreamSourceId src, const char* source, const int64_t receive_time_us,
+        size_t sourcelen, const picojson::value& meta = picojson::value()
+    );
+
+    void Clear() {
+        _packets.clear();
+        _payload.clear();
+    }
+
+    size_t Size() const {
+        return _packets.size();
+    }
+
+    bool Empty() const {
+        return _packets.empty();
+    }
+
+private:
+    friend class PacketStreamWriter;
+
+    struct Entry
+    {
+        PacketStreamSourceId src;
+        int64_t receive_time_us;
+        size_t offset;
+        size_t size;
+        picojson::value meta;
+    };
+
+    std::vector<Entry> _packets;
+    std::vector<char> _payload;
+};
+
 class PANGOLIN_EXPORT PacketStreamWriter
 {
 public:
@@ -44,8 +84,8 @@ public:
         _stream.exceptions(std::ostream::badbit);
     }
 
-    PacketStreamWriter(const std::string& filename, size_t buffer_size  = 100*1024*1024)
-        : _buffer(pangolin::PathExpand(filename), buffer_size), _stream(&_buffer),
+    PacketStreamWriter(const std::string& filename, size_t buffer_size  = 100*1024*1024, FileWriteMode write_mode = FileWriteModeSync, size_t sync_interval_bytes = 0)
+        : _buffer(pangolin::PathExpand(filename), buffer_size, write_mode, sync_interval_bytes), _stream(&_buffer),
           _indexable(!IsPipe(filename)), _open(_stream.good()), _bytes_written(0)
     {
         _stream.exceptions(std::ostream::badbit);
@@ -56,10 +96,10 @@ public:
         Close();
     }
 
-    void Open(const std::string& filename, size_t buffer_size = 100 * 1024 * 1024)
+    void Open(const std::string& filename, size_t buffer_size = 100 * 1024 * 1024, FileWriteMode write_mode = FileWriteModeSync, size_t sync_interval_bytes = 0)
     {
         Close();
-        _buffer.open(filename, buffer_size);
+        _buffer.open(filename, buffer_size, write_mode, sync_interval_bytes);
         _open = _stream.good();
         _bytes_written = 0;
         _indexable = !IsPipe(filename);
@@ -101,6 +141,9 @@ public:
         size_t sourcelen, const picojson::value& meta = picojson::value()
     );
 
+    // Append all packets in batch, in order, under a single lock.
+    void WriteBatch(const PacketStreamBatch& batch);
+
     // For stream read/write synchronization. Note that this is NOT the same as
     // time synchronization on playback of iPacketStreams.
     void WriteSync();
@@ -117,10 +160,23 @@ public:
         return _open;
     }
 
+    // Queue depth and throughput of the underlying writer thread
+    threadedfilebuf::Stats BufferStats() const {
+        return _buffer.GetStats();
+    }
+
 private:
     void WriteHeader();
     void Write(const PacketStreamSource&);
-    void WriteMeta(PacketStreamSourceId src, const picojson::value& data);
+
+    void ValidatePacket(PacketStreamSourceId src, size_t sourcelen) const;
+
+    // Encode optional metadata and the packet header into _scratch, and
+    // record the packet in the index at position pos.
+    void EncodePacketHeader(
+        PacketStreamSourceId src, int64_t receive_time_us, size_t sourcelen,
+        const picojson::value& meta, std::streampos pos
+    );
 
     threadedfilebuf _buffer;
     std::ostream _stream;
@@ -129,6 +185,10 @@ private:
     std::vector<PacketStreamSource> _sources;
     size_t _bytes_written;
     std::recursive_mutex _lock;
+
+    // Reused between packets
+    std::vector<char> _scratch;
+    std::vector<threadedfilebuf::Segment> _segments;
 };
 
 inline void writeCompressedUnsignedInt(std::ostream& writer, size_t n)
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <pangolin/log/packetstream_reader.h>
+#include <pangolin/log/playback_session_index.h>
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/utils/registration.h>
 
@@ -11,38 +14,64 @@ namespace pangolin {
 
 class Params;
 
-class PlaybackSession
+class PANGOLIN_EXPORT PlaybackSession
 {
 public:
+    PlaybackSession();
+
     // Singleton Instance
     static std::shared_ptr<PlaybackSession> Default();
 
     // Return thread-safe, shared instance of PacketStreamReader, providing
-    // serialised read for PacketStreamReader
-    std::shared_ptr<PacketStreamReader> Open(const std::string& filename)
-    {
-        const std::string path = SanitizePath(PathExpand(filename));
-
-        auto i = readers.find(path);
-        if(i == readers.end()) {
-            auto psr = std::make_shared<PacketStreamReader>(path);
-            readers[path] = psr;
-            return psr;
-        }else{
-            return i->second;
-        }
-    }
+    // serialised read for PacketStreamReader. read_ahead_bytes applies
+    // only when the reader is first opened.
+    std::shared_ptr<PacketStreamReader> Open(const std::string& filename, size_t read_ahead_bytes = 0);
+
+    // As Open, for several logs at once. Logs not yet open are opened and
+    // their indices parsed concurrently.
+    std::vector<std::shared_ptr<PacketStreamReader>> OpenAll(const std::vector<std::string>& filenames, size_t read_ahead_bytes = 0);
 
     SyncTime& Time()
     {
         return time;
     }
 
+    // Merged, time ordered index of every log opened in this session. It
+    // is built on first use and rebuilt only once more logs are opened.
+    std::shared_ptr<const PlaybackSessionIndex> Index();
+
+    // Report that packet 'frame' of src has been read from reader. Readers
+    // opened with read-ahead are then asked for the next ReadAheadPackets()
+    // packets of the whole session, in global time order, so that logs
+    // played together are read in the order they are consumed.
+    void PacketRead(const PacketStreamReader& reader, PacketStreamSourceId src, size_t frame);
+
+    void SetReadAheadPackets(size_t packets);
+
+    size_t ReadAheadPackets() const
+    {
+        return read_ahead_packets;
+    }
+
     static std::shared_ptr<PlaybackSession> ChooseFromParams(const Params& params);
 
 private:
+    std::shared_ptr<const PlaybackSessionIndex> IndexLocked();
+    void ScheduleReads(const PlaybackSessionIndex& idx);
+
+    std::mutex mutex;
     std::map<std::string,std::shared_ptr<PacketStreamReader>> readers;
     SyncTime time;
+
+    std::shared_ptr<const PlaybackSessionIndex> index;
+    std::vector<std::shared_ptr<PacketStreamReader>> index_readers;
+
+    // Scheduling is only needed once a reader with read-ahead is open
+    bool schedule_reads;
+    size_t read_ahead_packets;
+    size_t read_cursor;
+    size_t scheduled_until;
+    Registration<size_t> session_seek;
 };
 
 }
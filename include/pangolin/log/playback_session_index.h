@@ -0,0 +1,80 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/log/packetstream_reader.h>
+
+#include <memory>
+#include <vector>
+
+namespace pangolin {
+
+// Time ordered index over every packet of every source in a set of logs,
+// merged from the readers' own indices without touching the files. Used
+// by PlaybackSession to seek all logs at once and to read ahead across
+// files in global time order.
+class PANGOLIN_EXPORT PlaybackSessionIndex
+{
+public:
+    struct Entry
+    {
+        int64_t capture_time;
+        uint32_t reader;
+        uint32_t src;
+        size_t frame;
+    };
+
+    static constexpr size_t npos = (size_t)-1;
+
+    void Build(const std::vector<std::shared_ptr<PacketStreamReader>>& readers);
+
+    size_t Size() const {
+        return entries.size();
+    }
+
+    const Entry& operator[](size_t i) const {
+        return entries[i];
+    }
+
+    // Position of the first packet with capture_time >= time_us
+    size_t LowerBound(int64_t time_us) const;
+
+    // Position of packet 'frame' of src in reader, or npos
+    size_t Find(size_t reader, size_t src, size_t frame) const;
+
+private:
+    std::vector<Entry> entries;
+
+    // positions[source_offset[reader][src] + frame] is the position of
+    // that packet within entries. Each reader's offsets end with a sentinel.
+    std::vector<std::vector<size_t>> source_offset;
+    std::vector<size_t> positions;
+};
+
+}
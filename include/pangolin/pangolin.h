@@ -33,6 +33,7 @@
   #include <pangolin/gl/gl.h>
   #include <pangolin/gl/gldraw.h>
   #include <pangolin/gl/glvbo.h>
+  #include <pangolin/gl/glprimitives.h>
   #include <pangolin/gl/glstate.h>
   #include <pangolin/gl/colour.h>
   #include <pangolin/display/display.h>
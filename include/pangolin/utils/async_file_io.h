@@ -0,0 +1,122 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/platform.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pangolin
+{
+
+enum AsyncFileIOBackend
+{
+    // io_uring where the kernel supports it, otherwise a thread pool.
+    AsyncFileIOAuto,
+    AsyncFileIOUring,
+    AsyncFileIOThreads
+};
+
+// Positional reads and writes on file descriptors, many of which may be in
+// flight at once. Requests complete in any order; callers match completions
+// by user_data. Not thread safe: each instance should be driven from a
+// single thread.
+//
+//   auto io = AsyncFileIO::Create(8);
+//   io->Submit({AsyncFileIO::Read, fd, buf, len, offset, id});
+//   io->Wait(completions, 1);
+class PANGOLIN_EXPORT AsyncFileIO
+{
+public:
+    enum Op { Read, Write };
+
+    struct Request
+    {
+        Op op;
+        int fd;
+        char* buffer;
+        size_t size;
+        uint64_t offset;
+        uint64_t user_data;
+        // Index of a buffer passed to RegisterBuffers containing
+        // [buffer, buffer+size), or -1.
+        int buffer_index = -1;
+    };
+
+    struct Completion
+    {
+        uint64_t user_data;
+        // Bytes transferred, or -errno on failure.
+        int64_t result;
+    };
+
+    struct Buffer
+    {
+        char* data;
+        size_t size;
+    };
+
+    // Returns nullptr if no backend is available on this platform, or if
+    // AsyncFileIOUring is requested and unsupported.
+    static std::unique_ptr<AsyncFileIO> Create(
+        size_t queue_depth, AsyncFileIOBackend backend = AsyncFileIOAuto, size_t num_threads = 2
+    );
+
+    virtual ~AsyncFileIO() {}
+
+    virtual const char* Name() const = 0;
+
+    // Maximum number of requests in flight.
+    virtual size_t QueueDepth() const = 0;
+
+    // Number of requests submitted which have not yet been returned by Wait.
+    virtual size_t InFlight() const = 0;
+
+    // Queue request, returning false if QueueDepth() requests are already
+    // in flight. Queued requests are started no later than the next Flush()
+    // or Wait().
+    virtual bool Submit(const Request& request) = 0;
+
+    // Start any queued requests without waiting for completions.
+    virtual void Flush() = 0;
+
+    // Append completions to out, blocking until at least min_complete are
+    // available (or fewer if fewer are in flight). Returns number appended.
+    virtual size_t Wait(std::vector<Completion>& out, size_t min_complete) = 0;
+
+    // Pin buffers for reuse across many requests to avoid per-request
+    // mapping costs. Only meaningful for io_uring; requires InFlight() == 0.
+    virtual bool RegisterBuffers(const std::vector<Buffer>& /*buffers*/) { return false; }
+
+    virtual void UnregisterBuffers() {}
+};
+
+}
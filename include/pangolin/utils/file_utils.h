@@ -42,6 +42,11 @@ std::vector<std::string>& Split(const std::string& s, char delim, std::vector<st
 PANGOLIN_EXPORT
 std::vector<std::string> Split(const std::string &s, char delim);
 
+// Returns the contents of each top-level bracketed group in src, e.g.
+// "{a}{b{c}}" gives {"a", "b{c}"}.
+PANGOLIN_EXPORT
+std::vector<std::string> SplitBrackets(const std::string src, char open='{', char close='}');
+
 PANGOLIN_EXPORT
 std::vector<std::string> Expand(const std::string &s, char open='[', char close=']', char delim=',');
 
@@ -63,15 +68,29 @@ std::string PathExpand(const std::string& sPath);
 PANGOLIN_EXPORT
 bool MatchesWildcard(const std::string& str, const std::string& wildcard);
 
+// Strict weak ordering which compares runs of digits by numeric value,
+//   e.g. img2.png < img10.png
+PANGOLIN_EXPORT
+bool NaturalLess(const std::string& a, const std::string& b);
+
 // Fill 'file_vec' with the files that match the glob-like 'wildcard_file_path'
 // ? can be used to match any single charector
 // * can be used to match any sequence of charectors in a directory
 // ** can be used to match any directories across any number of levels
 //   e.g. FilesMatchingWildcard("~/*/code/*.h", vec);
 //   e.g. FilesMatchingWildcard("~/**/*.png", vec);
+// Matches are appended in natural order (see NaturalLess) within each
+// directory. Returns true if any file was appended.
 PANGOLIN_EXPORT
 bool FilesMatchingWildcard(const std::string& wildcard_file_path, std::vector<std::string>& file_vec);
 
+// As FilesMatchingWildcard, but reuse a listing persisted by a previous call
+// for the same wildcard whilst none of the directories it read have changed
+// (by mtime). Listings are stored in 'cache_dir', by default
+// $XDG_CACHE_HOME/pangolin or ~/.cache/pangolin. Cache errors are ignored.
+PANGOLIN_EXPORT
+bool FilesMatchingWildcardCached(const std::string& wildcard_file_path, std::vector<std::string>& file_vec, const std::string& cache_dir = "");
+
 PANGOLIN_EXPORT
 std::string MakeUniqueFilename(const std::string& filename);
 
@@ -0,0 +1,164 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/platform.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace pangolin
+{
+
+//! Thread-safe latency histogram with logarithmic bucketing, in the style of
+//! HdrHistogram. Values are nanoseconds; each power of two is split into
+//! 2^SubBucketBits linear buckets, giving ~6% relative precision from 1ns up
+//! to 2^MaxExponent ns (~18 minutes). Record() is wait-free and costs a few
+//! relaxed atomic increments, so it is safe on capture hot-paths.
+class PANGOLIN_EXPORT LatencyHistogram
+{
+public:
+    static constexpr int SubBucketBits = 4;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int MaxExponent = 40;
+    static constexpr int NumBuckets = (MaxExponent - SubBucketBits + 2) * SubBuckets;
+
+    LatencyHistogram()
+    {
+        Reset();
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    static int BucketIndex(uint64_t ns)
+    {
+        if(ns < (uint64_t)SubBuckets) return (int)ns;
+        int e = 63 - Clz(ns);
+        if(e > MaxExponent) {
+            return NumBuckets - 1;
+        }
+        const int shift = e - SubBucketBits;
+        return (shift + 1) * SubBuckets + (int)((ns >> shift) & (SubBuckets - 1));
+    }
+
+    //! Smallest value that falls into bucket
+    static uint64_t BucketLowerBound(int index)
+    {
+        if(index < SubBuckets) return (uint64_t)index;
+        const int shift = index / SubBuckets - 1;
+        return (uint64_t)(SubBuckets + index % SubBuckets) << shift;
+    }
+
+    //! Number of values covered by bucket
+    static uint64_t BucketWidth(int index)
+    {
+        return index < SubBuckets ? 1 : (uint64_t)1 << (index / SubBuckets - 1);
+    }
+
+    void Record(uint64_t ns)
+    {
+        buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t m = max_ns.load(std::memory_order_relaxed);
+        while(ns > m && !max_ns.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+    }
+
+    void Reset()
+    {
+        for(int i=0; i < NumBuckets; ++i) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sum_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t MaxNs() const
+    {
+        return max_ns.load(std::memory_order_relaxed);
+    }
+
+    double MeanNs() const
+    {
+        const uint64_t n = Count();
+        return n ? (double)sum_ns.load(std::memory_order_relaxed) / n : 0.0;
+    }
+
+    uint64_t BucketCount(int index) const
+    {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+
+    //! Value below which fraction p (in [0,1]) of recorded samples lie,
+    //! accurate to the width of the containing bucket.
+    uint64_t PercentileNs(double p) const
+    {
+        uint64_t total = 0;
+        for(int i=0; i < NumBuckets; ++i) total += BucketCount(i);
+        if(total == 0) return 0;
+
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * total + 0.5));
+        uint64_t seen = 0;
+        for(int i=0; i < NumBuckets; ++i) {
+            seen += BucketCount(i);
+            if(seen >= rank) {
+                const uint64_t v = BucketLowerBound(i) + BucketWidth(i) / 2;
+                return std::min(v, MaxNs());
+            }
+        }
+        return MaxNs();
+    }
+
+private:
+    static int Clz(uint64_t v)
+    {
+#if defined(__GNUC__)
+        return __builtin_clzll(v);
+#else
+        int n = 0;
+        while(!(v & ((uint64_t)1 << 63))) { v <<= 1; ++n; }
+        return n;
+#endif
+    }
+
+    std::atomic<uint64_t> buckets[NumBuckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> max_ns;
+};
+
+}
@@ -15,6 +15,7 @@ namespace pangolin
     virtual void lock() = 0;
     virtual void unlock() = 0;
     virtual unsigned char *ptr() = 0;
+    virtual size_t size() = 0;
     virtual std::string name() = 0;
   };
 
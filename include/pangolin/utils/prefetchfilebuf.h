@@ -0,0 +1,120 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/platform.h>
+#include <pangolin/utils/async_file_io.h>
+
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace pangolin
+{
+
+// Read only counterpart to threadedfilebuf. The file is read in large
+// blocks through AsyncFileIO, keeping several blocks in flight ahead of
+// the read position so that the caller rarely waits on the disk, and
+// reading in big sequential chunks when several files are played at once.
+class PANGOLIN_EXPORT prefetchfilebuf : public std::streambuf
+{
+public:
+    prefetchfilebuf();
+    ~prefetchfilebuf();
+
+    // Returns false if the file can't be opened or no async I/O backend is
+    // available, in which case the caller should fall back to std::filebuf.
+    bool open(
+        const std::string& filename, size_t read_ahead_bytes, size_t block_size_bytes = 1024*1024,
+        AsyncFileIOBackend backend = AsyncFileIOAuto
+    );
+
+    void close();
+
+    bool is_open() const;
+
+    // Hint that [pos, pos+len) will be read soon. Reads are started for as
+    // much of the range as free blocks allow.
+    void prefetch(std::streampos pos, size_t len);
+
+    // Name of the AsyncFileIO backend in use, if open.
+    const char* backend_name() const;
+
+protected:
+    int_type underflow() override;
+
+    std::streamsize showmanyc() override;
+
+    std::streampos seekoff(
+        std::streamoff off, std::ios_base::seekdir way,
+        std::ios_base::openmode which = std::ios_base::in
+    ) override;
+
+    std::streampos seekpos(
+        std::streampos pos, std::ios_base::openmode which = std::ios_base::in
+    ) override;
+
+private:
+    enum BlockState { BlockEmpty, BlockPending, BlockReady };
+
+    struct Block
+    {
+        char* data;
+        uint64_t offset;
+        size_t size;      // requested, or valid bytes once ready
+        BlockState state;
+        uint64_t last_use;
+    };
+
+    uint64_t position() const;
+    int find_block(uint64_t pos) const;
+    int claim_block(uint64_t window_begin, uint64_t window_end, bool wait);
+    void submit(int b, uint64_t offset);
+    void reap(size_t min_complete);
+    void read_ahead(uint64_t from);
+    void refresh_file_size();
+
+    int fd;
+    uint64_t file_size;
+    size_t block_size;
+    size_t read_ahead_blocks;
+
+    std::unique_ptr<AsyncFileIO> io;
+    char* arena;
+    bool arena_registered;
+    std::vector<Block> blocks;
+
+    // Block backing the get area, or -1 with the position in seek_pos.
+    int current;
+    uint64_t seek_pos;
+    uint64_t use_counter;
+};
+
+}
@@ -32,6 +32,7 @@
 #include <fstream>
 
 #include <pangolin/platform.h>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -44,22 +45,89 @@
 namespace pangolin
 {
 
+// How the writer thread commits data to disk. Only honoured with posix file
+// i/o; otherwise data is written through std::filebuf.
+enum FileWriteMode
+{
+    // O_SYNC, one write per contiguous region of the buffer.
+    FileWriteModeSync,
+    // O_DIRECT, bypassing the page cache with large aligned block writes.
+    // Falls back to FileWriteModeBuffered where unsupported (e.g. tmpfs).
+    FileWriteModeDirect,
+    // Through the page cache, with fdatasync every sync_interval_bytes
+    // (or only on close if 0).
+    FileWriteModeBuffered
+};
+
+// Direct and buffered modes keep this many writes in flight through
+// AsyncFileIO (io_uring, or a thread pool where unavailable).
+const size_t threadedfilebuf_async_depth = 4;
+
 class PANGOLIN_EXPORT threadedfilebuf : public std::streambuf
 {
 public:
+    struct Stats
+    {
+        size_t   buffer_bytes;      // capacity of the queue
+        size_t   queued_bytes;      // waiting to be written
+        size_t   peak_queued_bytes;
+        uint64_t bytes_written;
+        uint64_t write_calls;
+        uint64_t producer_stalls;   // times a producer waited on a full queue
+        double   write_seconds;     // spent in write and sync calls
+        double   elapsed_seconds;   // since open
+
+        double ThroughputMBps() const {
+            return elapsed_seconds > 0.0 ? bytes_written / (1024.0*1024.0) / elapsed_seconds : 0.0;
+        }
+    };
+
+    // Contiguous piece of a vectored write
+    struct Segment
+    {
+        const char* data;
+        std::streamsize size;
+    };
+
     ~threadedfilebuf();
     threadedfilebuf();
-    threadedfilebuf(const std::string& filename, size_t buffer_size_bytes);
+    threadedfilebuf(const std::string& filename, size_t buffer_size_bytes, FileWriteMode mode = FileWriteModeSync, size_t sync_interval_bytes = 0);
     
-    void open(const std::string& filename, size_t buffer_size_bytes);
+    void open(const std::string& filename, size_t buffer_size_bytes, FileWriteMode mode = FileWriteModeSync, size_t sync_interval_bytes = 0);
     void close();
     void force_close();
+
+    Stats GetStats() const;
+
+    //! Append segments in order as one queue insertion, taking the queue
+    //! lock once. Anything pending in the put area is written first.
+    void write_segments(const Segment* segments, size_t num_segments);
     
     void operator()();
     
 protected:
     void soft_close();
 
+    //! Copy data into the queue for the writer thread
+    void enqueue(const char* s, std::streamsize n);
+    void enqueue(const Segment* segments, size_t num_segments);
+
+    //! Writer loop for non-sync modes. Returns false if async i/o is unavailable.
+    bool write_async();
+
+    //! True if a producer is waiting for space and enough is queued for the
+    //! writer to make progress without a full block. Call with update_mutex held.
+    bool flush_partial() const;
+
+    //! Move small writes coalesced in the put area into the queue
+    void flush_put_area();
+
+    char* alloc_buffer(std::streamsize size);
+    void free_buffer(char* buffer);
+
+    //! Override streambuf::sync to flush the put area
+    int sync() override;
+
     //! Override streambuf::xsputn for asynchronous write
     std::streamsize xsputn(const char * s, std::streamsize n) override;
 
@@ -77,21 +145,37 @@ protected:
     std::filebuf file;
 #endif
 
+    // Small writes (tags, varints, timestamps) are coalesced here before
+    // taking update_mutex.
+    char* put_area;
+
+    FileWriteMode write_mode;
+    size_t sync_interval_bytes;
+    size_t bytes_since_sync;
+    // Granularity of writes in FileWriteModeDirect
+    std::streamsize block_size;
+
     char* mem_buffer;
     std::streamsize mem_size;
     std::streamsize mem_max_size;
     std::streamsize mem_start;
     std::streamsize mem_end;
+    // Queued bytes the writer is using outside update_mutex
+    std::streamsize write_pending;
+    int producers_waiting;
 
     std::streampos input_pos;
     
-    std::mutex update_mutex;
+    mutable std::mutex update_mutex;
     std::condition_variable cond_queued;
     std::condition_variable cond_dequeued;
     std::thread write_thread;
 
     bool should_run;
     bool is_pipe;
+
+    Stats stats;
+    std::chrono::steady_clock::time_point open_time;
 };
 
 }
@@ -0,0 +1,117 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/platform.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace pangolin
+{
+
+// Timeline tracing of Pangolin's worker threads, written as Chrome Trace Event
+// JSON (viewable in chrome://tracing or ui.perfetto.dev).
+//
+// Tracing is enabled by setting the environment variable PANGOLIN_TRACE to an
+// output filename, which is written when the process exits, or at runtime
+// with TraceStart() / TraceStop(). Each thread records into its own buffer, so
+// recording a marker takes no locks: two clock reads and one store. When
+// tracing is disabled a marker costs a single relaxed atomic load.
+
+namespace detail
+{
+PANGOLIN_EXPORT
+extern std::atomic<bool> trace_enabled;
+
+PANGOLIN_EXPORT
+void TraceRecord(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+}
+
+inline bool TraceEnabled()
+{
+    return detail::trace_enabled.load(std::memory_order_relaxed);
+}
+
+//! Begin recording, discarding any previously recorded events.
+//! If filename is non-empty it is written by TraceStop() or at exit.
+PANGOLIN_EXPORT
+void TraceStart(const std::string& filename = std::string());
+
+//! Stop recording and write the trace file given to TraceStart, if any.
+PANGOLIN_EXPORT
+void TraceStop();
+
+//! Write all events recorded so far to filename. May be called while threads
+//! are still recording; events completed after the call are not included.
+PANGOLIN_EXPORT
+bool TraceWrite(const std::string& filename);
+
+//! Number of events recorded so far, across all threads.
+PANGOLIN_EXPORT
+size_t TraceEventCount();
+
+//! Label the calling thread in the trace viewer.
+PANGOLIN_EXPORT
+void TraceSetThreadName(const std::string& name);
+
+//! Records the lifetime of the scope as a complete ("X") event. name and
+//! category must be string literals or otherwise outlive the trace.
+class TraceScope
+{
+public:
+    TraceScope(const char* name, const char* category = "pangolin")
+        : name(TraceEnabled() ? name : nullptr), category(category)
+    {
+        if(this->name) start = std::chrono::steady_clock::now();
+    }
+
+    ~TraceScope()
+    {
+        if(name) detail::TraceRecord(name, category, start, std::chrono::steady_clock::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#define PANGOLIN_TRACE_CONCAT_(a,b) a##b
+#define PANGOLIN_TRACE_CONCAT(a,b) PANGOLIN_TRACE_CONCAT_(a,b)
+
+//! Trace the enclosing scope, e.g. PANGOLIN_TRACE_SCOPE("ThreadVideo::Grab")
+#define PANGOLIN_TRACE_SCOPE(...) pangolin::TraceScope PANGOLIN_TRACE_CONCAT(pango_trace_scope_, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,92 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/platform.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pangolin
+{
+
+//! Number of threads to split work between by default: one per core, but
+//! no more than max_threads, and at least one.
+PANGOLIN_EXPORT
+size_t DefaultWorkerThreads(size_t max_threads = 4);
+
+//! Fixed set of threads for splitting per-frame work into parts. Threads
+//! are started once and reused by every ParallelFor, so the cost per call
+//! is a wake up rather than thread creation.
+class PANGOLIN_EXPORT WorkerPool
+{
+public:
+    //! Start num_threads workers. The thread calling ParallelFor takes part
+    //! too, so num_threads = 0 runs everything on the caller.
+    explicit WorkerPool(size_t num_threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t NumThreads() const
+    {
+        return workers.size();
+    }
+
+    //! Call fn(i) for every i in [0,n), returning once all calls have
+    //! finished. The first exception thrown by fn is rethrown here. Calls
+    //! from several threads are run one after another.
+    void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+private:
+    void Run();
+    void RunJob(const std::function<void(size_t)>& fn, size_t n);
+
+    std::vector<std::thread> workers;
+
+    std::mutex call_mutex;
+    std::mutex mutex;
+    std::condition_variable cond_start;
+    std::condition_variable cond_done;
+    const std::function<void(size_t)>* job;
+    size_t job_size;
+    std::atomic<size_t> next;
+    size_t busy;
+    uint64_t generation;
+    bool quit;
+    std::exception_ptr error;
+};
+
+}
@@ -29,6 +29,15 @@
 
 #include <pangolin/pangolin.h>
 #include <pangolin/video/video.h>
+#include <pangolin/utils/worker_pool.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 extern "C"
 {
@@ -52,35 +61,90 @@ extern "C"
 namespace pangolin
 {
 
-class PANGOLIN_EXPORT FfmpegVideo : public VideoInterface
+// Decode video files and streams using libavcodec.
+//
+// Decoding uses frame and slice threading within libavcodec. When
+// decode_ahead > 0, packets are demuxed, decoded and converted to the
+// output format on a background thread which keeps up to decode_ahead
+// frames queued ahead of the reader.
+//
+// For seekable inputs, an index of packet timestamps and keyframes is
+// taken from the container when it carries a complete one (e.g. mp4,
+// mkv with cues), otherwise built by demuxing the file on a background
+// thread started by the first GetTotalFrames() or Seek(). GetTotalFrames()
+// returns 0 until the index is ready; Seek() waits for it. Seeks are frame
+// accurate: the demuxer is positioned on the preceding keyframe and
+// frames are decoded forward until the requested one.
+class PANGOLIN_EXPORT FfmpegVideo : public VideoInterface, public VideoPlaybackInterface
 {
 public:
-    FfmpegVideo(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false, int user_video_stream = -1, ImageDim size = ImageDim(0,0));
+    FfmpegVideo(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false, int user_video_stream = -1, ImageDim size = ImageDim(0,0), int threads = 0, size_t decode_ahead = 0);
     ~FfmpegVideo();
     
     //! Implement VideoInput::Start()
-    void Start();
+    void Start() override;
     
     //! Implement VideoInput::Stop()
-    void Stop();
+    void Stop() override;
 
     //! Implement VideoInput::SizeBytes()
-    size_t SizeBytes() const;
+    size_t SizeBytes() const override;
 
     //! Implement VideoInput::Streams()
-    const std::vector<StreamInfo>& Streams() const;
+    const std::vector<StreamInfo>& Streams() const override;
     
     //! Implement VideoInput::GrabNext()
-    bool GrabNext( unsigned char* image, bool wait = true );
+    bool GrabNext( unsigned char* image, bool wait = true ) override;
     
     //! Implement VideoInput::GrabNewest()
-    bool GrabNewest( unsigned char* image, bool wait = true );
-    
+    bool GrabNewest( unsigned char* image, bool wait = true ) override;
+
+    //! Implement VideoPlaybackInterface::GetCurrentFrameId()
+    size_t GetCurrentFrameId() const override;
+
+    //! Implement VideoPlaybackInterface::GetTotalFrames()
+    size_t GetTotalFrames() const override;
+
+    //! Implement VideoPlaybackInterface::Seek()
+    size_t Seek(size_t frameid) override;
+
 protected:
-    void InitUrl(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false , int user_video_stream = -1, ImageDim size= ImageDim(0,0));
-    
+    struct DecodedFrame
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t frame_id;
+    };
+
+    void InitUrl(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false , int user_video_stream = -1, ImageDim size= ImageDim(0,0), int threads = 0);
+
+    // Decode the next frame in presentation order into pFrame.
+    // Returns false at end of stream.
+    bool DecodeFrame();
+
+    // Convert pFrame to fmtout, writing into image.
+    void ConvertFrame(unsigned char* image);
+
+    // Start building frame_pts and keyframe_pts, if not already started.
+    void BuildIndex() const;
+
+    // Fill frame_pts and keyframe_pts from the container's own index.
+    // Returns false if it is missing or incomplete.
+    bool LoadContainerIndex() const;
+
+    // Fill frame_pts and keyframe_pts by demuxing the whole file through
+    // a second context. Runs on index_thread.
+    void ScanIndex(AVInputFormat* iformat) const;
+
+    // Block until the index is ready
+    void WaitForIndex() const;
+
+    void StartDecodeThread();
+    void StopDecodeThread();
+    void DecodeThreadLoop();
+
     std::vector<StreamInfo> streams;
-    
+    std::string url;
+
     SwsContext      *img_convert_ctx;
     AVFormatContext *pFormatCtx;
     int             videoStream;
@@ -93,8 +157,35 @@ protected:
     AVFrame         *pFrameOut;
     AVPacket        packet;
     int             numBytesOut;
-    uint8_t         *buffer;
     AVPixelFormat     fmtout;
+
+    // Decoder state, only touched by decode thread whilst it runs
+    bool            flushing;
+    bool            have_pending_frame;
+    size_t          next_decode_id;
+
+    // Frame id of last frame returned to the user
+    size_t          current_frame_id;
+
+    // Lazily built index of presentation timestamps, in presentation order.
+    // Only read once index_ready is set; written by index_thread before.
+    mutable bool                 index_started;
+    mutable std::atomic<bool>    index_ready;
+    mutable std::atomic<bool>    index_should_run;
+    mutable std::thread          index_thread;
+    mutable std::vector<int64_t> frame_pts;
+    mutable std::vector<int64_t> keyframe_pts;
+
+    // Decode ahead queue
+    size_t                      decode_ahead;
+    std::thread                 decode_thread;
+    std::mutex                  queue_mutex;
+    std::condition_variable     queue_cond;
+    std::deque<DecodedFrame>    queue_ready;
+    std::vector<DecodedFrame>   queue_free;
+    bool                        decode_should_run;
+    bool                        decode_eof;
+    std::exception_ptr          decode_error;
 };
 
 enum FfmpegMethod
@@ -112,6 +203,9 @@ enum FfmpegMethod
     FFMPEG_SPLINE        =0x400
 };
 
+// Forward declaration
+class FfmpegSlicedScale;
+
 class PANGOLIN_EXPORT FfmpegConverter : public VideoInterface
 {
 public:
@@ -137,11 +231,13 @@ public:
     bool GrabNewest( unsigned char* image, bool wait = true );
     
 protected:
+    void ConvertStreams(unsigned char* image);
+
     std::vector<StreamInfo> streams;
     
     struct ConvertContext
     {
-        SwsContext*     img_convert_ctx;
+        std::shared_ptr<FfmpegSlicedScale> img_convert_ctx;
         AVPixelFormat   fmtsrc;
         AVPixelFormat   fmtdst;
         AVFrame*        avsrc;
@@ -150,7 +246,9 @@ protected:
         size_t          src_buffer_offset;
         size_t          dst_buffer_offset;
         
-        void convert(const unsigned char * src, unsigned char* dst);
+        // Point the frames at src and dst, then convert each band
+        void fill(const unsigned char * src, unsigned char* dst);
+        void convert_band(size_t band);
         
     };
     
@@ -158,6 +256,9 @@ protected:
     std::unique_ptr<unsigned char[]> input_buffer;
 
     std::vector<ConvertContext> converters;
+    // (stream, band) of every band to convert, and the threads which do so
+    std::vector<std::pair<size_t,size_t>> bands;
+    std::unique_ptr<WorkerPool> workers;
     //size_t src_buffer_size;
     size_t dst_buffer_size;
 };
@@ -174,7 +275,11 @@ class PANGOLIN_EXPORT FfmpegVideoOutput
 {
     friend class FfmpegVideoOutputStream;
 public:
-    FfmpegVideoOutput( const std::string& filename, int base_frame_rate, int bit_rate, bool flip = false );
+    // threads: codec threads per stream (0 = auto).
+    // preset, tune: codec private options, e.g. x264 'ultrafast', 'zerolatency'.
+    // queue_depth: frames buffered per stream for its encoder thread. If 0,
+    //              frames are encoded synchronously within WriteStreams().
+    FfmpegVideoOutput( const std::string& filename, int base_frame_rate, int bit_rate, bool flip = false, int threads = 0, const std::string& preset = "", const std::string& tune = "", size_t queue_depth = 2 );
     ~FfmpegVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -202,6 +307,13 @@ protected:
     int bit_rate;
     bool is_pipe;
     bool flip;
+    int threads;
+    std::string preset;
+    std::string tune;
+    size_t queue_depth;
+
+    // Serialises muxing of packets from each stream's encoder thread
+    std::mutex mux_mutex;
 };
 
 }
@@ -41,8 +41,10 @@ namespace pangolin
 class PANGOLIN_EXPORT ImagesVideo : public VideoInterface, public VideoPlaybackInterface, public VideoPropertiesInterface
 {
 public:
-    ImagesVideo(const std::string& wildcard_path);
-    ImagesVideo(const std::string& wildcard_path, const PixelFormat& raw_fmt, size_t raw_width, size_t raw_height);
+    // If listing_cache is set, directory listings for wildcards are persisted
+    // and reused until a listed directory changes (see FilesMatchingWildcardCached).
+    ImagesVideo(const std::string& wildcard_path, bool listing_cache = true);
+    ImagesVideo(const std::string& wildcard_path, const PixelFormat& raw_fmt, size_t raw_width, size_t raw_height, bool listing_cache = true);
 
     // Explicitly delete copy ctor and assignment operator.
     // See http://stackoverflow.com/questions/29565299/how-to-use-a-vector-of-unique-pointers-in-a-dll-exported-class-with-visual-studi
@@ -94,6 +96,12 @@ protected:
 
     void PopulateFilenamesFromJson(const std::string& filename);
 
+    // Line delimited index written incrementally by ImagesVideoOutput. A
+    // truncated final line (e.g. after a crash) is ignored.
+    void PopulateFilenamesFromJsonLines(const std::string& filename);
+
+    void PopulateFilenamesFromJsonFrames(const std::string& folder);
+
     bool LoadFrame(size_t i);
 
     void ConfigureStreamSizes();
@@ -107,6 +115,7 @@ protected:
     std::vector<std::vector<std::string> > filenames;
     std::vector<Frame> loaded;
 
+    bool listing_cache;
     bool unknowns_are_raw;
     PixelFormat raw_fmt;
     size_t raw_width;
@@ -31,13 +31,31 @@
 #include <pangolin/video/video_output.h>
 #include <pangolin/log/packetstream_writer.h>
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
+// Writes each stream of each frame to its own image file. Frames are
+// indexed in 'archive.jsonl': a header line followed by one line per frame,
+// appended only once all of that frame's images are on disk, so that a
+// crash loses at most the frames still being encoded. 'archive.json' is
+// written from it on close for older readers.
+//
+// With num_threads > 0, images are encoded on a pool of worker threads and
+// WriteStreams only copies the frame, blocking once max_queued_frames are
+// waiting.
 class PANGOLIN_EXPORT ImagesVideoOutput : public VideoOutputInterface
 {
 public:
-    ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string &image_file_extension);
+    ImagesVideoOutput(
+        const std::string& image_folder, const std::string& json_file_out, const std::string &image_file_extension,
+        size_t num_threads = 0, size_t max_queued_frames = 0
+    );
     ~ImagesVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -46,15 +64,42 @@ public:
     bool IsPipe() const override;
 
 protected:
+    struct Frame
+    {
+        size_t index;
+        std::vector<unsigned char> data;
+        picojson::value frame_properties;
+        size_t streams_remaining;
+        bool failed;
+    };
+
+    std::string StreamFilename(size_t frame, size_t stream) const;
+    void SaveStream(const unsigned char* data, size_t frame, size_t stream);
+    void AppendIndex(size_t frame, const picojson::value& frame_properties);
+    void WriteArchiveJson();
+    void WorkerLoop();
+
     std::vector<StreamInfo> streams;
     std::string input_uri;
     picojson::value device_properties;
-    picojson::value json_frames;
 
     size_t image_index;
     std::string image_folder;
     std::string image_file_extension;
-    std::ofstream file;
+    std::string json_filename;
+    std::ofstream index_file;
+
+    // Frames awaiting encode, in submission order
+    size_t max_queued_frames;
+    std::deque<std::shared_ptr<Frame>> frames;
+    std::deque<std::pair<std::shared_ptr<Frame>,size_t>> jobs;
+    std::vector<std::vector<unsigned char>> free_buffers;
+    std::string error;
+    bool should_run;
+    std::mutex mutex;
+    std::condition_variable cond_jobs;
+    std::condition_variable cond_done;
+    std::vector<std::thread> workers;
 };
 
 }
@@ -28,12 +28,13 @@
 #pragma once
 
 #include <pangolin/video/video.h>
+#include <pangolin/video/video_stats.h>
 
 namespace pangolin
 {
 
 class PANGOLIN_EXPORT JoinVideo
-    : public VideoInterface, public VideoFilterInterface
+    : public VideoInterface, public VideoFilterInterface, public VideoStatsInterface
 {
 public:
     JoinVideo(std::vector<std::unique_ptr<VideoInterface>> &src);
@@ -62,6 +63,8 @@ public:
 
     std::vector<VideoInterface*>& InputStreams();
 
+    VideoStats& Stats();
+
 protected:
     int64_t GetAdjustedCaptureTime(size_t src_index);
 
@@ -72,6 +75,8 @@ protected:
 
     int64_t sync_tolerance_us;
     int64_t transfer_bandwidth_bytes_per_us;
+
+    VideoStats stats;
 };
 
 
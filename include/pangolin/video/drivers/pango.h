@@ -31,15 +31,32 @@
 #include <pangolin/log/playback_session.h>
 #include <pangolin/video/stream_encoder_factory.h>
 #include <pangolin/video/video.h>
+#include <pangolin/video/video_stats.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 namespace pangolin
 {
 
+// Plays back the video stream of a .pango log. Frames are normally paced
+// through the playback session's SyncTime, so that several logs (or
+// devices) stay in order. In throughput mode that machinery is skipped
+// entirely and frames are delivered as fast as they can be read and
+// decoded: with read_ahead_frames > 0, a background thread keeps up to
+// that many decoded frames ready in a buffer pool.
 class PANGOLIN_EXPORT PangoVideo
-    : public VideoInterface, public VideoPropertiesInterface, public VideoPlaybackInterface
+    : public VideoInterface, public VideoPropertiesInterface, public VideoPlaybackInterface,
+      public VideoStatsInterface
 {
 public:
-    PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSession> playback_session);
+    PangoVideo(
+        const std::string& filename, std::shared_ptr<PlaybackSession> playback_session, size_t read_ahead_bytes = 0,
+        bool throughput = false, size_t read_ahead_frames = 0
+    );
     ~PangoVideo();
 
     // Implement VideoInterface
@@ -76,13 +93,34 @@ public:
 
     std::string GetSourceUri();
 
+    VideoStats& Stats() override;
+
 private:
     void HandlePipeClosed();
 
 protected:
+    struct Frame
+    {
+        std::vector<unsigned char> data;
+        picojson::value frame_properties;
+        size_t frame_id;
+        bool valid;
+    };
+
     int FindPacketStreamSource();
     void SetupStreams(const PacketStreamSource& src);
 
+    // Read and decode the next packet of our source into image, throwing
+    // at the end of the log.
+    void ReadFrame(unsigned char* image, picojson::value& frame_properties, size_t& frame_id);
+
+    // Reposition the reader through seek, restarting read-ahead or pacing
+    void SeekReader(const std::function<void()>& seek);
+
+    void StartReadAhead();
+    void StopReadAhead();
+    void ReadAheadLoop();
+
     const std::string _filename;
     std::shared_ptr<PlaybackSession> _playback_session;
     std::shared_ptr<PacketStreamReader> _reader;
@@ -98,6 +136,19 @@ protected:
     picojson::value _frame_properties;
     std::string _source_uri;
 
+    // Throughput mode
+    const bool _throughput;
+    const size_t _read_ahead_frames;
+    size_t _current_frame_id;
+    std::deque<Frame> _ready;
+    std::vector<std::vector<unsigned char>> _free;
+    bool _read_ahead_run;
+    std::mutex _read_ahead_mutex;
+    std::condition_variable _read_ahead_cond;
+    std::thread _read_ahead_thread;
+
+    VideoStats _stats;
+
     Registration<size_t> session_seek;
 };
 
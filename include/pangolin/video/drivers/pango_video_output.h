@@ -29,18 +29,54 @@
 
 #include <pangolin/log/packetstream_writer.h>
 #include <pangolin/video/video_output.h>
+#include <pangolin/video/video_stats.h>
 
 #include <pangolin/video/stream_encoder_factory.h>
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace pangolin
 {
 
-class PANGOLIN_EXPORT PangoVideoOutput : public VideoOutputInterface
+// Filename of segment 'index' of a segmented recording, formed by
+// inserting a zero padded index before the extension of filename
+// (e.g. log.pango -> log_000003.pango).
+PANGOLIN_EXPORT
+std::string PangoSegmentFilename(const std::string& filename, size_t index);
+
+// Rotation policy for segmented recordings. A new segment is started
+// before the frame which would take the current segment past max_bytes,
+// or max_us of host reception time after its first frame (0 disables
+// either limit). With max_segments > 0, only the most recent segments,
+// including the one being written, are kept on disk.
+struct PangoSegmentOptions
+{
+    size_t max_bytes = 0;
+    int64_t max_us = 0;
+    size_t max_segments = 0;
+
+    bool Enabled() const {
+        return max_bytes > 0 || max_us > 0;
+    }
+};
+
+// Records frames to a .pango file. With encode_threads > 0 and stream
+// encoders in use, frames are encoded on a pool of threads and written in
+// order once encoded; WriteStreams then only copies the frame, blocking
+// while 2 * encode_threads frames are in flight. When segmenting, each segment is a
+// complete, independently indexed .pango file: the next segment is opened
+// ahead of time and the finished one is indexed and closed in the
+// background, so rotation does not stall the writer or drop frames.
+class PANGOLIN_EXPORT PangoVideoOutput : public VideoOutputInterface, public VideoStatsInterface
 {
 public:
-    PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris);
+    PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris, FileWriteMode write_mode = FileWriteModeSync, size_t sync_interval_bytes = 0, const PangoSegmentOptions& segment_options = PangoSegmentOptions(), size_t encode_threads = 0);
     ~PangoVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -48,16 +84,44 @@ public:
     int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
     bool IsPipe() const override;
 
+    // Segments started so far, including the one being written
+    size_t NumSegments() const;
+
+    VideoStats& Stats() override;
+
 protected:
 //    void WriteHeader();
 
+    struct EncodeJob
+    {
+        std::vector<unsigned char> data;
+        int64_t host_reception_time_us;
+        picojson::value frame_properties;
+        std::vector<uint8_t> encoded;
+        bool claimed;
+        bool done;
+    };
+
+    void EncodeFrame(const unsigned char* data, std::vector<uint8_t>& encoded, bool parallel_streams);
+    void QueueEncode(const unsigned char* data, int64_t host_reception_time_us, const picojson::value& frame_properties);
+    void EncodeLoop();
+    void StopEncoders();
+
+    std::unique_ptr<PacketStreamWriter> OpenSegment(size_t index) const;
+    void WritePacket(const char* data, int64_t host_reception_time_us, size_t size, const picojson::value& frame_properties);
+    void RotateSegment();
+    void FinishSegment(std::unique_ptr<PacketStreamWriter> writer, const std::string& segment_filename, size_t keep);
+
     std::vector<StreamInfo> streams;
     std::string input_uri;
     const std::string filename;
     picojson::value device_properties;
 
-    PacketStreamWriter packetstream;
+    std::unique_ptr<PacketStreamWriter> packetstream;
+    PacketStreamSource packetstream_source;
     size_t packetstream_buffer_size_bytes;
+    FileWriteMode packetstream_write_mode;
+    size_t packetstream_sync_interval_bytes;
     int packetstreamsrcid;
     size_t total_frame_size;
     bool is_pipe;
@@ -65,6 +129,28 @@ protected:
     bool fixed_size;
     std::map<size_t, std::string> stream_encoder_uris;
     std::vector<ImageEncoderFunc> stream_encoders;
+    // Reused for frames encoded in WriteStreams
+    std::vector<uint8_t> encode_buffer;
+
+    // Encode pool, in submission order
+    size_t encode_threads;
+    std::deque<std::shared_ptr<EncodeJob>> encode_jobs;
+    std::string encode_error;
+    bool encode_run;
+    std::mutex encode_mutex;
+    std::condition_variable encode_cond;
+    std::vector<std::thread> encode_workers;
+
+    // Segmented recording state
+    PangoSegmentOptions segment_options;
+    size_t segment_index;
+    size_t segment_bytes;
+    int64_t segment_start_us;
+    std::future<std::unique_ptr<PacketStreamWriter>> next_segment;
+    std::future<void> closing_segment;
+    std::deque<std::string> finished_segments;
+
+    VideoStats stats;
 };
 
 }
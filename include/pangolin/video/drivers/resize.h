@@ -0,0 +1,108 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/pangolin.h>
+#include <pangolin/image/image_resize.h>
+#include <pangolin/video/video.h>
+#include <pangolin/video/video_stats.h>
+
+namespace pangolin
+{
+
+// Video class that outputs resized copies of its input streams, e.g. a
+// reduced resolution preview or an image pyramid.
+class PANGOLIN_EXPORT ResizeVideo :
+    public VideoInterface,
+    public VideoFilterInterface,
+    public VideoPropertiesInterface,
+    public VideoStatsInterface
+{
+public:
+    // Description of one output stream
+    struct Output
+    {
+        // Input stream this output derives from.
+        size_t input;
+        // Resize from this earlier output instead of the input when >= 0,
+        // allowing pyramid levels to be computed from the level above.
+        int from_output;
+        size_t w;
+        size_t h;
+        ResizeMethod method;
+    };
+
+    ResizeVideo(std::unique_ptr<VideoInterface>& videoin, const std::vector<Output>& outputs, size_t threads = 1);
+    ~ResizeVideo();
+
+    //! Implement VideoInput::Start()
+    void Start();
+
+    //! Implement VideoInput::Stop()
+    void Stop();
+
+    //! Implement VideoInput::SizeBytes()
+    size_t SizeBytes() const;
+
+    //! Implement VideoInput::Streams()
+    const std::vector<StreamInfo>& Streams() const;
+
+    //! Implement VideoInput::GrabNext()
+    bool GrabNext( unsigned char* image, bool wait = true );
+
+    //! Implement VideoInput::GrabNewest()
+    bool GrabNewest( unsigned char* image, bool wait = true );
+
+    //! Implement VideoFilterInterface method
+    std::vector<VideoInterface*>& InputStreams();
+
+    //! Implement VideoPropertiesInterface, forwarding from the input
+    const picojson::value& DeviceProperties() const;
+
+    const picojson::value& FrameProperties() const;
+
+    VideoStats& Stats();
+
+protected:
+    void Process(unsigned char* image, const unsigned char* buffer);
+
+    std::unique_ptr<VideoInterface> src;
+    std::vector<VideoInterface*> videoin;
+    std::vector<Output> outputs;
+    std::vector<StreamInfo> streams;
+    WorkerPool workers;
+    size_t size_bytes;
+    unsigned char* buffer;
+
+    picojson::value null_properties;
+
+    VideoStats stats;
+};
+
+}
@@ -5,18 +5,109 @@
 #include <pangolin/utils/posix/condition_variable.h>
 #include <pangolin/utils/posix/shared_memory_buffer.h>
 
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <vector>
 
 namespace pangolin
 {
 
-class SharedMemoryVideo : public VideoInterface
+// Layout of a multi-slot shared memory frame ring, as written by the
+// shmem:// VideoOutput and read by SharedMemoryVideo.
+//
+//   SharedMemoryRingHeader | slot 0 | slot 1 | ... | slot num_slots-1
+//
+// where each slot is a SharedMemorySlotHeader followed by one frame.
+// Frame n (counting from 1) is written to slot (n-1) % num_slots. The
+// writer never waits for readers. Each slot is guarded by a seqlock so
+// that readers can detect frames overwritten whilst being copied, and
+// readers wait for new frames on a futex.
+const uint32_t SHARED_MEMORY_RING_VERSION = 1;
+const size_t SHARED_MEMORY_RING_MAX_STREAMS = 8;
+const size_t SHARED_MEMORY_RING_ALIGN = 64;
+
+struct SharedMemoryStreamDesc
+{
+  char fmt[32];
+  uint32_t w;
+  uint32_t h;
+  uint64_t pitch;
+  uint64_t offset;
+};
+
+struct SharedMemoryRingHeader
+{
+  // Written last by the creator, once the rest of the header is valid.
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint32_t num_streams;
+  uint32_t reserved;
+  uint64_t slot_stride;
+  uint64_t frame_bytes;
+  SharedMemoryStreamDesc streams[SHARED_MEMORY_RING_MAX_STREAMS];
+
+  // Sequence number of the most recently published frame, 0 if none.
+  alignas(SHARED_MEMORY_RING_ALIGN) std::atomic<uint64_t> write_seq;
+
+  // Incremented with each publish. Readers futex wait on this word.
+  std::atomic<uint32_t> futex;
+};
+
+struct SharedMemorySlotHeader
+{
+  // Seqlock: 2n-1 whilst frame n is being written, 2n once complete.
+  std::atomic<uint64_t> seq;
+  int64_t host_reception_time_us;
+  int64_t capture_time_us;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+inline uint64_t SharedMemoryRingMagic()
+{
+  uint64_t magic;
+  memcpy(&magic, "PANGSHM", sizeof(magic));
+  return magic;
+}
+
+inline size_t SharedMemoryRingHeaderBytes()
+{
+  return (sizeof(SharedMemoryRingHeader) + SHARED_MEMORY_RING_ALIGN - 1) / SHARED_MEMORY_RING_ALIGN * SHARED_MEMORY_RING_ALIGN;
+}
+
+inline SharedMemorySlotHeader* SharedMemoryRingSlot(unsigned char* base, const SharedMemoryRingHeader& header, uint64_t frame_seq)
+{
+  return reinterpret_cast<SharedMemorySlotHeader*>(
+    base + SharedMemoryRingHeaderBytes() + ((frame_seq - 1) % header.num_slots) * header.slot_stride
+  );
+}
+
+inline unsigned char* SharedMemorySlotData(SharedMemorySlotHeader* slot)
+{
+  return reinterpret_cast<unsigned char*>(slot) + SHARED_MEMORY_RING_ALIGN;
+}
+
+// Block until header.futex no longer equals expected, or timeout_us elapses
+// (wait forever if timeout_us < 0).
+void SharedMemoryRingWait(SharedMemoryRingHeader& header, uint32_t expected, int64_t timeout_us = -1);
+
+// Wake all processes waiting on header.futex.
+void SharedMemoryRingWake(SharedMemoryRingHeader& header);
+
+class SharedMemoryVideo : public VideoInterface, public VideoPropertiesInterface
 {
 public:
+  // Read a single unsynchronised buffer of known size and format, guarded by
+  // an flock and signalled by buffer_full.
   SharedMemoryVideo(size_t w, size_t h, std::string pix_fmt,
     const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
     const std::shared_ptr<ConditionVariableInterface>& buffer_full);
+
+  // Read frames from a frame ring. Stream format is taken from its header.
+  SharedMemoryVideo(const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory);
+
   ~SharedMemoryVideo();
 
   size_t SizeBytes() const;
@@ -26,12 +117,31 @@ public:
   bool GrabNext(unsigned char *image, bool wait);
   bool GrabNewest(unsigned char *image, bool wait);
 
+  const picojson::value& DeviceProperties() const;
+  const picojson::value& FrameProperties() const;
+
+  // Number of frames published by the writer but never returned to us.
+  uint64_t DroppedFrames() const;
+
 private:
+  bool GrabLegacy(unsigned char *image, bool wait);
+  bool GrabRing(unsigned char *image, bool wait, bool newest);
+
   PixelFormat _fmt;
   size_t _frame_size;
   std::vector<StreamInfo> _streams;
   std::shared_ptr<SharedMemoryBufferInterface> _shared_memory;
   std::shared_ptr<ConditionVariableInterface> _buffer_full;
+
+  SharedMemoryRingHeader* _ring;
+  uint64_t _last_seq;
+  uint64_t _dropped;
+  // Host time of the last frame returned, and the estimated frame period
+  // which bounds how long a blocking ring grab waits.
+  int64_t _last_host_time_us;
+  int64_t _frame_period_us;
+  picojson::value _device_properties;
+  picojson::value _frame_properties;
 };
 
 }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <pangolin/video/video_output_interface.h>
+#include <pangolin/video/drivers/shared_memory.h>
+
+#include <memory>
+#include <vector>
+
+namespace pangolin
+{
+
+// Publish frames to a shared memory frame ring (see shared_memory.h) which
+// any number of local processes can read with shmem://name. The writer
+// never blocks on readers; slow readers skip frames instead.
+class SharedMemoryVideoOutput : public VideoOutputInterface
+{
+public:
+  SharedMemoryVideoOutput(const std::string& name, size_t num_slots = 4);
+  ~SharedMemoryVideoOutput();
+
+  const std::vector<StreamInfo>& Streams() const override;
+  void SetStreams(const std::vector<StreamInfo>& streams, const std::string& uri, const picojson::value& properties) override;
+  int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
+  bool IsPipe() const override;
+
+private:
+  std::string _name;
+  size_t _num_slots;
+  std::vector<StreamInfo> _streams;
+  std::shared_ptr<SharedMemoryBufferInterface> _shared_memory;
+  SharedMemoryRingHeader* _ring;
+  uint64_t _seq;
+};
+
+}
@@ -0,0 +1,132 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/video/video_output.h>
+#include <pangolin/video/video_stats.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace pangolin
+{
+
+enum TeeDropPolicy
+{
+    TeeDropBlock,  // Wait for space in the sink's queue (lossless)
+    TeeDropOldest, // Discard the oldest queued frame to make room
+    TeeDropNewest  // Discard the incoming frame
+};
+
+PANGOLIN_EXPORT
+TeeDropPolicy TeeDropPolicyFromString(const std::string& str);
+
+// Fans each written frame out to several outputs. WriteStreams copies the
+// frame once into a pooled, reference counted buffer which is shared by
+// every sink; each sink drains its own bounded queue on its own thread so
+// that a slow sink can only hold up the writer if its policy is
+// TeeDropBlock.
+//
+// A sink whose WriteStreams throws is disabled with a warning. Once every
+// sink has failed, WriteStreams throws.
+class PANGOLIN_EXPORT TeeVideoOutput : public VideoOutputInterface, public VideoStatsInterface
+{
+public:
+    struct Sink
+    {
+        std::unique_ptr<VideoOutputInterface> output;
+        size_t max_queued_frames;
+        TeeDropPolicy drop;
+    };
+
+    TeeVideoOutput(std::vector<Sink>&& sinks);
+    ~TeeVideoOutput();
+
+    const std::vector<StreamInfo>& Streams() const override;
+    void SetStreams(const std::vector<StreamInfo>& streams, const std::string& uri, const picojson::value& device_properties) override;
+    int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
+    bool IsPipe() const override;
+
+    size_t NumSinks() const;
+    VideoOutputInterface& SinkOutput(size_t i);
+
+    // Number of frames sink i has discarded under its drop policy
+    size_t Dropped(size_t i) const;
+
+    // Number of frames sink i has written
+    size_t Written(size_t i) const;
+
+    // Block until every sink has written or dropped all queued frames
+    void Flush();
+
+    // Totals across sinks; write latency is per sink frame
+    VideoStats& Stats() override;
+
+protected:
+    struct Frame
+    {
+        std::vector<unsigned char> data;
+        picojson::value frame_properties;
+    };
+
+    struct SinkState
+    {
+        Sink sink;
+        std::deque<std::shared_ptr<const Frame>> queue;
+        size_t written = 0;
+        size_t dropped = 0;
+        bool busy = false;
+        bool failed = false;
+        std::condition_variable cond_jobs;
+        std::thread worker;
+    };
+
+    void WorkerLoop(SinkState& s);
+    std::shared_ptr<const Frame> MakeFrame(const unsigned char* data, const picojson::value& frame_properties);
+
+    std::vector<StreamInfo> streams;
+    size_t frame_bytes;
+
+    std::vector<std::unique_ptr<SinkState>> sinks;
+
+    // Buffers released by every sink, recycled by MakeFrame
+    size_t max_free_buffers;
+    std::vector<std::vector<unsigned char>> free_buffers;
+    std::mutex free_mutex;
+
+    bool should_run;
+    mutable std::mutex mutex;
+    std::condition_variable cond_done;
+
+    VideoStats stats;
+};
+
+}
@@ -30,14 +30,36 @@
 #include <pangolin/pangolin.h>
 #include <pangolin/video/video.h>
 
+#include <cstdint>
+#include <vector>
+
 namespace pangolin
 {
 
+enum TestVideoPattern
+{
+    TestVideoPatternNoise = 0,    // uniform random bytes, reproducible from seed
+    TestVideoPatternGradient,     // horizontal ramp in each channel
+    TestVideoPatternCheckerboard, // 32 pixel squares
+    TestVideoPatternMovingBar,    // vertical bar advancing 4 pixels per frame
+    TestVideoPatternBayer         // RGGB mosaic of a colour ramp (single channel formats)
+};
+
 // Video class that outputs test video signal.
-class PANGOLIN_EXPORT TestVideo : public VideoInterface
+//
+// Frame n of stream c depends only on (pattern, seed, c, n), so any run can
+// be reproduced exactly. If fps > 0, frames are paced to that rate and
+// stamped with a synthetic capture time of start + n/fps, offset by uniform
+// noise in [-jitter_us, +jitter_us]. jitter_us is limited to just under
+// half a frame period so that capture times stay strictly increasing.
+// GrabNewest skips frames that are
+// already due, as a real camera would drop them.
+class PANGOLIN_EXPORT TestVideo : public VideoInterface, public VideoPropertiesInterface
 {
 public:
-    TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt);
+    TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt,
+              TestVideoPattern pattern = TestVideoPatternNoise, uint64_t seed = 0,
+              double fps = 0.0, double jitter_us = 0.0);
     ~TestVideo();
     
     //! Implement VideoInput::Start()
@@ -57,10 +79,38 @@ public:
     
     //! Implement VideoInput::GrabNewest()
     bool GrabNewest( unsigned char* image, bool wait = true ) override;
-    
+
+    //! Implement VideoPropertiesInterface::DeviceProperties()
+    const picojson::value& DeviceProperties() const override;
+
+    //! Implement VideoPropertiesInterface::FrameProperties()
+    const picojson::value& FrameProperties() const override;
+
+    static TestVideoPattern PatternFromString(const std::string& str);
+
 protected:
+    bool Grab(unsigned char* image, bool wait, bool newest);
+
+    void RenderFrame(unsigned char* image, uint64_t frame) const;
+
+    // Synthetic capture time of frame, relative to the first frame.
+    int64_t CaptureOffset_us(uint64_t frame) const;
+
     std::vector<StreamInfo> streams;
     size_t size_bytes;
+
+    TestVideoPattern pattern;
+    uint64_t seed;
+    double fps;
+    double jitter_us;
+
+    // Pre-rendered stream images for patterns which don't change over time.
+    std::vector<unsigned char> static_frame;
+
+    uint64_t next_frame;
+    int64_t start_time_us;
+    picojson::value device_properties;
+    picojson::value frame_properties;
 };
 
 }
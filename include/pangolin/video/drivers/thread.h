@@ -29,6 +29,7 @@
 
 #include <pangolin/pangolin.h>
 #include <pangolin/video/video.h>
+#include <pangolin/video/video_stats.h>
 
 #include <memory>
 #include <pangolin/utils/fix_size_buffer_queue.h>
@@ -39,7 +40,8 @@ namespace pangolin
 
 // Video class that creates a thread that keeps pulling frames and processing from its children.
 class PANGOLIN_EXPORT ThreadVideo :  public VideoInterface, public VideoPropertiesInterface,
-        public BufferAwareVideoInterface, public VideoFilterInterface
+        public BufferAwareVideoInterface, public VideoFilterInterface,
+        public VideoStatsInterface
 {
 public:
     ThreadVideo(std::unique_ptr<VideoInterface>& videoin, size_t num_buffers);
@@ -75,6 +77,8 @@ public:
 
     std::vector<VideoInterface*>& InputStreams();
 
+    VideoStats& Stats();
+
 protected:
     struct GrabResult
     {
@@ -107,6 +111,8 @@ protected:
 
     mutable picojson::value device_properties;
     picojson::value frame_properties;
+
+    VideoStats stats;
 };
 
 }
@@ -29,6 +29,7 @@
 
 #include <pangolin/pangolin.h>
 #include <pangolin/video/video.h>
+#include <pangolin/video/video_stats.h>
 
 namespace pangolin
 {
@@ -37,7 +38,8 @@ namespace pangolin
 class PANGOLIN_EXPORT UnpackVideo :
     public VideoInterface,
     public VideoFilterInterface,
-    public BufferAwareVideoInterface
+    public BufferAwareVideoInterface,
+    public VideoStatsInterface
 {
 public:
     UnpackVideo(std::unique_ptr<VideoInterface>& videoin, PixelFormat new_fmt);
@@ -68,6 +70,8 @@ public:
 
     bool DropNFrames(uint32_t n);
 
+    VideoStats& Stats();
+
 protected:
     void Process(unsigned char* image, const unsigned char* buffer);
 
@@ -79,6 +83,8 @@ protected:
 
     picojson::value device_properties;
     picojson::value frame_properties;
+
+    VideoStats stats;
 };
 
 }
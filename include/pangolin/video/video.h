@@ -44,6 +44,7 @@
 //
 //  e.g. "file:[fmt=GRAY8,size=640x480]///home/user/raw_image.bin"
 //  e.g. "file:[realtime=1]///home/user/video/movie.pango"
+//  e.g. "pango:[throughput=1,read_ahead_frames=8]///home/user/video/movie.pango"
 //  e.g. "file:[stream=1]///home/user/video/movie.avi"
 //
 // dc1394 - capture video through a firewire camera
@@ -42,6 +42,12 @@
 //
 //  e.g. ffmpeg://output_file.avi
 //  e.g. ffmpeg:[fps=30,bps=1000000,unique_filename]//output_file.avi
+//
+// tee - write every frame to several outputs, each from its own thread
+//  queue : frames each output may have waiting (queueN for output N)
+//  drop : block, oldest or newest, when an output's queue is full (dropN)
+//
+//  e.g. tee:[drop1=oldest]//{pango://log.pango}{shmem://preview}
 
 #include <pangolin/video/video_output_interface.h>
 #include <pangolin/utils/uri.h>
@@ -0,0 +1,170 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/utils/latency_histogram.h>
+#include <pangolin/utils/picojson.h>
+#include <pangolin/utils/timer.h>
+
+#include <atomic>
+#include <string>
+
+namespace pangolin
+{
+
+struct VideoInterface;
+
+enum VideoStatsStage
+{
+    VideoStatsGrab = 0,      // Time spent obtaining a frame from upstream / hardware
+    VideoStatsProcess,       // Time spent transforming a frame (unpack, convert, ...)
+    VideoStatsQueueWait,     // Time a consumer blocked waiting for a queued frame
+    VideoStatsWrite,         // Time spent encoding / writing a frame to an output
+    VideoStatsNumStages
+};
+
+PANGOLIN_EXPORT
+const char* VideoStatsStageName(VideoStatsStage stage);
+
+//! Instrumentation globally enabled. Defaults to on unless the environment
+//! variable PANGOLIN_VIDEO_STATS=0. When disabled, Scope does not read the clock.
+PANGOLIN_EXPORT
+bool VideoStatsEnabled();
+
+PANGOLIN_EXPORT
+void SetVideoStatsEnabled(bool enabled);
+
+//! Per-driver counters and latency histograms. All members may be updated
+//! concurrently from capture, consumer and writer threads.
+class PANGOLIN_EXPORT VideoStats
+{
+public:
+    //! Records the lifetime of the scope into stage of stats.
+    class Scope
+    {
+    public:
+        Scope(VideoStats& stats, VideoStatsStage stage)
+            : stats(VideoStatsEnabled() ? &stats : nullptr), stage(stage)
+        {
+            if(this->stats) start = TimeNow();
+        }
+
+        ~Scope()
+        {
+            if(stats) stats->Record(stage, TimeNow() - start);
+        }
+
+    private:
+        VideoStats* stats;
+        VideoStatsStage stage;
+        basetime start;
+    };
+
+    VideoStats(const std::string& name);
+
+    const std::string& Name() const
+    {
+        return name;
+    }
+
+    void Record(VideoStatsStage stage, baseclock::duration d)
+    {
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        histograms[stage].Record(ns > 0 ? (uint64_t)ns : 0);
+    }
+
+    void AddFrames(uint64_t n = 1)
+    {
+        frames.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void AddDropped(uint64_t n = 1)
+    {
+        dropped.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void AddBytes(uint64_t n)
+    {
+        bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Frames() const
+    {
+        return frames.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Bytes() const
+    {
+        return bytes.load(std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& Histogram(VideoStatsStage stage) const
+    {
+        return histograms[stage];
+    }
+
+    void Reset();
+
+    //! {"name":..,"frames":..,"dropped":..,"bytes":..,"stages":{"grab":{"count":..,
+    //!  "mean_us":..,"p50_us":..,"p90_us":..,"p99_us":..,"max_us":..},..}}
+    //! Stages with no samples are omitted.
+    picojson::value ToJson() const;
+
+private:
+    std::string name;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> bytes;
+    LatencyHistogram histograms[VideoStatsNumStages];
+};
+
+//! Implemented by drivers and outputs which expose VideoStats.
+struct PANGOLIN_EXPORT VideoStatsInterface
+{
+    virtual ~VideoStatsInterface() {}
+
+    virtual VideoStats& Stats() = 0;
+};
+
+//! Collect stats for video and every instrumented driver beneath it, following
+//! VideoFilterInterface::InputStreams(). Returns a JSON tree mirroring the chain:
+//! {"driver": <stats or null>, "inputs": [...]}
+PANGOLIN_EXPORT
+picojson::value GetVideoStats(VideoInterface* video);
+
+//! Reset stats of every instrumented driver in the chain.
+PANGOLIN_EXPORT
+void ResetVideoStats(VideoInterface* video);
+
+}
@@ -48,6 +48,7 @@
 #include <pangolin/handler/handler.h>
 #include <pangolin/utils/simple_math.h>
 #include <pangolin/utils/timer.h>
+#include <pangolin/utils/trace.h>
 #include <pangolin/utils/type_convert.h>
 #include <pangolin/image/image_io.h>
 
@@ -327,10 +328,20 @@ void PostRender()
 
 void FinishFrame()
 {
-    RenderViews();
-    PostRender();
-    context->SwapBuffers();
-    context->ProcessEvents();
+    PANGOLIN_TRACE_SCOPE("FinishFrame", "gl");
+    {
+        PANGOLIN_TRACE_SCOPE("RenderViews", "gl");
+        RenderViews();
+        PostRender();
+    }
+    {
+        PANGOLIN_TRACE_SCOPE("SwapBuffers", "gl");
+        context->SwapBuffers();
+    }
+    {
+        PANGOLIN_TRACE_SCOPE("ProcessEvents", "gl");
+        context->ProcessEvents();
+    }
 }
 
 View& DisplayBase()
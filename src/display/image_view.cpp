@@ -6,7 +6,9 @@ namespace pangolin
 {
 
 ImageView::ImageView()
-    : offset_scale(0.0f, 1.0f), lastPressed(false), mouseReleased(false), mousePressed(false), overlayRender(true)
+    : offset_scale(0.0f, 1.0f), lastPressed(false), mouseReleased(false), mousePressed(false), overlayRender(true),
+      auto_scale(false), auto_scale_saturate(0.0f),
+      auto_scale_range(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest())
 {
     SetHandler(this);
 }
@@ -82,6 +84,17 @@ void ImageView::Keyboard(View& view, unsigned char key, int x, int y, bool press
         tex.Download(img);
         offset_scale = pangolin::GetOffsetScale(img, pangolin::Round(froi), img.fmt);
     }
+    else if(key == 'A')
+    {
+        if(pressed) {
+            SetAutoScale(!auto_scale, auto_scale_saturate);
+        }
+    }
+    else if(key == 'b' && auto_scale && auto_scale_range.first <= auto_scale_range.second)
+    {
+        // Already known from the last image, no need to read back the texture
+        printf("Min / Max in Region: %f / %f\n", auto_scale_range.first, auto_scale_range.second);
+    }
     else if(key == 'b')
     {
         if(!tex.IsValid())
@@ -156,6 +169,10 @@ ImageView& ImageView::SetImage(void* ptr, size_t w, size_t h, size_t pitch, pang
     }
 
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if(auto_scale) {
+        UpdateAutoScale(Image<unsigned char>((unsigned char*)ptr, w, h, pitch), img_fmt);
+    }
     return *this;
 }
 
@@ -220,4 +237,34 @@ void ImageView::SetRenderOverlay(const bool& val) {
     overlayRender = val;
 }
 
+ImageView& ImageView::SetAutoScale(bool enabled, float saturate_fraction)
+{
+    auto_scale = enabled;
+    auto_scale_saturate = saturate_fraction;
+    if(!enabled) {
+        offset_scale = std::pair<float, float>(0.0f, 1.0f);
+        auto_scale_range = std::pair<float, float>(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    }
+    return *this;
+}
+
+bool ImageView::AutoScale() const
+{
+    return auto_scale;
+}
+
+void ImageView::UpdateAutoScale(const pangolin::Image<unsigned char>& img, const pangolin::GlPixFormat& img_fmt)
+{
+    const bool have_selection = std::isfinite(GetSelection().Area()) && std::abs(GetSelection().Area()) >= 4;
+    const pangolin::XYRangei roi = pangolin::Round(have_selection ? GetSelection() : GetViewToRender());
+
+    auto_scale_range = auto_scale_saturate > 0.0f ?
+        pangolin::GetPercentileRange(img, roi, img_fmt, auto_scale_saturate, 1.0f - auto_scale_saturate) :
+        pangolin::GetMinMax(img, roi, img_fmt);
+
+    if(auto_scale_range.first < auto_scale_range.second) {
+        offset_scale = pangolin::GetOffsetScale(auto_scale_range, img_fmt);
+    }
+}
+
 }
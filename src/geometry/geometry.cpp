@@ -28,6 +28,7 @@
 #include <pangolin/geometry/geometry.h>
 #include <pangolin/geometry/geometry_ply.h>
 #include <pangolin/geometry/geometry_obj.h>
+#include <pangolin/geometry/geometry_cache.h>
 
 #include <pangolin/utils/file_extension.h>
 #include <pangolin/utils/file_utils.h>
@@ -38,17 +39,33 @@
 namespace pangolin {
 
 // TODO: Replace this with proper factory registry
-pangolin::Geometry LoadGeometry(const std::string& filename)
+pangolin::Geometry LoadGeometry(const std::string& filename, bool use_cache)
 {
     const std::string expanded_filename = PathExpand(filename);
+    const std::string cache_filename = GeometryCacheFilename(expanded_filename);
+
+    pangolin::Geometry geom;
+    if(use_cache && TryLoadGeometryCache(geom, cache_filename, expanded_filename)) {
+        return geom;
+    }
+
     const ImageFileType ft = FileType(expanded_filename);
     if(ft == ImageFileTypePly) {
-        return LoadGeometryPly(expanded_filename);
+        geom = LoadGeometryPly(expanded_filename);
     }else if(ft == ImageFileTypeObj) {
-        return LoadGeometryObj(expanded_filename);
+        geom = LoadGeometryObj(expanded_filename);
     }else{
         throw std::runtime_error("Unsupported geometry file type.");
     }
+
+    if(use_cache) {
+        try {
+            SaveGeometryCache(geom, cache_filename, expanded_filename);
+        }catch(const std::exception& e) {
+            pango_print_warn("%s\n", e.what());
+        }
+    }
+    return geom;
 }
 
 pangolin::Geometry::Element::Attribute MakeAttribute(GLenum datatype, size_t num_items, size_t count_per_item, void* ptr, size_t pitch_bytes)
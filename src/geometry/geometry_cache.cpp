@@ -0,0 +1,402 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/geometry/geometry_cache.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace pangolin {
+
+namespace {
+
+const char GEOMETRY_CACHE_MAGIC[8] = {'P','A','N','G','E','O','M','\0'};
+const size_t GEOMETRY_CACHE_ALIGN = 64;
+
+// Bytes per serialized GeometryOctreeNode: min, max, first, count, skip, leaf
+const size_t GEOMETRY_CACHE_OCTREE_NODE_BYTES = 6 * sizeof(float) + 3 * sizeof(uint32_t) + sizeof(uint8_t);
+
+struct GeometryCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t source_size;
+    uint64_t source_hash;
+};
+
+// FNV-1a, stable across platforms and runs unlike std::hash
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+uint64_t HashBytes(uint64_t h, const char* data, size_t size)
+{
+    for(size_t i=0; i < size; ++i) {
+        h ^= (uint8_t)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool SourceSize(const std::string& source_filename, uint64_t& size)
+{
+    struct stat st;
+    if(stat(source_filename.c_str(), &st) != 0) {
+        return false;
+    }
+    size = (uint64_t)st.st_size;
+    return true;
+}
+
+bool HashSource(const std::string& source_filename, uint64_t& hash)
+{
+    std::ifstream is(source_filename, std::ios::binary);
+    if(!is.is_open()) return false;
+
+    std::vector<char> chunk(1 << 20);
+    hash = FNV_OFFSET_BASIS;
+    while(is) {
+        is.read(chunk.data(), (std::streamsize)chunk.size());
+        hash = HashBytes(hash, chunk.data(), (size_t)is.gcount());
+    }
+    return is.eof();
+}
+
+bool MakeHeader(GeometryCacheHeader& hdr, const std::string& source_filename)
+{
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, GEOMETRY_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = GEOMETRY_CACHE_VERSION;
+    return SourceSize(source_filename, hdr.source_size) && HashSource(source_filename, hdr.source_hash);
+}
+
+template<typename T>
+void WritePod(std::ostream& os, const T& v)
+{
+    os.write((const char*)&v, sizeof(T));
+}
+
+void WriteString(std::ostream& os, const std::string& s)
+{
+    WritePod<uint32_t>(os, (uint32_t)s.size());
+    os.write(s.data(), s.size());
+}
+
+void WritePadding(std::ostream& os)
+{
+    const char zeros[GEOMETRY_CACHE_ALIGN] = {};
+    const size_t pos = (size_t)os.tellp();
+    os.write(zeros, (GEOMETRY_CACHE_ALIGN - pos % GEOMETRY_CACHE_ALIGN) % GEOMETRY_CACHE_ALIGN);
+}
+
+void WriteElement(std::ostream& os, const Geometry::Element& el)
+{
+    WritePod<uint64_t>(os, el.w);
+    WritePod<uint64_t>(os, el.h);
+    WritePod<uint64_t>(os, el.pitch);
+
+    WritePod<uint32_t>(os, (uint32_t)el.attributes.size());
+    for(const auto& a : el.attributes) {
+        WriteString(os, a.first);
+        WritePod<uint32_t>(os, (uint32_t)a.second.index());
+        visit([&](auto&& attrib){
+            WritePod<uint64_t>(os, attrib.w);
+            WritePod<uint64_t>(os, attrib.h);
+            WritePod<uint64_t>(os, attrib.pitch);
+            WritePod<uint64_t>(os, (uint64_t)((const uint8_t*)attrib.ptr - el.ptr));
+        }, a.second);
+    }
+
+    WritePod<uint64_t>(os, el.octree.size());
+    for(const GeometryOctreeNode& node : el.octree) {
+        os.write((const char*)node.min, sizeof(node.min));
+        os.write((const char*)node.max, sizeof(node.max));
+        WritePod<uint32_t>(os, node.first);
+        WritePod<uint32_t>(os, node.count);
+        WritePod<uint32_t>(os, node.skip);
+        WritePod<uint8_t>(os, node.leaf ? 1 : 0);
+    }
+
+    WritePadding(os);
+    os.write((const char*)el.ptr, el.SizeBytes());
+}
+
+template<typename T>
+Geometry::Element::Attribute MakeCachedAttribute(uint8_t* ptr, size_t w, size_t h, size_t pitch)
+{
+    return Image<T>((T*)ptr, w, h, pitch);
+}
+
+// Reads from a cache file which may be truncated or corrupt. Every length
+// is checked against what remains of the file before anything is allocated,
+// and any failure leaves ok false rather than throwing.
+struct CacheReader
+{
+    CacheReader(std::istream& is, uint64_t file_size)
+        : is(is), pos(0), file_size(file_size), ok(true)
+    {}
+
+    uint64_t Remaining() const
+    {
+        return file_size - pos;
+    }
+
+    bool Read(void* dst, uint64_t size)
+    {
+        if(!ok || size > Remaining()) return ok = false;
+        is.read((char*)dst, (std::streamsize)size);
+        pos += size;
+        return ok = is.good();
+    }
+
+    template<typename T>
+    bool Pod(T& v)
+    {
+        return Read(&v, sizeof(T));
+    }
+
+    bool String(std::string& s)
+    {
+        uint32_t size;
+        if(!Pod(size) || size > Remaining()) return ok = false;
+        s.resize(size);
+        return Read(&s[0], size);
+    }
+
+    bool SkipPadding()
+    {
+        const uint64_t pad = (GEOMETRY_CACHE_ALIGN - pos % GEOMETRY_CACHE_ALIGN) % GEOMETRY_CACHE_ALIGN;
+        if(!ok || pad > Remaining()) return ok = false;
+        is.seekg((std::streamoff)pad, std::ios_base::cur);
+        pos += pad;
+        return ok = is.good();
+    }
+
+    // True if h rows of pitch bytes fit in what remains of the file
+    bool FitsRows(uint64_t pitch, uint64_t h) const
+    {
+        return h == 0 || pitch <= Remaining() / h;
+    }
+
+    std::istream& is;
+    uint64_t pos;
+    uint64_t file_size;
+    bool ok;
+};
+
+template<typename T>
+bool MakeCachedAttribute(Geometry::Element::Attribute& attrib, const Geometry::Element& el, uint64_t offset, uint64_t w, uint64_t h, uint64_t pitch)
+{
+    // The attribute must lie within the element's rows
+    const uint64_t size = el.SizeBytes();
+    if(h > 0) {
+        if(w > pitch / sizeof(T) || offset > size || (h - 1) > (size - offset) / std::max<uint64_t>(pitch, 1)) return false;
+        if((h - 1) * pitch + w * sizeof(T) > size - offset) return false;
+    }else if(offset > size) {
+        return false;
+    }
+    attrib = Image<T>((T*)(el.ptr + offset), w, h, pitch);
+    return true;
+}
+
+bool ReadElement(CacheReader& r, Geometry::Element& el)
+{
+    uint64_t w, h, pitch;
+    if(!r.Pod(w) || !r.Pod(h) || !r.Pod(pitch)) return false;
+    if(w > pitch || !r.FitsRows(pitch, h)) return false;
+    el.Reinitialise(w, h, pitch);
+
+    uint32_t num_attributes;
+    if(!r.Pod(num_attributes)) return false;
+    for(uint32_t i=0; i < num_attributes; ++i) {
+        std::string name;
+        uint32_t type;
+        uint64_t aw, ah, apitch, offset;
+        if(!r.String(name) || !r.Pod(type) || !r.Pod(aw) || !r.Pod(ah) || !r.Pod(apitch) || !r.Pod(offset)) {
+            return false;
+        }
+        Geometry::Element::Attribute& attrib = el.attributes[name];
+        bool valid = false;
+        switch(type) {
+        case 0: valid = MakeCachedAttribute<float>(attrib, el, offset, aw, ah, apitch); break;
+        case 1: valid = MakeCachedAttribute<uint32_t>(attrib, el, offset, aw, ah, apitch); break;
+        case 2: valid = MakeCachedAttribute<uint16_t>(attrib, el, offset, aw, ah, apitch); break;
+        case 3: valid = MakeCachedAttribute<uint8_t>(attrib, el, offset, aw, ah, apitch); break;
+        default: break;
+        }
+        if(!valid) return false;
+    }
+
+    uint64_t num_nodes;
+    if(!r.Pod(num_nodes) || num_nodes > r.Remaining() / GEOMETRY_CACHE_OCTREE_NODE_BYTES) return false;
+    el.octree.resize(num_nodes);
+    for(GeometryOctreeNode& node : el.octree) {
+        uint8_t leaf;
+        if(!r.Read(node.min, sizeof(node.min)) || !r.Read(node.max, sizeof(node.max)) ||
+           !r.Pod(node.first) || !r.Pod(node.count) || !r.Pod(node.skip) || !r.Pod(leaf)) return false;
+        // Ranges must lie within the element's rows
+        if(node.first > h || node.count > h - node.first || node.skip > num_nodes || leaf > 1) return false;
+        node.leaf = leaf != 0;
+    }
+
+    return r.SkipPadding() && r.Read(el.ptr, el.SizeBytes());
+}
+
+}
+
+std::string GeometryCacheFilename(const std::string& source_filename, const std::string& post_process_key)
+{
+    if(post_process_key.empty()) {
+        return source_filename + ".pangogeom";
+    }
+    char key_hash[32];
+    snprintf(key_hash, sizeof(key_hash), ".%016llx", (unsigned long long)HashBytes(FNV_OFFSET_BASIS, post_process_key.data(), post_process_key.size()));
+    return source_filename + key_hash + ".pangogeom";
+}
+
+void SaveGeometryCache(const Geometry& geom, const std::string& cache_filename, const std::string& source_filename, const std::string& post_process_key)
+{
+    GeometryCacheHeader hdr;
+    if(!MakeHeader(hdr, source_filename)) {
+        throw std::runtime_error("Geometry cache: unable to read source '" + source_filename + "'.");
+    }
+
+    // Write to a temporary then rename, so readers never see a partial cache.
+    const std::string tmp_filename = cache_filename + ".tmp";
+    {
+        std::ofstream os(tmp_filename, std::ios::binary);
+        if(!os.is_open()) {
+            throw std::runtime_error("Geometry cache: unable to open '" + tmp_filename + "' for writing.");
+        }
+
+        WritePod(os, hdr);
+        WriteString(os, post_process_key);
+
+        WritePod<uint32_t>(os, (uint32_t)geom.buffers.size());
+        for(const auto& b : geom.buffers) {
+            WriteString(os, b.first);
+            WriteElement(os, b.second);
+        }
+
+        WritePod<uint32_t>(os, (uint32_t)geom.objects.size());
+        for(const auto& o : geom.objects) {
+            WriteString(os, o.first);
+            WriteElement(os, o.second);
+        }
+
+        WritePod<uint32_t>(os, (uint32_t)geom.textures.size());
+        for(const auto& t : geom.textures) {
+            WriteString(os, t.first);
+            WriteString(os, t.second.fmt.format);
+            WritePod<uint64_t>(os, t.second.w);
+            WritePod<uint64_t>(os, t.second.h);
+            WritePod<uint64_t>(os, t.second.pitch);
+            WritePadding(os);
+            os.write((const char*)t.second.ptr, t.second.SizeBytes());
+        }
+
+        if(!os.good()) {
+            throw std::runtime_error("Geometry cache: error writing '" + tmp_filename + "'.");
+        }
+    }
+    if(std::rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+        std::remove(tmp_filename.c_str());
+        throw std::runtime_error("Geometry cache: unable to rename '" + tmp_filename + "'.");
+    }
+}
+
+bool TryLoadGeometryCache(Geometry& geom, const std::string& cache_filename, const std::string& source_filename, const std::string& post_process_key)
+{
+    std::ifstream is(cache_filename, std::ios::binary);
+    if(!is.is_open()) return false;
+
+    is.seekg(0, std::ios_base::end);
+    const std::streamoff file_size = is.tellg();
+    is.seekg(0, std::ios_base::beg);
+    if(file_size < 0 || !is.good()) return false;
+    CacheReader r(is, (uint64_t)file_size);
+
+    // Check the cheap fields before hashing the source
+    GeometryCacheHeader hdr;
+    std::string key;
+    uint64_t source_size;
+    if(!r.Pod(hdr) || std::memcmp(hdr.magic, GEOMETRY_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != GEOMETRY_CACHE_VERSION || !r.String(key) || key != post_process_key ||
+       !SourceSize(source_filename, source_size) || source_size != hdr.source_size) {
+        return false;
+    }
+    GeometryCacheHeader expected;
+    if(!MakeHeader(expected, source_filename) || std::memcmp(&hdr, &expected, sizeof(hdr)) != 0) {
+        return false;
+    }
+
+    Geometry cached;
+    uint32_t num_buffers;
+    if(!r.Pod(num_buffers)) return false;
+    for(uint32_t i=0; i < num_buffers; ++i) {
+        std::string name;
+        if(!r.String(name) || !ReadElement(r, cached.buffers[name])) return false;
+    }
+
+    uint32_t num_objects;
+    if(!r.Pod(num_objects)) return false;
+    for(uint32_t i=0; i < num_objects; ++i) {
+        std::string name;
+        if(!r.String(name)) return false;
+        auto it = cached.objects.emplace(name, Geometry::Element());
+        if(!ReadElement(r, it->second)) return false;
+    }
+
+    uint32_t num_textures;
+    if(!r.Pod(num_textures)) return false;
+    for(uint32_t i=0; i < num_textures; ++i) {
+        std::string name, format;
+        uint64_t w, h, pitch;
+        if(!r.String(name) || !r.String(format) || !r.Pod(w) || !r.Pod(h) || !r.Pod(pitch)) return false;
+
+        PixelFormat fmt;
+        try {
+            fmt = PixelFormatFromString(format);
+        }catch(const std::exception&) {
+            return false;
+        }
+        if(pitch > r.Remaining() || w > pitch * 8 / fmt.bpp || !r.FitsRows(pitch, h)) return false;
+
+        TypedImage& img = cached.textures[name];
+        img.Reinitialise(w, h, fmt, pitch);
+        if(!r.SkipPadding() || !r.Read(img.ptr, img.SizeBytes())) return false;
+    }
+
+    geom = std::move(cached);
+    return true;
+}
+
+}
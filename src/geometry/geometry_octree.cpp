@@ -0,0 +1,240 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/geometry/geometry.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+
+namespace pangolin {
+
+namespace {
+
+// Avoid unbounded recursion on coincident points
+const int MAX_OCTREE_DEPTH = 21;
+
+struct OctreeBuilder
+{
+    OctreeBuilder(const ManagedImage<float>& pos, size_t max_rows_per_leaf)
+        : pos(pos), max_rows_per_leaf(std::max<size_t>(max_rows_per_leaf,1))
+    {
+        order.resize(pos.h);
+        for(uint32_t i=0; i < order.size(); ++i) order[i] = i;
+    }
+
+    void Build(uint32_t* begin, uint32_t* end, int depth)
+    {
+        const size_t node_id = nodes.size();
+        nodes.emplace_back();
+        {
+            GeometryOctreeNode& node = nodes.back();
+            node.first = (uint32_t)(begin - order.data());
+            node.count = (uint32_t)(end - begin);
+            for(int d=0; d<3; ++d) {
+                node.min[d] = +std::numeric_limits<float>::max();
+                node.max[d] = -std::numeric_limits<float>::max();
+            }
+            for(const uint32_t* it = begin; it != end; ++it) {
+                const float* p = pos.RowPtr(*it);
+                for(int d=0; d<3; ++d) {
+                    node.min[d] = std::min(node.min[d], p[d]);
+                    node.max[d] = std::max(node.max[d], p[d]);
+                }
+            }
+            node.leaf = node.count <= max_rows_per_leaf || depth >= MAX_OCTREE_DEPTH;
+        }
+
+        if(!nodes[node_id].leaf) {
+            float mid[3];
+            for(int d=0; d<3; ++d) {
+                mid[d] = (nodes[node_id].min[d] + nodes[node_id].max[d]) / 2.0f;
+            }
+
+            // Partition into octants along z, then y, then x.
+            uint32_t* split[9];
+            split[0] = begin;
+            split[8] = end;
+            auto below = [&](int d){ return [this,d,&mid](uint32_t i){ return pos(d,i) < mid[d]; }; };
+            split[4] = std::partition(split[0], split[8], below(2));
+            split[2] = std::partition(split[0], split[4], below(1));
+            split[6] = std::partition(split[4], split[8], below(1));
+            for(int c=0; c < 8; c+=2) {
+                split[c+1] = std::partition(split[c], split[c+2], below(0));
+            }
+
+            for(int c=0; c < 8; ++c) {
+                if(split[c] != split[c+1]) {
+                    Build(split[c], split[c+1], depth+1);
+                }
+            }
+        }
+
+        nodes[node_id].skip = (uint32_t)nodes.size();
+    }
+
+    const ManagedImage<float>& pos;
+    size_t max_rows_per_leaf;
+    std::vector<uint32_t> order;
+    GeometryOctree nodes;
+};
+
+// Permute rows of el in place such that new row i is old row order[i].
+void PermuteRows(Geometry::Element& el, const std::vector<uint32_t>& order)
+{
+    PANGO_ENSURE(order.size() == el.h);
+    std::vector<bool> done(order.size(), false);
+    std::vector<uint8_t> tmp(el.pitch);
+
+    for(size_t start=0; start < order.size(); ++start) {
+        if(done[start] || order[start] == start) continue;
+        std::memcpy(tmp.data(), el.RowPtr(start), el.pitch);
+        size_t dst = start;
+        while(order[dst] != start) {
+            std::memcpy(el.RowPtr(dst), el.RowPtr(order[dst]), el.pitch);
+            done[dst] = true;
+            dst = order[dst];
+        }
+        std::memcpy(el.RowPtr(dst), tmp.data(), el.pitch);
+        done[dst] = true;
+    }
+}
+
+GeometryOctree BuildAndPermute(
+    const ManagedImage<float>& pos, size_t max_rows_per_leaf, bool shuffle_leaves,
+    const std::vector<Geometry::Element*>& elements
+) {
+    OctreeBuilder builder(pos, max_rows_per_leaf);
+    if(pos.h) {
+        builder.Build(builder.order.data(), builder.order.data() + builder.order.size(), 0);
+    }
+
+    if(shuffle_leaves) {
+        std::minstd_rand rng(0);
+        for(const GeometryOctreeNode& n : builder.nodes) {
+            if(n.leaf) {
+                std::shuffle(builder.order.begin() + n.first, builder.order.begin() + n.first + n.count, rng);
+            }
+        }
+    }
+
+    for(Geometry::Element* el : elements) {
+        PermuteRows(*el, builder.order);
+    }
+
+    return std::move(builder.nodes);
+}
+
+// Grow leaf bounds to enclose whole faces rather than just their centroids,
+// then propagate bounds up to the root.
+void FitOctreeToFaces(GeometryOctree& tree, const Image<uint32_t>& ibo, const Image<float>& verts)
+{
+    for(size_t n = tree.size(); n-- > 0; ) {
+        GeometryOctreeNode& node = tree[n];
+        if(node.leaf) {
+            for(size_t f = node.first; f < node.first + node.count; ++f) {
+                for(size_t v=0; v < ibo.w; ++v) {
+                    const float* p = verts.RowPtr(ibo(v,f));
+                    for(int d=0; d<3; ++d) {
+                        node.min[d] = std::min(node.min[d], p[d]);
+                        node.max[d] = std::max(node.max[d], p[d]);
+                    }
+                }
+            }
+        }else{
+            for(size_t c = n+1; c < node.skip; c = tree[c].skip) {
+                for(int d=0; d<3; ++d) {
+                    node.min[d] = std::min(node.min[d], tree[c].min[d]);
+                    node.max[d] = std::max(node.max[d], tree[c].max[d]);
+                }
+            }
+        }
+    }
+}
+
+}
+
+void BuildGeometryOctree(Geometry& geom, size_t max_rows_per_leaf)
+{
+    Geometry::Element* vert_el = nullptr;
+    const Image<float>* verts = nullptr;
+    for(auto& b : geom.buffers) {
+        auto it_vert = b.second.attributes.find("vertex");
+        if(it_vert != b.second.attributes.end()) {
+            verts = get_if<Image<float>>(&it_vert->second);
+            if(verts && verts->w >= 3) {
+                vert_el = &b.second;
+                break;
+            }
+        }
+    }
+
+    if(!vert_el) {
+        throw std::runtime_error("BuildGeometryOctree: Geometry has no 3D float 'vertex' attribute.");
+    }
+
+    PANGO_ENSURE(verts->h <= std::numeric_limits<uint32_t>::max());
+
+    if(geom.objects.empty()) {
+        // Point cloud: reorder every per-vertex buffer together.
+        ManagedImage<float> pos(3, verts->h);
+        for(size_t i=0; i < verts->h; ++i) {
+            std::memcpy(pos.RowPtr(i), verts->RowPtr(i), 3*sizeof(float));
+        }
+
+        std::vector<Geometry::Element*> elements;
+        for(auto& b : geom.buffers) {
+            if(b.second.h == vert_el->h) elements.push_back(&b.second);
+        }
+        vert_el->octree = BuildAndPermute(pos, max_rows_per_leaf, true, elements);
+    }else{
+        // Mesh: reorder faces of each object by centroid.
+        for(auto& o : geom.objects) {
+            auto it_ibo = o.second.attributes.find("vertex_indices");
+            if(it_ibo == o.second.attributes.end()) continue;
+            const Image<uint32_t>* ibo = get_if<Image<uint32_t>>(&it_ibo->second);
+            if(!ibo || ibo->w == 0) continue;
+
+            ManagedImage<float> centroids(3, ibo->h);
+            for(size_t f=0; f < ibo->h; ++f) {
+                float* c = centroids.RowPtr(f);
+                c[0] = c[1] = c[2] = 0.0f;
+                for(size_t v=0; v < ibo->w; ++v) {
+                    const float* p = verts->RowPtr((*ibo)(v,f));
+                    for(int d=0; d<3; ++d) c[d] += p[d];
+                }
+                for(int d=0; d<3; ++d) c[d] /= ibo->w;
+            }
+            o.second.octree = BuildAndPermute(centroids, max_rows_per_leaf, false, {&o.second});
+            FitOctreeToFaces(o.second.octree, *ibo, *verts);
+        }
+    }
+}
+
+}
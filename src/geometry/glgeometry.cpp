@@ -26,14 +26,19 @@
  */
 
 #include <pangolin/geometry/glgeometry.h>
+#include <pangolin/geometry/geometry_cache.h>
 
 #include <pangolin/gl/glformattraits.h>
+#include <pangolin/utils/file_utils.h>
+
+#include <algorithm>
+#include <limits>
 
 namespace pangolin {
 
-GlGeometry::Element ToGlGeometryElement(const Geometry::Element& el, GlBufferType buffertype)
+GlGeometry::Element ToGlGeometryElement(const Geometry::Element& el, GlBufferType buffertype, bool upload = true)
 {
-    GlGeometry::Element glel(buffertype, el.SizeBytes(), GL_STATIC_DRAW, el.ptr );
+    GlGeometry::Element glel(buffertype, el.SizeBytes(), GL_STATIC_DRAW, upload ? el.ptr : nullptr );
     for(const auto& attrib_variant : el.attributes) {
         visit([&](auto&& attrib){
             using T = std::decay_t<decltype(attrib)>;
@@ -45,6 +50,7 @@ GlGeometry::Element ToGlGeometryElement(const Geometry::Element& el, GlBufferTyp
             glattrib.stride_bytes = attrib.pitch;
         }, attrib_variant.second);
     }
+    glel.octree = el.octree;
     return glel;
 }
 
@@ -64,6 +70,134 @@ GlGeometry ToGlGeometry(const Geometry& geom)
     return gl;
 }
 
+GlGeometryLoader::GlGeometryLoader(const std::string& filename, const std::function<void(Geometry&)>& post_process, bool use_cache, const std::string& post_process_key)
+    : state(Loading), total_bytes(0), uploaded_bytes(0)
+{
+    // Without a key there is no telling what post_process did
+    if(use_cache && post_process && post_process_key.empty()) {
+        pango_print_warn("GlGeometryLoader: post processing without a post_process_key, not caching '%s'.\n", filename.c_str());
+        use_cache = false;
+    }
+
+    loading = std::async(std::launch::async, [filename, post_process, use_cache, post_process_key](){
+        const std::string expanded_filename = PathExpand(filename);
+        const std::string cache_filename = GeometryCacheFilename(expanded_filename, post_process_key);
+
+        Geometry geom;
+        if(use_cache && TryLoadGeometryCache(geom, cache_filename, expanded_filename, post_process_key)) {
+            return geom;
+        }
+
+        geom = LoadGeometry(expanded_filename);
+        if(post_process) post_process(geom);
+
+        if(use_cache) {
+            try {
+                SaveGeometryCache(geom, cache_filename, expanded_filename, post_process_key);
+            }catch(const std::exception& e) {
+                pango_print_warn("%s\n", e.what());
+            }
+        }
+        return geom;
+    });
+}
+
+GlGeometryLoader::~GlGeometryLoader()
+{
+    if(loading.valid()) loading.wait();
+}
+
+GlGeometryLoader::State GlGeometryLoader::GetState() const
+{
+    return state;
+}
+
+float GlGeometryLoader::Progress() const
+{
+    if(state == Ready) return 1.0f;
+    return total_bytes ? (float)uploaded_bytes / (float)total_bytes : 0.0f;
+}
+
+void GlGeometryLoader::BeginUpload()
+{
+    // Allocate GPU storage for everything up front, but defer the data.
+    for(const auto& b : geom.buffers) {
+        GlGeometry::Element& el = glgeom.buffers[b.first] = ToGlGeometryElement(b.second, GlArrayBuffer, false);
+        pending.push_back({&el, b.second.ptr, b.second.SizeBytes(), 0});
+    }
+    for(const auto& b : geom.objects) {
+        auto it = glgeom.objects.emplace(b.first, ToGlGeometryElement(b.second, GlElementArrayBuffer, false));
+        pending.push_back({&it->second, b.second.ptr, b.second.SizeBytes(), 0});
+    }
+    for(const auto& tex : geom.textures) {
+        pending_textures.push_back(tex.first);
+    }
+
+    for(const auto& p : pending) total_bytes += p.size_bytes;
+    for(const auto& tex : geom.textures) total_bytes += tex.second.SizeBytes();
+    state = Uploading;
+}
+
+bool GlGeometryLoader::Upload(size_t max_bytes)
+{
+    if(state == Loading) {
+        if(loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        try {
+            geom = loading.get();
+        }catch(...) {
+            state = Failed;
+            throw;
+        }
+        BeginUpload();
+    }
+
+    if(state == Failed) {
+        throw std::runtime_error("GlGeometryLoader: loading failed.");
+    }
+
+    size_t budget = max_bytes;
+    bool first = true;
+    while(!pending_textures.empty() && (first || budget > 0)) {
+        const TypedImage& img = geom.textures[pending_textures.back()];
+        glgeom.textures[pending_textures.back()].Load(img);
+        const size_t bytes = img.SizeBytes();
+        budget -= std::min(budget, bytes);
+        uploaded_bytes += bytes;
+        pending_textures.pop_back();
+        first = false;
+    }
+
+    while(!pending.empty() && (first || budget > 0)) {
+        PendingUpload& p = pending.back();
+        const size_t bytes = std::min(p.size_bytes - p.uploaded_bytes, std::max<size_t>(budget,1));
+        p.buffer->Upload(p.data + p.uploaded_bytes, bytes, p.uploaded_bytes);
+        p.uploaded_bytes += bytes;
+        uploaded_bytes += bytes;
+        budget -= std::min(budget, bytes);
+        if(p.uploaded_bytes == p.size_bytes) pending.pop_back();
+        first = false;
+    }
+
+    if(pending.empty() && pending_textures.empty()) {
+        state = Ready;
+    }
+    return state == Ready;
+}
+
+GlGeometry& GlGeometryLoader::GetGlGeometry()
+{
+    PANGO_ENSURE(state == Ready);
+    return glgeom;
+}
+
+const Geometry& GlGeometryLoader::GetGeometry() const
+{
+    PANGO_ENSURE(state == Uploading || state == Ready);
+    return geom;
+}
+
 void BindGlElement(GlSlProgram& prog, const GlGeometry::Element& el)
 {
     el.Bind();
@@ -92,9 +226,8 @@ void UnbindGlElements(GlSlProgram& prog, const GlGeometry::Element& el)
     el.Unbind();
 }
 
-void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
+int BindGlTextures(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
 {
-    // Bind textures
     int num_tex_bound = 0;
     for(auto& tex : geom.textures) {
         glActiveTexture(GL_TEXTURE0 + num_tex_bound);
@@ -109,6 +242,19 @@ void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
         prog.SetUniform("matcap", (int)num_tex_bound);
         ++num_tex_bound;
     }
+    return num_tex_bound;
+}
+
+void UnbindGlTextures()
+{
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
+{
+    // Bind textures
+    BindGlTextures(prog, geom, matcap);
 
     // Bind all attribute buffers
     for(auto& buffer : geom.buffers) {
@@ -135,8 +281,199 @@ void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
     }
 
     // Unbind textures
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0);
+    UnbindGlTextures();
+}
+
+namespace {
+
+// Clip space culling planes (a,b,c,d), inside when a*x+b*y+c*z+d >= 0
+struct ClipFrustum
+{
+    ClipFrustum(const OpenGlMatrix& KT_cw)
+        : KT_cw(KT_cw)
+    {
+        // Row r of column major matrix is m[c*4+r]
+        auto row = [&](int r, int c){ return (float)KT_cw.m[c*4+r]; };
+        for(int i=0; i < 3; ++i) {
+            for(int c=0; c < 4; ++c) {
+                planes[2*i+0][c] = row(3,c) + row(i,c);
+                planes[2*i+1][c] = row(3,c) - row(i,c);
+            }
+        }
+    }
+
+    // -1 outside, 0 intersecting, +1 fully inside
+    int Classify(const GeometryOctreeNode& n) const
+    {
+        int result = 1;
+        for(const float* p : planes) {
+            float pos = p[3], neg = p[3];
+            for(int d=0; d<3; ++d) {
+                pos += p[d] * (p[d] >= 0.0f ? n.max[d] : n.min[d]);
+                neg += p[d] * (p[d] >= 0.0f ? n.min[d] : n.max[d]);
+            }
+            if(pos < 0.0f) return -1;
+            if(neg < 0.0f) result = 0;
+        }
+        return result;
+    }
+
+    // Approximate area of node on screen in pixels
+    float ProjectedArea(const GeometryOctreeNode& n, float vp_w, float vp_h) const
+    {
+        float lo[2] = {+1.0f, +1.0f};
+        float hi[2] = {-1.0f, -1.0f};
+        for(int c=0; c < 8; ++c) {
+            const double P[3] = { (c&1) ? n.max[0] : n.min[0], (c&2) ? n.max[1] : n.min[1], (c&4) ? n.max[2] : n.min[2] };
+            double clip[4];
+            for(int r=0; r<4; ++r) {
+                clip[r] = KT_cw.m[12+r];
+                for(int d=0; d<3; ++d) clip[r] += KT_cw.m[d*4+r] * P[d];
+            }
+            if(clip[3] <= 0.0) {
+                // Camera inside or behind box: treat as filling the screen.
+                return vp_w * vp_h;
+            }
+            for(int d=0; d<2; ++d) {
+                const float ndc = (float)(clip[d] / clip[3]);
+                lo[d] = std::min(lo[d], std::max(ndc, -1.0f));
+                hi[d] = std::max(hi[d], std::min(ndc, +1.0f));
+            }
+        }
+        const float w = std::max(0.0f, hi[0]-lo[0]) * vp_w / 2.0f;
+        const float h = std::max(0.0f, hi[1]-lo[1]) * vp_h / 2.0f;
+        return w * h;
+    }
+
+    // Append visible leaves of tree to leaves
+    void VisibleLeaves(const GeometryOctree& tree, std::vector<uint32_t>& leaves) const
+    {
+        size_t n = 0;
+        while(n < tree.size()) {
+            const int c = Classify(tree[n]);
+            if(c < 0) {
+                n = tree[n].skip;
+            }else if(c > 0) {
+                // Fully inside, accept whole subtree without further tests
+                for(size_t i=n; i < tree[n].skip; ++i) {
+                    if(tree[i].leaf) leaves.push_back((uint32_t)i);
+                }
+                n = tree[n].skip;
+            }else{
+                if(tree[n].leaf) leaves.push_back((uint32_t)n);
+                ++n;
+            }
+        }
+    }
+
+    const OpenGlMatrix& KT_cw;
+    float planes[6][4];
+};
+
+inline void MultiDrawArrays(GLenum mode, const std::vector<GLint>& firsts, const std::vector<GLsizei>& counts)
+{
+#ifndef HAVE_GLES
+    glMultiDrawArrays(mode, firsts.data(), counts.data(), (GLsizei)firsts.size());
+#else
+    for(size_t i=0; i < firsts.size(); ++i) glDrawArrays(mode, firsts[i], counts[i]);
+#endif
+}
+
+inline void MultiDrawElements(GLenum mode, const std::vector<GLsizei>& counts, GLenum type, const std::vector<const GLvoid*>& offsets)
+{
+#ifndef HAVE_GLES
+    glMultiDrawElements(mode, counts.data(), type, offsets.data(), (GLsizei)counts.size());
+#else
+    for(size_t i=0; i < counts.size(); ++i) glDrawElements(mode, counts[i], type, offsets[i]);
+#endif
+}
+
+}
+
+void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap, const OpenGlMatrix& KT_cw, size_t point_budget)
+{
+    const ClipFrustum frustum(KT_cw);
+    std::vector<uint32_t> leaves;
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+    std::vector<const GLvoid*> offsets;
+
+    BindGlTextures(prog, geom, matcap);
+
+    for(auto& buffer : geom.buffers) {
+        BindGlElement(prog, buffer.second);
+    }
+
+    if(geom.objects.empty()) {
+        // Point cloud
+        for(auto& buffer : geom.buffers) {
+            auto it_vert = buffer.second.attributes.find("vertex");
+            if(it_vert == buffer.second.attributes.end()) continue;
+            const GeometryOctree& tree = buffer.second.octree;
+
+            if(tree.empty()) {
+                const size_t n = std::min(it_vert->second.num_elements, point_budget);
+                glDrawArrays(GL_POINTS, 0, (GLsizei)n);
+                continue;
+            }
+
+            GLint vp[4];
+            glGetIntegerv(GL_VIEWPORT, vp);
+
+            // Aim for about one point per pixel covered by each chunk, then
+            // scale down uniformly to respect the budget. Leaves are
+            // shuffled, so any prefix is a uniform subsample.
+            frustum.VisibleLeaves(tree, leaves);
+            std::vector<float> desired(leaves.size());
+            double total = 0.0;
+            for(size_t i=0; i < leaves.size(); ++i) {
+                const GeometryOctreeNode& n = tree[leaves[i]];
+                desired[i] = std::min((float)n.count, std::max(1.0f, frustum.ProjectedArea(n, (float)vp[2], (float)vp[3])));
+                total += desired[i];
+            }
+            const double scale = (total > point_budget) ? point_budget / total : 1.0;
+            for(size_t i=0; i < leaves.size(); ++i) {
+                const GeometryOctreeNode& n = tree[leaves[i]];
+                firsts.push_back((GLint)n.first);
+                counts.push_back(std::min((GLsizei)n.count, std::max((GLsizei)1, (GLsizei)(desired[i] * scale))));
+            }
+            MultiDrawArrays(GL_POINTS, firsts, counts);
+            break;
+        }
+    }else{
+        // Meshes
+        for(auto& buffer : geom.objects) {
+            auto it_indices = buffer.second.attributes.find("vertex_indices");
+            if(it_indices == buffer.second.attributes.end()) continue;
+            auto& attrib = it_indices->second;
+
+            buffer.second.Bind();
+            if(buffer.second.octree.empty()) {
+                glDrawElements(
+                   GL_TRIANGLES, attrib.count_per_element * attrib.num_elements,
+                   attrib.gltype, (uint8_t*)0 + attrib.offset
+                );
+            }else{
+                leaves.clear();
+                counts.clear();
+                offsets.clear();
+                frustum.VisibleLeaves(buffer.second.octree, leaves);
+                for(uint32_t l : leaves) {
+                    const GeometryOctreeNode& n = buffer.second.octree[l];
+                    counts.push_back((GLsizei)(n.count * attrib.count_per_element));
+                    offsets.push_back((uint8_t*)0 + attrib.offset + n.first * attrib.stride_bytes);
+                }
+                MultiDrawElements(GL_TRIANGLES, counts, attrib.gltype, offsets);
+            }
+            buffer.second.Unbind();
+        }
+    }
+
+    for(auto& buffer : geom.buffers) {
+        UnbindGlElements(prog, buffer.second);
+    }
+
+    UnbindGlTextures();
 }
 
 }
@@ -0,0 +1,312 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/gl/glprimitives.h>
+
+#ifndef HAVE_GLES
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace pangolin
+{
+
+namespace
+{
+
+// Per instance attributes follow the standard attribute locations in glsl.h
+const GLuint LOCATION_INSTANCE_T = 4; // occupies 4..7
+const GLuint LOCATION_INSTANCE_COLOUR = 8;
+
+const char* instanced_shader =
+    "@start vertex\n"
+    "#version 120\n"
+    "attribute vec3 a_position;\n"
+    "attribute vec4 a_color;\n"
+    "attribute mat4 a_instance_T;\n"
+    "attribute vec4 a_instance_color;\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "  gl_Position = gl_ModelViewProjectionMatrix * a_instance_T * vec4(a_position,1.0);\n"
+    "  v_color = a_color * a_instance_color;\n"
+    "}\n"
+    "@start fragment\n"
+    "#version 120\n"
+    "varying vec4 v_color;\n"
+    "void main() {\n"
+    "  gl_FragColor = v_color;\n"
+    "}\n";
+
+// out = lhs * rhs for column major 4x4 matrices
+inline void MatMul(GLfloat* out, const OpenGlMatrix& lhs, const GLfloat* rhs)
+{
+    for(int c=0; c<4; ++c) {
+        for(int r=0; r<4; ++r) {
+            double v = 0.0;
+            for(int k=0; k<4; ++k) {
+                v += lhs.m[k*4+r] * rhs[c*4+k];
+            }
+            out[c*4+r] = (GLfloat)v;
+        }
+    }
+}
+
+}
+
+GlPrimitiveBatch::GlPrimitiveBatch()
+    : initialised(false)
+{
+}
+
+void GlPrimitiveBatch::Clear()
+{
+    for(Primitive& p : primitives) {
+        p.instances.clear();
+    }
+}
+
+size_t GlPrimitiveBatch::NumInstances() const
+{
+    size_t n = 0;
+    for(const Primitive& p : primitives) {
+        n += p.instances.size();
+    }
+    return n;
+}
+
+void GlPrimitiveBatch::Add(GlPrimitiveType type, const OpenGlMatrix& T_wp, const Colour& colour)
+{
+    Instance inst;
+    for(int i=0; i<16; ++i) inst.T_wp[i] = (GLfloat)T_wp.m[i];
+    inst.colour[0] = colour.r;
+    inst.colour[1] = colour.g;
+    inst.colour[2] = colour.b;
+    inst.colour[3] = colour.a;
+    primitives[type].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::AddAxis(const OpenGlMatrix& T_wf, float scale)
+{
+    Instance inst = {
+        {scale,0,0,0, 0,scale,0,0, 0,0,scale,0, 0,0,0,1},
+        {1,1,1,1}
+    };
+    MatMul(inst.T_wp, T_wf, inst.T_wp);
+    primitives[GlPrimitiveAxis].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::AddFrustum(const OpenGlMatrix& T_wf, GLfloat u0, GLfloat v0, GLfloat fu, GLfloat fv, int w, int h, GLfloat scale, const Colour& colour)
+{
+    // The unit frustum has its image plane spanning [0,1]^2 at z=1. The
+    // mapping to the camera frustum is linear (the apex stays at the origin).
+    const GLfloat xl = scale * u0;
+    const GLfloat xh = scale * (w*fu + u0);
+    const GLfloat yl = scale * v0;
+    const GLfloat yh = scale * (h*fv + v0);
+
+    Instance inst = {
+        {xh-xl,0,0,0, 0,yh-yl,0,0, xl,yl,scale,0, 0,0,0,1},
+        {colour.r, colour.g, colour.b, colour.a}
+    };
+    MatMul(inst.T_wp, T_wf, inst.T_wp);
+    primitives[GlPrimitiveFrustum].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::AddColouredCube(const OpenGlMatrix& T_wf, GLfloat axis_min, GLfloat axis_max)
+{
+    const GLfloat s = axis_max - axis_min;
+    const GLfloat t = (axis_max + axis_min) / 2.0f;
+    Instance inst = {
+        {s,0,0,0, 0,s,0,0, 0,0,s,0, t,t,t,1},
+        {1,1,1,1}
+    };
+    MatMul(inst.T_wp, T_wf, inst.T_wp);
+    primitives[GlPrimitiveColouredCube].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::AddCircle(GLfloat x, GLfloat y, GLfloat rad, const Colour& colour)
+{
+    Instance inst = {
+        {rad,0,0,0, 0,rad,0,0, 0,0,1,0, x,y,0,1},
+        {colour.r, colour.g, colour.b, colour.a}
+    };
+    primitives[GlPrimitiveCircle].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::AddCross(GLfloat x, GLfloat y, GLfloat z, GLfloat rad, const Colour& colour)
+{
+    Instance inst = {
+        {rad,0,0,0, 0,rad,0,0, 0,0,rad,0, x,y,z,1},
+        {colour.r, colour.g, colour.b, colour.a}
+    };
+    primitives[GlPrimitiveCross].instances.push_back(inst);
+}
+
+void GlPrimitiveBatch::InitPrimitive(GlPrimitiveType type, GLenum mode, const std::vector<GLfloat>& verts, const std::vector<GLfloat>& cols)
+{
+    Primitive& p = primitives[type];
+    p.mode = mode;
+    p.num_vertices = (GLsizei)(verts.size() / 3);
+    p.has_vertex_colour = !cols.empty();
+    p.vbo.Reinitialise(GlArrayBuffer, p.num_vertices, GL_FLOAT, 3, GL_STATIC_DRAW, (const unsigned char*)verts.data());
+    if(p.has_vertex_colour) {
+        PANGO_ENSURE(cols.size() == verts.size());
+        p.cbo.Reinitialise(GlArrayBuffer, p.num_vertices, GL_FLOAT, 3, GL_STATIC_DRAW, (const unsigned char*)cols.data());
+    }
+}
+
+void GlPrimitiveBatch::InitGlResources()
+{
+    prog.AddShader(GlSlAnnotatedShader, instanced_shader);
+    glBindAttribLocation(prog.ProgramId(), LOCATION_INSTANCE_T, "a_instance_T");
+    glBindAttribLocation(prog.ProgramId(), LOCATION_INSTANCE_COLOUR, "a_instance_color");
+    prog.BindPangolinDefaultAttribLocationsAndLink();
+
+    InitPrimitive(GlPrimitiveAxis, GL_LINES,
+        { 0,0,0, 1,0,0, 0,0,0, 0,1,0, 0,0,0, 0,0,1 },
+        { 1,0,0, 1,0,0, 0,1,0, 0,1,0, 0,0,1, 0,0,1 }
+    );
+
+    InitPrimitive(GlPrimitiveFrustum, GL_LINE_STRIP, {
+        0,0,1,  1,0,1,
+        1,1,1,  0,1,1,
+        0,0,1,  0,0,0,
+        1,0,1,  0,0,0,
+        0,1,1,  0,0,0,
+        1,1,1
+    });
+
+    {
+        // Triangle strips from glDrawColouredCube, unrolled so that all
+        // faces can be issued in one draw call.
+        const GLfloat l = -0.5f;
+        const GLfloat h = +0.5f;
+        const GLfloat strips[] = {
+            l,l,h,  h,l,h,  l,h,h,  h,h,h,  // FRONT
+            l,l,l,  l,h,l,  h,l,l,  h,h,l,  // BACK
+            l,l,h,  l,h,h,  l,l,l,  l,h,l,  // LEFT
+            h,l,l,  h,h,l,  h,l,h,  h,h,h,  // RIGHT
+            l,h,h,  h,h,h,  l,h,l,  h,h,l,  // TOP
+            l,l,h,  l,l,l,  h,l,h,  h,l,l   // BOTTOM
+        };
+        const int tri_order[] = {0,1,2, 2,1,3};
+        std::vector<GLfloat> verts, cols;
+        for(int face=0; face < 6; ++face) {
+            const GLfloat col[] = {face/2==0 ? 1.0f : 0.0f, face/2==1 ? 1.0f : 0.0f, face/2==2 ? 1.0f : 0.0f};
+            for(int i : tri_order) {
+                verts.insert(verts.end(), strips + 12*face + 3*i, strips + 12*face + 3*i + 3);
+                cols.insert(cols.end(), col, col+3);
+            }
+        }
+        InitPrimitive(GlPrimitiveColouredCube, GL_TRIANGLES, verts, cols);
+    }
+
+    {
+        // Anticlockwise for front face, as glDrawCircle
+        const int N = 50;
+        const float TAU_DIV_N = 2*(float)M_PI/N;
+        std::vector<GLfloat> verts;
+        for(int i = 0; i < N; ++i) {
+            verts.push_back(std::cos(-i*TAU_DIV_N));
+            verts.push_back(std::sin(-i*TAU_DIV_N));
+            verts.push_back(0.0f);
+        }
+        InitPrimitive(GlPrimitiveCircle, GL_TRIANGLE_FAN, verts);
+    }
+
+    InitPrimitive(GlPrimitiveCross, GL_LINES,
+        { -1,0,0, 1,0,0, 0,-1,0, 0,1,0, 0,0,-1, 0,0,1 }
+    );
+
+    initialised = true;
+}
+
+void GlPrimitiveBatch::Render()
+{
+    if(NumInstances() == 0) return;
+
+    if(!initialised) {
+        InitGlResources();
+    }
+
+    prog.Bind();
+
+    for(Primitive& p : primitives) {
+        if(p.instances.empty()) continue;
+
+        // Stream per instance data, growing the buffer geometrically.
+        const size_t bytes = p.instances.size() * sizeof(Instance);
+        if(!p.instance_bo.IsValid() || p.instance_bo.SizeBytes() < bytes) {
+            p.instance_bo.Reinitialise(GlArrayBuffer, (GLuint)std::max(2*p.instance_bo.SizeBytes(), bytes), GL_STREAM_DRAW);
+        }
+        p.instance_bo.Upload(p.instances.data(), bytes);
+
+        p.vbo.Bind();
+        glVertexAttribPointer(DEFAULT_LOCATION_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(DEFAULT_LOCATION_POSITION);
+
+        if(p.has_vertex_colour) {
+            p.cbo.Bind();
+            glVertexAttribPointer(DEFAULT_LOCATION_COLOUR, 3, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(DEFAULT_LOCATION_COLOUR);
+        }else{
+            glVertexAttrib4f(DEFAULT_LOCATION_COLOUR, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+
+        p.instance_bo.Bind();
+        for(GLuint c=0; c < 4; ++c) {
+            const GLuint loc = LOCATION_INSTANCE_T + c;
+            glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*)(offsetof(Instance,T_wp) + 4*c*sizeof(GLfloat)));
+            glVertexAttribDivisor(loc, 1);
+            glEnableVertexAttribArray(loc);
+        }
+        glVertexAttribPointer(LOCATION_INSTANCE_COLOUR, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*)offsetof(Instance,colour));
+        glVertexAttribDivisor(LOCATION_INSTANCE_COLOUR, 1);
+        glEnableVertexAttribArray(LOCATION_INSTANCE_COLOUR);
+
+        glDrawArraysInstanced(p.mode, 0, p.num_vertices, (GLsizei)p.instances.size());
+
+        for(GLuint loc = LOCATION_INSTANCE_T; loc <= LOCATION_INSTANCE_COLOUR; ++loc) {
+            glVertexAttribDivisor(loc, 0);
+            glDisableVertexAttribArray(loc);
+        }
+        p.instance_bo.Unbind();
+
+        if(p.has_vertex_colour) {
+            glDisableVertexAttribArray(DEFAULT_LOCATION_COLOUR);
+        }
+        glDisableVertexAttribArray(DEFAULT_LOCATION_POSITION);
+        p.vbo.Unbind();
+    }
+
+    prog.Unbind();
+}
+
+}
+
+#endif // HAVE_GLES
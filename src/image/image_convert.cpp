@@ -0,0 +1,692 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_convert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PANGO_CONVERT_X86
+#  include <immintrin.h>
+#  define PANGO_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace pangolin
+{
+
+namespace {
+
+enum ConvertType
+{
+    ConvertTypeU8,
+    ConvertTypeU16,
+    ConvertTypeU32,
+    ConvertTypeF32,
+    ConvertTypeF64
+};
+
+// How a pixel format is laid out, as far as conversion is concerned.
+struct ConvertFormat
+{
+    ConvertType type;
+    int channels;
+    // Position of R, G, B and A within a pixel, or -1 if absent. Gray
+    // formats have R = G = B.
+    int rgba[4];
+    bool gray;
+    bool yuv422;
+    bool y_first;       // YUYV422 rather than UYVY422
+    int packed_bits;    // 10 or 12 for packed gray, 0 otherwise
+};
+
+bool DescribeFormat(const PixelFormat& fmt, ConvertFormat& f)
+{
+    struct Entry { const char* name; ConvertType type; int channels; int r, g, b, a; };
+    static const Entry entries[] = {
+        {"GRAY8",    ConvertTypeU8,  1, 0, 0, 0, -1},
+        {"GRAY16LE", ConvertTypeU16, 1, 0, 0, 0, -1},
+        {"GRAY32",   ConvertTypeU32, 1, 0, 0, 0, -1},
+        {"GRAY32F",  ConvertTypeF32, 1, 0, 0, 0, -1},
+        {"GRAY64F",  ConvertTypeF64, 1, 0, 0, 0, -1},
+        {"Y400A",    ConvertTypeU8,  2, 0, 0, 0,  1},
+        {"RGB24",    ConvertTypeU8,  3, 0, 1, 2, -1},
+        {"BGR24",    ConvertTypeU8,  3, 2, 1, 0, -1},
+        {"RGB48",    ConvertTypeU16, 3, 0, 1, 2, -1},
+        {"BGR48",    ConvertTypeU16, 3, 2, 1, 0, -1},
+        {"RGBA32",   ConvertTypeU8,  4, 0, 1, 2,  3},
+        {"BGRA32",   ConvertTypeU8,  4, 2, 1, 0,  3},
+        {"RGBA64",   ConvertTypeU16, 4, 0, 1, 2,  3},
+        {"BGRA64",   ConvertTypeU16, 4, 2, 1, 0,  3},
+        {"RGB96F",   ConvertTypeF32, 3, 0, 1, 2, -1},
+        {"RGBA128F", ConvertTypeF32, 4, 0, 1, 2,  3},
+    };
+
+    f = ConvertFormat();
+    f.packed_bits = 0;
+    f.yuv422 = false;
+    f.y_first = false;
+
+    if(fmt.format == "YUYV422" || fmt.format == "UYVY422") {
+        f.type = ConvertTypeU8;
+        f.channels = 3;
+        f.rgba[0] = 0; f.rgba[1] = 1; f.rgba[2] = 2; f.rgba[3] = -1;
+        f.gray = false;
+        f.yuv422 = true;
+        f.y_first = fmt.format == "YUYV422";
+        return true;
+    }else if(fmt.format == "GRAY10" || fmt.format == "GRAY12") {
+        f.type = ConvertTypeU16;
+        f.channels = 1;
+        f.rgba[0] = 0; f.rgba[1] = 0; f.rgba[2] = 0; f.rgba[3] = -1;
+        f.gray = true;
+        f.packed_bits = fmt.format == "GRAY10" ? 10 : 12;
+        return true;
+    }
+
+    for(const Entry& e : entries) {
+        if(fmt.format == e.name) {
+            f.type = e.type;
+            f.channels = e.channels;
+            f.rgba[0] = e.r; f.rgba[1] = e.g; f.rgba[2] = e.b; f.rgba[3] = e.a;
+            f.gray = e.channels <= 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsFloat(ConvertType t)
+{
+    return t == ConvertTypeF32 || t == ConvertTypeF64;
+}
+
+double MaxValue(ConvertType t)
+{
+    switch(t) {
+    case ConvertTypeU8: return 255.0;
+    case ConvertTypeU16: return 65535.0;
+    case ConvertTypeU32: return 4294967295.0;
+    default: return 1.0;
+    }
+}
+
+template<typename T>
+inline T SaturateCast(float v)
+{
+    const float maxv = (float)std::numeric_limits<T>::max();
+    return (T)std::lrint(std::min(std::max(v, 0.0f), maxv));
+}
+
+template<>
+inline float SaturateCast<float>(float v)
+{
+    return v;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// CPU feature detection
+
+#ifdef PANGO_CONVERT_X86
+bool CpuHasSsse3()
+{
+    static const bool has = __builtin_cpu_supports("ssse3");
+    return has;
+}
+
+bool CpuHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return has;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+// Byte swizzles between 8 bit formats, e.g. RGB24 <-> BGR24, RGBA32 -> RGB24.
+// perm[c] is the source channel for destination channel c, or -1 for 255.
+
+void ShuffleRow(const uint8_t* src, uint8_t* dst, size_t w, int cin, int cout, const int* perm)
+{
+    for(size_t x=0; x < w; ++x, src += cin, dst += cout) {
+        for(int c=0; c < cout; ++c) {
+            dst[c] = perm[c] >= 0 ? src[perm[c]] : 255;
+        }
+    }
+}
+
+#ifdef PANGO_CONVERT_X86
+// Convert as many whole pixels as fit in 16 byte loads and stores, returning
+// the number of pixels converted. Stores may write garbage past the last
+// converted pixel, but never past the end of the row.
+PANGO_TARGET("ssse3")
+size_t ShuffleRowSsse3(const uint8_t* src, uint8_t* dst, size_t w, int cin, int cout, const int* perm)
+{
+    const size_t step = 16 / std::max(cin, cout);
+    alignas(16) int8_t mask[16];
+    alignas(16) uint8_t alpha[16];
+    for(int i=0; i < 16; ++i) {
+        mask[i] = -128;
+        alpha[i] = 0;
+    }
+    for(size_t p=0; p < step; ++p) {
+        for(int c=0; c < cout; ++c) {
+            if(perm[c] >= 0) {
+                mask[p*cout + c] = int8_t(p*cin + perm[c]);
+            }else{
+                alpha[p*cout + c] = 255;
+            }
+        }
+    }
+    const __m128i m = _mm_load_si128((const __m128i*)mask);
+    const __m128i a = _mm_load_si128((const __m128i*)alpha);
+
+    size_t x = 0;
+    for(; (w - x) * cin >= 16 && (w - x) * cout >= 16; x += step) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + x*cin));
+        _mm_storeu_si128((__m128i*)(dst + x*cout), _mm_or_si128(_mm_shuffle_epi8(v, m), a));
+    }
+    return x;
+}
+#endif
+
+void ShuffleRowDispatch(const uint8_t* src, uint8_t* dst, size_t w, int cin, int cout, const int* perm)
+{
+    size_t x = 0;
+#ifdef PANGO_CONVERT_X86
+    if(CpuHasSsse3()) {
+        x = ShuffleRowSsse3(src, dst, w, cin, cout, perm);
+    }
+#endif
+    ShuffleRow(src + x*cin, dst + x*cout, w - x, cin, cout, perm);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Element wise dst = src*scale + offset between uint8, uint16 and float
+
+template<typename S, typename D>
+void ScaleRow(const S* src, D* dst, size_t n, float scale, float offset)
+{
+    for(size_t i=0; i < n; ++i) {
+        dst[i] = SaturateCast<D>(src[i] * scale + offset);
+    }
+}
+
+#ifdef PANGO_CONVERT_X86
+PANGO_TARGET("avx2,fma") inline __m256 Load8(const uint8_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+PANGO_TARGET("avx2,fma") inline __m256 Load8(const uint16_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)));
+}
+
+PANGO_TARGET("avx2,fma") inline __m256 Load8(const float* p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+PANGO_TARGET("avx2,fma") inline __m128i PackU16(__m256 v, float maxv)
+{
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(maxv));
+    const __m256i i = _mm256_cvtps_epi32(v);
+    return _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(uint8_t* p, __m256 v)
+{
+    const __m128i u16 = PackU16(v, 255.0f);
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(u16, u16));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(uint16_t* p, __m256 v)
+{
+    _mm_storeu_si128((__m128i*)p, PackU16(v, 65535.0f));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(float* p, __m256 v)
+{
+    _mm256_storeu_ps(p, v);
+}
+
+template<typename S, typename D>
+PANGO_TARGET("avx2,fma")
+size_t ScaleRowAvx2(const S* src, D* dst, size_t n, float scale, float offset)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+    const __m256 o = _mm256_set1_ps(offset);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        Store8(dst + i, _mm256_fmadd_ps(Load8(src + i), s, o));
+    }
+    return i;
+}
+#endif
+
+template<typename S, typename D>
+void ScaleRowDispatch(const uint8_t* src, uint8_t* dst, size_t n, float scale, float offset)
+{
+    const S* s = (const S*)src;
+    D* d = (D*)dst;
+    size_t i = 0;
+#ifdef PANGO_CONVERT_X86
+    if(CpuHasAvx2()) {
+        i = ScaleRowAvx2<S,D>(s, d, n, scale, offset);
+    }
+#endif
+    ScaleRow<S,D>(s + i, d + i, n - i, scale, offset);
+}
+
+template<typename S>
+std::function<void(const uint8_t*, uint8_t*, size_t, float, float)> ScaleRowFor(ConvertType dst)
+{
+    switch(dst) {
+    case ConvertTypeU8: return ScaleRowDispatch<S,uint8_t>;
+    case ConvertTypeU16: return ScaleRowDispatch<S,uint16_t>;
+    case ConvertTypeF32: return ScaleRowDispatch<S,float>;
+    default: return nullptr;
+    }
+}
+
+std::function<void(const uint8_t*, uint8_t*, size_t, float, float)> ScaleRowFor(ConvertType src, ConvertType dst)
+{
+    switch(src) {
+    case ConvertTypeU8: return ScaleRowFor<uint8_t>(dst);
+    case ConvertTypeU16: return ScaleRowFor<uint16_t>(dst);
+    case ConvertTypeF32: return ScaleRowFor<float>(dst);
+    default: return nullptr;
+    }
+}
+
+// 8 bit colour to GRAY8 with BT.601 luma weights in 8 bit fixed point.
+void LumaRow(const uint8_t* src, uint8_t* dst, size_t w, int cin, int r, int g, int b)
+{
+    for(size_t x=0; x < w; ++x, src += cin) {
+        dst[x] = uint8_t((77*src[r] + 150*src[g] + 29*src[b] + 128) >> 8);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// YUV 4:2:2 to 8 bit RGB / BGR / GRAY, BT.601 studio range in fixed point
+
+enum YuvOut { YuvOutRGB, YuvOutBGR, YuvOutGray };
+
+inline uint8_t Clamp8(int v)
+{
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+inline void YuvToRgb(int y, int u, int v, int& r, int& g, int& b)
+{
+    const int c = 298 * (y - 16);
+    const int d = u - 128;
+    const int e = v - 128;
+    r = (c + 409*e + 128) >> 8;
+    g = (c - 100*d - 208*e + 128) >> 8;
+    b = (c + 516*d + 128) >> 8;
+}
+
+// Chroma for pixel x of a 4:2:2 row of width w. The last pixel of an odd
+// width row has no V sample of its own, so it takes the chroma of the
+// preceding pair (or neutral V if the row is one pixel wide).
+inline void YuvChroma(const uint8_t* row, size_t x, size_t w, bool y_first, int& u, int& v)
+{
+    const int uo = y_first ? 1 : 0;
+    const uint8_t* pair = row + 4*(x/2);
+    if((x | 1) < w) {
+        u = pair[uo];
+        v = pair[uo + 2];
+    }else if(x >= 2) {
+        u = pair[uo - 4];
+        v = pair[uo - 2];
+    }else{
+        u = pair[uo];
+        v = 128;
+    }
+}
+
+inline uint8_t* YuvStorePixel(uint8_t* dst, int y, int u, int v, YuvOut out)
+{
+    if(out == YuvOutGray) {
+        *(dst++) = Clamp8((298 * (y - 16) + 128) >> 8);
+    }else{
+        int r, g, b;
+        YuvToRgb(y, u, v, r, g, b);
+        if(out == YuvOutBGR) std::swap(r, b);
+        *(dst++) = Clamp8(r);
+        *(dst++) = Clamp8(g);
+        *(dst++) = Clamp8(b);
+    }
+    return dst;
+}
+
+void YuvRow(const uint8_t* src, uint8_t* dst, size_t w, bool y_first, YuvOut out)
+{
+    const uint8_t* row = src;
+    const int yo = y_first ? 0 : 1;
+    const int uo = y_first ? 1 : 0;
+    size_t x = 0;
+    for(; x + 2 <= w; x += 2, src += 4) {
+        const int u = src[uo], v = src[uo + 2];
+        for(int k=0; k < 2; ++k) {
+            dst = YuvStorePixel(dst, src[yo + 2*k], u, v, out);
+        }
+    }
+    if(x < w) {
+        int u, v;
+        YuvChroma(row, x, w, y_first, u, v);
+        YuvStorePixel(dst, src[yo], u, v, out);
+    }
+}
+
+#ifdef PANGO_CONVERT_X86
+PANGO_TARGET("avx2") inline __m128i PackS32ToU8(__m256i v)
+{
+    const __m128i s16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_packus_epi16(s16, s16);
+}
+
+// Eight pixels per iteration, computing exactly the same fixed point
+// result as YuvRow. Returns the number of pixels converted.
+PANGO_TARGET("avx2")
+size_t YuvRowAvx2(const uint8_t* src, uint8_t* dst, size_t w, bool y_first, YuvOut out)
+{
+    const int yo = y_first ? 0 : 1;
+    const int uo = y_first ? 1 : 0;
+    alignas(16) int8_t ym[16], um[16], vm[16];
+    for(int i=0; i < 16; ++i) ym[i] = um[i] = vm[i] = -128;
+    for(int p=0; p < 8; ++p) {
+        ym[p] = int8_t(2*p + yo);
+        um[p] = int8_t(4*(p/2) + uo);
+        vm[p] = int8_t(4*(p/2) + uo + 2);
+    }
+    const __m128i ymask = _mm_load_si128((const __m128i*)ym);
+    const __m128i umask = _mm_load_si128((const __m128i*)um);
+    const __m128i vmask = _mm_load_si128((const __m128i*)vm);
+
+    // Interleave planar R,G (one register) and B into 24 bytes of RGB.
+    alignas(16) int8_t rg0[16], b0[16], rg1[16], b1[16];
+    for(int k=0; k < 32; ++k) {
+        const int p = k / 3, ch = k % 3;
+        int8_t* rg = k < 16 ? rg0 : rg1;
+        int8_t* b = k < 16 ? b0 : b1;
+        const int i = k % 16;
+        rg[i] = k < 24 && ch < 2 ? int8_t(ch*8 + p) : -128;
+        b[i] = k < 24 && ch == 2 ? int8_t(p) : -128;
+    }
+    const __m128i rgm0 = _mm_load_si128((const __m128i*)rg0);
+    const __m128i bm0 = _mm_load_si128((const __m128i*)b0);
+    const __m128i rgm1 = _mm_load_si128((const __m128i*)rg1);
+    const __m128i bm1 = _mm_load_si128((const __m128i*)b1);
+
+    const __m256i c16 = _mm256_set1_epi32(16);
+    const __m256i c128 = _mm256_set1_epi32(128);
+    const __m256i k298 = _mm256_set1_epi32(298);
+
+    size_t x = 0;
+    for(; x + 8 <= w; x += 8) {
+        const __m128i in = _mm_loadu_si128((const __m128i*)(src + 2*x));
+        const __m256i y = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, ymask));
+        const __m256i c = _mm256_mullo_epi32(_mm256_sub_epi32(y, c16), k298);
+
+        if(out == YuvOutGray) {
+            const __m256i l = _mm256_srai_epi32(_mm256_add_epi32(c, c128), 8);
+            _mm_storel_epi64((__m128i*)(dst + x), PackS32ToU8(l));
+            continue;
+        }
+
+        const __m256i d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, umask)), c128);
+        const __m256i e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, vmask)), c128);
+        const __m256i cr = _mm256_add_epi32(c, c128);
+        __m256i r = _mm256_srai_epi32(_mm256_add_epi32(cr, _mm256_mullo_epi32(e, _mm256_set1_epi32(409))), 8);
+        const __m256i g = _mm256_srai_epi32(_mm256_sub_epi32(cr, _mm256_add_epi32(
+            _mm256_mullo_epi32(d, _mm256_set1_epi32(100)), _mm256_mullo_epi32(e, _mm256_set1_epi32(208)))), 8);
+        __m256i b = _mm256_srai_epi32(_mm256_add_epi32(cr, _mm256_mullo_epi32(d, _mm256_set1_epi32(516))), 8);
+        if(out == YuvOutBGR) std::swap(r, b);
+
+        const __m128i rg = _mm_unpacklo_epi64(PackS32ToU8(r), PackS32ToU8(g));
+        const __m128i b8 = PackS32ToU8(b);
+        uint8_t* o = dst + 3*x;
+        _mm_storeu_si128((__m128i*)o, _mm_or_si128(_mm_shuffle_epi8(rg, rgm0), _mm_shuffle_epi8(b8, bm0)));
+        _mm_storel_epi64((__m128i*)(o + 16), _mm_or_si128(_mm_shuffle_epi8(rg, rgm1), _mm_shuffle_epi8(b8, bm1)));
+    }
+    return x;
+}
+#endif
+
+void YuvRowDispatch(const uint8_t* src, uint8_t* dst, size_t w, bool y_first, YuvOut out)
+{
+    size_t x = 0;
+#ifdef PANGO_CONVERT_X86
+    if(CpuHasAvx2()) {
+        x = YuvRowAvx2(src, dst, w, y_first, out);
+    }
+#endif
+    YuvRow(src + 2*x, dst + x*(out == YuvOutGray ? 1 : 3), w - x, y_first, out);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Generic path for everything else, via RGBA doubles.
+
+template<typename T>
+void DecodeElements(const uint8_t* src, size_t n, double* out)
+{
+    const T* s = (const T*)src;
+    for(size_t i=0; i < n; ++i) out[i] = (double)s[i];
+}
+
+void DecodeRow(const ConvertFormat& f, const uint8_t* src, size_t w, std::vector<double>& tmp, double* rgba)
+{
+    if(f.yuv422) {
+        const int yo = f.y_first ? 0 : 1;
+        for(size_t x=0; x < w; ++x) {
+            int u, v, r, g, b;
+            YuvChroma(src, x, w, f.y_first, u, v);
+            YuvToRgb(src[4*(x/2) + yo + 2*(x%2)], u, v, r, g, b);
+            rgba[4*x+0] = Clamp8(r);
+            rgba[4*x+1] = Clamp8(g);
+            rgba[4*x+2] = Clamp8(b);
+        }
+        return;
+    }
+
+    tmp.resize(w * f.channels);
+    if(f.packed_bits) {
+        // 4 pixels in 5 bytes (10 bit) or 2 in 3 (12 bit), little endian. A
+        // partial group at the end of the row occupies only the whole bytes
+        // its pixels need.
+        const int bits = f.packed_bits;
+        const size_t group = bits == 10 ? 4 : 2;
+        const uint64_t mask = (1u << bits) - 1;
+        for(size_t x=0; x < w; x += group) {
+            const size_t count = std::min(group, w - x);
+            const size_t bytes = (count * bits + 7) / 8;
+            uint64_t v = 0;
+            for(size_t b=0; b < bytes; ++b) v |= uint64_t(src[b]) << (8*b);
+            for(size_t k=0; k < count; ++k) tmp[x+k] = double((v >> (bits*k)) & mask);
+            src += bytes;
+        }
+    }else{
+        const size_t n = w * f.channels;
+        switch(f.type) {
+        case ConvertTypeU8: DecodeElements<uint8_t>(src, n, tmp.data()); break;
+        case ConvertTypeU16: DecodeElements<uint16_t>(src, n, tmp.data()); break;
+        case ConvertTypeU32: DecodeElements<uint32_t>(src, n, tmp.data()); break;
+        case ConvertTypeF32: DecodeElements<float>(src, n, tmp.data()); break;
+        case ConvertTypeF64: DecodeElements<double>(src, n, tmp.data()); break;
+        }
+    }
+
+    for(size_t x=0; x < w; ++x) {
+        for(int c=0; c < 4; ++c) {
+            rgba[4*x+c] = f.rgba[c] >= 0 ? tmp[x*f.channels + f.rgba[c]] : 0.0;
+        }
+    }
+}
+
+template<typename T>
+void EncodeElements(const double* in, size_t n, uint8_t* dst)
+{
+    T* d = (T*)dst;
+    for(size_t i=0; i < n; ++i) {
+        if(std::numeric_limits<T>::is_integer) {
+            const double maxv = (double)std::numeric_limits<T>::max();
+            d[i] = (T)std::llrint(std::min(std::max(in[i], 0.0), maxv));
+        }else{
+            d[i] = (T)in[i];
+        }
+    }
+}
+
+void EncodeRow(const ConvertFormat& f, const ConvertFormat& sf, const double* rgba, size_t w, double scale, double offset, std::vector<double>& tmp, uint8_t* dst)
+{
+    tmp.resize(w * f.channels);
+    const double opaque = MaxValue(f.type);
+    for(size_t x=0; x < w; ++x) {
+        const double* p = rgba + 4*x;
+        double* o = tmp.data() + x*f.channels;
+        if(f.gray) {
+            const double l = sf.gray ? p[0] : 0.299*p[0] + 0.587*p[1] + 0.114*p[2];
+            o[f.rgba[0]] = l * scale + offset;
+        }else{
+            for(int c=0; c < 3; ++c) o[f.rgba[c]] = p[c] * scale + offset;
+        }
+        if(f.rgba[3] >= 0) {
+            o[f.rgba[3]] = sf.rgba[3] >= 0 ? p[3] * scale + offset : opaque;
+        }
+    }
+
+    const size_t n = w * f.channels;
+    switch(f.type) {
+    case ConvertTypeU8: EncodeElements<uint8_t>(tmp.data(), n, dst); break;
+    case ConvertTypeU16: EncodeElements<uint16_t>(tmp.data(), n, dst); break;
+    case ConvertTypeU32: EncodeElements<uint32_t>(tmp.data(), n, dst); break;
+    case ConvertTypeF32: EncodeElements<float>(tmp.data(), n, dst); break;
+    case ConvertTypeF64: EncodeElements<double>(tmp.data(), n, dst); break;
+    }
+}
+
+bool SameLayout(const ConvertFormat& a, const ConvertFormat& b)
+{
+    return a.channels == b.channels && std::equal(a.rgba, a.rgba + 4, b.rgba);
+}
+
+bool IsPlain(const ConvertFormat& f)
+{
+    return !f.yuv422 && !f.packed_bits;
+}
+
+}
+
+bool CanConvertImage(const PixelFormat& src_fmt, const PixelFormat& dst_fmt)
+{
+    ConvertFormat sf, df;
+    return DescribeFormat(src_fmt, sf) && DescribeFormat(dst_fmt, df) && IsPlain(df);
+}
+
+float DefaultConvertScale(const PixelFormat& src_fmt, const PixelFormat& dst_fmt)
+{
+    ConvertFormat sf, df;
+    if( DescribeFormat(src_fmt, sf) && DescribeFormat(dst_fmt, df) &&
+        !IsFloat(sf.type) && !IsFloat(df.type) )
+    {
+        return std::ldexp(1.0f, (int)dst_fmt.channel_bit_depth - (int)src_fmt.channel_bit_depth);
+    }
+    return 1.0f;
+}
+
+void ConvertImage(Image<unsigned char>& dst, const PixelFormat& dst_fmt, const Image<unsigned char>& src, const PixelFormat& src_fmt, float scale, float offset)
+{
+    ConvertFormat sf, df;
+    if(!DescribeFormat(src_fmt, sf) || !DescribeFormat(dst_fmt, df) || !IsPlain(df)) {
+        throw std::runtime_error("ConvertImage: Unable to convert from " + src_fmt.format + " to " + dst_fmt.format);
+    }
+    if(dst.w != src.w || dst.h != src.h) {
+        throw std::runtime_error("ConvertImage: Image dimensions must match");
+    }
+
+    const size_t w = src.w;
+    const bool identity = scale == 1.0f && offset == 0.0f;
+    std::function<void(const uint8_t*, uint8_t*)> row;
+
+    if(identity && src_fmt.format == dst_fmt.format) {
+        const size_t bytes = w * dst_fmt.bpp / 8;
+        row = [bytes](const uint8_t* s, uint8_t* d) { std::memcpy(d, s, bytes); };
+    }else if( identity && IsPlain(sf) && sf.type == ConvertTypeU8 && df.type == ConvertTypeU8 &&
+              (sf.gray || !df.gray) )
+    {
+        int perm[4];
+        for(int c=0; c < 4; ++c) {
+            if(df.rgba[c] >= 0) perm[df.rgba[c]] = sf.rgba[c];
+        }
+        const int cin = sf.channels, cout = df.channels;
+        row = [=](const uint8_t* s, uint8_t* d) { ShuffleRowDispatch(s, d, w, cin, cout, perm); };
+    }else if( identity && IsPlain(sf) && !sf.gray && sf.type == ConvertTypeU8 && df.gray && df.channels == 1 && df.type == ConvertTypeU8 ) {
+        const int cin = sf.channels, r = sf.rgba[0], g = sf.rgba[1], b = sf.rgba[2];
+        row = [=](const uint8_t* s, uint8_t* d) { LumaRow(s, d, w, cin, r, g, b); };
+    }else if(IsPlain(sf) && SameLayout(sf, df) && ScaleRowFor(sf.type, df.type)) {
+        const auto fn = ScaleRowFor(sf.type, df.type);
+        const size_t n = w * sf.channels;
+        row = [=](const uint8_t* s, uint8_t* d) { fn(s, d, n, scale, offset); };
+    }else if( identity && sf.yuv422 && df.type == ConvertTypeU8 && (df.gray ? df.channels == 1 : df.channels == 3) ) {
+        const YuvOut out = df.gray ? YuvOutGray : (df.rgba[0] == 0 ? YuvOutRGB : YuvOutBGR);
+        const bool y_first = sf.y_first;
+        row = [=](const uint8_t* s, uint8_t* d) { YuvRowDispatch(s, d, w, y_first, out); };
+    }else{
+        std::vector<double> rgba(4*w), tmp;
+        row = [=](const uint8_t* s, uint8_t* d) mutable {
+            DecodeRow(sf, s, w, tmp, rgba.data());
+            EncodeRow(df, sf, rgba.data(), w, scale, offset, tmp, d);
+        };
+    }
+
+    for(size_t y=0; y < src.h; ++y) {
+        row(src.RowPtr(y), dst.RowPtr(y));
+    }
+}
+
+void ConvertImage(Image<unsigned char>& dst, const PixelFormat& dst_fmt, const Image<unsigned char>& src, const PixelFormat& src_fmt)
+{
+    ConvertImage(dst, dst_fmt, src, src_fmt, DefaultConvertScale(src_fmt, dst_fmt), 0.0f);
+}
+
+TypedImage ConvertImage(const TypedImage& src, const PixelFormat& dst_fmt)
+{
+    TypedImage dst(src.w, src.h, dst_fmt);
+    ConvertImage(dst, dst_fmt, src, src.fmt);
+    return dst;
+}
+
+}
@@ -0,0 +1,385 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_resize.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PANGO_RESIZE_X86
+#  include <immintrin.h>
+#  define PANGO_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace pangolin
+{
+
+namespace {
+
+// Minimum source pixels per thread before splitting work across threads.
+const size_t RESIZE_MIN_PIXELS_PER_THREAD = 1 << 16;
+
+enum ResizeType { ResizeTypeU8, ResizeTypeU16, ResizeTypeF32 };
+
+bool DescribeFormat(const PixelFormat& fmt, ResizeType& type, int& channels)
+{
+    if( fmt.planar || fmt.channels < 1 || fmt.channels > 4 ||
+        fmt.format == "YUYV422" || fmt.format == "UYVY422" )
+    {
+        return false;
+    }
+    for(unsigned c=1; c < fmt.channels; ++c) {
+        if(fmt.channel_bits[c] != fmt.channel_bits[0]) return false;
+    }
+    if(fmt.bpp != fmt.channel_bits[0] * fmt.channels) return false;
+
+    const bool is_float = !fmt.format.empty() && fmt.format.back() == 'F';
+    channels = fmt.channels;
+    if(fmt.channel_bits[0] == 8 && !is_float) {
+        type = ResizeTypeU8;
+    }else if(fmt.channel_bits[0] == 16 && !is_float) {
+        type = ResizeTypeU16;
+    }else if(fmt.channel_bits[0] == 32 && is_float) {
+        type = ResizeTypeF32;
+    }else{
+        return false;
+    }
+    return true;
+}
+
+#ifdef PANGO_RESIZE_X86
+bool CpuHasSsse3()
+{
+    static const bool has = __builtin_cpu_supports("ssse3");
+    return has;
+}
+
+bool CpuHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return has;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+// 2x2 box reduction of 8 bit rows: dst = (a + b + c + d + 2) / 4
+
+void Box2Row(const uint8_t* r0, const uint8_t* r1, uint8_t* dst, size_t dst_w, int channels)
+{
+    const int c = channels;
+    for(size_t x=0; x < dst_w; ++x, r0 += 2*c, r1 += 2*c, dst += c) {
+        for(int k=0; k < c; ++k) {
+            dst[k] = uint8_t((r0[k] + r0[c+k] + r1[k] + r1[c+k] + 2) >> 2);
+        }
+    }
+}
+
+#ifdef PANGO_RESIZE_X86
+// Bring horizontally adjacent samples of each channel together, sum the
+// pairs with maddubs, then add rows. Returns the number of output pixels.
+PANGO_TARGET("ssse3")
+size_t Box2RowSsse3(const uint8_t* r0, const uint8_t* r1, uint8_t* dst, size_t dst_w, int c)
+{
+    // Input pixels per 16 byte load, kept even
+    const size_t in_px = c == 3 ? 4 : 16 / c;
+    const size_t out_px = in_px / 2;
+    alignas(16) int8_t mask[16];
+    for(int i=0; i < 16; ++i) mask[i] = -128;
+    for(size_t j=0; j < out_px * c; ++j) {
+        const size_t o = j / c, k = j % c;
+        mask[2*j]   = int8_t((2*o) * c + k);
+        mask[2*j+1] = int8_t((2*o + 1) * c + k);
+    }
+    const __m128i m = _mm_load_si128((const __m128i*)mask);
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi16(2);
+
+    size_t x = 0;
+    // Each iteration reads 16 bytes and writes 8 bytes.
+    for(; (dst_w - x) * c >= 8 && (dst_w - x) * 2 * c >= 16; x += out_px) {
+        const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r0 + 2*x*c)), m);
+        const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(r1 + 2*x*c)), m);
+        __m128i s = _mm_add_epi16(_mm_maddubs_epi16(a, ones), _mm_maddubs_epi16(b, ones));
+        s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+        _mm_storel_epi64((__m128i*)(dst + x*c), _mm_packus_epi16(s, s));
+    }
+    return x;
+}
+#endif
+
+void Box2Rows(Image<unsigned char>& dst, const Image<unsigned char>& src, int channels, size_t y0, size_t y1)
+{
+    for(size_t y=y0; y < y1; ++y) {
+        const uint8_t* r0 = src.RowPtr(2*y);
+        const uint8_t* r1 = src.RowPtr(2*y+1);
+        uint8_t* d = dst.RowPtr(y);
+        size_t x = 0;
+#ifdef PANGO_RESIZE_X86
+        if(CpuHasSsse3()) {
+            x = Box2RowSsse3(r0, r1, d, dst.w, channels);
+        }
+#endif
+        Box2Row(r0 + 2*x*channels, r1 + 2*x*channels, d + x*channels, dst.w - x, channels);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Separable weighted resampling. Each output row is a weighted sum of
+// horizontally resampled input rows, accumulated in float.
+
+struct Taps
+{
+    // Taps for output i are [begin[i], begin[i+1])
+    std::vector<size_t> begin;
+    std::vector<size_t> index;
+    std::vector<float> weight;
+
+    void Add(size_t i, float w)
+    {
+        index.push_back(i);
+        weight.push_back(w);
+    }
+};
+
+Taps ComputeTaps(size_t src_n, size_t dst_n, ResizeMethod method)
+{
+    Taps taps;
+    const double ratio = double(src_n) / double(dst_n);
+    for(size_t i=0; i < dst_n; ++i) {
+        taps.begin.push_back(taps.index.size());
+        if(method == ResizeMethodBox) {
+            const size_t f = src_n / dst_n;
+            for(size_t k=0; k < f; ++k) taps.Add(i*f + k, 1.0f / f);
+        }else if(method == ResizeMethodArea) {
+            const double a = i * ratio, b = (i + 1) * ratio;
+            for(size_t k = (size_t)a; k < std::min<size_t>((size_t)std::ceil(b), src_n); ++k) {
+                const double overlap = std::min<double>(b, k + 1) - std::max<double>(a, k);
+                if(overlap > 1e-6) taps.Add(k, float(overlap / ratio));
+            }
+        }else{
+            const double s = std::max(0.0, (i + 0.5) * ratio - 0.5);
+            const size_t k0 = std::min<size_t>((size_t)s, src_n - 1);
+            const size_t k1 = std::min<size_t>(k0 + 1, src_n - 1);
+            // Past the last sample centre, the edge sample takes all weight
+            const float f = k1 != k0 ? float(s - k0) : 0.0f;
+            taps.Add(k0, 1.0f - f);
+            if(f > 0.0f) taps.Add(k1, f);
+        }
+    }
+    taps.begin.push_back(taps.index.size());
+    return taps;
+}
+
+template<typename S>
+void HorizontalPass(const S* src, const Taps& taps, size_t dst_w, int c, float* out)
+{
+    for(size_t x=0; x < dst_w; ++x, out += c) {
+        for(int k=0; k < c; ++k) out[k] = 0.0f;
+        for(size_t t = taps.begin[x]; t < taps.begin[x+1]; ++t) {
+            const S* p = src + taps.index[t] * c;
+            const float w = taps.weight[t];
+            for(int k=0; k < c; ++k) out[k] += w * p[k];
+        }
+    }
+}
+
+void Accumulate(float* acc, const float* row, float w, size_t n)
+{
+    for(size_t i=0; i < n; ++i) acc[i] += w * row[i];
+}
+
+template<typename D>
+void StoreRow(const float* acc, D* dst, size_t n)
+{
+    for(size_t i=0; i < n; ++i) {
+        if(std::numeric_limits<D>::is_integer) {
+            const float maxv = (float)std::numeric_limits<D>::max();
+            dst[i] = (D)std::lrint(std::min(std::max(acc[i], 0.0f), maxv));
+        }else{
+            dst[i] = (D)acc[i];
+        }
+    }
+}
+
+#ifdef PANGO_RESIZE_X86
+PANGO_TARGET("avx2,fma")
+size_t AccumulateAvx2(float* acc, const float* row, float w, size_t n)
+{
+    const __m256 wv = _mm256_set1_ps(w);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(wv, _mm256_loadu_ps(row + i), _mm256_loadu_ps(acc + i)));
+    }
+    return i;
+}
+
+PANGO_TARGET("avx2,fma") inline __m128i PackU16(__m256 v, float maxv)
+{
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(maxv));
+    const __m256i i = _mm256_cvtps_epi32(v);
+    return _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(uint8_t* p, __m256 v)
+{
+    const __m128i u16 = PackU16(v, 255.0f);
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(u16, u16));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(uint16_t* p, __m256 v)
+{
+    _mm_storeu_si128((__m128i*)p, PackU16(v, 65535.0f));
+}
+
+PANGO_TARGET("avx2,fma") inline void Store8(float* p, __m256 v)
+{
+    _mm256_storeu_ps(p, v);
+}
+
+template<typename D>
+PANGO_TARGET("avx2,fma")
+size_t StoreRowAvx2(const float* acc, D* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        Store8(dst + i, _mm256_loadu_ps(acc + i));
+    }
+    return i;
+}
+#endif
+
+template<typename T>
+void ResampleRows(Image<unsigned char>& dst, const Image<unsigned char>& src, int c, const Taps& tx, const Taps& ty, size_t y0, size_t y1)
+{
+    const size_t n = dst.w * c;
+    std::vector<float> acc(n), row(n);
+#ifdef PANGO_RESIZE_X86
+    const bool avx2 = CpuHasAvx2();
+#endif
+
+    for(size_t y=y0; y < y1; ++y) {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for(size_t t = ty.begin[y]; t < ty.begin[y+1]; ++t) {
+            HorizontalPass<T>((const T*)src.RowPtr(ty.index[t]), tx, dst.w, c, row.data());
+            size_t i = 0;
+#ifdef PANGO_RESIZE_X86
+            if(avx2) i = AccumulateAvx2(acc.data(), row.data(), ty.weight[t], n);
+#endif
+            Accumulate(acc.data() + i, row.data() + i, ty.weight[t], n - i);
+        }
+
+        T* d = (T*)dst.RowPtr(y);
+        size_t i = 0;
+#ifdef PANGO_RESIZE_X86
+        if(avx2) i = StoreRowAvx2<T>(acc.data(), d, n);
+#endif
+        StoreRow<T>(acc.data() + i, d + i, n - i);
+    }
+}
+
+ResizeMethod EffectiveMethod(ResizeMethod method, size_t src_n, size_t dst_n)
+{
+    // Box requires dst_n == floor(src_n / f) for integer factor f.
+    if(method == ResizeMethodBox && (dst_n > src_n || src_n - (src_n / dst_n) * dst_n >= src_n / dst_n)) {
+        method = ResizeMethodArea;
+    }
+    if(method == ResizeMethodArea && dst_n > src_n) {
+        method = ResizeMethodBilinear;
+    }
+    return method;
+}
+
+}
+
+ResizeMethod ResizeMethodFromString(const std::string& str)
+{
+    if(!str.compare("box")) return ResizeMethodBox;
+    else if(!str.compare("area")) return ResizeMethodArea;
+    else if(!str.compare("bilinear")) return ResizeMethodBilinear;
+    else throw std::runtime_error("Unknown resize method: " + str);
+}
+
+bool CanResizeImage(const PixelFormat& fmt)
+{
+    ResizeType type;
+    int channels;
+    return DescribeFormat(fmt, type, channels);
+}
+
+void ResizeImage(Image<unsigned char>& dst, const Image<unsigned char>& src, const PixelFormat& fmt, ResizeMethod method, WorkerPool& workers)
+{
+    ResizeType type;
+    int c;
+    if(!DescribeFormat(fmt, type, c)) {
+        throw std::runtime_error("ResizeImage: Unsupported pixel format " + fmt.format);
+    }
+    if(!dst.w || !dst.h || !src.w || !src.h) {
+        return;
+    }
+
+    const ResizeMethod method_x = EffectiveMethod(method, src.w, dst.w);
+    const ResizeMethod method_y = EffectiveMethod(method, src.h, dst.h);
+
+    std::function<void(size_t,size_t)> rows;
+    if( type == ResizeTypeU8 && method_x == ResizeMethodBox && method_y == ResizeMethodBox &&
+        src.w / dst.w == 2 && src.h / dst.h == 2 )
+    {
+        rows = [&](size_t y0, size_t y1) { Box2Rows(dst, src, c, y0, y1); };
+    }else{
+        const Taps tx = ComputeTaps(src.w, dst.w, method_x);
+        const Taps ty = ComputeTaps(src.h, dst.h, method_y);
+        rows = [&, tx, ty](size_t y0, size_t y1) {
+            switch(type) {
+            case ResizeTypeU8: ResampleRows<uint8_t>(dst, src, c, tx, ty, y0, y1); break;
+            case ResizeTypeU16: ResampleRows<uint16_t>(dst, src, c, tx, ty, y0, y1); break;
+            case ResizeTypeF32: ResampleRows<float>(dst, src, c, tx, ty, y0, y1); break;
+            }
+        };
+    }
+
+    size_t parts = std::max<size_t>(1, std::min(workers.NumThreads() + 1, src.w * src.h / RESIZE_MIN_PIXELS_PER_THREAD));
+    parts = std::min(parts, dst.h);
+    const size_t per = (dst.h + parts - 1) / parts;
+    workers.ParallelFor((dst.h + per - 1) / per, [&](size_t i){
+        rows(i * per, std::min(dst.h, (i + 1) * per));
+    });
+}
+
+void ResizeImage(Image<unsigned char>& dst, const Image<unsigned char>& src, const PixelFormat& fmt, ResizeMethod method, size_t threads)
+{
+    WorkerPool workers(std::max<size_t>(1, threads) - 1);
+    ResizeImage(dst, src, fmt, method, workers);
+}
+
+}
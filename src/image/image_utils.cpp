@@ -0,0 +1,342 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_utils.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PANGO_UTILS_X86
+#  include <immintrin.h>
+#  define PANGO_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace pangolin
+{
+
+namespace internal
+{
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////
+// CPU feature detection
+
+#ifdef PANGO_UTILS_X86
+bool CpuHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////
+// Min / max
+//
+// Rows are treated as flat arrays of w*channels elements. Only the first
+// three channels of each pixel are colour, so for channels == 4 the alpha
+// lanes are neutralised rather than skipped. Kernels return the number of
+// elements consumed and the scalar loop finishes the row.
+
+template<typename T>
+void MinMaxScalar(const T* p, size_t begin, size_t n, size_t channels, T& mn, T& mx)
+{
+    const bool all_colour = channels <= 3;
+    for(size_t i = begin; i < n; ++i) {
+        if(all_colour || i % channels < 3) {
+            const T v = p[i];
+            if(v < mn) mn = v;
+            if(v > mx) mx = v;
+        }
+    }
+}
+
+#ifdef PANGO_UTILS_X86
+PANGO_TARGET("avx2")
+size_t MinMaxAvx2(const uint8_t* p, size_t n, size_t channels, uint8_t& mn, uint8_t& mx)
+{
+    if(channels > 4 || n < 32) return 0;
+    const __m256i alpha = channels == 4 ? _mm256_set1_epi32((int)0xFF000000) : _mm256_setzero_si256();
+    __m256i vmin = _mm256_set1_epi8((char)mn);
+    __m256i vmax = _mm256_set1_epi8((char)mx);
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        vmin = _mm256_min_epu8(vmin, _mm256_or_si256(v, alpha));
+        vmax = _mm256_max_epu8(vmax, _mm256_andnot_si256(alpha, v));
+    }
+    alignas(32) uint8_t lmin[32], lmax[32];
+    _mm256_store_si256((__m256i*)lmin, vmin);
+    _mm256_store_si256((__m256i*)lmax, vmax);
+    mn = *std::min_element(lmin, lmin + 32);
+    mx = *std::max_element(lmax, lmax + 32);
+    return i;
+}
+
+PANGO_TARGET("avx2")
+size_t MinMaxAvx2(const uint16_t* p, size_t n, size_t channels, uint16_t& mn, uint16_t& mx)
+{
+    if(channels > 4 || n < 16) return 0;
+    const __m256i alpha = channels == 4 ? _mm256_set1_epi64x((long long)0xFFFF000000000000ull) : _mm256_setzero_si256();
+    __m256i vmin = _mm256_set1_epi16((short)mn);
+    __m256i vmax = _mm256_set1_epi16((short)mx);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        vmin = _mm256_min_epu16(vmin, _mm256_or_si256(v, alpha));
+        vmax = _mm256_max_epu16(vmax, _mm256_andnot_si256(alpha, v));
+    }
+    alignas(32) uint16_t lmin[16], lmax[16];
+    _mm256_store_si256((__m256i*)lmin, vmin);
+    _mm256_store_si256((__m256i*)lmax, vmax);
+    mn = *std::min_element(lmin, lmin + 16);
+    mx = *std::max_element(lmax, lmax + 16);
+    return i;
+}
+
+PANGO_TARGET("avx2")
+size_t MinMaxAvx2(const float* p, size_t n, size_t channels, float& mn, float& mx)
+{
+    if(channels > 4 || n < 8) return 0;
+    const float inf = std::numeric_limits<float>::infinity();
+    const __m256 pos_inf = _mm256_set1_ps(inf);
+    const __m256 neg_inf = _mm256_set1_ps(-inf);
+    __m256 vmin = _mm256_set1_ps(mn);
+    __m256 vmax = _mm256_set1_ps(mx);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(p + i);
+        // min/max return their second operand when either is NaN, so NaNs are skipped
+        if(channels == 4) {
+            vmin = _mm256_min_ps(_mm256_blend_ps(v, pos_inf, 0x88), vmin);
+            vmax = _mm256_max_ps(_mm256_blend_ps(v, neg_inf, 0x88), vmax);
+        }else{
+            vmin = _mm256_min_ps(v, vmin);
+            vmax = _mm256_max_ps(v, vmax);
+        }
+    }
+    alignas(32) float lmin[8], lmax[8];
+    _mm256_store_ps(lmin, vmin);
+    _mm256_store_ps(lmax, vmax);
+    mn = *std::min_element(lmin, lmin + 8);
+    mx = *std::max_element(lmax, lmax + 8);
+    return i;
+}
+#endif
+
+template<typename T, typename Acc>
+std::pair<float, float> MinMaxImage(const Image<T>& img, size_t channels, Acc init_min, Acc init_max)
+{
+    Acc mn = init_min;
+    Acc mx = init_max;
+    const size_t n = img.w * channels;
+    for(size_t y = 0; y < img.h; ++y) {
+        const T* row = img.RowPtr(y);
+        size_t done = 0;
+#ifdef PANGO_UTILS_X86
+        if(CpuHasAvx2()) {
+            done = MinMaxAvx2(row, n, channels, mn, mx);
+        }
+#endif
+        MinMaxScalar(row, done, n, channels, mn, mx);
+    }
+
+    if(mn > mx) {
+        return std::pair<float, float>(std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    }
+    return std::pair<float, float>((float)mn, (float)mx);
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Histogram
+
+// Integer images are counted exactly per value (four interleaved tables to
+// break store-to-load dependencies), then folded into the requested bins.
+template<typename T>
+void HistogramIntegral(const Image<T>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    const size_t num_values = (size_t)std::numeric_limits<T>::max() + 1;
+    std::vector<uint32_t> counts(4 * num_values, 0);
+    uint32_t* c0 = counts.data();
+    uint32_t* c1 = c0 + num_values;
+    uint32_t* c2 = c1 + num_values;
+    uint32_t* c3 = c2 + num_values;
+
+    // Flush before the 32 bit counters could overflow
+    std::vector<size_t> totals(num_values, 0);
+    auto flush = [&]() {
+        for(size_t v = 0; v < num_values; ++v) {
+            totals[v] += (size_t)c0[v] + c1[v] + c2[v] + c3[v];
+        }
+        std::fill(counts.begin(), counts.end(), 0);
+    };
+    const size_t flush_interval = size_t(1) << 30;
+    size_t since_flush = 0;
+
+    const size_t n = img.w * channels;
+    for(size_t y = 0; y < img.h; ++y) {
+        const T* row = img.RowPtr(y);
+        if(channels <= 3) {
+            size_t i = 0;
+            for(; i + 4 <= n; i += 4) {
+                ++c0[row[i]];
+                ++c1[row[i+1]];
+                ++c2[row[i+2]];
+                ++c3[row[i+3]];
+            }
+            for(; i < n; ++i) ++c0[row[i]];
+        }else{
+            for(size_t i = 0; i < n; i += channels) {
+                ++c0[row[i]];
+                ++c1[row[i+1]];
+                ++c2[row[i+2]];
+            }
+        }
+        since_flush += n;
+        if(since_flush >= flush_interval) {
+            flush();
+            since_flush = 0;
+        }
+    }
+    flush();
+
+    const float max_bin = (float)(bins.size() - 1);
+    const float s = hi > lo ? bins.size() / (hi - lo) : 0.0f;
+    for(size_t v = 0; v < num_values; ++v) {
+        if(totals[v]) {
+            const float b = ((float)v - lo) * s;
+            bins[(size_t)std::min(std::max(b, 0.0f), max_bin)] += totals[v];
+        }
+    }
+}
+
+#ifdef PANGO_UTILS_X86
+// Bin index of 8 floats at a time. NaNs and alpha lanes map to the discard
+// bin at bins.size().
+PANGO_TARGET("avx2")
+size_t HistogramAvx2(const float* p, size_t n, size_t channels, float lo, float s, size_t num_bins, size_t* counts)
+{
+    if(channels > 4 || n < 8) return 0;
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 vs = _mm256_set1_ps(s);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 vmax_bin = _mm256_set1_ps((float)(num_bins - 1));
+    const __m256i discard = _mm256_set1_epi32((int)num_bins);
+    const __m256 colour = channels == 4 ?
+        _mm256_castsi256_ps(_mm256_setr_epi32(-1,-1,-1,0,-1,-1,-1,0)) :
+        _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    alignas(32) int32_t idx[8];
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256 v = _mm256_loadu_ps(p + i);
+        const __m256 keep = _mm256_and_ps(_mm256_cmp_ps(v, v, _CMP_ORD_Q), colour);
+        const __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(v, vlo), vs), zero), vmax_bin);
+        const __m256i bi = _mm256_castps_si256(_mm256_blendv_ps(
+            _mm256_castsi256_ps(discard), _mm256_castsi256_ps(_mm256_cvttps_epi32(b)), keep));
+        _mm256_store_si256((__m256i*)idx, bi);
+        ++counts[idx[0]]; ++counts[idx[1]]; ++counts[idx[2]]; ++counts[idx[3]];
+        ++counts[idx[4]]; ++counts[idx[5]]; ++counts[idx[6]]; ++counts[idx[7]];
+    }
+    return i;
+}
+#endif
+
+void HistogramFloat(const Image<float>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    const size_t num_bins = bins.size();
+    std::vector<size_t> counts(num_bins + 1, 0);
+    const float max_bin = (float)(num_bins - 1);
+    const float s = hi > lo ? num_bins / (hi - lo) : 0.0f;
+    const bool all_colour = channels <= 3;
+
+    const size_t n = img.w * channels;
+    for(size_t y = 0; y < img.h; ++y) {
+        const float* row = img.RowPtr(y);
+        size_t i = 0;
+#ifdef PANGO_UTILS_X86
+        if(CpuHasAvx2()) {
+            i = HistogramAvx2(row, n, channels, lo, s, num_bins, counts.data());
+        }
+#endif
+        for(; i < n; ++i) {
+            const float b = (row[i] - lo) * s;
+            if(b == b && (all_colour || i % channels < 3)) {
+                ++counts[(size_t)std::min(std::max(b, 0.0f), max_bin)];
+            }
+        }
+    }
+
+    for(size_t b = 0; b < num_bins; ++b) {
+        bins[b] += counts[b];
+    }
+}
+
+}
+
+std::pair<float, float> GetMinMax(const Image<unsigned char>& img, size_t channels)
+{
+    return MinMaxImage<uint8_t, uint8_t>(img, channels, 0xFF, 0);
+}
+
+std::pair<float, float> GetMinMax(const Image<unsigned short>& img, size_t channels)
+{
+    return MinMaxImage<uint16_t, uint16_t>(img, channels, 0xFFFF, 0);
+}
+
+std::pair<float, float> GetMinMax(const Image<float>& img, size_t channels)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    return MinMaxImage<float, float>(img, channels, inf, -inf);
+}
+
+void GetHistogram(const Image<unsigned char>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    if(bins.empty() || !img.IsValid()) return;
+    HistogramIntegral(img, channels, lo, hi, bins);
+}
+
+void GetHistogram(const Image<unsigned short>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    if(bins.empty() || !img.IsValid()) return;
+    HistogramIntegral(img, channels, lo, hi, bins);
+}
+
+void GetHistogram(const Image<float>& img, size_t channels, float lo, float hi, std::vector<size_t>& bins)
+{
+    if(bins.empty() || !img.IsValid()) return;
+    HistogramFloat(img, channels, lo, hi, bins);
+}
+
+}
+
+}
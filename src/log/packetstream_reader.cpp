@@ -35,6 +35,7 @@ using std::ios_base;
 using std::streampos;
 using std::streamoff;
 
+#include <limits>
 #include <thread>
 
 #ifndef _WIN_
@@ -45,14 +46,14 @@ namespace pangolin
 {
 
 PacketStreamReader::PacketStreamReader()
-    : _pipe_fd(-1)
+    : _pipe_fd(-1), _read_ahead_bytes(0)
 {
 }
 
-PacketStreamReader::PacketStreamReader(const std::string& filename)
-    : _pipe_fd(-1)
+PacketStreamReader::PacketStreamReader(const std::string& filename, size_t read_ahead_bytes)
+    : _pipe_fd(-1), _read_ahead_bytes(0)
 {
-    Open(filename);
+    Open(filename, read_ahead_bytes);
 }
 
 PacketStreamReader::~PacketStreamReader()
@@ -60,7 +61,7 @@ PacketStreamReader::~PacketStreamReader()
     Close();
 }
 
-void PacketStreamReader::Open(const std::string& filename)
+void PacketStreamReader::Open(const std::string& filename, size_t read_ahead_bytes)
 {
     std::lock_guard<std::recursive_mutex> lg(_mutex);
 
@@ -68,7 +69,8 @@ void PacketStreamReader::Open(const std::string& filename)
 
     _filename = filename;
     _is_pipe = IsPipe(filename);
-    _stream.open(filename);
+    _read_ahead_bytes = read_ahead_bytes;
+    _stream.open(filename, read_ahead_bytes);
 
     if (!_stream.is_open())
         throw runtime_error("Cannot open stream.");
@@ -98,6 +100,7 @@ void PacketStreamReader::Close() {
 
     _stream.close();
     _sources.clear();
+    _prefetched_until.clear();
 
 #ifndef _WIN_
     if (_pipe_fd != -1) {
@@ -235,7 +238,7 @@ bool PacketStreamReader::GoodToRead()
                 {
                     close(_pipe_fd);
                     _pipe_fd = -1;
-                    Open(_filename);
+                    Open(_filename, _read_ahead_bytes);
                     return _stream.good();
                 }
             }
@@ -267,7 +270,11 @@ Packet PacketStreamReader::NextFrame()
             break;
         case TAG_SRC_JSON: //frames are sometimes preceded by metadata, but metadata must ALWAYS be followed by a frame from the same source.
         case TAG_SRC_PACKET:
-            return Packet(_stream, std::move(lock), _sources);
+        {
+            Packet packet(_stream, std::move(lock), _sources);
+            ReadAhead(packet.src, packet.sequence_num + 1);
+            return packet;
+        }
         case TAG_PANGO_STATS:
             ParseIndex();
             break;
@@ -380,6 +387,8 @@ size_t PacketStreamReader::Seek(PacketStreamSourceId src, size_t framenum)
     PANGO_ASSERT(framenum < source.index.size());
 
     if(source.index[framenum].pos > 0) {
+        if(src < _prefetched_until.size()) _prefetched_until[src] = framenum;
+        ReadAhead(src, framenum);
         _stream.clear();
         _stream.seekg(source.index[framenum].pos);
         source.next_packet_id = framenum;
@@ -412,6 +421,65 @@ size_t PacketStreamReader::Seek(PacketStreamSourceId src, SyncTime::TimePoint ti
     }
 }
 
+void PacketStreamReader::Prefetch(PacketStreamSourceId src, size_t framenum, size_t count)
+{
+    lock_guard<decltype(_mutex)> lg(_mutex);
+
+    if(src >= _sources.size() || !count) return;
+    const auto& index = _sources[src].index;
+    if(framenum >= index.size()) return;
+
+    // Packets are contiguous, so the range ends where the next packet of
+    // any source starts. After the last indexed packet, prefetch up to the
+    // end of the file (the prefetch is clamped to the file size).
+    const size_t last = std::min(framenum + count, index.size()) - 1;
+    const std::streampos begin = index[framenum].pos;
+    std::streampos end = -1;
+    if(last + 1 < index.size()) {
+        end = index[last + 1].pos;
+    }else{
+        for(const auto& s : _sources) {
+            const auto next = std::upper_bound(
+                s.index.begin(), s.index.end(), index[last].pos,
+                [](const std::streampos& p, const PacketStreamSource::PacketInfo& info){
+                    return p < info.pos;
+                }
+            );
+            if(next != s.index.end() && (end < 0 || next->pos < end)) end = next->pos;
+        }
+    }
+    const size_t len = end >= 0 ? static_cast<size_t>(end - begin) : std::numeric_limits<size_t>::max();
+    _stream.prefetch(begin, len);
+}
+
+void PacketStreamReader::ReadAhead(PacketStreamSourceId src, size_t framenum)
+{
+    if(!_read_ahead_bytes || src >= _sources.size()) return;
+    const auto& index = _sources[src].index;
+    if(framenum >= index.size()) return;
+
+    if(_prefetched_until.size() < _sources.size()) {
+        _prefetched_until.resize(_sources.size(), 0);
+    }
+
+    // Frames within read_ahead_bytes of framenum, using the index positions
+    const std::streampos limit = index[framenum].pos + static_cast<std::streamoff>(_read_ahead_bytes);
+    const auto end = std::upper_bound(
+        index.begin() + framenum, index.end(), limit,
+        [](const std::streampos& p, const PacketStreamSource::PacketInfo& info){
+            return p < info.pos;
+        }
+    );
+    const size_t count = std::max<size_t>(1, end - index.begin() - framenum);
+
+    // Top the window up once half of it has been consumed
+    size_t& until = _prefetched_until[src];
+    if(framenum < until && until - framenum > count / 2) return;
+
+    Prefetch(src, framenum, count);
+    until = framenum + count;
+}
+
 void PacketStreamReader::SkipSync()
 {
     //Assume we have just read PAN, read GO
@@ -27,6 +27,8 @@
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/utils/timer.h>
 
+#include <iterator>
+
 using std::ios;
 using std::lock_guard;
 
@@ -37,6 +39,28 @@ using std::lock_guard;
 namespace pangolin
 {
 
+static inline void appendCompressedUnsignedInt(std::vector<char>& buffer, size_t n)
+{
+    while (n >= 0x80)
+    {
+        buffer.push_back(static_cast<char>(0x80 | (n & 0x7F)));
+        n >>= 7;
+    }
+    buffer.push_back(static_cast<char>(n));
+}
+
+static inline void appendTimestamp(std::vector<char>& buffer, int64_t time_us)
+{
+    const char* p = reinterpret_cast<const char*>(&time_us);
+    buffer.insert(buffer.end(), p, p + sizeof(time_us));
+}
+
+static inline void appendTag(std::vector<char>& buffer, const pangoTagType tag)
+{
+    const char* p = reinterpret_cast<const char*>(&tag);
+    buffer.insert(buffer.end(), p, p + TAG_LENGTH);
+}
+
 static inline const std::string CurrentTimeStr()
 {
     time_t time_now = time(0);
@@ -61,6 +85,8 @@ void PacketStreamWriter::WriteHeader()
 
     for (const auto& source : _sources)
         Write(source);
+
+    _stream.flush();
 }
 
 void PacketStreamWriter::Write(const PacketStreamSource& source)
@@ -78,6 +104,7 @@ void PacketStreamWriter::Write(const PacketStreamSource& source)
 
     writeTag(_stream, TAG_ADD_SOURCE);
     serialize.serialize(std::ostream_iterator<char>(_stream), true);
+    _stream.flush();
 }
 
 
@@ -101,36 +128,89 @@ PacketStreamSourceId PacketStreamWriter::AddSource(const PacketStreamSource& sou
     return _sources.back().id;
 }
 
-void PacketStreamWriter::WriteMeta(PacketStreamSourceId src, const picojson::value& data)
+void PacketStreamWriter::ValidatePacket(PacketStreamSourceId src, size_t sourcelen) const
 {
-    SCOPED_LOCK;
-    writeTag(_stream, TAG_SRC_JSON);
-    writeCompressedUnsignedInt(_stream, src);
-    data.serialize(std::ostream_iterator<char>(_stream), false);
+    if (src >= _sources.size())
+        throw std::runtime_error("oPacketStream::writePacket --> Tried to write a packet for an unknown source.");
+
+    if (_sources[src].data_size_bytes && sourcelen != static_cast<size_t>(_sources[src].data_size_bytes))
+        throw std::runtime_error("oPacketStream::writePacket --> Tried to write a fixed-size packet with bad size.");
+}
+
+void PacketStreamWriter::EncodePacketHeader(
+    PacketStreamSourceId src, int64_t receive_time_us, size_t sourcelen,
+    const picojson::value& meta, std::streampos pos
+) {
+    _sources[src].index.push_back({pos, receive_time_us});
+
+    if (!meta.is<picojson::null>()) {
+        appendTag(_scratch, TAG_SRC_JSON);
+        appendCompressedUnsignedInt(_scratch, src);
+        meta.serialize(std::back_inserter(_scratch), false);
+    }
+
+    appendTag(_scratch, TAG_SRC_PACKET);
+    appendTimestamp(_scratch, receive_time_us);
+    appendCompressedUnsignedInt(_scratch, src);
+
+    if (!_sources[src].data_size_bytes) {
+        appendCompressedUnsignedInt(_scratch, sourcelen);
+    }
 }
 
 void PacketStreamWriter::WriteSourcePacket(PacketStreamSourceId src, const char* source, const int64_t receive_time_us, size_t sourcelen, const picojson::value& meta)
 {
-
     SCOPED_LOCK;
-    _sources[src].index.push_back({_stream.tellp(), receive_time_us});
+    ValidatePacket(src, sourcelen);
+
+    _scratch.clear();
+    EncodePacketHeader(src, receive_time_us, sourcelen, meta, _stream.tellp());
+
+    // Header and payload are handed to the writer thread together
+    const threadedfilebuf::Segment segments[2] = {
+        {_scratch.data(), static_cast<std::streamsize>(_scratch.size())},
+        {source, static_cast<std::streamsize>(sourcelen)}
+    };
+    _buffer.write_segments(segments, 2);
+    _bytes_written += sourcelen;
+}
 
-    if (!meta.is<picojson::null>())
-        WriteMeta(src, meta);
+void PacketStreamBatch::Add(PacketStreamSourceId src, const char* source, const int64_t receive_time_us, size_t sourcelen, const picojson::value& meta)
+{
+    _packets.push_back({src, receive_time_us, _payload.size(), sourcelen, meta});
+    _payload.insert(_payload.end(), source, source + sourcelen);
+}
 
-    writeTag(_stream, TAG_SRC_PACKET);
-    writeTimestamp(_stream, receive_time_us);
-    writeCompressedUnsignedInt(_stream, src);
+void PacketStreamWriter::WriteBatch(const PacketStreamBatch& batch)
+{
+    SCOPED_LOCK;
+    for (const auto& p : batch._packets)
+        ValidatePacket(p.src, p.size);
+
+    const std::streampos start = _stream.tellp();
+    std::streamoff offset = 0;
+
+    _scratch.clear();
+    _segments.clear();
+    for (const auto& p : batch._packets) {
+        const size_t header_begin = _scratch.size();
+        EncodePacketHeader(p.src, p.receive_time_us, p.size, p.meta, start + offset);
+        const std::streamsize header_size = static_cast<std::streamsize>(_scratch.size() - header_begin);
+
+        // Header pointers are filled in once _scratch stops growing
+        _segments.push_back({nullptr, header_size});
+        _segments.push_back({batch._payload.data() + p.offset, static_cast<std::streamsize>(p.size)});
+        offset += header_size + static_cast<std::streamoff>(p.size);
+        _bytes_written += p.size;
+    }
 
-    if (_sources[src].data_size_bytes) {
-        if (sourcelen != static_cast<size_t>(_sources[src].data_size_bytes))
-            throw std::runtime_error("oPacketStream::writePacket --> Tried to write a fixed-size packet with bad size.");
-    } else {
-        writeCompressedUnsignedInt(_stream, sourcelen);
+    const char* header = _scratch.data();
+    for (size_t i = 0; i < _segments.size(); i += 2) {
+        _segments[i].data = header;
+        header += _segments[i].size;
     }
 
-    _stream.write(source, sourcelen);
-    _bytes_written += sourcelen;
+    _buffer.write_segments(_segments.data(), _segments.size());
 }
 
 void PacketStreamWriter::WriteSync()
@@ -138,6 +218,7 @@ void PacketStreamWriter::WriteSync()
     SCOPED_LOCK;
     for (unsigned i = 0; i < 10; ++i)
     writeTag(_stream, TAG_PANGO_SYNC);
+    _stream.flush();
 }
 
 void PacketStreamWriter::WriteEnd()
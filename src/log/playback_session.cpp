@@ -1,14 +1,156 @@
 #include <pangolin/log/playback_session.h>
 #include <pangolin/utils/params.h>
 
+#include <future>
+
 namespace pangolin {
 
+PlaybackSession::PlaybackSession()
+    : schedule_reads(false), read_ahead_packets(64), read_cursor(0), scheduled_until(0)
+{
+    // Restart reading ahead from the seek target, once for the whole session
+    session_seek = time.OnSeek.Connect([this](SyncTime::TimePoint t){
+        std::lock_guard<std::mutex> l(mutex);
+        if(!schedule_reads) return;
+        auto idx = IndexLocked();
+        read_cursor = idx->LowerBound(std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count());
+        scheduled_until = read_cursor;
+        ScheduleReads(*idx);
+    });
+}
+
 std::shared_ptr<PlaybackSession> PlaybackSession::Default()
 {
     static std::shared_ptr<PlaybackSession> instance = std::make_shared<PlaybackSession>();
     return instance;
 }
 
+std::shared_ptr<PacketStreamReader> PlaybackSession::Open(const std::string& filename, size_t read_ahead_bytes)
+{
+    const std::string path = SanitizePath(PathExpand(filename));
+
+    std::lock_guard<std::mutex> l(mutex);
+    auto i = readers.find(path);
+    if(i == readers.end()) {
+        auto psr = std::make_shared<PacketStreamReader>(path, read_ahead_bytes);
+        readers[path] = psr;
+        schedule_reads |= read_ahead_bytes > 0;
+        return psr;
+    }else{
+        return i->second;
+    }
+}
+
+std::vector<std::shared_ptr<PacketStreamReader>> PlaybackSession::OpenAll(const std::vector<std::string>& filenames, size_t read_ahead_bytes)
+{
+    std::vector<std::string> paths;
+    std::map<std::string, std::future<std::shared_ptr<PacketStreamReader>>> opening;
+    {
+        std::lock_guard<std::mutex> l(mutex);
+        for(const std::string& filename : filenames) {
+            const std::string path = SanitizePath(PathExpand(filename));
+            paths.push_back(path);
+            if(readers.find(path) == readers.end() && opening.find(path) == opening.end()) {
+                opening[path] = std::async(std::launch::async, [path, read_ahead_bytes](){
+                    return std::make_shared<PacketStreamReader>(path, read_ahead_bytes);
+                });
+            }
+        }
+    }
+
+    // Wait for all before rethrowing any error
+    std::map<std::string, std::shared_ptr<PacketStreamReader>> opened;
+    std::exception_ptr error;
+    for(auto& o : opening) {
+        try {
+            opened[o.first] = o.second.get();
+        }catch(...) {
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+
+    std::lock_guard<std::mutex> l(mutex);
+    std::vector<std::shared_ptr<PacketStreamReader>> result;
+    for(const std::string& path : paths) {
+        auto i = readers.find(path);
+        if(i == readers.end()) {
+            i = readers.emplace(path, opened[path]).first;
+            schedule_reads |= read_ahead_bytes > 0;
+        }
+        result.push_back(i->second);
+    }
+    return result;
+}
+
+std::shared_ptr<const PlaybackSessionIndex> PlaybackSession::Index()
+{
+    std::lock_guard<std::mutex> l(mutex);
+    return IndexLocked();
+}
+
+std::shared_ptr<const PlaybackSessionIndex> PlaybackSession::IndexLocked()
+{
+    if(!index || index_readers.size() != readers.size()) {
+        index_readers.clear();
+        for(const auto& r : readers) {
+            index_readers.push_back(r.second);
+        }
+        auto idx = std::make_shared<PlaybackSessionIndex>();
+        idx->Build(index_readers);
+        index = idx;
+        read_cursor = 0;
+        scheduled_until = 0;
+    }
+    return index;
+}
+
+void PlaybackSession::PacketRead(const PacketStreamReader& reader, PacketStreamSourceId src, size_t frame)
+{
+    std::lock_guard<std::mutex> l(mutex);
+    if(!schedule_reads) return;
+
+    auto idx = IndexLocked();
+    for(size_t r=0; r < index_readers.size(); ++r) {
+        if(index_readers[r].get() == &reader) {
+            const size_t pos = idx->Find(r, src, frame);
+            if(pos != PlaybackSessionIndex::npos && pos >= read_cursor) {
+                read_cursor = pos + 1;
+                ScheduleReads(*idx);
+            }
+            return;
+        }
+    }
+}
+
+void PlaybackSession::SetReadAheadPackets(size_t packets)
+{
+    std::lock_guard<std::mutex> l(mutex);
+    read_ahead_packets = packets;
+}
+
+void PlaybackSession::ScheduleReads(const PlaybackSessionIndex& idx)
+{
+    const size_t end = std::min(idx.Size(), read_cursor + read_ahead_packets);
+    size_t i = std::max(scheduled_until, read_cursor);
+
+    // Issue consecutive packets of the same source as one request
+    while(i < end) {
+        const PlaybackSessionIndex::Entry& e = idx[i];
+        size_t run = 1;
+        while(i + run < end && idx[i+run].reader == e.reader && idx[i+run].src == e.src && idx[i+run].frame == e.frame + run) {
+            ++run;
+        }
+        if(index_readers[e.reader]->ReadAheadBytes() > 0) {
+            index_readers[e.reader]->Prefetch(e.src, e.frame, run);
+        }
+        i += run;
+    }
+    scheduled_until = std::max(scheduled_until, end);
+}
+
 std::shared_ptr<PlaybackSession> PlaybackSession::ChooseFromParams(const Params& params)
 {
     bool use_ordered_playback = params.Get<bool>("OrderedPlayback", false);
@@ -0,0 +1,93 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/log/playback_session_index.h>
+
+#include <algorithm>
+
+namespace pangolin {
+
+void PlaybackSessionIndex::Build(const std::vector<std::shared_ptr<PacketStreamReader>>& readers)
+{
+    entries.clear();
+    positions.clear();
+    source_offset.assign(readers.size(), {});
+
+    size_t total = 0;
+    for(size_t r=0; r < readers.size(); ++r) {
+        for(const PacketStreamSource& src : readers[r]->Sources()) {
+            source_offset[r].push_back(total);
+            total += src.index.size();
+        }
+        source_offset[r].push_back(total);
+    }
+
+    entries.reserve(total);
+    for(size_t r=0; r < readers.size(); ++r) {
+        const auto& sources = readers[r]->Sources();
+        for(size_t s=0; s < sources.size(); ++s) {
+            const auto& index = sources[s].index;
+            for(size_t f=0; f < index.size(); ++f) {
+                entries.push_back({index[f].capture_time, (uint32_t)r, (uint32_t)s, f});
+            }
+        }
+    }
+
+    // Stable, so that simultaneous packets keep reader then source order
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){
+        return a.capture_time < b.capture_time;
+    });
+
+    positions.resize(total);
+    for(size_t i=0; i < entries.size(); ++i) {
+        const Entry& e = entries[i];
+        positions[source_offset[e.reader][e.src] + e.frame] = i;
+    }
+}
+
+size_t PlaybackSessionIndex::LowerBound(int64_t time_us) const
+{
+    auto lb = std::lower_bound(entries.begin(), entries.end(), time_us, [](const Entry& e, int64_t t){
+        return e.capture_time < t;
+    });
+    return lb - entries.begin();
+}
+
+size_t PlaybackSessionIndex::Find(size_t reader, size_t src, size_t frame) const
+{
+    if(reader >= source_offset.size() || src + 1 >= source_offset[reader].size()) {
+        return npos;
+    }
+    const size_t offset = source_offset[reader][src];
+    if(offset + frame >= source_offset[reader][src+1]) {
+        return npos;
+    }
+    return positions[offset + frame];
+}
+
+}
@@ -292,90 +292,180 @@ namespace py_pangolin {
 
   };
 
-  pybind11::list VideoInputGrab(pangolin::VideoInput& vi, bool wait, bool newest){
-      unsigned char *buffer = new unsigned char[vi.SizeBytes()];
+  // numpy element type and shape of one stream
+  struct StreamArrayFormat {
+      pybind11::dtype dtype;
+      int channels;
+      int Bpp;
+      int Bpc;
+  };
+
+  StreamArrayFormat GetStreamArrayFormat(const pangolin::StreamInfo& si){
+      const int c = si.PixFormat().channels;
+      const std::string fmt = si.PixFormat().format;
+      const int Bpp = si.PixFormat().bpp / (8);
+      const int Bpc = Bpp / c;
+      const int bpc = si.PixFormat().bpp / c;
+      PANGO_ASSERT(bpc == 8 || bpc == 16 || bpc == 32, "only support 8, 16, 32 bits channel");
+
+      if (bpc == 8) {
+          return {pybind11::dtype::of<uint8_t>(), c, Bpp, Bpc};
+      }
+      else if (bpc == 16){
+          return {pybind11::dtype::of<uint16_t>(), c, Bpp, Bpc};
+      }
+      else if (fmt == "GRAY32"){
+          return {pybind11::dtype::of<uint32_t>(), c, Bpp, Bpc};
+      }
+      else if (fmt == "GRAY32F" ||
+               fmt == "RGB96F" ||
+               fmt == "RGBA128F")
+      {
+          return {pybind11::dtype::of<float>(), c, Bpp, Bpc};
+      }
+      PANGO_ASSERT(false, "unsupported 32 bpc format");
+      return {pybind11::dtype::of<uint8_t>(), c, Bpp, Bpc};
+  }
+
+  // True if the whole frame is a single, tightly packed stream, so that it
+  // can be grabbed straight into a numpy array.
+  bool IsSingleDenseStream(pangolin::VideoInput& vi){
+      if(vi.Streams().size() != 1) return false;
+      const pangolin::StreamInfo& si = vi.Streams()[0];
+      return (size_t)si.Offset() == 0 && !si.IsPitched() && si.SizeBytes() == vi.SizeBytes();
+  }
 
-      std::vector<pangolin::Image<unsigned char>> imgs;
+  // Reused frame buffer for grabs which can't go straight into the result.
+  unsigned char* GrabScratch(size_t size_bytes){
+      static thread_local std::vector<unsigned char> scratch;
+      if(scratch.size() < size_bytes) scratch.resize(size_bytes);
+      return scratch.data();
+  }
+
+  // Grab one frame into buffer without holding the GIL.
+  bool GrabWithoutGil(pangolin::VideoInput& vi, unsigned char* buffer, bool wait, bool newest){
+      pybind11::gil_scoped_release release;
+      return newest ? vi.GrabNewest(buffer, wait) : vi.GrabNext(buffer, wait);
+  }
+
+  // Grab a frame and return one array per stream. The arrays are views of a
+  // single frame buffer, so no per stream copy is made.
+  pybind11::list VideoInputGrab(pangolin::VideoInput& vi, bool wait, bool newest){
+      pybind11::array_t<uint8_t> frame((pybind11::ssize_t)vi.SizeBytes());
       pybind11::list imgsList;
 
-      if(vi.Grab(buffer,imgs,wait,newest)) {
+      if(GrabWithoutGil(vi, frame.mutable_data(), wait, newest)) {
           for(size_t s=0; s < vi.Streams().size(); ++s) {
-              // Let's just return the first stream for the moment
               const pangolin::StreamInfo& si = vi.Streams()[s];
-              const pangolin::Image<uint8_t> img = si.StreamImage(buffer);
-
-              const int c = si.PixFormat().channels;
-              const std::string fmt = si.PixFormat().format;
-              const int Bpp = si.PixFormat().bpp / (8);
-              const int Bpc = Bpp / c;
-              const int bpc = si.PixFormat().bpp / c;
-              PANGO_ASSERT(bpc == 8 || bpc == 16 || bpc == 32, "only support 8, 16, 32 bits channel");
-
-              pangolin::Image<uint8_t> dstImage(
-                  new unsigned char[img.h * img.w * Bpp],
-                  img.w, img.h, img.w*Bpp
+              const StreamArrayFormat f = GetStreamArrayFormat(si);
+              imgsList.append(
+                  pybind11::array(
+                      f.dtype,
+                      {(pybind11::ssize_t)si.Height(), (pybind11::ssize_t)si.Width(), (pybind11::ssize_t)f.channels},
+                      {(pybind11::ssize_t)si.Pitch(), (pybind11::ssize_t)f.Bpp, (pybind11::ssize_t)f.Bpc},
+                      frame.data() + (size_t)si.Offset(),
+                      frame)
+                  );
+          }
+      }
+      return imgsList;
+  }
+
+  // Fill caller provided arrays, one C-contiguous array per stream with the
+  // stream's shape and dtype, avoiding any allocation. Arrays which don't
+  // match raise ValueError.
+  bool VideoInputGrabInto(pangolin::VideoInput& vi, pybind11::list images, bool wait, bool newest){
+      if(images.size() != vi.Streams().size()) {
+          throw pybind11::value_error("Expected one array per stream (" + std::to_string(vi.Streams().size()) + "), got " + std::to_string(images.size()) + ".");
+      }
+
+      std::vector<pybind11::array> arrays;
+      for(size_t s=0; s < vi.Streams().size(); ++s) {
+          const pangolin::StreamInfo& si = vi.Streams()[s];
+          const StreamArrayFormat f = GetStreamArrayFormat(si);
+          const std::string which = "Array " + std::to_string(s) + ": ";
+          pybind11::array arr = images[s].cast<pybind11::array>();
+          if(!arr.writeable() || !(arr.flags() & pybind11::array::c_style)) {
+              throw pybind11::value_error(which + "must be writeable and C-contiguous.");
+          }
+          if(!arr.dtype().equal(f.dtype)) {
+              throw pybind11::value_error(which + "dtype does not match stream.");
+          }
+          // (h, w, c), or (h, w) for single channel streams
+          const bool shape_ok =
+              (arr.ndim() == 3 && arr.shape(2) == f.channels) || (arr.ndim() == 2 && f.channels == 1);
+          if(!shape_ok || (size_t)arr.shape(0) != si.Height() || (size_t)arr.shape(1) != si.Width()) {
+              throw pybind11::value_error(
+                  which + "shape must be (" + std::to_string(si.Height()) + ", " +
+                  std::to_string(si.Width()) + ", " + std::to_string(f.channels) + ")."
               );
+          }
+          arrays.push_back(arr);
+      }
 
-              pangolin::PitchedCopy((char*)dstImage.ptr, dstImage.pitch, (char*)img.ptr, img.pitch, img.w * Bpp, img.h);
-
-              // Create a Python object that will free the allocated memory
-              pybind11::capsule free_when_done(dstImage.ptr,[](void* f) {
-                unsigned char* buffer = (unsigned char*)f;
-                delete[] buffer;
-              });
-
-              if (bpc == 8) {
-                  imgsList.append(
-                      pybind11::array_t<uint8_t>(
-                      {(int)dstImage.h, (int)dstImage.w, c },
-                      {(int)dstImage.pitch, Bpp, Bpc},
-                      (uint8_t*)dstImage.ptr,
-                      free_when_done)
-                      );
-              }
-              else if (bpc == 16){
-                  imgsList.append(
-                      pybind11::array_t<uint16_t>(
-                      {(int)dstImage.h, (int)dstImage.w, c },
-                      {(int)dstImage.pitch, Bpp, Bpc},
-                      (uint16_t*)dstImage.ptr,
-                      free_when_done)
-                      );
-              }
-              else if (bpc == 32){
-                  if (fmt == "GRAY32")
-                  {
-                      imgsList.append(
-                          pybind11::array_t<uint32_t>(
-                          {(int)dstImage.h, (int)dstImage.w, c },
-                          {(int)dstImage.pitch, Bpp, Bpc},
-                          (uint32_t*)dstImage.ptr,
-                          free_when_done)
-                          );
-                  }
-                  else if (fmt == "GRAY32F" ||
-                           fmt == "RGB96F" ||
-                           fmt == "RGBA128F")
-                  {
-                      imgsList.append(
-                          pybind11::array_t<float>(
-                          {(int)dstImage.h, (int)dstImage.w, c },
-                          {(int)dstImage.pitch, Bpp, Bpc},
-                          (float*)dstImage.ptr,
-                          free_when_done)
-                          );
-                  }
-                  else{
-                      PANGO_ASSERT(false, "unsupported 32 bpc format");
+      if(IsSingleDenseStream(vi)) {
+          return GrabWithoutGil(vi, (unsigned char*)arrays[0].mutable_data(), wait, newest);
+      }
+
+      std::vector<unsigned char*> dst;
+      for(auto& arr : arrays) dst.push_back((unsigned char*)arr.mutable_data());
+
+      pybind11::gil_scoped_release release;
+      unsigned char* buffer = GrabScratch(vi.SizeBytes());
+      if(!(newest ? vi.GrabNewest(buffer, wait) : vi.GrabNext(buffer, wait))) {
+          return false;
+      }
+      for(size_t s=0; s < vi.Streams().size(); ++s) {
+          const pangolin::Image<uint8_t> img = vi.Streams()[s].StreamImage(buffer);
+          const size_t row_bytes = vi.Streams()[s].RowBytes();
+          pangolin::PitchedCopy((char*)dst[s], row_bytes, (char*)img.ptr, img.pitch, row_bytes, img.h);
+      }
+      return true;
+  }
+
+  // Grab up to n frames and return one array per stream of shape
+  // (frames, h, w, c). Fewer than n frames are returned at end of stream.
+  pybind11::list VideoInputGrabMany(pangolin::VideoInput& vi, size_t n, bool wait){
+      std::vector<pybind11::array> stacks;
+      std::vector<unsigned char*> dst;
+      for(size_t s=0; s < vi.Streams().size(); ++s) {
+          const pangolin::StreamInfo& si = vi.Streams()[s];
+          const StreamArrayFormat f = GetStreamArrayFormat(si);
+          stacks.emplace_back(
+              f.dtype,
+              std::vector<pybind11::ssize_t>{(pybind11::ssize_t)n, (pybind11::ssize_t)si.Height(), (pybind11::ssize_t)si.Width(), (pybind11::ssize_t)f.channels}
+          );
+          dst.push_back((unsigned char*)stacks.back().mutable_data());
+      }
+
+      const bool dense = IsSingleDenseStream(vi);
+      size_t grabbed = 0;
+      {
+          pybind11::gil_scoped_release release;
+          unsigned char* buffer = dense ? nullptr : GrabScratch(vi.SizeBytes());
+          for(; grabbed < n; ++grabbed) {
+              if(dense) {
+                  if(!vi.GrabNext(dst[0] + grabbed * vi.SizeBytes(), wait)) break;
+              }else{
+                  if(!vi.GrabNext(buffer, wait)) break;
+                  for(size_t s=0; s < vi.Streams().size(); ++s) {
+                      const pangolin::Image<uint8_t> img = vi.Streams()[s].StreamImage(buffer);
+                      const size_t row_bytes = vi.Streams()[s].RowBytes();
+                      pangolin::PitchedCopy((char*)dst[s] + grabbed * img.h * row_bytes, row_bytes, (char*)img.ptr, img.pitch, row_bytes, img.h);
                   }
               }
-              else{
-                  PANGO_ASSERT(false, "incompatible bpc");
-              }
           }
       }
-      delete[] buffer;
-      return imgsList;
+
+      pybind11::list result;
+      for(auto& stack : stacks) {
+          if(grabbed < n) {
+              result.append(stack[pybind11::slice(0, (pybind11::ssize_t)grabbed, 1)]);
+          }else{
+              result.append(stack);
+          }
+      }
+      return result;
   }
 
   picojson::value PicojsonFromPyObject(pybind11::object& obj)
@@ -489,6 +579,8 @@ namespace py_pangolin {
       .def("Open", &pangolin::VideoInput::Open, pybind11::arg("input_uri"), pybind11::arg("output_uri")="pango:[buffer_size_mb=100]//video_log.pango")      
       .def("Close", &pangolin::VideoInput::Close)
       .def("Grab", VideoInputGrab, pybind11::arg("wait")=true, pybind11::arg("newest")=false )
+      .def("GrabInto", VideoInputGrabInto, pybind11::arg("images"), pybind11::arg("wait")=true, pybind11::arg("newest")=false )
+      .def("GrabMany", VideoInputGrabMany, pybind11::arg("n"), pybind11::arg("wait")=true )
       .def("GetStreamsBitDepth", [](pangolin::VideoInput& vi){
         std::vector<int> bitDepthList;
         for(size_t s=0; s < vi.Streams().size(); ++s) {
@@ -0,0 +1,435 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/async_file_io.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN_
+#  include <unistd.h>
+#endif
+
+#if defined(_LINUX_) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <sys/uio.h>
+#    ifdef __NR_io_uring_setup
+#      define PANGO_HAVE_IO_URING
+#    endif
+#  endif
+#endif
+
+namespace pangolin
+{
+
+#ifndef _WIN_
+
+namespace
+{
+
+// Blocking positional transfer of the whole request, retrying short
+// transfers. Stops early only at end of file.
+int64_t TransferAll(const AsyncFileIO::Request& r)
+{
+    size_t done = 0;
+    while(done < r.size) {
+        const ssize_t n = (r.op == AsyncFileIO::Read)
+            ? ::pread(r.fd, r.buffer + done, r.size - done, static_cast<off_t>(r.offset + done))
+            : ::pwrite(r.fd, r.buffer + done, r.size - done, static_cast<off_t>(r.offset + done));
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -errno;
+        }
+        if(n == 0) break;
+        done += static_cast<size_t>(n);
+    }
+    return static_cast<int64_t>(done);
+}
+
+class ThreadPoolFileIO : public AsyncFileIO
+{
+public:
+    ThreadPoolFileIO(size_t queue_depth, size_t num_threads)
+        : depth(std::max<size_t>(queue_depth,1)), in_flight(0), should_run(true)
+    {
+        for(size_t i=0; i < std::max<size_t>(num_threads,1); ++i) {
+            workers.emplace_back(&ThreadPoolFileIO::Run, this);
+        }
+    }
+
+    ~ThreadPoolFileIO()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            should_run = false;
+        }
+        cond_queued.notify_all();
+        for(auto& t : workers) t.join();
+    }
+
+    const char* Name() const override { return "threads"; }
+
+    size_t QueueDepth() const override { return depth; }
+
+    size_t InFlight() const override { return in_flight; }
+
+    bool Submit(const Request& request) override
+    {
+        if(in_flight >= depth) return false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.push_back(request);
+        }
+        ++in_flight;
+        cond_queued.notify_one();
+        return true;
+    }
+
+    void Flush() override {}
+
+    size_t Wait(std::vector<Completion>& out, size_t min_complete) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        min_complete = std::min(min_complete, in_flight);
+        while(done.size() < min_complete) {
+            cond_done.wait(lock);
+        }
+        const size_t n = done.size();
+        out.insert(out.end(), done.begin(), done.end());
+        done.clear();
+        in_flight -= n;
+        return n;
+    }
+
+private:
+    void Run()
+    {
+        while(true) {
+            Request r;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(queued.empty() && should_run) {
+                    cond_queued.wait(lock);
+                }
+                if(queued.empty()) return;
+                r = queued.front();
+                queued.pop_front();
+            }
+
+            const Completion c = {r.user_data, TransferAll(r)};
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.push_back(c);
+            }
+            cond_done.notify_one();
+        }
+    }
+
+    const size_t depth;
+    size_t in_flight;
+    bool should_run;
+
+    std::mutex mutex;
+    std::condition_variable cond_queued;
+    std::condition_variable cond_done;
+    std::deque<Request> queued;
+    std::vector<Completion> done;
+    std::vector<std::thread> workers;
+};
+
+#ifdef PANGO_HAVE_IO_URING
+
+// io_uring through the raw syscall interface, so that liburing isn't a
+// build dependency.
+class UringFileIO : public AsyncFileIO
+{
+public:
+    UringFileIO(size_t queue_depth)
+        : depth(std::max<size_t>(queue_depth,1)), in_flight(0), to_submit(0), buffers_registered(false),
+          ring_fd(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sqes(reinterpret_cast<io_uring_sqe*>(MAP_FAILED)),
+          sq_bytes(0), cq_bytes(0), sqe_bytes(0)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+        if(ring_fd < 0) {
+            throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+        }
+
+        sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+
+        bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+        single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+#endif
+        if(single_mmap) {
+            sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+        }
+
+        sq_ptr = mmap(0, sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        cq_ptr = single_mmap ? sq_ptr :
+                 mmap(0, cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        sqes = reinterpret_cast<io_uring_sqe*>(
+            mmap(0, sqe_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES)
+        );
+        if(sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+            Release();
+            throw std::runtime_error("Unable to map io_uring rings.");
+        }
+
+        char* sq = static_cast<char*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // One iovec per in flight request for the non-registered path,
+        // which must outlive submission.
+        slots.resize(depth);
+        free_slots.resize(depth);
+        for(size_t i=0; i < depth; ++i) free_slots[i] = depth - 1 - i;
+    }
+
+    ~UringFileIO()
+    {
+        std::vector<Completion> discard;
+        while(in_flight) Wait(discard, in_flight);
+        Release();
+    }
+
+    const char* Name() const override { return "io_uring"; }
+
+    size_t QueueDepth() const override { return depth; }
+
+    size_t InFlight() const override { return in_flight; }
+
+    bool Submit(const Request& request) override
+    {
+        if(in_flight >= depth) return false;
+
+        const unsigned tail = __atomic_load_n(sq_tail, __ATOMIC_RELAXED);
+        if(tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            Flush();
+            if(tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) return false;
+        }
+
+        const size_t slot = free_slots.back();
+        free_slots.pop_back();
+        slots[slot].user_data = request.user_data;
+        slots[slot].iov.iov_base = request.buffer;
+        slots[slot].iov.iov_len = request.size;
+
+        const unsigned index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = request.fd;
+        sqe.off = request.offset;
+        sqe.user_data = slot;
+        if(request.buffer_index >= 0 && buffers_registered) {
+            sqe.opcode = (request.op == Read) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe.len = static_cast<uint32_t>(request.size);
+            sqe.buf_index = static_cast<uint16_t>(request.buffer_index);
+        }else{
+            sqe.opcode = (request.op == Read) ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe.addr = reinterpret_cast<uint64_t>(&slots[slot].iov);
+            sqe.len = 1;
+        }
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        ++to_submit;
+        ++in_flight;
+        return true;
+    }
+
+    void Flush() override
+    {
+        while(to_submit) {
+            const int r = Enter(0, 0);
+            if(r <= 0) break;
+        }
+    }
+
+    size_t Wait(std::vector<Completion>& out, size_t min_complete) override
+    {
+        min_complete = std::min(min_complete, in_flight);
+        size_t n = Reap(out);
+        while(n < min_complete) {
+            Enter(static_cast<unsigned>(min_complete - n), IORING_ENTER_GETEVENTS);
+            n += Reap(out);
+        }
+        Flush();
+        return n;
+    }
+
+    bool RegisterBuffers(const std::vector<Buffer>& buffers) override
+    {
+        if(in_flight) return false;
+        UnregisterBuffers();
+        std::vector<iovec> iovs(buffers.size());
+        for(size_t i=0; i < buffers.size(); ++i) {
+            iovs[i].iov_base = buffers[i].data;
+            iovs[i].iov_len = buffers[i].size;
+        }
+        buffers_registered = syscall(
+            __NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovs.data(), static_cast<unsigned>(iovs.size())
+        ) == 0;
+        return buffers_registered;
+    }
+
+    void UnregisterBuffers() override
+    {
+        if(buffers_registered) {
+            syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            buffers_registered = false;
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t user_data;
+        iovec iov;
+    };
+
+    // Submit queued entries and optionally wait. Returns entries consumed.
+    int Enter(unsigned min_complete, unsigned flags)
+    {
+        const int r = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+        if(r < 0) {
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY) return 0;
+            throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+        }
+        to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(r));
+        return r;
+    }
+
+    size_t Reap(std::vector<Completion>& out)
+    {
+        unsigned head = __atomic_load_n(cq_head, __ATOMIC_RELAXED);
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        size_t n = 0;
+        for(; head != tail; ++head, ++n) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            const size_t slot = static_cast<size_t>(cqe.user_data);
+            out.push_back({slots[slot].user_data, cqe.res});
+            free_slots.push_back(slot);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        in_flight -= n;
+        return n;
+    }
+
+    void Release()
+    {
+        if(sqes != MAP_FAILED) munmap(sqes, sqe_bytes);
+        if(cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_bytes);
+        if(sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_bytes);
+        if(ring_fd >= 0) ::close(ring_fd);
+        ring_fd = -1;
+    }
+
+    const size_t depth;
+    size_t in_flight;
+    unsigned to_submit;
+    bool buffers_registered;
+
+    int ring_fd;
+    void* sq_ptr;
+    void* cq_ptr;
+    io_uring_sqe* sqes;
+    size_t sq_bytes;
+    size_t cq_bytes;
+    size_t sqe_bytes;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    std::vector<Slot> slots;
+    std::vector<size_t> free_slots;
+};
+
+#endif // PANGO_HAVE_IO_URING
+
+}
+
+std::unique_ptr<AsyncFileIO> AsyncFileIO::Create(size_t queue_depth, AsyncFileIOBackend backend, size_t num_threads)
+{
+#ifdef PANGO_HAVE_IO_URING
+    if(backend != AsyncFileIOThreads) {
+        try {
+            return std::unique_ptr<AsyncFileIO>(new UringFileIO(queue_depth));
+        }catch(const std::exception&) {
+            // e.g. ENOSYS on older kernels, or EPERM under seccomp
+        }
+    }
+#endif
+    if(backend == AsyncFileIOUring) {
+        return nullptr;
+    }
+    return std::unique_ptr<AsyncFileIO>(new ThreadPoolFileIO(queue_depth, num_threads));
+}
+
+#else // _WIN_
+
+std::unique_ptr<AsyncFileIO> AsyncFileIO::Create(size_t, AsyncFileIOBackend, size_t)
+{
+    return nullptr;
+}
+
+#endif // _WIN_
+
+}
@@ -49,11 +49,22 @@
 #  include <fcntl.h>
 #  include <errno.h>
 #  include <poll.h>
+#  include <sys/syscall.h>
+#  include <time.h>
 #endif // _WIN_
 
 #include <algorithm>
-#include <sstream>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
 #include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
 
 namespace pangolin
 {
@@ -72,6 +83,32 @@ std::vector<std::string> Split(const std::string &s, char delim) {
     return Split(s, delim, elems);
 }
 
+std::vector<std::string> SplitBrackets(const std::string src, char open, char close)
+{
+    std::vector<std::string> splits;
+
+    int nesting = 0;
+    int begin = -1;
+
+    for(size_t i=0; i < src.length(); ++i) {
+        if(src[i] == open) {
+            if(nesting==0) {
+                begin = (int)i;
+            }
+            nesting++;
+        }else if(src[i] == close) {
+            nesting--;
+            if(nesting == 0) {
+                // matching close bracket.
+                int str_start = begin+1;
+                splits.push_back( src.substr(str_start, i-str_start) );
+            }
+        }
+    }
+
+    return splits;
+}
+
 std::vector<std::string> Expand(const std::string &s, char open, char close, char delim)
 {
     const size_t no = s.find_first_of(open);
@@ -230,40 +267,69 @@ std::string PathExpand(const std::string& sPath)
     }
 }
 
-// Based on http://www.codeproject.com/Articles/188256/A-Simple-Wildcard-Matching-Function
+// Greedy matcher which backtracks only to the most recent '*', so it runs
+// without allocation or recursion in O(|str|*|wildcard|) worst case.
 bool MatchesWildcard(const std::string& str, const std::string& wildcard)
 {
     const char* psQuery = str.c_str();
     const char* psWildcard = wildcard.c_str();
-    
-    while(*psWildcard)
+    const char* psStarWildcard = nullptr;
+    const char* psStarQuery = nullptr;
+
+    while(*psQuery)
     {
-        if(*psWildcard=='?')
+        if(*psWildcard=='*')
+        {
+            psStarWildcard = ++psWildcard;
+            psStarQuery = psQuery;
+        }
+        else if(*psWildcard=='?' || *psWildcard==*psQuery)
         {
-            if(!*psQuery)
-                return false;
-
             ++psQuery;
             ++psWildcard;
         }
-        else if(*psWildcard=='*')
+        else if(psStarWildcard)
         {
-            if(MatchesWildcard(psQuery,psWildcard+1))
-                return true;
-
-            if(*psQuery && MatchesWildcard(psQuery+1,psWildcard))
-                return true;
-
-            return false;
+            psWildcard = psStarWildcard;
+            psQuery = ++psStarQuery;
         }
         else
         {
-            if(*psQuery++ != *psWildcard++ )
-                return false;
+            return false;
         }
     }
 
-    return !*psQuery && !*psWildcard;
+    while(*psWildcard=='*') ++psWildcard;
+    return !*psWildcard;
+}
+
+bool NaturalLess(const std::string& a, const std::string& b)
+{
+    size_t i = 0, j = 0;
+    while(i < a.size() && j < b.size()) {
+        if(isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j])) {
+            // Compare digit runs by value: skip leading zeros, then the
+            // longer run is larger, otherwise compare lexically.
+            size_t ie = i, je = j;
+            while(ie < a.size() && isdigit((unsigned char)a[ie])) ++ie;
+            while(je < b.size() && isdigit((unsigned char)b[je])) ++je;
+            size_t iz = i, jz = j;
+            while(iz + 1 < ie && a[iz] == '0') ++iz;
+            while(jz + 1 < je && b[jz] == '0') ++jz;
+            if(ie - iz != je - jz) return ie - iz < je - jz;
+            const int c = a.compare(iz, ie - iz, b, jz, je - jz);
+            if(c != 0) return c < 0;
+            // Equal value: fewer leading zeros first.
+            if(ie - i != je - j) return ie - i < je - j;
+            i = ie;
+            j = je;
+        }else{
+            if(a[i] != b[j]) return (unsigned char)a[i] < (unsigned char)b[j];
+            ++i;
+            ++j;
+        }
+    }
+    return a.size() - i < b.size() - j;
 }
 
 std::string MakeUniqueFilename(const std::string& filename)
@@ -425,8 +491,7 @@ bool FilesMatchingWildcard(const std::string& wildcard, std::vector<std::string>
         FindClose(fh);
     }
 
-    // TOOD: Use different comparison to achieve better ordering.
-    std::sort(files.begin(), files.end() );
+    std::sort(files.begin(), files.end(), NaturalLess);
 
     // Put file list at end of file_vec
     file_vec.insert(file_vec.end(), files.begin(), files.end() );
@@ -434,6 +499,11 @@ bool FilesMatchingWildcard(const std::string& wildcard, std::vector<std::string>
     return files.size() > 0;
 }
 
+bool FilesMatchingWildcardCached(const std::string& wildcard, std::vector<std::string>& file_vec, const std::string& /*cache_dir*/)
+{
+    return FilesMatchingWildcard(wildcard, file_vec);
+}
+
 bool FileExists(const std::string& filename)
 {
     std::string search_filename = filename;
@@ -449,40 +519,437 @@ bool FileExists(const std::string& filename)
 
 #else // _WIN_
 
-bool FilesMatchingWildcard(const std::string& in_wildcard, std::vector<std::string>& file_vec)
+namespace {
+
+struct DirEntry
 {
-    const std::string wildcard = PathExpand(in_wildcard);
-    const size_t first_wildcard = wildcard.find_first_of("?*");
-    if(first_wildcard != std::string::npos) {
+    std::string name;
+    unsigned char type;
+};
+
+struct ListingDir
+{
+    std::string path;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+void StatMTime(const struct stat& st, int64_t& sec, int64_t& nsec)
+{
+#ifdef __APPLE__
+    sec = st.st_mtimespec.tv_sec;
+    nsec = st.st_mtimespec.tv_nsec;
+#else
+    sec = st.st_mtim.tv_sec;
+    nsec = st.st_mtim.tv_nsec;
+#endif
+}
+
+// Read every entry of directory 'path' (excluding . and ..) in large
+// batches, and return the directory's mtime as seen when it was opened.
+bool ReadDirectory(const std::string& path, std::vector<DirEntry>& entries, ListingDir& listed)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    listed.path = path;
+    StatMTime(st, listed.mtime_sec, listed.mtime_nsec);
+
+    auto add = [&entries](const char* name, unsigned char type) {
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) return;
+        entries.push_back({name, type});
+    };
+
+#if defined(__linux__) && defined(SYS_getdents64)
+    // struct linux_dirent64 { u64 d_ino; s64 d_off; u16 d_reclen; u8 d_type; char d_name[]; }
+    std::vector<char> buffer(1 << 20);
+    while(true) {
+        const long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if(n < 0) {
+            close(fd);
+            return false;
+        }
+        if(n == 0) break;
+        for(long pos = 0; pos < n; ) {
+            const char* d = buffer.data() + pos;
+            uint16_t reclen;
+            memcpy(&reclen, d + 16, sizeof(reclen));
+            add(d + 19, (unsigned char)d[18]);
+            pos += reclen;
+        }
+    }
+    close(fd);
+#else
+    DIR* dir = fdopendir(fd);
+    if(!dir) {
+        close(fd);
+        return false;
+    }
+    while(struct dirent* d = readdir(dir)) {
+        add(d->d_name, d->d_type);
+    }
+    closedir(dir);
+#endif
+    return true;
+}
+
+// Expands a wildcard one path component at a time. Each directory is read
+// once in bulk, files are only stat'd when no wildcard is present and
+// sibling directories are visited concurrently, up to a fixed thread budget.
+class WildcardWalker
+{
+public:
+    explicit WildcardWalker(int max_threads)
+        : spare_threads(max_threads)
+    {
+    }
+
+    void Match(const std::string& wildcard, std::vector<std::string>& out)
+    {
+        const size_t first_wildcard = wildcard.find_first_of("?*");
+        if(first_wildcard == std::string::npos) {
+            // Whether or not it exists, creating or removing it changes
+            // the parent directory.
+            struct stat st;
+            if(stat(wildcard.c_str(), &st) == 0) {
+                out.push_back(wildcard);
+            }
+            DependOnParent(wildcard);
+            return;
+        }
+
         const std::string root = PathParent(wildcard.substr(0,first_wildcard));
-        struct dirent **namelist;
-        int n = scandir(root.c_str(), &namelist, 0, alphasort );
-        if (n >= 0) {
-            const size_t next_slash = wildcard.find_first_of("/\\",first_wildcard+1);
-            std::string dir_wildcard, rest;
-            if(next_slash != std::string::npos) {
-                dir_wildcard = wildcard.substr(root.size()+1, next_slash-root.size()-1);
-                rest = wildcard.substr(next_slash);
+        std::vector<DirEntry> entries;
+        ListingDir listed;
+        if(!ReadDirectory(root, entries, listed)) {
+            DependOnParent(root);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> l(dirs_mutex);
+            dirs.push_back(listed);
+        }
+
+        const size_t next_slash = wildcard.find_first_of("/\\",first_wildcard+1);
+        std::string dir_wildcard, rest;
+        if(next_slash != std::string::npos) {
+            dir_wildcard = wildcard.substr(root.size()+1, next_slash-root.size()-1);
+            rest = wildcard.substr(next_slash);
+        }else{
+            dir_wildcard = wildcard.substr(root.size()+1);
+        }
+
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const DirEntry& e){
+            return !MatchesWildcard(e.name, dir_wildcard);
+        }), entries.end());
+        std::sort(entries.begin(), entries.end(), [](const DirEntry& a, const DirEntry& b){
+            return NaturalLess(a.name, b.name);
+        });
+
+        struct Item
+        {
+            std::string path;
+            bool recurse;
+            std::vector<std::string> files;
+        };
+        std::vector<Item> items;
+        items.reserve(entries.size());
+        for(const DirEntry& e : entries) {
+            const std::string path = root + "/" + e.name;
+            const bool maybe_dir = e.type == DT_DIR || e.type == DT_UNKNOWN || e.type == DT_LNK;
+            if(rest.empty()) {
+                items.push_back({path, false, {}});
+            }else if(maybe_dir) {
+                items.push_back({path + rest, true, {}});
+            }
+            if(dir_wildcard == "**" && maybe_dir) {
+                items.push_back({path + "/**" + rest, true, {}});
+            }
+        }
+
+        std::vector<std::future<void>> pending;
+        for(Item& item : items) {
+            if(!item.recurse) continue;
+            if(spare_threads.fetch_sub(1) > 0) {
+                pending.push_back(std::async(std::launch::async, [this,&item](){
+                    Match(item.path, item.files);
+                    spare_threads.fetch_add(1);
+                }));
             }else{
-                dir_wildcard = wildcard.substr(root.size()+1);
+                spare_threads.fetch_add(1);
+                Match(item.path, item.files);
             }
+        }
+        for(auto& f : pending) f.get();
 
-            while(n--) {
-                const std::string file_name(namelist[n]->d_name);
-                if( file_name != "." && file_name != ".." && MatchesWildcard(file_name, dir_wildcard) ) {
-                    const std::string sub_wildcard = root + "/" + file_name + rest;
-                    FilesMatchingWildcard(sub_wildcard, file_vec);
-                    if(dir_wildcard == "**") {
-                        const std::string sub_wildcard2 = root + "/" + file_name + "/**" + rest;
-                        FilesMatchingWildcard(sub_wildcard2, file_vec);
-                    }
-                }
+        for(Item& item : items) {
+            if(item.recurse) {
+                out.insert(out.end(), item.files.begin(), item.files.end());
+            }else{
+                out.push_back(std::move(item.path));
             }
         }
-    }else if(FileExists(wildcard)) {
-        file_vec.push_back(wildcard);
     }
-    return file_vec.size() > 0;
+
+    std::vector<ListingDir> dirs;
+
+private:
+    // Record the mtime of the nearest existing directory above path
+    void DependOnParent(const std::string& path)
+    {
+        std::string parent = path;
+        while(true) {
+            const size_t slash = parent.find_last_of('/');
+            if(slash == std::string::npos) {
+                parent = ".";
+            }else{
+                parent = slash == 0 ? std::string("/") : parent.substr(0, slash);
+            }
+
+            struct stat st;
+            if(stat(parent.c_str(), &st) == 0) {
+                ListingDir d;
+                d.path = parent;
+                StatMTime(st, d.mtime_sec, d.mtime_nsec);
+                std::lock_guard<std::mutex> l(dirs_mutex);
+                dirs.push_back(d);
+                return;
+            }
+            if(parent == "." || parent == "/") return;
+        }
+    }
+
+    std::mutex dirs_mutex;
+    std::atomic<int> spare_threads;
+};
+
+const int WILDCARD_WALK_THREADS = 8;
+const char LISTING_CACHE_MAGIC[8] = {'P','A','N','G','L','S','T','2'};
+
+// Directories modified this close to (or after) the start of a listing may
+// have changed again within their mtime granularity, so a listing which
+// depends on them is never reused.
+const int64_t LISTING_CACHE_MTIME_MARGIN_NS = 2000000000;
+
+std::string ListingCacheDir()
+{
+    if(const char* xdg = getenv("XDG_CACHE_HOME")) {
+        if(*xdg) return std::string(xdg) + "/pangolin";
+    }
+    if(const char* home = getenv("HOME")) {
+        return std::string(home) + "/.cache/pangolin";
+    }
+    return std::string();
+}
+
+template<typename T>
+void WritePod(std::ostream& os, const T& v)
+{
+    os.write((const char*)&v, sizeof(T));
+}
+
+// Cursor over a cache file held in memory. Reads fail rather than run past
+// the end, so corrupt lengths can't cause large allocations.
+struct CacheCursor
+{
+    const char* pos;
+    const char* end;
+
+    template<typename T>
+    bool Pod(T& v)
+    {
+        if((size_t)(end - pos) < sizeof(T)) return false;
+        memcpy(&v, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool String(std::string& s)
+    {
+        uint32_t n;
+        if(!Pod(n) || (size_t)(end - pos) < n) return false;
+        s.assign(pos, n);
+        pos += n;
+        return true;
+    }
+};
+
+void WriteString(std::ostream& os, const std::string& s)
+{
+    WritePod(os, (uint32_t)s.size());
+    os.write(s.data(), s.size());
+}
+
+int64_t ToNs(int64_t sec, int64_t nsec)
+{
+    return sec * 1000000000 + nsec;
+}
+
+int64_t WallClockNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ToNs(ts.tv_sec, ts.tv_nsec);
+}
+
+// Cache layout: magic, wildcard, time the listing started, directories
+// listed (with mtimes), then each file as an index into the directory
+// table and its leaf name.
+bool ReadListingCache(const std::string& cache_file, const std::string& wildcard, std::vector<std::string>& files)
+{
+    std::ifstream is(cache_file, std::ios::binary);
+    if(!is.is_open()) return false;
+    const std::vector<char> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    CacheCursor c = {data.data(), data.data() + data.size()};
+
+    std::string cached_wildcard;
+    int64_t listing_ns;
+    if( data.size() < sizeof(LISTING_CACHE_MAGIC) || memcmp(c.pos, LISTING_CACHE_MAGIC, sizeof(LISTING_CACHE_MAGIC)) )
+    {
+        return false;
+    }
+    c.pos += sizeof(LISTING_CACHE_MAGIC);
+    if(!c.String(cached_wildcard) || cached_wildcard != wildcard || !c.Pod(listing_ns)) {
+        return false;
+    }
+
+    uint32_t num_dirs;
+    if(!c.Pod(num_dirs) || num_dirs > (size_t)(c.end - c.pos)) return false;
+    std::vector<std::string> dirs(num_dirs);
+    for(std::string& dir : dirs) {
+        int64_t sec, nsec;
+        if(!c.String(dir) || !c.Pod(sec) || !c.Pod(nsec)) return false;
+        if(ToNs(sec, nsec) >= listing_ns - LISTING_CACHE_MTIME_MARGIN_NS) return false;
+        struct stat st;
+        if(stat(dir.c_str(), &st) != 0) return false;
+        int64_t now_sec, now_nsec;
+        StatMTime(st, now_sec, now_nsec);
+        if(now_sec != sec || now_nsec != nsec) return false;
+    }
+
+    uint64_t num_files;
+    if(!c.Pod(num_files) || num_files > (size_t)(c.end - c.pos)) return false;
+    std::vector<std::string> cached;
+    cached.reserve(num_files);
+    std::string name;
+    for(uint64_t i=0; i < num_files; ++i) {
+        uint32_t dir;
+        if(!c.Pod(dir) || dir >= dirs.size() || !c.String(name)) return false;
+        cached.push_back(dirs[dir] + "/" + name);
+    }
+
+    files.insert(files.end(), cached.begin(), cached.end());
+    return true;
+}
+
+void WriteListingCache(const std::string& cache_dir, const std::string& cache_file, const std::string& wildcard,
+                       int64_t listing_ns, std::vector<ListingDir> dirs, const std::vector<std::string>& files)
+{
+    std::map<std::string,uint32_t> dir_index;
+    for(const ListingDir& d : dirs) {
+        dir_index.emplace(d.path, (uint32_t)dir_index.size());
+    }
+    // dirs may contain duplicates (e.g. via '**'); keep the first of each.
+    std::vector<ListingDir> unique_dirs(dir_index.size());
+    for(const ListingDir& d : dirs) {
+        unique_dirs[dir_index[d.path]] = d;
+    }
+
+    std::vector<std::pair<uint32_t,std::string>> entries;
+    entries.reserve(files.size());
+    for(const std::string& f : files) {
+        const size_t slash = f.find_last_of('/');
+        const std::string parent = slash == std::string::npos ? std::string(".") : f.substr(0, slash);
+        auto it = dir_index.find(parent);
+        if(it == dir_index.end()) {
+            // Literal path with no wildcard: depend on its parent instead.
+            struct stat st;
+            if(stat(parent.c_str(), &st) != 0) return;
+            ListingDir d;
+            d.path = parent;
+            StatMTime(st, d.mtime_sec, d.mtime_nsec);
+            it = dir_index.emplace(parent, (uint32_t)unique_dirs.size()).first;
+            unique_dirs.push_back(d);
+        }
+        entries.emplace_back(it->second, slash == std::string::npos ? f : f.substr(slash+1));
+    }
+
+    mkdir(PathParent(cache_dir).c_str(), 0755);
+    mkdir(cache_dir.c_str(), 0755);
+
+    // Write to a temporary and rename so that concurrent readers never see
+    // a partial cache.
+    const std::string tmp_file = cache_file + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream os(tmp_file, std::ios::binary);
+        if(!os.is_open()) return;
+        os.write(LISTING_CACHE_MAGIC, sizeof(LISTING_CACHE_MAGIC));
+        WriteString(os, wildcard);
+        WritePod(os, listing_ns);
+        WritePod(os, (uint32_t)unique_dirs.size());
+        for(const ListingDir& d : unique_dirs) {
+            WriteString(os, d.path);
+            WritePod(os, d.mtime_sec);
+            WritePod(os, d.mtime_nsec);
+        }
+        WritePod(os, (uint64_t)entries.size());
+        for(const auto& e : entries) {
+            WritePod(os, e.first);
+            WriteString(os, e.second);
+        }
+        if(!os) {
+            os.close();
+            unlink(tmp_file.c_str());
+            return;
+        }
+    }
+    if(rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+        unlink(tmp_file.c_str());
+    }
+}
+
+}
+
+bool FilesMatchingWildcard(const std::string& in_wildcard, std::vector<std::string>& file_vec)
+{
+    const std::string wildcard = PathExpand(in_wildcard);
+    WildcardWalker walker(WILDCARD_WALK_THREADS);
+    const size_t num_before = file_vec.size();
+    walker.Match(wildcard, file_vec);
+    return file_vec.size() > num_before;
+}
+
+bool FilesMatchingWildcardCached(const std::string& in_wildcard, std::vector<std::string>& file_vec, const std::string& in_cache_dir)
+{
+    const std::string wildcard = PathExpand(in_wildcard);
+    const std::string cache_dir = in_cache_dir.empty() ? ListingCacheDir() : PathExpand(in_cache_dir);
+    if(cache_dir.empty()) {
+        return FilesMatchingWildcard(wildcard, file_vec);
+    }
+
+    std::ostringstream cache_name;
+    cache_name << cache_dir << "/listing_" << std::hex << std::hash<std::string>()(wildcard) << ".bin";
+    const std::string cache_file = cache_name.str();
+
+    const size_t num_before = file_vec.size();
+    if(ReadListingCache(cache_file, wildcard, file_vec)) {
+        return file_vec.size() > num_before;
+    }
+
+    WildcardWalker walker(WILDCARD_WALK_THREADS);
+    std::vector<std::string> files;
+    const int64_t listing_ns = WallClockNs();
+    walker.Match(wildcard, files);
+    if(!files.empty()) {
+        WriteListingCache(cache_dir, cache_file, wildcard, listing_ns, std::move(walker.dirs), files);
+    }
+    file_vec.insert(file_vec.end(), files.begin(), files.end());
+    return file_vec.size() > num_before;
 }
 
 bool FileExists(const std::string& filename)
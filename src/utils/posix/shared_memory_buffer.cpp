@@ -69,6 +69,11 @@ public:
     return _ptr;
   }
 
+  size_t size()
+  {
+    return _size;
+  }
+
   std::string name()
   {
     return _name;
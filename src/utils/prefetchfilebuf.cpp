@@ -0,0 +1,338 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/prefetchfilebuf.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef _WIN_
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace pangolin
+{
+
+namespace
+{
+const size_t block_align = 4096;
+}
+
+prefetchfilebuf::prefetchfilebuf()
+    : fd(-1), file_size(0), block_size(0), read_ahead_blocks(0), arena(nullptr), arena_registered(false),
+      current(-1), seek_pos(0), use_counter(0)
+{
+}
+
+prefetchfilebuf::~prefetchfilebuf()
+{
+    close();
+}
+
+bool prefetchfilebuf::open(const std::string& filename, size_t read_ahead_bytes, size_t block_size_bytes, AsyncFileIOBackend backend)
+{
+    close();
+
+#ifdef _WIN_
+    return false;
+#else
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd == -1) return false;
+
+    block_size = std::max(block_align, (block_size_bytes + block_align - 1) / block_align * block_align);
+    read_ahead_blocks = std::max<size_t>(1, read_ahead_bytes / block_size);
+
+    io = AsyncFileIO::Create(read_ahead_blocks + 1, backend);
+    if(!io) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // One block being consumed, read_ahead_blocks in flight and one spare
+    // for reads after a seek.
+    const size_t num_blocks = read_ahead_blocks + 2;
+    void* ptr = nullptr;
+    if(posix_memalign(&ptr, block_align, num_blocks * block_size) != 0) {
+        close();
+        return false;
+    }
+    arena = static_cast<char*>(ptr);
+    arena_registered = io->RegisterBuffers({{arena, num_blocks * block_size}});
+
+    blocks.resize(num_blocks);
+    for(size_t i=0; i < num_blocks; ++i) {
+        blocks[i] = {arena + i * block_size, 0, 0, BlockEmpty, 0};
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    refresh_file_size();
+    current = -1;
+    seek_pos = 0;
+    setg(nullptr, nullptr, nullptr);
+    return true;
+#endif
+}
+
+void prefetchfilebuf::close()
+{
+    // Outstanding reads must finish before their buffers are freed.
+    io.reset();
+    blocks.clear();
+    free(arena);
+    arena = nullptr;
+    arena_registered = false;
+
+#ifndef _WIN_
+    if(fd != -1) ::close(fd);
+#endif
+    fd = -1;
+    file_size = 0;
+    current = -1;
+    seek_pos = 0;
+    setg(nullptr, nullptr, nullptr);
+}
+
+bool prefetchfilebuf::is_open() const
+{
+    return fd != -1;
+}
+
+const char* prefetchfilebuf::backend_name() const
+{
+    return io ? io->Name() : "";
+}
+
+void prefetchfilebuf::refresh_file_size()
+{
+#ifndef _WIN_
+    struct stat st;
+    if(fd != -1 && fstat(fd, &st) == 0) {
+        file_size = static_cast<uint64_t>(st.st_size);
+    }
+#endif
+}
+
+uint64_t prefetchfilebuf::position() const
+{
+    return current >= 0 ? blocks[current].offset + static_cast<uint64_t>(gptr() - eback()) : seek_pos;
+}
+
+int prefetchfilebuf::find_block(uint64_t pos) const
+{
+    int pending = -1;
+    for(size_t i=0; i < blocks.size(); ++i) {
+        const Block& b = blocks[i];
+        if(b.state != BlockEmpty && b.offset <= pos && pos < b.offset + b.size) {
+            if(b.state == BlockReady) return static_cast<int>(i);
+            pending = static_cast<int>(i);
+        }
+    }
+    return pending;
+}
+
+int prefetchfilebuf::claim_block(uint64_t window_begin, uint64_t window_end, bool wait)
+{
+    while(true) {
+        int best = -1;
+        for(size_t i=0; i < blocks.size(); ++i) {
+            const Block& b = blocks[i];
+            if(static_cast<int>(i) == current || b.state == BlockPending) continue;
+            if(b.state == BlockEmpty) return static_cast<int>(i);
+            const bool in_window = b.offset < window_end && window_begin < b.offset + b.size;
+            if(!in_window && (best == -1 || b.last_use < blocks[best].last_use)) {
+                best = static_cast<int>(i);
+            }
+        }
+        if(best != -1 || !wait) return best;
+
+        // Everything is in flight or wanted; recycle whatever lands first.
+        if(io->InFlight()) {
+            reap(1);
+        }else{
+            window_end = window_begin;
+        }
+    }
+}
+
+void prefetchfilebuf::submit(int b, uint64_t offset)
+{
+    Block& blk = blocks[b];
+    blk.offset = offset;
+    blk.size = static_cast<size_t>(std::min<uint64_t>(block_size, file_size - offset));
+    blk.state = BlockPending;
+
+    while(!io->Submit({AsyncFileIO::Read, fd, blk.data, blk.size, offset, static_cast<uint64_t>(b), arena_registered ? 0 : -1})) {
+        reap(1);
+    }
+}
+
+void prefetchfilebuf::reap(size_t min_complete)
+{
+    std::vector<AsyncFileIO::Completion> done;
+    io->Wait(done, min_complete);
+    for(const auto& c : done) {
+        Block& blk = blocks[c.user_data];
+        if(c.result > 0) {
+            blk.size = static_cast<size_t>(c.result);
+            blk.state = BlockReady;
+        }else{
+            blk.size = 0;
+            blk.state = BlockEmpty;
+        }
+    }
+}
+
+void prefetchfilebuf::prefetch(std::streampos pos, size_t len)
+{
+    if(!io || pos < 0) return;
+
+    const uint64_t begin = static_cast<uint64_t>(pos);
+    if(begin >= file_size) return;
+    const uint64_t end = begin + std::min<uint64_t>(len, file_size - begin);
+
+    for(uint64_t off = begin; off < end; ) {
+        const int b = find_block(off);
+        if(b >= 0) {
+            off = blocks[b].offset + blocks[b].size;
+            continue;
+        }
+        if(io->InFlight() >= io->QueueDepth()) break;
+        const int c = claim_block(begin, end, false);
+        if(c < 0) break;
+        submit(c, off);
+        off += blocks[c].size;
+    }
+    io->Flush();
+}
+
+void prefetchfilebuf::read_ahead(uint64_t from)
+{
+    const uint64_t begin = blocks[current].offset;
+    const uint64_t end = std::min<uint64_t>(from + read_ahead_blocks * block_size, file_size);
+
+    for(uint64_t off = from; off < end; ) {
+        const int b = find_block(off);
+        if(b >= 0) {
+            off = blocks[b].offset + blocks[b].size;
+            continue;
+        }
+        if(io->InFlight() >= io->QueueDepth()) break;
+        const int c = claim_block(begin, end, false);
+        if(c < 0) break;
+        submit(c, off);
+        off += blocks[c].size;
+    }
+    io->Flush();
+}
+
+prefetchfilebuf::int_type prefetchfilebuf::underflow()
+{
+    if(!io) return traits_type::eof();
+    if(current >= 0 && gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    const uint64_t pos = position();
+    current = -1;
+    seek_pos = pos;
+    setg(nullptr, nullptr, nullptr);
+
+    if(pos >= file_size) {
+        refresh_file_size();
+        if(pos >= file_size) return traits_type::eof();
+    }
+
+    reap(0);
+
+    int b = find_block(pos);
+    if(b < 0) {
+        b = claim_block(pos, pos + read_ahead_blocks * block_size, true);
+        submit(b, pos / block_align * block_align);
+        io->Flush();
+    }
+
+    while(blocks[b].state == BlockPending) {
+        reap(1);
+    }
+
+    Block& blk = blocks[b];
+    if(blk.state != BlockReady || pos >= blk.offset + blk.size) {
+        // Read error, or the file was truncated beneath us
+        return traits_type::eof();
+    }
+
+    current = b;
+    blk.last_use = ++use_counter;
+    setg(blk.data, blk.data + (pos - blk.offset), blk.data + blk.size);
+    read_ahead(blk.offset + blk.size);
+
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize prefetchfilebuf::showmanyc()
+{
+    const uint64_t pos = position();
+    return pos < file_size ? static_cast<std::streamsize>(file_size - pos) : -1;
+}
+
+std::streampos prefetchfilebuf::seekoff(std::streamoff off, std::ios_base::seekdir way, std::ios_base::openmode which)
+{
+    if(!io || !(which & std::ios_base::in)) return std::streampos(std::streamoff(-1));
+
+    std::streamoff base = 0;
+    if(way == std::ios_base::cur) {
+        base = static_cast<std::streamoff>(position());
+    }else if(way == std::ios_base::end) {
+        refresh_file_size();
+        base = static_cast<std::streamoff>(file_size);
+    }
+
+    if(base + off < 0) return std::streampos(std::streamoff(-1));
+    return seekpos(std::streampos(base + off), which);
+}
+
+std::streampos prefetchfilebuf::seekpos(std::streampos pos, std::ios_base::openmode which)
+{
+    if(!io || !(which & std::ios_base::in) || pos < 0) return std::streampos(std::streamoff(-1));
+
+    const uint64_t p = static_cast<uint64_t>(std::streamoff(pos));
+    if(current >= 0 && blocks[current].offset <= p && p < blocks[current].offset + blocks[current].size) {
+        setg(eback(), eback() + (p - blocks[current].offset), egptr());
+    }else{
+        current = -1;
+        seek_pos = p;
+        setg(nullptr, nullptr, nullptr);
+    }
+    return pos;
+}
+
+}
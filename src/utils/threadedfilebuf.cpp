@@ -25,11 +25,17 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+
 #include <pangolin/utils/threadedfilebuf.h>
+#include <pangolin/utils/async_file_io.h>
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/utils/sigstate.h>
+#include <pangolin/utils/trace.h>
 
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <stdexcept>
 
 #ifdef USE_POSIX_FILE_IO
@@ -42,18 +48,64 @@ using namespace std;
 namespace pangolin
 {
 
+namespace
+{
+// Size of the put area used to coalesce small writes
+const std::streamsize put_area_size = 64*1024;
+
+// Alignment of buffer, offsets and sizes required by O_DIRECT
+const std::streamsize direct_align = 4096;
+
+// Largest write issued in FileWriteModeDirect
+const std::streamsize max_block_size = 8*1024*1024;
+
+inline std::streamsize round_up(std::streamsize x, std::streamsize a)
+{
+    return (x + a - 1) / a * a;
+}
+
+inline double seconds_since(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+}
+
 threadedfilebuf::threadedfilebuf()
-    : mem_buffer(0), mem_size(0), mem_max_size(0), mem_start(0), mem_end(0), should_run(false), is_pipe(false)
+    : put_area(0), write_mode(FileWriteModeSync), sync_interval_bytes(0), bytes_since_sync(0), block_size(1),
+      mem_buffer(0), mem_size(0), mem_max_size(0), mem_start(0), mem_end(0), write_pending(0), producers_waiting(0), should_run(false), is_pipe(false), stats()
 {
 }
 
-threadedfilebuf::threadedfilebuf(const std::string& filename, size_t buffer_size_bytes )
-    : mem_buffer(0), mem_size(0), mem_max_size(0), mem_start(0), mem_end(0), should_run(false), is_pipe(pangolin::IsPipe(filename))
+threadedfilebuf::threadedfilebuf(const std::string& filename, size_t buffer_size_bytes, FileWriteMode mode, size_t sync_interval_bytes )
+    : put_area(0), write_mode(mode), sync_interval_bytes(sync_interval_bytes), bytes_since_sync(0), block_size(1),
+      mem_buffer(0), mem_size(0), mem_max_size(0), mem_start(0), mem_end(0), write_pending(0), producers_waiting(0), should_run(false), is_pipe(pangolin::IsPipe(filename)), stats()
 {
-    open(filename, buffer_size_bytes);
+    open(filename, buffer_size_bytes, mode, sync_interval_bytes);
 }
 
-void threadedfilebuf::open(const std::string& filename, size_t buffer_size_bytes)
+char* threadedfilebuf::alloc_buffer(std::streamsize size)
+{
+#ifdef USE_POSIX_FILE_IO
+    void* ptr = nullptr;
+    if(posix_memalign(&ptr, direct_align, static_cast<size_t>(size)) != 0) {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(ptr);
+#else
+    return new char[static_cast<size_t>(size)];
+#endif
+}
+
+void threadedfilebuf::free_buffer(char* buffer)
+{
+#ifdef USE_POSIX_FILE_IO
+    free(buffer);
+#else
+    delete [] buffer;
+#endif
+}
+
+void threadedfilebuf::open(const std::string& filename, size_t buffer_size_bytes, FileWriteMode mode, size_t sync_interval)
 {
     is_pipe = pangolin::IsPipe(filename);
 
@@ -65,9 +117,26 @@ void threadedfilebuf::open(const std::string& filename, size_t buffer_size_bytes
         close();
     }
 
+    write_mode = is_pipe ? FileWriteModeSync : mode;
+    sync_interval_bytes = sync_interval;
+    bytes_since_sync = 0;
+
 #ifdef USE_POSIX_FILE_IO
-    filenum = ::open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_SYNC, S_IRWXU);
+    const int flags = O_CREAT | O_TRUNC | O_WRONLY;
+    if(write_mode == FileWriteModeDirect) {
+        filenum = ::open(filename.c_str(), flags | O_DIRECT, S_IRWXU);
+        if(filenum == -1 && errno == EINVAL) {
+            pango_print_warn("threadedfilebuf: O_DIRECT unsupported for '%s', using buffered writes.\n", filename.c_str());
+            write_mode = FileWriteModeBuffered;
+        }
+    }
+    if(write_mode == FileWriteModeSync) {
+        filenum = ::open(filename.c_str(), flags | O_SYNC, S_IRWXU);
+    }else if(write_mode == FileWriteModeBuffered) {
+        filenum = ::open(filename.c_str(), flags, S_IRWXU);
+    }
 #else
+    write_mode = FileWriteModeSync;
     file.open(filename.c_str(), ios::out | ios::binary);
 #endif
 
@@ -79,12 +148,30 @@ void threadedfilebuf::open(const std::string& filename, size_t buffer_size_bytes
         throw std::runtime_error("Unable to open '" + filename + "' for writing.");
     }
 
-    mem_buffer = 0;
+    // Direct writes are whole blocks from an aligned buffer whose size is
+    // a multiple of the block size, so every write stays aligned.
+    mem_max_size = static_cast<std::streamsize>(buffer_size_bytes);
+    if(write_mode == FileWriteModeDirect) {
+        block_size = std::max(direct_align, std::min(max_block_size, mem_max_size / 4 / direct_align * direct_align));
+        mem_max_size = round_up(std::max(mem_max_size, block_size), block_size);
+    }else{
+        block_size = 1;
+    }
+
     mem_size = 0;
     mem_start = 0;
     mem_end = 0;
-    mem_max_size = static_cast<std::streamsize>(buffer_size_bytes);
-    mem_buffer = new char[static_cast<size_t>(mem_max_size)];
+    write_pending = 0;
+    producers_waiting = 0;
+    mem_buffer = alloc_buffer(mem_max_size);
+
+    put_area = new char[static_cast<size_t>(put_area_size)];
+    setp(put_area, put_area + put_area_size);
+    input_pos = 0;
+
+    stats = Stats();
+    stats.buffer_bytes = static_cast<size_t>(mem_max_size);
+    open_time = std::chrono::steady_clock::now();
 
     should_run = true;
     write_thread = std::thread(std::ref(*this));
@@ -92,6 +179,8 @@ void threadedfilebuf::open(const std::string& filename, size_t buffer_size_bytes
 
 void threadedfilebuf::close()
 {
+    flush_put_area();
+
     should_run = false;
 
     cond_queued.notify_all();
@@ -103,11 +192,22 @@ void threadedfilebuf::close()
 
     if(mem_buffer)
     {
-        delete [] mem_buffer;
+        stats.elapsed_seconds = seconds_since(open_time);
+        free_buffer(mem_buffer);
         mem_buffer = 0;
     }
 
+    if(put_area)
+    {
+        delete [] put_area;
+        put_area = 0;
+        setp(0, 0);
+    }
+
 #ifdef USE_POSIX_FILE_IO
+    if(filenum != -1 && write_mode != FileWriteModeSync) {
+        fdatasync(filenum);
+    }
     ::close(filenum);
     filenum = -1;
 #else
@@ -123,6 +223,8 @@ void threadedfilebuf::soft_close()
 
 void threadedfilebuf::force_close()
 {
+    // Discard coalesced writes too
+    setp(pbase(), epptr());
     soft_close();
     close();
 }
@@ -132,99 +234,330 @@ threadedfilebuf::~threadedfilebuf()
     close();
 }
 
+threadedfilebuf::Stats threadedfilebuf::GetStats() const
+{
+    std::unique_lock<std::mutex> lock(update_mutex);
+    Stats s = stats;
+    s.queued_bytes = static_cast<size_t>(mem_size);
+    s.elapsed_seconds = mem_buffer ? seconds_since(open_time) : stats.elapsed_seconds;
+    return s;
+}
+
+void threadedfilebuf::flush_put_area()
+{
+    const std::streamsize n = pptr() - pbase();
+    if(n > 0) {
+        enqueue(pbase(), n);
+        setp(pbase(), epptr());
+    }
+}
+
+int threadedfilebuf::sync()
+{
+    flush_put_area();
+    return 0;
+}
+
 std::streamsize threadedfilebuf::xsputn(const char* data, std::streamsize num_bytes)
 {
-    if( num_bytes > mem_max_size ) {
+    if(num_bytes > epptr() - pptr()) {
+        flush_put_area();
+    }
+
+    if(num_bytes <= epptr() - pptr()) {
+        // Coalesce small writes
+        memcpy(pptr(), data, static_cast<size_t>(num_bytes));
+        pbump(static_cast<int>(num_bytes));
+    }else{
+        enqueue(data, num_bytes);
+    }
+
+    return num_bytes;
+}
+
+int threadedfilebuf::overflow(int c)
+{
+    flush_put_area();
+
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+        if(pptr() == epptr()) {
+            const char ch = traits_type::to_char_type(c);
+            enqueue(&ch, 1);
+        }else{
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+    }
+
+    return traits_type::not_eof(c);
+}
+
+void threadedfilebuf::write_segments(const Segment* segments, size_t num_segments)
+{
+    flush_put_area();
+    enqueue(segments, num_segments);
+}
+
+void threadedfilebuf::enqueue(const char* data, std::streamsize num_bytes)
+{
+    const Segment segment = {data, num_bytes};
+    enqueue(&segment, 1);
+}
+
+void threadedfilebuf::enqueue(const Segment* segments, size_t num_segments)
+{
+    std::streamsize num_bytes = 0;
+    for(size_t i=0; i < num_segments; ++i) {
+        num_bytes += segments[i].size;
+    }
+    if(num_bytes == 0) return;
+
+    // In FileWriteModeDirect up to direct_align bytes can stay queued until
+    // more data arrives, so the request must fit alongside them.
+    const std::streamsize residual = (write_mode == FileWriteModeDirect) ? direct_align : 0;
+    if( num_bytes > mem_max_size - residual ) {
         std::unique_lock<std::mutex> lock(update_mutex);
-        // Wait until queue is empty
-        while( mem_size > 0 ) {
+        // Wait until the writer isn't using the buffer. Queued data is
+        // carried over, so this doesn't depend on the writer draining it.
+        while( write_pending > 0 ) {
             cond_dequeued.wait(lock);
         }
 
-        // Allocate bigger buffer
-        delete [] mem_buffer;
+        // Allocate bigger buffer, moving queued data to its start
+        const std::streamsize new_max_size = round_up(num_bytes * 4, block_size);
+        char* new_buffer = alloc_buffer(new_max_size);
+        const std::streamsize array_a_size = std::min(mem_size, mem_max_size - mem_start);
+        memcpy(new_buffer, mem_buffer + mem_start, static_cast<size_t>(array_a_size));
+        memcpy(new_buffer + array_a_size, mem_buffer, static_cast<size_t>(mem_size - array_a_size));
+        free_buffer(mem_buffer);
+        mem_buffer = new_buffer;
+        mem_max_size = new_max_size;
         mem_start = 0;
-        mem_end = 0;
-        mem_max_size = num_bytes * 4;
-        mem_buffer = new char[static_cast<size_t>(mem_max_size)];
+        mem_end = mem_size;
+        stats.buffer_bytes = static_cast<size_t>(mem_max_size);
     }
 
     {
         std::unique_lock<std::mutex> lock(update_mutex);
         
         // wait until there is space to write into buffer
-        while( mem_size + num_bytes > mem_max_size ) {
-            cond_dequeued.wait(lock);
+        if( mem_size + num_bytes > mem_max_size ) {
+            ++stats.producer_stalls;
+            PANGOLIN_TRACE_SCOPE("threadedfilebuf::WaitForSpace", "io");
+            // Ask the writer to flush partial blocks until we can continue
+            ++producers_waiting;
+            cond_queued.notify_one();
+            while( mem_size + num_bytes > mem_max_size ) {
+                cond_dequeued.wait(lock);
+            }
+            --producers_waiting;
         }
         
-        // add image to end of mem_buffer
-        const std::streamsize array_a_size =
-                (mem_start <= mem_end) ? (mem_max_size - mem_end) : (mem_start - mem_end);
-        
-        if( num_bytes <= array_a_size )
-        {
-            // copy in one
-            memcpy(mem_buffer + mem_end, data, static_cast<size_t>(num_bytes));
-            mem_end += num_bytes;
-            mem_size += num_bytes;
-        }else{
-            const std::streamsize array_b_size = num_bytes - array_a_size;
-            memcpy(mem_buffer + mem_end, data, (size_t)array_a_size);
-            memcpy(mem_buffer, data+array_a_size, (size_t)array_b_size);
-            mem_end = array_b_size;
-            mem_size += num_bytes;
+        // add segments to end of mem_buffer
+        for(size_t i=0; i < num_segments; ++i) {
+            const char* data = segments[i].data;
+            const std::streamsize size = segments[i].size;
+            const std::streamsize array_a_size = mem_max_size - mem_end;
+
+            if( size <= array_a_size )
+            {
+                // copy in one
+                memcpy(mem_buffer + mem_end, data, static_cast<size_t>(size));
+                mem_end += size;
+            }else{
+                const std::streamsize array_b_size = size - array_a_size;
+                memcpy(mem_buffer + mem_end, data, (size_t)array_a_size);
+                memcpy(mem_buffer, data+array_a_size, (size_t)array_b_size);
+                mem_end = array_b_size;
+            }
+
+            if(mem_end == mem_max_size)
+                mem_end = 0;
         }
-        
-        if(mem_end == mem_max_size)
-            mem_end = 0;
+        mem_size += num_bytes;
+
+        stats.peak_queued_bytes = std::max(stats.peak_queued_bytes, static_cast<size_t>(mem_size));
     }
     
     cond_queued.notify_one();
     
     input_pos += num_bytes;
-    return num_bytes;
 }
 
-int threadedfilebuf::overflow(int c)
+std::streampos threadedfilebuf::seekoff(
+    std::streamoff off, std::ios_base::seekdir way,
+    std::ios_base::openmode /*which*/
+) {
+    if(off == 0 && way == ios_base::cur) {
+        return input_pos + std::streamoff(pptr() - pbase());
+    }else{
+        return -1;
+    }
+}
+
+bool threadedfilebuf::write_async()
 {
-    const std::streamsize num_bytes = 1;
+#ifdef USE_POSIX_FILE_IO
+    std::unique_ptr<AsyncFileIO> io = AsyncFileIO::Create(threadedfilebuf_async_depth);
+    if(!io) return false;
+
+    // Writes in submission order. Completions may arrive in any order, but
+    // queue space is only released from the front.
+    struct Chunk { std::streamsize size; bool done; };
+    std::deque<Chunk> in_flight;
+    std::streamsize in_flight_bytes = 0;
+    uint64_t file_offset = 0;
+    char* registered = nullptr;
+    std::vector<AsyncFileIO::Completion> completions;
 
+    while(true)
     {
-        std::unique_lock<std::mutex> lock(update_mutex);
+        char* buffer = nullptr;
+        std::streamsize submit_pos = 0;
+        std::streamsize data_to_write = 0;
 
-        // wait until there is space to write into buffer
-        while( mem_size + num_bytes > mem_max_size ) {
-            cond_dequeued.wait(lock);
+        {
+            std::unique_lock<std::mutex> lock(update_mutex);
+
+            // Sleep only if nothing is in flight; otherwise reap below.
+            while( in_flight.empty() && should_run && mem_size < block_size && !flush_partial() ) {
+                cond_queued.wait(lock);
+            }
+
+            const std::streamsize pending = mem_size - in_flight_bytes;
+            if(!should_run && pending == 0 && in_flight.empty()) {
+                break;
+            }
+
+            if(pending > 0 && in_flight.size() < io->QueueDepth() && (pending >= block_size || !should_run || flush_partial())) {
+                submit_pos = (mem_start + in_flight_bytes) % mem_max_size;
+                data_to_write = std::min(std::min(pending, mem_max_size - submit_pos), max_block_size);
+                if(data_to_write >= block_size) {
+                    data_to_write = data_to_write / block_size * block_size;
+                }else if(should_run && write_mode == FileWriteModeDirect) {
+                    // Partial block for a stalled producer; the unaligned
+                    // remainder waits for more data.
+                    data_to_write = data_to_write / direct_align * direct_align;
+                }
+                buffer = mem_buffer;
+            }
+
+            if(data_to_write > 0 && write_mode == FileWriteModeDirect && data_to_write % direct_align != 0) {
+                if(in_flight.empty()) {
+                    // Unaligned tail on close can't be written with O_DIRECT
+                    fcntl(filenum, F_SETFL, fcntl(filenum, F_GETFL) & ~O_DIRECT);
+                    write_mode = FileWriteModeBuffered;
+                }else{
+                    data_to_write = 0;
+                }
+            }
+            write_pending += data_to_write;
         }
 
-        // add image to end of mem_buffer
-        mem_buffer[mem_end] = c;
-        mem_end += num_bytes;
-        mem_size += num_bytes;
+        if(data_to_write > 0) {
+            // The queue is only reallocated while nothing is pending, so
+            // nothing using the old registration is in flight.
+            if(buffer != registered) {
+                io->RegisterBuffers({{buffer, static_cast<size_t>(mem_max_size)}});
+                registered = buffer;
+            }
+            PANGOLIN_TRACE_SCOPE("threadedfilebuf::Submit", "io");
+            io->Submit({AsyncFileIO::Write, filenum, buffer + submit_pos, static_cast<size_t>(data_to_write),
+                        file_offset, file_offset, 0});
+            io->Flush();
+            in_flight.push_back({data_to_write, false});
+            in_flight_bytes += data_to_write;
+            file_offset += static_cast<uint64_t>(data_to_write);
+        }
 
-        if(mem_end == mem_max_size)
-            mem_end = 0;
-    }
+        // Block for a completion only if we can't submit more.
+        const bool can_submit_more = data_to_write > 0 && in_flight.size() < io->QueueDepth();
+        const auto wait_start = std::chrono::steady_clock::now();
+        completions.clear();
+        {
+            PANGOLIN_TRACE_SCOPE("threadedfilebuf::Wait", "io");
+            io->Wait(completions, can_submit_more ? 0 : 1);
+        }
+        const double wait_seconds = seconds_since(wait_start);
 
-    cond_queued.notify_one();
+        const uint64_t front_offset = file_offset - static_cast<uint64_t>(in_flight_bytes);
+        for(const auto& c : completions) {
+            if(c.result < 0) {
+                throw std::runtime_error("Unable to write data.");
+            }
+            // Locate chunk by its file offset
+            uint64_t offset = front_offset;
+            for(Chunk& chunk : in_flight) {
+                if(offset == c.user_data) {
+                    const std::streamsize written = static_cast<std::streamsize>(c.result);
+                    if(written < chunk.size) {
+                        // Finish short writes synchronously
+                        const ssize_t r = ::pwrite(filenum, registered + ((mem_start + (offset - front_offset)) % mem_max_size) + written,
+                                                   static_cast<size_t>(chunk.size - written), static_cast<off_t>(offset + written));
+                        if(r != chunk.size - written) {
+                            throw std::runtime_error("Unable to write data.");
+                        }
+                    }
+                    chunk.done = true;
+                    break;
+                }
+                offset += static_cast<uint64_t>(chunk.size);
+            }
+        }
 
-    input_pos += num_bytes;
-    return num_bytes;
-}
+        std::streamsize released = 0;
+        while(!in_flight.empty() && in_flight.front().done) {
+            released += in_flight.front().size;
+            in_flight.pop_front();
+        }
 
-std::streampos threadedfilebuf::seekoff(
-    std::streamoff off, std::ios_base::seekdir way,
-    std::ios_base::openmode /*which*/
-) {
-    if(off == 0 && way == ios_base::cur) {
-        return input_pos;
-    }else{
-        return -1;
+        if(released || completions.size()) {
+            if(released && write_mode == FileWriteModeBuffered && sync_interval_bytes) {
+                bytes_since_sync += released;
+                if(bytes_since_sync >= sync_interval_bytes) {
+                    fdatasync(filenum);
+                    bytes_since_sync = 0;
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(update_mutex);
+                in_flight_bytes -= released;
+                write_pending -= released;
+                mem_size -= released;
+                mem_start = (mem_start + released) % mem_max_size;
+                stats.bytes_written += released;
+                stats.write_calls += completions.size();
+                stats.write_seconds += wait_seconds;
+            }
+
+            cond_dequeued.notify_all();
+        }
+    }
+
+    if(registered) {
+        io->UnregisterBuffers();
     }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool threadedfilebuf::flush_partial() const
+{
+    const std::streamsize min_write = (write_mode == FileWriteModeDirect) ? direct_align : 1;
+    return producers_waiting > 0 && mem_size - write_pending >= min_write;
 }
 
 void threadedfilebuf::operator()()
 {
+    TraceSetThreadName("threadedfilebuf writer");
+
+    if(write_mode != FileWriteModeSync && write_async()) {
+        return;
+    }
+
     std::streamsize data_to_write = 0;
     
     while(true)
@@ -247,8 +580,13 @@ void threadedfilebuf::operator()()
         {
             std::unique_lock<std::mutex> lock(update_mutex);
             
-            while( mem_size == 0 ) {
-                if(!should_run) return;
+            // Wait for a full block, or whatever remains once closing. A
+            // stalled producer gets whatever can be written now.
+            while( mem_size < block_size && !flush_partial() ) {
+                if(!should_run) {
+                    if(mem_size == 0) return;
+                    break;
+                }
                 cond_queued.wait(lock);
             }
 
@@ -256,27 +594,60 @@ void threadedfilebuf::operator()()
                     (mem_start < mem_end) ?
                         mem_end - mem_start :
                         mem_max_size - mem_start;
+
+            if(write_mode == FileWriteModeDirect) {
+                if(data_to_write >= block_size) {
+                    data_to_write = std::min(data_to_write, max_block_size) / block_size * block_size;
+                }else if(should_run) {
+                    data_to_write = data_to_write / direct_align * direct_align;
+                }
+            }
+            write_pending = data_to_write;
         }
 
+        PANGOLIN_TRACE_SCOPE("threadedfilebuf::write", "io");
+        const auto write_start = std::chrono::steady_clock::now();
+
 #ifdef USE_POSIX_FILE_IO
-        int bytes_written = ::write(filenum, mem_buffer + mem_start, data_to_write);
+        if(write_mode == FileWriteModeDirect && data_to_write % direct_align != 0) {
+            // Unaligned tail on close can't be written with O_DIRECT
+            fcntl(filenum, F_SETFL, fcntl(filenum, F_GETFL) & ~O_DIRECT);
+            write_mode = FileWriteModeBuffered;
+        }
+
+        ssize_t bytes_written = ::write(filenum, mem_buffer + mem_start, data_to_write);
         if(bytes_written == -1)
         {
             throw std::runtime_error("Unable to write data.");
         }
+
+        if(write_mode == FileWriteModeBuffered && sync_interval_bytes) {
+            bytes_since_sync += bytes_written;
+            if(bytes_since_sync >= sync_interval_bytes) {
+                fdatasync(filenum);
+                bytes_since_sync = 0;
+            }
+        }
 #else
         std::streamsize bytes_written =
                 file.sputn(mem_buffer + mem_start, data_to_write );
 #endif
 
+        const double write_seconds = seconds_since(write_start);
+
         {
             std::unique_lock<std::mutex> lock(update_mutex);
             
             mem_size -= bytes_written;
             mem_start += bytes_written;
+            write_pending = 0;
             
             if(mem_start == mem_max_size)
                 mem_start = 0;
+
+            stats.bytes_written += bytes_written;
+            stats.write_calls++;
+            stats.write_seconds += write_seconds;
         }
         
         cond_dequeued.notify_all();
@@ -0,0 +1,345 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/trace.h>
+#include <pangolin/utils/log.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pangolin
+{
+
+namespace detail
+{
+std::atomic<bool> trace_enabled(false);
+}
+
+namespace
+{
+
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+// Events are stored in fixed chunks which are never moved or freed, so the
+// writer can read a thread's buffer while its owner keeps appending.
+const size_t trace_chunk_events = 4096;
+const size_t trace_max_chunks = 1024;
+
+// Written only by its owning thread. A buffer is handed to a new thread once
+// its owner exits, so short-lived workers (e.g. std::async tasks) share rows.
+// The viewer labels a whole row with one name, so unnamed buffers are only
+// reused by unnamed threads and named buffers only by threads of that name.
+struct ThreadTraceBuffer
+{
+    ThreadTraceBuffer(uint32_t tid, const std::string& name)
+        : tid(tid), name(name), in_use(true), shared(false), count(0), generation(0), dropped(0)
+    {
+        for(size_t c=0; c < trace_max_chunks; ++c) {
+            chunks[c].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    const uint32_t tid;
+    std::string name;   // guarded by TraceRegistry::mutex
+    bool in_use;        // guarded by TraceRegistry::mutex
+    bool shared;        // guarded by TraceRegistry::mutex, had previous owners
+    std::atomic<size_t> count;
+    std::atomic<uint64_t> generation;
+    std::atomic<size_t> dropped;
+    std::atomic<TraceEvent*> chunks[trace_max_chunks];
+};
+
+struct TraceRegistry
+{
+    TraceRegistry()
+        : generation(1), origin_ns(0), atexit_registered(false)
+    {
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTraceBuffer>> buffers;
+    std::string filename;
+    std::atomic<uint64_t> generation;
+    std::atomic<int64_t> origin_ns;
+    bool atexit_registered;
+};
+
+// Intentionally leaked: buffers must outlive any thread still recording
+// while statics are destroyed at exit.
+TraceRegistry& Registry()
+{
+    static TraceRegistry* registry = new TraceRegistry();
+    return *registry;
+}
+
+int64_t SteadyNs(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+struct ThreadTraceHandle
+{
+    ThreadTraceHandle()
+        : buffer(nullptr)
+    {
+    }
+
+    ~ThreadTraceHandle()
+    {
+        if(buffer) {
+            TraceRegistry& r = Registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            buffer->in_use = false;
+        }
+    }
+
+    ThreadTraceBuffer* Get()
+    {
+        if(!buffer) {
+            TraceRegistry& r = Registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            Acquire(r, std::string());
+        }
+        return buffer;
+    }
+
+    void SetName(const std::string& name)
+    {
+        TraceRegistry& r = Registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if(buffer) {
+            if(buffer->name == name) return;
+            if(buffer->name.empty() && !buffer->shared) {
+                // Only this thread's events are on the row
+                buffer->name = name;
+                return;
+            }
+            // Keep earlier events under the name they were recorded with
+            buffer->in_use = false;
+            buffer = nullptr;
+        }
+        Acquire(r, name);
+    }
+
+    // Take a free buffer with this name, or a new one. Requires r.mutex.
+    void Acquire(TraceRegistry& r, const std::string& name)
+    {
+        for(auto& b : r.buffers) {
+            if(!b->in_use && b->name == name) {
+                buffer = b.get();
+                buffer->in_use = true;
+                buffer->shared = true;
+                return;
+            }
+        }
+        r.buffers.emplace_back(new ThreadTraceBuffer((uint32_t)r.buffers.size() + 1, name));
+        buffer = r.buffers.back().get();
+    }
+
+    ThreadTraceBuffer* buffer;
+};
+
+thread_local ThreadTraceHandle thread_trace;
+
+void WriteJsonString(FILE* f, const std::string& s)
+{
+    std::fputc('"', f);
+    for(char c : s) {
+        if(c == '"' || c == '\\') {
+            std::fputc('\\', f);
+            std::fputc(c, f);
+        }else if((unsigned char)c < 0x20) {
+            std::fprintf(f, "\\u%04x", (unsigned)c);
+        }else{
+            std::fputc(c, f);
+        }
+    }
+    std::fputc('"', f);
+}
+
+void TraceAtExit()
+{
+    if(TraceEnabled()) {
+        TraceStop();
+    }
+}
+
+struct TraceEnvironmentInit
+{
+    TraceEnvironmentInit()
+    {
+        const char* filename = std::getenv("PANGOLIN_TRACE");
+        if(filename && *filename) {
+            TraceStart(filename);
+        }
+    }
+};
+
+TraceEnvironmentInit trace_environment_init;
+
+}
+
+namespace detail
+{
+
+void TraceRecord(const char* name, const char* category, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    ThreadTraceBuffer* b = thread_trace.Get();
+    TraceRegistry& r = Registry();
+
+    // Lazily discard events from before the latest TraceStart()
+    const uint64_t generation = r.generation.load(std::memory_order_acquire);
+    if(b->generation.load(std::memory_order_relaxed) != generation) {
+        b->count.store(0, std::memory_order_relaxed);
+        b->dropped.store(0, std::memory_order_relaxed);
+        b->generation.store(generation, std::memory_order_release);
+    }
+
+    const size_t i = b->count.load(std::memory_order_relaxed);
+    const size_t c = i / trace_chunk_events;
+    if(c >= trace_max_chunks) {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent* chunk = b->chunks[c].load(std::memory_order_relaxed);
+    if(!chunk) {
+        chunk = new TraceEvent[trace_chunk_events];
+        b->chunks[c].store(chunk, std::memory_order_release);
+    }
+
+    const int64_t start_ns = SteadyNs(start);
+    chunk[i % trace_chunk_events] = {name, category, start_ns - r.origin_ns.load(std::memory_order_relaxed), SteadyNs(end) - start_ns};
+    b->count.store(i + 1, std::memory_order_release);
+}
+
+}
+
+void TraceStart(const std::string& filename)
+{
+    TraceRegistry& r = Registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.filename = filename;
+    r.origin_ns.store(SteadyNs(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    r.generation.fetch_add(1, std::memory_order_acq_rel);
+    if(!filename.empty() && !r.atexit_registered) {
+        std::atexit(&TraceAtExit);
+        r.atexit_registered = true;
+    }
+    detail::trace_enabled.store(true, std::memory_order_release);
+}
+
+void TraceStop()
+{
+    detail::trace_enabled.store(false, std::memory_order_release);
+
+    std::string filename;
+    {
+        TraceRegistry& r = Registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::swap(filename, r.filename);
+    }
+
+    if(!filename.empty() && !TraceWrite(filename)) {
+        pango_print_error("Unable to write trace file '%s'\n", filename.c_str());
+    }
+}
+
+size_t TraceEventCount()
+{
+    TraceRegistry& r = Registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const uint64_t generation = r.generation.load(std::memory_order_acquire);
+    size_t total = 0;
+    for(auto& b : r.buffers) {
+        if(b->generation.load(std::memory_order_acquire) == generation) {
+            total += b->count.load(std::memory_order_acquire);
+        }
+    }
+    return total;
+}
+
+void TraceSetThreadName(const std::string& name)
+{
+    thread_trace.SetName(name);
+}
+
+bool TraceWrite(const std::string& filename)
+{
+    FILE* f = std::fopen(filename.c_str(), "w");
+    if(!f) return false;
+
+    TraceRegistry& r = Registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const uint64_t generation = r.generation.load(std::memory_order_acquire);
+
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    bool first = true;
+    size_t dropped = 0;
+    for(auto& b : r.buffers) {
+        // Rows with nothing since the latest TraceStart() are left out
+        if(b->generation.load(std::memory_order_acquire) != generation) continue;
+
+        if(!b->name.empty()) {
+            std::fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", b->tid);
+            WriteJsonString(f, b->name);
+            std::fputs("}}", f);
+            first = false;
+        }
+
+        const size_t n = b->count.load(std::memory_order_acquire);
+        dropped += b->dropped.load(std::memory_order_relaxed);
+        for(size_t i=0; i < n; ++i) {
+            const TraceEvent& e = b->chunks[i / trace_chunk_events].load(std::memory_order_acquire)[i % trace_chunk_events];
+            std::fprintf(f, "%s{\"ph\":\"X\",\"name\":", first ? "" : ",\n");
+            WriteJsonString(f, e.name);
+            std::fputs(",\"cat\":", f);
+            WriteJsonString(f, e.category);
+            std::fprintf(f, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", b->tid, e.start_ns * 1e-3, e.duration_ns * 1e-3);
+            first = false;
+        }
+    }
+    std::fputs("\n]}\n", f);
+
+    if(dropped) {
+        pango_print_warn("Trace buffers full, %zu events were not recorded\n", dropped);
+    }
+
+    return std::fclose(f) == 0;
+}
+
+}
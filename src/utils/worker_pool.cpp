@@ -0,0 +1,125 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/worker_pool.h>
+
+#include <algorithm>
+
+namespace pangolin
+{
+
+size_t DefaultWorkerThreads(size_t max_threads)
+{
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(max_threads, cores));
+}
+
+WorkerPool::WorkerPool(size_t num_threads)
+    : job(nullptr), job_size(0), next(0), busy(0), generation(0), quit(false)
+{
+    for(size_t i=0; i < num_threads; ++i) {
+        workers.emplace_back(&WorkerPool::Run, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond_start.notify_all();
+    for(std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void WorkerPool::ParallelFor(size_t n, const std::function<void(size_t)>& fn)
+{
+    if(workers.empty() || n < 2) {
+        for(size_t i=0; i < n; ++i) fn(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(call_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        job_size = n;
+        next = 0;
+        error = nullptr;
+        ++generation;
+    }
+    cond_start.notify_all();
+
+    RunJob(fn, n);
+
+    std::exception_ptr e;
+    {
+        // Workers which haven't picked the job up by now never will
+        std::unique_lock<std::mutex> lock(mutex);
+        cond_done.wait(lock, [this](){ return busy == 0; });
+        job = nullptr;
+        e = error;
+    }
+    if(e) std::rethrow_exception(e);
+}
+
+void WorkerPool::Run()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        cond_start.wait(lock, [&](){ return quit || generation != seen; });
+        if(quit) return;
+        seen = generation;
+        if(!job) continue;
+
+        const std::function<void(size_t)>& fn = *job;
+        const size_t n = job_size;
+        ++busy;
+        lock.unlock();
+        RunJob(fn, n);
+        lock.lock();
+        if(--busy == 0) cond_done.notify_all();
+    }
+}
+
+void WorkerPool::RunJob(const std::function<void(size_t)>& fn, size_t n)
+{
+    for(size_t i = next++; i < n; i = next++) {
+        try {
+            fn(i);
+        }catch(...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!error) error = std::current_exception();
+        }
+    }
+}
+
+}
@@ -0,0 +1,224 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/video/drivers/convert.h>
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/image/image_convert.h>
+#include <pangolin/utils/file_utils.h>
+#include <pangolin/video/iostream_operators.h>
+
+#ifdef HAVE_FFMPEG
+#include <pangolin/video/drivers/ffmpeg.h>
+#endif
+
+#include <cmath>
+#include <limits>
+
+namespace pangolin
+{
+
+ConvertVideo::ConvertVideo(std::unique_ptr<VideoInterface>& src_, PixelFormat out_fmt, float scale, float offset)
+    : src(std::move(src_)), offset(offset), size_bytes(0), buffer(0), stats("convert")
+{
+    if( !src ) {
+        throw VideoException("ConvertVideo: VideoInterface in must not be null");
+    }
+
+    videoin.push_back(src.get());
+
+    for(size_t s=0; s< src->Streams().size(); ++s) {
+        const StreamInfo& in = src->Streams()[s];
+        if(!CanConvertImage(in.PixFormat(), out_fmt)) {
+            throw VideoException("ConvertVideo: Unable to convert " + in.PixFormat().format + " to " + out_fmt.format);
+        }
+
+        const size_t pitch = (in.Width()*out_fmt.bpp)/ 8;
+        streams.push_back(pangolin::StreamInfo( out_fmt, in.Width(), in.Height(), pitch, (unsigned char*)0 + size_bytes ));
+        scales.push_back(std::isnan(scale) ? DefaultConvertScale(in.PixFormat(), out_fmt) : scale);
+        size_bytes += in.Height()*pitch;
+    }
+
+    buffer = new unsigned char[src->SizeBytes()];
+}
+
+ConvertVideo::~ConvertVideo()
+{
+    delete[] buffer;
+}
+
+//! Implement VideoInput::Start()
+void ConvertVideo::Start()
+{
+    videoin[0]->Start();
+}
+
+//! Implement VideoInput::Stop()
+void ConvertVideo::Stop()
+{
+    videoin[0]->Stop();
+}
+
+//! Implement VideoInput::SizeBytes()
+size_t ConvertVideo::SizeBytes() const
+{
+    return size_bytes;
+}
+
+//! Implement VideoInput::Streams()
+const std::vector<StreamInfo>& ConvertVideo::Streams() const
+{
+    return streams;
+}
+
+void ConvertVideo::Process(unsigned char* image, const unsigned char* buffer)
+{
+    VideoStats::Scope process_scope(stats, VideoStatsProcess);
+    stats.AddFrames();
+    stats.AddBytes(size_bytes);
+    for(size_t s=0; s<streams.size(); ++s) {
+        const StreamInfo& in = videoin[0]->Streams()[s];
+        const Image<unsigned char> img_in  = in.StreamImage(buffer);
+        Image<unsigned char> img_out = streams[s].StreamImage(image);
+        ConvertImage(img_out, streams[s].PixFormat(), img_in, in.PixFormat(), scales[s], offset);
+    }
+}
+
+//! Implement VideoInput::GrabNext()
+bool ConvertVideo::GrabNext( unsigned char* image, bool wait )
+{
+    if(videoin[0]->GrabNext(buffer,wait)) {
+        Process(image,buffer);
+        return true;
+    }else{
+        return false;
+    }
+}
+
+//! Implement VideoInput::GrabNewest()
+bool ConvertVideo::GrabNewest( unsigned char* image, bool wait )
+{
+    if(videoin[0]->GrabNewest(buffer,wait)) {
+        Process(image,buffer);
+        return true;
+    }else{
+        return false;
+    }
+}
+
+std::vector<VideoInterface*>& ConvertVideo::InputStreams()
+{
+    return videoin;
+}
+
+VideoStats& ConvertVideo::Stats()
+{
+    return stats;
+}
+
+uint32_t ConvertVideo::AvailableFrames() const
+{
+    BufferAwareVideoInterface* vpi = dynamic_cast<BufferAwareVideoInterface*>(videoin[0]);
+    if(!vpi)
+    {
+        pango_print_warn("Convert: child interface is not buffer aware.");
+        return 0;
+    }
+    else
+    {
+        return vpi->AvailableFrames();
+    }
+}
+
+bool ConvertVideo::DropNFrames(uint32_t n)
+{
+    BufferAwareVideoInterface* vpi = dynamic_cast<BufferAwareVideoInterface*>(videoin[0]);
+    if(!vpi)
+    {
+        pango_print_warn("Convert: child interface is not buffer aware.");
+        return false;
+    }
+    else
+    {
+        return vpi->DropNFrames(n);
+    }
+}
+
+const picojson::value& ConvertVideo::DeviceProperties() const
+{
+    VideoPropertiesInterface* vpi = dynamic_cast<VideoPropertiesInterface*>(videoin[0]);
+    return vpi ? vpi->DeviceProperties() : null_properties;
+}
+
+const picojson::value& ConvertVideo::FrameProperties() const
+{
+    VideoPropertiesInterface* vpi = dynamic_cast<VideoPropertiesInterface*>(videoin[0]);
+    return vpi ? vpi->FrameProperties() : null_properties;
+}
+
+PANGOLIN_REGISTER_FACTORY(ConvertVideo)
+{
+    struct ConvertVideoFactory final : public FactoryInterface<VideoInterface> {
+        std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
+            std::string fmt = uri.Get<std::string>("fmt", "RGB24");
+            ToUpper(fmt);
+            const float scale = uri.Get<float>("scale", std::numeric_limits<float>::quiet_NaN());
+            const float offset = uri.Get<float>("offset", 0.0f);
+            std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
+
+            // Leave conversions we can't do to the ffmpeg implementation,
+            // reusing the source we've already opened.
+            bool supported = true;
+            PixelFormat out_fmt;
+            try {
+                out_fmt = PixelFormatFromString(fmt);
+                for(const StreamInfo& si : subvid->Streams()) {
+                    supported = supported && CanConvertImage(si.PixFormat(), out_fmt);
+                }
+            }catch(const std::exception&) {
+                supported = false;
+            }
+
+            if(!supported) {
+#ifdef HAVE_FFMPEG
+                return std::unique_ptr<VideoInterface>( new FfmpegConverter(subvid, fmt, FFMPEG_POINT) );
+#else
+                return std::unique_ptr<VideoInterface>();
+#endif
+            }
+
+            return std::unique_ptr<VideoInterface>(
+                new ConvertVideo(subvid, out_fmt, scale, offset)
+            );
+        }
+    };
+
+    // Takes precedence over the ffmpeg (swscale) implementation of convert.
+    FactoryRegistry<VideoInterface>::I().RegisterFactory(std::make_shared<ConvertVideoFactory>(), 10, "convert");
+}
+
+}
@@ -25,7 +25,10 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <array>
+#include <future>
+#include <limits>
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/iostream_operators.h>
 #include <pangolin/utils/file_utils.h>
@@ -154,14 +157,24 @@ std::string FfmpegFmtToString(const AVPixelFormat fmt)
 
 #undef TEST_PIX_FMT_RETURN
 
-FfmpegVideo::FfmpegVideo(const std::string filename, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size)
-    :pFormatCtx(0)
+FfmpegVideo::FfmpegVideo(const std::string filename, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size, int threads, size_t decode_ahead)
+    :pFormatCtx(0), flushing(false), have_pending_frame(false), next_decode_id(0),
+     current_frame_id(std::numeric_limits<size_t>::max()),
+     index_started(false), index_ready(false), index_should_run(true),
+     decode_ahead(decode_ahead), decode_should_run(false), decode_eof(false)
 {
-    InitUrl(filename, strfmtout, codec_hint, dump_info, user_video_stream, size);
+    InitUrl(filename, strfmtout, codec_hint, dump_info, user_video_stream, size, threads);
+
+    for(size_t i=0; i < decode_ahead; ++i) {
+        queue_free.push_back( DecodedFrame{std::unique_ptr<uint8_t[]>(new uint8_t[numBytesOut]), 0} );
+    }
+    StartDecodeThread();
 }
 
-void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size)
+void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size, int threads)
 {
+    this->url = url;
+
     if( url.find('*') != url.npos )
         throw VideoException("Wildcards not supported. Please use ffmpegs printf style formatting for image sequences. e.g. img-000000%04d.ppm");
 
@@ -250,6 +263,12 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
     if(pVidCodec==0)
         throw VideoException("Codec not found");
 
+#ifdef FF_THREAD_FRAME
+    // Decode with frame and slice threads. 0 lets libavcodec pick.
+    pVidCodecCtx->thread_count = threads;
+    pVidCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#endif
+
     // Open video codec
 #if LIBAVCODEC_VERSION_MAJOR > 52
     if(avcodec_open2(pVidCodecCtx, pVidCodec,0)<0)
@@ -283,14 +302,9 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
     const int w = pVidCodecCtx->width;
     const int h = pVidCodecCtx->height;
 
-    // Determine required buffer size and allocate buffer
+    // Determine required buffer size
     numBytesOut=avpicture_get_size(fmtout, w, h);
 
-    buffer= new uint8_t[numBytesOut];
-
-    // Assign appropriate parts of buffer to image planes in pFrameRGB
-    avpicture_fill((AVPicture *)pFrameOut, buffer, fmtout, w, h);
-
     // Allocate SWS for converting pixel formats
     img_convert_ctx = sws_getContext(w, h,
                                      pVidCodecCtx->pix_fmt,
@@ -308,8 +322,14 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
 
 FfmpegVideo::~FfmpegVideo()
 {
+    StopDecodeThread();
+
+    index_should_run = false;
+    if(index_thread.joinable()) {
+        index_thread.join();
+    }
+
     // Free the RGB image
-    delete[] buffer;
     av_free(pFrameOut);
 
     // Free the YUV frame
@@ -342,36 +362,183 @@ size_t FfmpegVideo::SizeBytes() const
 
 void FfmpegVideo::Start()
 {
+    StartDecodeThread();
 }
 
 void FfmpegVideo::Stop()
 {
+    StopDecodeThread();
 }
 
-bool FfmpegVideo::GrabNext(unsigned char* image, bool /*wait*/)
+bool FfmpegVideo::DecodeFrame()
 {
+    if(have_pending_frame) {
+        // Frame left over from Seek()
+        have_pending_frame = false;
+        return true;
+    }
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,37,100)
+    while(true) {
+        const int ret = avcodec_receive_frame(pVidCodecCtx, pFrame);
+        if(ret == 0) {
+            return true;
+        }else if(ret == AVERROR_EOF) {
+            return false;
+        }else if(ret != AVERROR(EAGAIN)) {
+            throw VideoException("Error decoding video frame");
+        }
+
+        // Decoder needs more input
+        if(av_read_frame(pFormatCtx, &packet) < 0) {
+            if(flushing) return false;
+            // Enter draining mode to retrieve delayed frames
+            avcodec_send_packet(pVidCodecCtx, nullptr);
+            flushing = true;
+        }else{
+            if(packet.stream_index==videoStream) {
+                if(avcodec_send_packet(pVidCodecCtx, &packet) < 0) {
+                    pango_print_warn("FfmpegVideo: Dropping corrupt packet.\n");
+                }
+            }
+            av_packet_unref(&packet);
+        }
+    }
+#else
     int gotFrame = 0;
+    while(!gotFrame) {
+        if(!flushing && av_read_frame(pFormatCtx, &packet) < 0) {
+            flushing = true;
+        }
 
-    while(!gotFrame && av_read_frame(pFormatCtx, &packet)>=0)
-    {
-        // Is this a packet from the video stream?
-        if(packet.stream_index==videoStream)
-        {
-            // Decode video frame
+        if(flushing) {
+            // Empty packets retrieve frames delayed by frame threading
+            av_init_packet(&packet);
+            packet.data = nullptr;
+            packet.size = 0;
+            packet.stream_index = videoStream;
             avcodec_decode_video2(pVidCodecCtx, pFrame, &gotFrame, &packet);
+            return gotFrame != 0;
         }
 
-        // Did we get a video frame?
-        if(gotFrame) {
-            sws_scale(img_convert_ctx, pFrame->data, pFrame->linesize, 0, pVidCodecCtx->height, pFrameOut->data, pFrameOut->linesize);
-            memcpy(image,pFrameOut->data[0],numBytesOut);
+        if(packet.stream_index==videoStream) {
+            avcodec_decode_video2(pVidCodecCtx, pFrame, &gotFrame, &packet);
         }
-
-        // Free the packet that was allocated by av_read_frame
         av_free_packet(&packet);
     }
+    return true;
+#endif
+}
+
+void FfmpegVideo::ConvertFrame(unsigned char* image)
+{
+    // Convert straight into the destination buffer
+    avpicture_fill((AVPicture *)pFrameOut, image, fmtout, pVidCodecCtx->width, pVidCodecCtx->height);
+    sws_scale(img_convert_ctx, pFrame->data, pFrame->linesize, 0, pVidCodecCtx->height, pFrameOut->data, pFrameOut->linesize);
+}
+
+void FfmpegVideo::StartDecodeThread()
+{
+    if(!decode_ahead || decode_should_run) return;
+
+    if(decode_thread.joinable()) {
+        // Thread exited after reaching end of stream
+        decode_thread.join();
+    }
+
+    decode_should_run = true;
+    decode_eof = false;
+    decode_error = nullptr;
+    decode_thread = std::thread(&FfmpegVideo::DecodeThreadLoop, this);
+}
+
+void FfmpegVideo::StopDecodeThread()
+{
+    {
+        std::lock_guard<std::mutex> l(queue_mutex);
+        decode_should_run = false;
+    }
+    queue_cond.notify_all();
+
+    if(decode_thread.joinable()) {
+        decode_thread.join();
+    }
+}
+
+void FfmpegVideo::DecodeThreadLoop()
+{
+    try {
+        while(true) {
+            DecodedFrame frame;
+            {
+                std::unique_lock<std::mutex> l(queue_mutex);
+                queue_cond.wait(l, [this](){ return !decode_should_run || !queue_free.empty(); });
+                if(!decode_should_run) return;
+                frame = std::move(queue_free.back());
+                queue_free.pop_back();
+            }
+
+            const bool got_frame = DecodeFrame();
+            if(got_frame) {
+                ConvertFrame(frame.data.get());
+                frame.frame_id = next_decode_id++;
+            }
+
+            {
+                std::lock_guard<std::mutex> l(queue_mutex);
+                if(got_frame) {
+                    queue_ready.push_back(std::move(frame));
+                }else{
+                    queue_free.push_back(std::move(frame));
+                    decode_eof = true;
+                }
+            }
+            queue_cond.notify_all();
+
+            if(!got_frame) return;
+        }
+    }catch(...) {
+        {
+            std::lock_guard<std::mutex> l(queue_mutex);
+            decode_error = std::current_exception();
+            decode_eof = true;
+        }
+        queue_cond.notify_all();
+    }
+}
+
+bool FfmpegVideo::GrabNext(unsigned char* image, bool wait)
+{
+    if(!decode_ahead) {
+        if(!DecodeFrame()) return false;
+        ConvertFrame(image);
+        current_frame_id = next_decode_id++;
+        return true;
+    }
+
+    std::unique_lock<std::mutex> l(queue_mutex);
+    if(wait) {
+        queue_cond.wait(l, [this](){ return !queue_ready.empty() || decode_eof || !decode_should_run; });
+    }
 
-    return gotFrame;
+    if(queue_ready.empty()) {
+        if(decode_error) {
+            std::exception_ptr e = decode_error;
+            decode_error = nullptr;
+            std::rethrow_exception(e);
+        }
+        return false;
+    }
+
+    DecodedFrame frame = std::move(queue_ready.front());
+    queue_ready.pop_front();
+    memcpy(image, frame.data.get(), numBytesOut);
+    current_frame_id = frame.frame_id;
+    queue_free.push_back(std::move(frame));
+    l.unlock();
+    queue_cond.notify_all();
+
+    return true;
 }
 
 bool FfmpegVideo::GrabNewest(unsigned char *image, bool wait)
@@ -379,14 +546,273 @@ bool FfmpegVideo::GrabNewest(unsigned char *image, bool wait)
     return GrabNext(image,wait);
 }
 
-void FfmpegConverter::ConvertContext::convert(const unsigned char* src, unsigned char* dst)
+size_t FfmpegVideo::GetCurrentFrameId() const
+{
+    return current_frame_id;
+}
+
+size_t FfmpegVideo::GetTotalFrames() const
+{
+    BuildIndex();
+    return index_ready ? frame_pts.size() : 0;
+}
+
+void FfmpegVideo::BuildIndex() const
+{
+    if(index_started) return;
+    index_started = true;
+
+    // Devices and pipes can't be indexed or seeked
+    if(!pFormatCtx->pb || !pFormatCtx->pb->seekable || LoadContainerIndex()) {
+        index_ready = true;
+        return;
+    }
+
+    index_thread = std::thread(&FfmpegVideo::ScanIndex, this, pFormatCtx->iformat);
+}
+
+bool FfmpegVideo::LoadContainerIndex() const
+{
+    const AVStream* st = pFormatCtx->streams[videoStream];
+
+    // Index entries hold decode timestamps, which only match presentation
+    // timestamps for streams without reordered frames. The index must also
+    // cover every frame, not just keyframes or seek points.
+    if(pVidCodecCtx->has_b_frames || st->nb_frames <= 0 || st->nb_index_entries != st->nb_frames) {
+        return false;
+    }
+
+    std::vector<int64_t> pts, key_pts;
+    pts.reserve(st->nb_index_entries);
+    for(int i=0; i < st->nb_index_entries; ++i) {
+        const AVIndexEntry& e = st->index_entries[i];
+        if(e.timestamp == AV_NOPTS_VALUE) return false;
+        pts.push_back(e.timestamp);
+        if(e.flags & AVINDEX_KEYFRAME) {
+            key_pts.push_back(e.timestamp);
+        }
+    }
+
+    // A composition offset would make these disagree with decoded frames
+    if(key_pts.empty() || (st->start_time != AV_NOPTS_VALUE && pts.front() != st->start_time)) {
+        return false;
+    }
+
+    std::sort(pts.begin(), pts.end());
+    frame_pts.swap(pts);
+    keyframe_pts.swap(key_pts);
+    return true;
+}
+
+void FfmpegVideo::ScanIndex(AVInputFormat* iformat) const
+{
+    std::vector<int64_t> pts, key_pts;
+
+    // Demux (without decoding) through a second context so as not to
+    // disturb playback.
+    AVFormatContext* ctx = nullptr;
+    if(avformat_open_input(&ctx, url.c_str(), iformat, nullptr) < 0) {
+        pango_print_warn("FfmpegVideo: Unable to open '%s' for indexing.\n", url.c_str());
+        index_ready = true;
+        return;
+    }
+
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = nullptr;
+    pkt.size = 0;
+
+    bool valid = true;
+    while(index_should_run && av_read_frame(ctx, &pkt) >= 0) {
+        if(pkt.stream_index == videoStream) {
+            const int64_t ts = (pkt.pts != AV_NOPTS_VALUE) ? pkt.pts : pkt.dts;
+            if(ts == AV_NOPTS_VALUE) {
+                valid = false;
+            }else{
+                pts.push_back(ts);
+                if(pkt.flags & AV_PKT_FLAG_KEY) {
+                    key_pts.push_back(ts);
+                }
+            }
+        }
+        av_free_packet(&pkt);
+    }
+    avformat_close_input(&ctx);
+
+    if(!index_should_run) {
+        return;
+    }
+
+    if(!valid || key_pts.empty()) {
+        // e.g. raw elementary streams without timestamps
+        pango_print_warn("FfmpegVideo: '%s' lacks timestamps, seeking disabled.\n", url.c_str());
+    }else{
+        // Packets arrive in decode order
+        std::sort(pts.begin(), pts.end());
+        std::sort(key_pts.begin(), key_pts.end());
+        frame_pts.swap(pts);
+        keyframe_pts.swap(key_pts);
+    }
+    index_ready = true;
+}
+
+void FfmpegVideo::WaitForIndex() const
+{
+    BuildIndex();
+    if(index_thread.joinable()) {
+        index_thread.join();
+    }
+}
+
+size_t FfmpegVideo::Seek(size_t frameid)
+{
+    WaitForIndex();
+
+    const size_t next_frame_id = current_frame_id + 1;
+    if(frameid >= frame_pts.size()) {
+        return next_frame_id;
+    }
+
+    const bool was_running = decode_should_run;
+    StopDecodeThread();
+
+    // Discard frames decoded ahead of the old position
+    while(!queue_ready.empty()) {
+        queue_free.push_back(std::move(queue_ready.front()));
+        queue_ready.pop_front();
+    }
+
+    // Jump to the last keyframe at or before the target
+    const int64_t target_pts = frame_pts[frameid];
+    auto it_key = std::upper_bound(keyframe_pts.begin(), keyframe_pts.end(), target_pts);
+    const int64_t key_pts = (it_key == keyframe_pts.begin()) ? keyframe_pts.front() : *(it_key-1);
+
+    size_t result = next_frame_id;
+    if(av_seek_frame(pFormatCtx, videoStream, key_pts, AVSEEK_FLAG_BACKWARD) >= 0) {
+        avcodec_flush_buffers(pVidCodecCtx);
+        flushing = false;
+        have_pending_frame = false;
+
+        // Decode forward, holding on to the first frame at or after target
+        int64_t ts = AV_NOPTS_VALUE;
+        while(DecodeFrame()) {
+            ts = pFrame->best_effort_timestamp;
+            if(ts == AV_NOPTS_VALUE || ts >= target_pts) {
+                have_pending_frame = true;
+                break;
+            }
+        }
+
+        if(have_pending_frame) {
+            result = (ts == AV_NOPTS_VALUE) ? frameid :
+                std::lower_bound(frame_pts.begin(), frame_pts.end(), ts) - frame_pts.begin();
+        }else{
+            result = frame_pts.size();
+        }
+        next_decode_id = result;
+        current_frame_id = result - 1;
+    }else{
+        pango_print_warn("FfmpegVideo: Seek to frame %zu failed.\n", frameid);
+    }
+
+    if(was_running) StartDecodeThread();
+    return result;
+}
+
+// Pixel format conversion between equally sized images. The image is split
+// into horizontal bands, each with its own SwsContext, which can be
+// converted concurrently on a WorkerPool.
+class FfmpegSlicedScale
+{
+public:
+    FfmpegSlicedScale(int w, int h, AVPixelFormat fmtsrc, AVPixelFormat fmtdst, int flags, size_t max_slices = 0)
+        : desc_src(av_pix_fmt_desc_get(fmtsrc)), desc_dst(av_pix_fmt_desc_get(fmtdst))
+    {
+        if(!desc_src || !desc_dst)
+            throw VideoException("Unknown pixel format for conversion");
+
+        // Palette, bitstream and hardware formats can't be addressed by row
+        const uint64_t no_slice_flags = AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL;
+        const bool can_slice = !((desc_src->flags | desc_dst->flags) & no_slice_flags);
+
+        // Bands must start on whole chroma rows of both formats
+        const int align = 1 << std::max(desc_src->log2_chroma_h, desc_dst->log2_chroma_h);
+        const int min_band_rows = 32;
+
+        if(!max_slices) max_slices = DefaultWorkerThreads(std::numeric_limits<size_t>::max());
+        const int num_bands = can_slice ? (int)std::max<size_t>(1, std::min<size_t>(max_slices, h / min_band_rows)) : 1;
+
+        for(int i=0; i < num_bands; ++i) {
+            const int y0 = (int)((int64_t)h * i / num_bands) / align * align;
+            const int y1 = (i+1 == num_bands) ? h : (int)((int64_t)h * (i+1) / num_bands) / align * align;
+            Band band = {y0, y1-y0, sws_getContext(w, y1-y0, fmtsrc, w, y1-y0, fmtdst, flags, NULL, NULL, NULL)};
+            if(!band.ctx) {
+                for(Band& b : bands) sws_freeContext(b.ctx);
+                throw VideoException("Could not create SwScale context for pixel conversion");
+            }
+            bands.push_back(band);
+        }
+    }
+
+    ~FfmpegSlicedScale()
+    {
+        for(Band& b : bands) sws_freeContext(b.ctx);
+    }
+
+    size_t NumBands() const
+    {
+        return bands.size();
+    }
+
+    void ScaleBand(size_t i, uint8_t* const src[], const int src_stride[], uint8_t* const dst[], const int dst_stride[])
+    {
+        const Band& b = bands[i];
+        uint8_t* band_src[4];
+        uint8_t* band_dst[4];
+        OffsetPlanes(desc_src, src, src_stride, b.y, band_src);
+        OffsetPlanes(desc_dst, dst, dst_stride, b.y, band_dst);
+        sws_scale(b.ctx, band_src, src_stride, 0, b.h, band_dst, dst_stride);
+    }
+
+    void Scale(uint8_t* const src[], const int src_stride[], uint8_t* const dst[], const int dst_stride[], WorkerPool& workers)
+    {
+        workers.ParallelFor(bands.size(), [&](size_t i){
+            ScaleBand(i, src, src_stride, dst, dst_stride);
+        });
+    }
+
+protected:
+    struct Band
+    {
+        int y;
+        int h;
+        SwsContext* ctx;
+    };
+
+    static void OffsetPlanes(const AVPixFmtDescriptor* desc, uint8_t* const planes[], const int stride[], int y, uint8_t* out[4])
+    {
+        for(int p=0; p < 4; ++p) {
+            // Planes 1 and 2 hold (possibly subsampled) chroma
+            const int py = (p == 1 || p == 2) ? (y >> desc->log2_chroma_h) : y;
+            out[p] = planes[p] ? planes[p] + (ptrdiff_t)py * stride[p] : nullptr;
+        }
+    }
+
+    const AVPixFmtDescriptor* desc_src;
+    const AVPixFmtDescriptor* desc_dst;
+    std::vector<Band> bands;
+};
+
+void FfmpegConverter::ConvertContext::fill(const unsigned char* src, unsigned char* dst)
 {
     // avpicture_fill expects uint8_t* w/o const as the second parameter in earlier versions
     avpicture_fill((AVPicture*)avsrc, const_cast<unsigned char*>(src + src_buffer_offset), fmtsrc, w, h);
     avpicture_fill((AVPicture*)avdst, dst + dst_buffer_offset, fmtdst, w, h);
-    sws_scale(  img_convert_ctx,
-                avsrc->data, avsrc->linesize, 0, h,
-                avdst->data, avdst->linesize         );
+}
+
+void FfmpegConverter::ConvertContext::convert_band(size_t band)
+{
+    img_convert_ctx->ScaleBand(band, avsrc->data, avsrc->linesize, avdst->data, avdst->linesize);
 }
 
 FfmpegConverter::FfmpegConverter(std::unique_ptr<VideoInterface> &videoin_, const std::string sfmtdst, FfmpegMethod method )
@@ -409,13 +835,9 @@ FfmpegConverter::FfmpegConverter(std::unique_ptr<VideoInterface> &videoin_, cons
 
         converters[i].fmtdst = FfmpegFmtFromString(sfmtdst);
         converters[i].fmtsrc = FfmpegFmtFromString(instrm.PixFormat());
-        converters[i].img_convert_ctx = sws_getContext(
-            instrm.Width(), instrm.Height(), converters[i].fmtsrc,
-            instrm.Width(), instrm.Height(), converters[i].fmtdst,
-            method, NULL, NULL, NULL
+        converters[i].img_convert_ctx = std::make_shared<FfmpegSlicedScale>(
+            instrm.Width(), instrm.Height(), converters[i].fmtsrc, converters[i].fmtdst, method
         );
-        if(!converters[i].img_convert_ctx)
-            throw VideoException("Could not create SwScale context for pixel conversion");
 
         converters[i].dst_buffer_offset=dst_buffer_size;
         converters[i].src_buffer_offset=instrm.Offset() - (unsigned char*)0;
@@ -437,8 +859,15 @@ FfmpegConverter::FfmpegConverter(std::unique_ptr<VideoInterface> &videoin_, cons
 
         //src_buffer_size += instrm.SizeBytes();
         dst_buffer_size += avpicture_get_size(converters[i].fmtdst, instrm.Width(), instrm.Height());
+
+        for(size_t b=0; b < converters[i].img_convert_ctx->NumBands(); ++b) {
+            bands.emplace_back(i, b);
+        }
     }
 
+    // Bands of every stream share one pool, along with the grabbing thread
+    workers.reset(new WorkerPool(DefaultWorkerThreads(bands.size()) - 1));
+
 }
 
 FfmpegConverter::~FfmpegConverter()
@@ -470,13 +899,23 @@ const std::vector<StreamInfo>& FfmpegConverter::Streams() const
     return streams;
 }
 
+void FfmpegConverter::ConvertStreams(unsigned char* image)
+{
+    for(ConvertContext& c : converters) {
+        c.fill(input_buffer.get(), image);
+    }
+
+    // Bands of all streams are independent, so convert them concurrently
+    workers->ParallelFor(bands.size(), [&](size_t i){
+        converters[bands[i].first].convert_band(bands[i].second);
+    });
+}
+
 bool FfmpegConverter::GrabNext( unsigned char* image, bool wait )
 {
     if( videoin->GrabNext(input_buffer.get(),wait) )
     {
-        for(ConvertContext&c:converters) {
-            c.convert(input_buffer.get(),image);
-        }
+        ConvertStreams(image);
         return true;
     }
     return false;
@@ -486,9 +925,7 @@ bool FfmpegConverter::GrabNewest( unsigned char* image, bool wait )
 {
     if( videoin->GrabNewest(input_buffer.get(),wait) )
     {
-        for(ConvertContext&c:converters) {
-            c.convert(input_buffer.get(),image);
-        }
+        ConvertStreams(image);
         return true;
     }
     return false;
@@ -496,7 +933,7 @@ bool FfmpegConverter::GrabNewest( unsigned char* image, bool wait )
 
 // Based on this example
 // http://cekirdek.pardus.org.tr/~ismail/ffmpeg-docs/output-example_8c-source.html
-static AVStream* CreateStream(AVFormatContext *oc, CodecID codec_id, uint64_t frame_rate, int bit_rate, AVPixelFormat EncoderFormat, int width, int height)
+static AVStream* CreateStream(AVFormatContext *oc, CodecID codec_id, uint64_t frame_rate, int bit_rate, AVPixelFormat EncoderFormat, int width, int height, int threads, const std::string& preset, const std::string& tune)
 {
     AVCodec* codec = avcodec_find_encoder(codec_id);
     if (!(codec)) throw
@@ -529,6 +966,10 @@ static AVStream* CreateStream(AVFormatContext *oc, CodecID codec_id, uint64_t fr
         stream->codec->time_base.den = frame_rate;
         stream->codec->gop_size      = 12;
         stream->codec->pix_fmt       = EncoderFormat;
+#ifdef FF_THREAD_FRAME
+        stream->codec->thread_count  = threads;
+        stream->codec->thread_type   = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#endif
         break;
     default:
         break;
@@ -538,8 +979,17 @@ static AVStream* CreateStream(AVFormatContext *oc, CodecID codec_id, uint64_t fr
     if (oc->oformat->flags & AVFMT_GLOBALHEADER)
         stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
 
+    /* codec private options, ignored by codecs which don't support them */
+    AVDictionary* options = nullptr;
+    if(!preset.empty()) av_dict_set(&options, "preset", preset.c_str(), 0);
+    if(!tune.empty()) av_dict_set(&options, "tune", tune.c_str(), 0);
+
     /* open the codec */
-    int ret = avcodec_open2(stream->codec, codec, NULL);
+    int ret = avcodec_open2(stream->codec, codec, &options);
+    if(av_dict_count(options)) {
+        pango_print_warn("FfmpegVideoOutput: Codec ignored preset or tune option.\n");
+    }
+    av_dict_free(&options);
     if (ret < 0)  throw VideoException("Could not open video codec");
 
     return stream;
@@ -553,10 +1003,22 @@ public:
 
     const StreamInfo& GetStreamInfo() const;
 
+    // Queue image for encoding, blocking whilst the queue is full.
     void WriteImage(const uint8_t* img, int w, int h, double time);
+
+    // Wait for queued images, then drain frames buffered in the codec.
     void Flush();
 
 protected:
+    struct QueuedImage
+    {
+        std::unique_ptr<uint8_t[]> data;
+        int64_t pts;
+    };
+
+    void EncodeImage(const uint8_t* img, int64_t pts);
+    void EncodeThreadLoop();
+    void WaitForQueue();
     void WriteAvPacket(AVPacket* pkt);
     void WriteFrame(AVFrame* frame);
     double BaseFrameTime();
@@ -566,6 +1028,7 @@ protected:
     StreamInfo input_info;
     AVPixelFormat input_format;
     AVPixelFormat output_format;
+    int input_size_bytes;
 
     AVPicture src_picture;
     AVPicture dst_picture;
@@ -573,17 +1036,27 @@ protected:
 
     // These pointers are owned by class
     AVStream* stream;
-    SwsContext *sws_ctx;
+    std::unique_ptr<FfmpegSlicedScale> sws_ctx;
+    std::unique_ptr<WorkerPool> sws_workers;
     AVFrame* frame;
 
     bool flip;
+
+    // Encoder thread and its bounded input queue
+    size_t queue_depth;
+    std::thread encode_thread;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::deque<QueuedImage> queue_ready;
+    std::vector<QueuedImage> queue_free;
+    bool encode_should_run;
+    std::exception_ptr encode_error;
 };
 
 void FfmpegVideoOutputStream::WriteAvPacket(AVPacket* pkt)
 {
     if (pkt->size) {
         pkt->stream_index = stream->index;
-        int64_t pts = pkt->pts;
         /* convert unit from CODEC's timestamp to stream's one */
 #define C2S(field)                                              \
         do {                                                    \
@@ -597,9 +1070,9 @@ void FfmpegVideoOutputStream::WriteAvPacket(AVPacket* pkt)
         C2S(dts);
         C2S(duration);
 #undef C2S
+        std::lock_guard<std::mutex> l(recorder.mux_mutex);
         int ret = av_interleaved_write_frame(recorder.oc, pkt);
         if (ret < 0) throw VideoException("Error writing video frame");
-        if(pkt->pts != (int64_t)AV_NOPTS_VALUE) last_pts = pts;
     }
 }
 
@@ -650,39 +1123,27 @@ void FfmpegVideoOutputStream::WriteFrame(AVFrame* frame)
     av_free_packet(&pkt);
 }
 
-void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h, double time=-1.0)
+void FfmpegVideoOutputStream::EncodeImage(const uint8_t* img, int64_t pts)
 {
-    const int64_t pts = (time >= 0) ? time / BaseFrameTime() : ++last_pts;
-
-    recorder.StartStream();
-
     AVCodecContext *c = stream->codec;
+    const int w = input_info.Width();
+    const int h = input_info.Height();
 
+    // Earlier versions of ffmpeg do not annotate img as const, although it is
+    avpicture_fill(&src_picture,const_cast<uint8_t*>(img),input_format,w,h);
     if(flip) {
-        // Earlier versions of ffmpeg do not annotate img as const, although it is
-        avpicture_fill(&src_picture,const_cast<uint8_t*>(img),input_format,w,h);
         for(int i=0; i<4; ++i) {
             src_picture.data[i] += (h-1) * src_picture.linesize[i];
             src_picture.linesize[i] *= -1;
         }
-    }else{
-        // Earlier versions of ffmpeg do not annotate img as const, although it is
-        avpicture_fill(&src_picture,const_cast<uint8_t*>(img),input_format,w,h);
     }
 
     if (c->pix_fmt != input_format || c->width != w || c->height != h) {
         if(!sws_ctx) {
-            sws_ctx = sws_getCachedContext( sws_ctx,
-                w, h, input_format,
-                c->width, c->height, c->pix_fmt,
-                SWS_BICUBIC, NULL, NULL, NULL
-            );
-            if (!sws_ctx) throw VideoException("Could not initialize the conversion context");
+            sws_ctx.reset(new FfmpegSlicedScale(w, h, input_format, c->pix_fmt, SWS_BICUBIC));
+            sws_workers.reset(new WorkerPool(DefaultWorkerThreads(sws_ctx->NumBands()) - 1));
         }
-        sws_scale(sws_ctx,
-            src_picture.data, src_picture.linesize, 0, h,
-            dst_picture.data, dst_picture.linesize
-        );
+        sws_ctx->Scale(src_picture.data, src_picture.linesize, dst_picture.data, dst_picture.linesize, *sws_workers);
         *((AVPicture *)frame) = dst_picture;
     } else {
         *((AVPicture *)frame) = src_picture;
@@ -694,8 +1155,89 @@ void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h, doubl
     WriteFrame(frame);
 }
 
+void FfmpegVideoOutputStream::EncodeThreadLoop()
+{
+    while(true) {
+        QueuedImage image;
+        {
+            std::unique_lock<std::mutex> l(queue_mutex);
+            queue_cond.wait(l, [this](){ return !queue_ready.empty() || !encode_should_run; });
+            if(queue_ready.empty()) return;
+            image = std::move(queue_ready.front());
+            queue_ready.pop_front();
+        }
+
+        std::exception_ptr error;
+        try {
+            EncodeImage(image.data.get(), image.pts);
+        }catch(...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> l(queue_mutex);
+            if(error) encode_error = error;
+            queue_free.push_back(std::move(image));
+        }
+        queue_cond.notify_all();
+    }
+}
+
+void FfmpegVideoOutputStream::WaitForQueue()
+{
+    std::unique_lock<std::mutex> l(queue_mutex);
+    queue_cond.wait(l, [this](){ return queue_free.size() == queue_depth; });
+}
+
+void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h, double time=-1.0)
+{
+    PANGO_ENSURE(w == (int)input_info.Width() && h == (int)input_info.Height());
+
+    const int64_t pts = (time >= 0) ? time / BaseFrameTime() : last_pts + 1;
+    last_pts = pts;
+
+    recorder.StartStream();
+
+    if(!queue_depth) {
+        EncodeImage(img, pts);
+        return;
+    }
+
+    // Take a copy, since the caller may reuse img once we return.
+    std::unique_lock<std::mutex> l(queue_mutex);
+    queue_cond.wait(l, [this](){ return !queue_free.empty(); });
+    if(encode_error) {
+        std::exception_ptr e = encode_error;
+        encode_error = nullptr;
+        std::rethrow_exception(e);
+    }
+    QueuedImage image = std::move(queue_free.back());
+    queue_free.pop_back();
+    l.unlock();
+
+    memcpy(image.data.get(), img, input_size_bytes);
+    image.pts = pts;
+
+    l.lock();
+    queue_ready.push_back(std::move(image));
+    l.unlock();
+    queue_cond.notify_all();
+}
+
 void FfmpegVideoOutputStream::Flush()
 {
+    if(queue_depth) {
+        WaitForQueue();
+
+        // Report a failure in the last queued frames
+        std::lock_guard<std::mutex> l(queue_mutex);
+        if(encode_error) {
+            std::exception_ptr e = encode_error;
+            encode_error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
 #if (LIBAVFORMAT_VERSION_MAJOR >= 54)
     if (stream->codec->codec->capabilities & AV_CODEC_CAP_DELAY) {
         /* some CODECs like H.264 needs flushing buffered frames by encoding NULL frames. */
@@ -735,9 +1277,14 @@ FfmpegVideoOutputStream::FfmpegVideoOutputStream(
     : recorder(recorder), input_info(input_info),
       input_format(FfmpegFmtFromString(input_info.PixFormat())),
       output_format( FfmpegFmtFromString("YUV420P") ),
-      last_pts(-1), sws_ctx(NULL), frame(NULL), flip(flip_image)
+      input_size_bytes(avpicture_get_size(input_format, input_info.Width(), input_info.Height())),
+      last_pts(-1), frame(NULL), flip(flip_image),
+      queue_depth(recorder.queue_depth), encode_should_run(true)
 {
-    stream = CreateStream(recorder.oc, codec_id, frame_rate, bit_rate, output_format, input_info.Width(), input_info.Height() );
+    stream = CreateStream(
+        recorder.oc, codec_id, frame_rate, bit_rate, output_format, input_info.Width(), input_info.Height(),
+        recorder.threads, recorder.preset, recorder.tune
+    );
 
     // Allocate the encoded raw picture.
     int ret = avpicture_alloc(&dst_picture, stream->codec->pix_fmt, stream->codec->width, stream->codec->height);
@@ -750,14 +1297,30 @@ FfmpegVideoOutputStream::FfmpegVideoOutputStream(
     // Deprecated
     frame = avcodec_alloc_frame();
 #endif
+
+    if(queue_depth) {
+        for(size_t i=0; i < queue_depth; ++i) {
+            queue_free.push_back( QueuedImage{std::unique_ptr<uint8_t[]>(new uint8_t[input_size_bytes]), 0} );
+        }
+        encode_thread = std::thread(&FfmpegVideoOutputStream::EncodeThreadLoop, this);
+    }
 }
 
 FfmpegVideoOutputStream::~FfmpegVideoOutputStream()
 {
-    Flush();
+    if(encode_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> l(queue_mutex);
+            encode_should_run = false;
+        }
+        queue_cond.notify_all();
+        encode_thread.join();
+    }
 
-    if(sws_ctx) {
-        sws_freeContext(sws_ctx);
+    try {
+        Flush();
+    }catch(const std::exception& e) {
+        pango_print_warn("FfmpegVideoOutput: %s\n", e.what());
     }
 
     av_free(frame);
@@ -765,9 +1328,10 @@ FfmpegVideoOutputStream::~FfmpegVideoOutputStream()
     avcodec_close(stream->codec);
 }
 
-FfmpegVideoOutput::FfmpegVideoOutput(const std::string& filename, int base_frame_rate, int bit_rate, bool flip_image)
+FfmpegVideoOutput::FfmpegVideoOutput(const std::string& filename, int base_frame_rate, int bit_rate, bool flip_image, int threads, const std::string& preset, const std::string& tune, size_t queue_depth)
     : filename(filename), started(false), oc(NULL),
-      frame_count(0), base_frame_rate(base_frame_rate), bit_rate(bit_rate), is_pipe(pangolin::IsPipe(filename)), flip(flip_image)
+      frame_count(0), base_frame_rate(base_frame_rate), bit_rate(bit_rate), is_pipe(pangolin::IsPipe(filename)), flip(flip_image),
+      threads(threads), preset(preset), tune(tune), queue_depth(queue_depth)
 {
     Initialise(filename);
 }
@@ -833,7 +1397,11 @@ void FfmpegVideoOutput::Close()
 {
     for(std::vector<FfmpegVideoOutputStream*>::iterator i = streams.begin(); i!=streams.end(); ++i)
     {
-        (*i)->Flush();
+        try {
+            (*i)->Flush();
+        }catch(const std::exception& e) {
+            pango_print_warn("FfmpegVideoOutput: %s\n", e.what());
+        }
         delete *i;
     }
 
@@ -900,7 +1468,9 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideo)
                 std::string outfmt = uri.Get<std::string>("fmt","RGB24");
                 ToUpper(outfmt);
                 const int video_stream = uri.Get<int>("stream",-1);
-                return std::unique_ptr<VideoInterface>( new FfmpegVideo(uri.url.c_str(), outfmt, "", false, video_stream) );
+                const int threads = uri.Get<int>("threads",0);
+                const size_t decode_ahead = uri.Get<size_t>("decode_ahead",0);
+                return std::unique_ptr<VideoInterface>( new FfmpegVideo(uri.url.c_str(), outfmt, "", false, video_stream, ImageDim(0,0), threads, decode_ahead) );
             }else if( !uri.scheme.compare("v4lmjpeg")) {
                 const int video_stream = uri.Get<int>("stream",-1);
                 const ImageDim size = uri.Get<ImageDim>("size",ImageDim(0,0));
@@ -934,6 +1504,10 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideoOutput)
             const int desired_frame_rate = uri.Get("fps", 60);
             const int desired_bit_rate = uri.Get("bps", 20000*1024);
             const bool flip = uri.Get("flip", false);
+            const int threads = uri.Get("threads", 0);
+            const std::string preset = uri.Get<std::string>("preset", "");
+            const std::string tune = uri.Get<std::string>("tune", "");
+            const size_t queue_depth = uri.Get<size_t>("queue", 2);
             std::string filename = uri.url;
 
             if(uri.Contains("unique_filename")) {
@@ -941,7 +1515,7 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideoOutput)
             }
 
             return std::unique_ptr<VideoOutputInterface>(
-                new FfmpegVideoOutput(filename, desired_frame_rate, desired_bit_rate, flip)
+                new FfmpegVideoOutput(filename, desired_frame_rate, desired_bit_rate, flip, threads, preset, tune, queue_depth)
             );
         }
     };
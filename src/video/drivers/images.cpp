@@ -32,6 +32,7 @@
 
 #include <cstring>
 #include <fstream>
+#include <future>
 
 namespace pangolin
 {
@@ -64,29 +65,61 @@ void ImagesVideo::PopulateFilenamesFromJson(const std::string& filename)
         const std::string folder = PathParent(filename) + "/";
         device_properties = json["device_properties"];
         json_frames = json["frames"];
+        PopulateFilenamesFromJsonFrames(folder);
+    }else{
+        throw VideoException(err);
+    }
+}
 
-        num_files = json_frames.size();
-        if(num_files == 0) {
-            throw VideoException("Empty Json Image archive.");
-        }
+void ImagesVideo::PopulateFilenamesFromJsonLines(const std::string& filename)
+{
+    std::ifstream ifs( PathExpand(filename));
+    if(!ifs.is_open()) {
+        throw VideoException("Unable to open '" + filename + "'.");
+    }
+
+    json_frames = picojson::value(picojson::array_type, true);
 
-        num_channels = json_frames[0]["stream_files"].size();
-        if(num_channels == 0) {
-            throw VideoException("Empty Json Image archive.");
+    std::string line;
+    while(std::getline(ifs, line)) {
+        if(line.empty()) continue;
+        picojson::value json;
+        const std::string err = picojson::parse(json, line);
+        if(!err.empty()) {
+            pango_print_warn("Ignoring incomplete entry at end of '%s'.\n", filename.c_str());
+            break;
         }
+        if(json.contains("stream_files")) {
+            json_frames.push_back(json);
+        }else if(json.contains("device_properties")) {
+            device_properties = json["device_properties"];
+        }
+    }
 
-        filenames.resize(num_channels);
-        for(size_t c=0; c < num_channels; ++c) {
-            filenames[c].resize(num_files);
-            for(size_t i = 0; i < num_files; ++i) {
-                const std::string path = json_frames[i]["stream_files"][c].get<std::string>();
-                filenames[c][i] = (path.size() && path[0] == '/') ? path : (folder + path);
-            }
+    PopulateFilenamesFromJsonFrames(PathParent(filename) + "/");
+}
+
+void ImagesVideo::PopulateFilenamesFromJsonFrames(const std::string& folder)
+{
+    num_files = json_frames.size();
+    if(num_files == 0) {
+        throw VideoException("Empty Json Image archive.");
+    }
+
+    num_channels = json_frames[0]["stream_files"].size();
+    if(num_channels == 0) {
+        throw VideoException("Empty Json Image archive.");
+    }
+
+    filenames.resize(num_channels);
+    for(size_t c=0; c < num_channels; ++c) {
+        filenames[c].resize(num_files);
+        for(size_t i = 0; i < num_files; ++i) {
+            const std::string path = json_frames[i]["stream_files"][c].get<std::string>();
+            filenames[c][i] = (path.size() && path[0] == '/') ? path : (folder + path);
         }
-        loaded.resize(num_files);
-    }else{
-        throw VideoException(err);
     }
+    loaded.resize(num_files);
 }
 
 void ImagesVideo::PopulateFilenames(const std::string& wildcard_path)
@@ -97,10 +130,17 @@ void ImagesVideo::PopulateFilenames(const std::string& wildcard_path)
     if(wildcards.size() == 1 ) {
         const std::string expanded_path = PathExpand(wildcards[0]);
         const std::string possible_archive_path = expanded_path + "/archive.json";
+        const std::string possible_index_path = expanded_path + "/archive.jsonl";
 
-        if (FileLowercaseExtention(expanded_path) == ".json" ) {
+        if (FileLowercaseExtention(expanded_path) == ".jsonl" ) {
+            PopulateFilenamesFromJsonLines(wildcards[0]);
+            return;
+        }else if (FileLowercaseExtention(expanded_path) == ".json" ) {
             PopulateFilenamesFromJson(wildcards[0]);
             return;
+        }else if(FileExists(possible_index_path)){
+            PopulateFilenamesFromJsonLines(possible_index_path);
+            return;
         }else if(FileExists(possible_archive_path)){
             PopulateFilenamesFromJson(possible_archive_path);
             return;
@@ -109,9 +149,22 @@ void ImagesVideo::PopulateFilenames(const std::string& wildcard_path)
 
     filenames.resize(num_channels);
 
+    // Channels are typically in separate directories, so list them concurrently.
+    std::vector<std::future<void>> listings;
+    for(size_t i = 0; i < wildcards.size(); ++i) {
+        listings.push_back(std::async(std::launch::async, [this,i,&wildcards](){
+            const std::string channel_wildcard = PathExpand(wildcards[i]);
+            if(listing_cache) {
+                FilesMatchingWildcardCached(channel_wildcard, filenames[i]);
+            }else{
+                FilesMatchingWildcard(channel_wildcard, filenames[i]);
+            }
+        }));
+    }
+    for(auto& l : listings) l.get();
+
     for(size_t i = 0; i < wildcards.size(); ++i) {
         const std::string channel_wildcard = PathExpand(wildcards[i]);
-        FilesMatchingWildcard(channel_wildcard, filenames[i]);
         if(num_files == size_t(-1)) {
             num_files = filenames[i].size();
         }else{
@@ -140,9 +193,9 @@ void ImagesVideo::ConfigureStreamSizes()
     }
 }
 
-ImagesVideo::ImagesVideo(const std::string& wildcard_path)
+ImagesVideo::ImagesVideo(const std::string& wildcard_path, bool listing_cache)
     : num_files(-1), num_channels(0), next_frame_id(0),
-      unknowns_are_raw(false)
+      listing_cache(listing_cache), unknowns_are_raw(false)
 {
     // Work out which files to sequence
     PopulateFilenames(wildcard_path);
@@ -157,9 +210,10 @@ ImagesVideo::ImagesVideo(const std::string& wildcard_path)
 
 ImagesVideo::ImagesVideo(const std::string& wildcard_path,
                          const PixelFormat& raw_fmt,
-                         size_t raw_width, size_t raw_height
+                         size_t raw_width, size_t raw_height,
+                         bool listing_cache
 )   : num_files(-1), num_channels(0), next_frame_id(0),
-      unknowns_are_raw(true), raw_fmt(raw_fmt),
+      listing_cache(listing_cache), unknowns_are_raw(true), raw_fmt(raw_fmt),
       raw_width(raw_width), raw_height(raw_height)
 {
     // Work out which files to sequence
@@ -276,14 +330,15 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideo)
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
             const bool raw = uri.Contains("fmt");
             const std::string path = PathExpand(uri.url);
+            const bool listing_cache = uri.Get<bool>("listing_cache", true);
 
             if(raw) {
                 const std::string sfmt = uri.Get<std::string>("fmt", "GRAY8");
                 const PixelFormat fmt = PixelFormatFromString(sfmt);
                 const ImageDim dim = uri.Get<ImageDim>("size", ImageDim(640,480));
-                return std::unique_ptr<VideoInterface>( new ImagesVideo(path, fmt, dim.x, dim.y) );
+                return std::unique_ptr<VideoInterface>( new ImagesVideo(path, fmt, dim.x, dim.y, listing_cache) );
             }else{
-                return std::unique_ptr<VideoInterface>( new ImagesVideo(path) );
+                return std::unique_ptr<VideoInterface>( new ImagesVideo(path, listing_cache) );
             }
         }
     };
@@ -29,36 +29,78 @@
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/image/image_io.h>
 #include <pangolin/utils/file_utils.h>
+#include <pangolin/utils/worker_pool.h>
 #include <pangolin/video/drivers/images_out.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace pangolin {
 
-ImagesVideoOutput::ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string& image_file_extension)
-    : json_frames(picojson::array_type,true),
-      image_index(0), image_folder( PathExpand(image_folder) + "/" ), image_file_extension(image_file_extension)
+ImagesVideoOutput::ImagesVideoOutput(
+    const std::string& image_folder, const std::string& json_file_out, const std::string& image_file_extension,
+    size_t num_threads, size_t max_queued_frames
+)   : image_index(0), image_folder( PathExpand(image_folder) + "/" ), image_file_extension(image_file_extension),
+      json_filename(json_file_out), max_queued_frames(max_queued_frames ? max_queued_frames : 2*num_threads),
+      should_run(true)
 {
     if(!json_file_out.empty()) {
-        file.open(json_file_out);
-        if(!file.is_open()) {
+        index_file.open(json_file_out + "l");
+        if(!index_file.is_open()) {
             throw std::runtime_error("Unable to open json file for writing, " + json_file_out + ". Make sure output folder already exists.");
         }
     }
+
+    for(size_t i=0; i < num_threads; ++i) {
+        workers.emplace_back(&ImagesVideoOutput::WorkerLoop, this);
+    }
 }
 
 ImagesVideoOutput::~ImagesVideoOutput()
 {
-    if(file.is_open())
     {
-        const std::string video_uri = "images://" + image_folder + "archive.json";
-        picojson::value json_file;
-        json_file["device_properties"] = device_properties;
-        json_file["frames"] = json_frames;
-        json_file["input_uri"] = input_uri;
-        json_file["video_uri"] = video_uri;
+        std::unique_lock<std::mutex> lock(mutex);
+        should_run = false;
+    }
+    cond_jobs.notify_all();
+    for(auto& w : workers) {
+        w.join();
+    }
+
+    if(!error.empty()) {
+        pango_print_error("ImagesVideoOutput: %s\n", error.c_str());
+    }
+
+    if(index_file.is_open())
+    {
+        index_file.close();
+        WriteArchiveJson();
+    }
+}
+
+void ImagesVideoOutput::WriteArchiveJson()
+{
+    // Stream frames across from the line index rather than holding them all
+    std::ifstream index(json_filename + "l");
+    std::ofstream file(json_filename);
+    if(!index.is_open() || !file.is_open()) {
+        return;
+    }
+
+    const std::string video_uri = "images://" + image_folder + "archive.json";
+    file << "{\"device_properties\":" << device_properties.serialize() << ",\"frames\":[";
 
-        // Serialize json to file.
-        file << json_file.serialize(true);
+    std::string line;
+    bool first = true;
+    while(std::getline(index, line)) {
+        if(line.find("\"stream_files\"") == std::string::npos) continue;
+        if(!first) file << ",\n";
+        file << line;
+        first = false;
     }
+
+    file << "],\"input_uri\":" << picojson::value(input_uri).serialize()
+         << ",\"video_uri\":" << picojson::value(video_uri).serialize() << "}\n";
 }
 
 const std::vector<StreamInfo>& ImagesVideoOutput::Streams() const
@@ -71,26 +113,132 @@ void ImagesVideoOutput::SetStreams(const std::vector<StreamInfo>& streams, const
     this->streams = streams;
     this->input_uri = uri;
     this->device_properties = device_properties;
+
+    if(index_file.is_open()) {
+        picojson::value header;
+        header["device_properties"] = device_properties;
+        header["input_uri"] = input_uri;
+        header["video_uri"] = "images://" + image_folder + "archive.jsonl";
+        index_file << header.serialize(false) << std::endl;
+    }
 }
 
-int ImagesVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
+std::string ImagesVideoOutput::StreamFilename(size_t frame, size_t stream) const
 {
-    picojson::value json_filenames(picojson::array_type, true);
+    return pangolin::FormatString("image_%%%_%.%",std::setfill('0'),std::setw(10),frame, stream, image_file_extension);
+}
 
-    // Write each stream image to file.
+void ImagesVideoOutput::SaveStream(const unsigned char* data, size_t frame, size_t stream)
+{
+    const pangolin::StreamInfo& si = streams[stream];
+    const Image<unsigned char> img = si.StreamImage(data);
+    pangolin::SaveImage(img, si.PixFormat(), image_folder + StreamFilename(frame, stream));
+}
+
+void ImagesVideoOutput::AppendIndex(size_t frame, const picojson::value& frame_properties)
+{
+    picojson::value json_filenames(picojson::array_type, true);
     for(size_t s=0; s < streams.size(); ++s) {
-        const pangolin::StreamInfo& si = streams[s];
-        const std::string filename = pangolin::FormatString("image_%%%_%.%",std::setfill('0'),std::setw(10),image_index, s, image_file_extension);
-        json_filenames.push_back(filename);
-        const Image<unsigned char> img = si.StreamImage(data);
-        pangolin::SaveImage(img, si.PixFormat(), image_folder + filename);
+        json_filenames.push_back(StreamFilename(frame, s));
     }
 
-    // Add frame_properties to json file.
     picojson::value json_frame;
     json_frame["frame_properties"] = frame_properties;
     json_frame["stream_files"] = json_filenames;
-    json_frames.push_back(json_frame);
+
+    if(index_file.is_open()) {
+        // Flushed per frame so that the index survives a crash
+        index_file << json_frame.serialize(false) << std::endl;
+    }
+}
+
+void ImagesVideoOutput::WorkerLoop()
+{
+    while(true) {
+        std::pair<std::shared_ptr<Frame>,size_t> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(jobs.empty() && should_run) {
+                cond_jobs.wait(lock);
+            }
+            if(jobs.empty()) return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        try {
+            SaveStream(job.first->data.data(), job.first->index, job.second);
+        }catch(const std::exception& e) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(error.empty()) error = e.what();
+            job.first->failed = true;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            --job.first->streams_remaining;
+
+            // Index completed frames in order
+            while(!frames.empty() && frames.front()->streams_remaining == 0) {
+                if(!frames.front()->failed) {
+                    AppendIndex(frames.front()->index, frames.front()->frame_properties);
+                }
+                free_buffers.push_back(std::move(frames.front()->data));
+                frames.pop_front();
+            }
+        }
+        cond_done.notify_all();
+    }
+}
+
+int ImagesVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
+{
+    if(workers.empty()) {
+        // Write each stream image to file.
+        for(size_t s=0; s < streams.size(); ++s) {
+            SaveStream(data, image_index, s);
+        }
+        AppendIndex(image_index, frame_properties);
+        ++image_index;
+        return 0;
+    }
+
+    size_t frame_bytes = 0;
+    for(const StreamInfo& si : streams) {
+        frame_bytes = std::max(frame_bytes, (size_t)si.Offset() + si.SizeBytes());
+    }
+
+    auto frame = std::make_shared<Frame>();
+    frame->index = image_index;
+    frame->frame_properties = frame_properties;
+    frame->streams_remaining = streams.size();
+    frame->failed = false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        while(frames.size() >= max_queued_frames) {
+            cond_done.wait(lock);
+        }
+        if(!free_buffers.empty()) {
+            frame->data = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+
+    frame->data.resize(frame_bytes);
+    std::memcpy(frame->data.data(), data, frame_bytes);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        frames.push_back(frame);
+        for(size_t s=0; s < streams.size(); ++s) {
+            jobs.emplace_back(frame, s);
+        }
+    }
+    cond_jobs.notify_all();
 
     ++image_index;
     return 0;
@@ -108,13 +256,15 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideoOutput)
             const std::string images_folder = PathExpand(uri.url);
             const std::string json_filename = images_folder + "/archive.json";
             const std::string image_extension = uri.Get<std::string>("fmt", "png");
+            const size_t num_threads = uri.Get<size_t>("threads", DefaultWorkerThreads());
+            const size_t max_queued_frames = uri.Get<size_t>("queue", 0);
 
-            if(FileExists(json_filename)) {
+            if(FileExists(json_filename) || FileExists(json_filename + "l")) {
                 throw std::runtime_error("Dataset already exists in directory.");
             }
 
             return std::unique_ptr<VideoOutputInterface>(
-                new ImagesVideoOutput(images_folder, json_filename, image_extension)
+                new ImagesVideoOutput(images_folder, json_filename, image_extension, num_threads, max_queued_frames)
             );
         }
     };
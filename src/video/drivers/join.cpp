@@ -26,9 +26,13 @@
  */
 
 #include <pangolin/factory/factory_registry.h>
+#include <pangolin/log/playback_session.h>
+#include <pangolin/utils/file_utils.h>
 #include <pangolin/video/drivers/join.h>
 #include <pangolin/video/iostream_operators.h>
 
+#include <map>
+
 //#define DEBUGJOIN
 
 #ifdef DEBUGJOIN
@@ -45,7 +49,7 @@
 namespace pangolin
 {
 JoinVideo::JoinVideo(std::vector<std::unique_ptr<VideoInterface> > &src_)
-    : storage(std::move(src_)), size_bytes(0), sync_tolerance_us(0)
+    : storage(std::move(src_)), size_bytes(0), sync_tolerance_us(0), stats("join")
 {
     for(auto& p : storage) {
         src.push_back(p.get());
@@ -174,6 +178,7 @@ bool JoinVideo::GrabNext(unsigned char* image, bool wait)
     std::vector<size_t> offsets(src.size(), 0);
     std::vector<int64_t> capture_us(src.size(), 0);
 
+    VideoStats::Scope grab_scope(stats, VideoStatsGrab);
     TSTART()
     DBGPRINT("Entering GrabNext:")
     for(size_t s=0; s<src.size(); ++s) {
@@ -210,6 +215,7 @@ bool JoinVideo::GrabNext(unsigned char* image, bool wait)
                     {
                         if(src[s]->GrabNext(image+offsets[s],true)) {
                             capture_us[s] = GetAdjustedCaptureTime(s);
+                            stats.AddDropped();
                         }
                     }
                 }
@@ -220,15 +226,20 @@ bool JoinVideo::GrabNext(unsigned char* image, bool wait)
         range = std::minmax_element(capture_us.begin(), capture_us.end());
         if( (*range.second - *range.first) > sync_tolerance_us) {
             TGRABANDPRINT("NOT IN SYNC oldest:%ld newest:%ld delta:%ld", *range.first, *range.second, (*range.second - *range.first));
+            stats.AddDropped();
             return false;
         } else {
             TGRABANDPRINT("    IN SYNC oldest:%ld newest:%ld delta:%ld", *range.first, *range.second, (*range.second - *range.first));
+            stats.AddFrames();
+            stats.AddBytes(size_bytes);
             return true;
         }
     }
     else
     {
         pango_print_warn("JoinVideo: sync_tolerance_us = 0, frames are not synced!\n");
+        stats.AddFrames();
+        stats.AddBytes(size_bytes);
         return true;
     }
 }
@@ -267,11 +278,13 @@ bool JoinVideo::GrabNewest( unsigned char* image, bool wait )
                  return false;
              }
          }
+         stats.AddDropped(minN - 1);
          TGRABANDPRINT("Dropping %u frames on each interface took ",(minN -1));
      }
      return GrabNext(image, wait);
   } else {
       DBGPRINT("NOT all interfaces are BufferAwareVideoInterface.")
+      VideoStats::Scope grab_scope(stats, VideoStatsGrab);
       // Simply calling GrabNewest on the child streams might cause loss of sync,
       // instead we perform as many GrabNext as possible on the first stream and
       // then pull the same number of frames from every other stream.
@@ -303,6 +316,7 @@ bool JoinVideo::GrabNewest( unsigned char* image, bool wait )
           if(oldest > rt) oldest = rt;
       }
       TGRABANDPRINT("Stream 0 grab took ");
+      if(first_stream_backlog > 1) stats.AddDropped(first_stream_backlog - 1);
 
       for(size_t s=1; s<src.size(); ++s) {
           for (int i=0; i<first_stream_backlog; i++){
@@ -342,12 +356,19 @@ bool JoinVideo::GrabNewest( unsigned char* image, bool wait )
 
           if(std::abs(newest - oldest) > sync_tolerance_us ) {
               TGRABANDPRINT("NOT IN SYNC newest:%ld oldest:%ld delta:%ld syncing took ", newest, oldest, (newest - oldest));
+              stats.AddDropped();
               return false;
           } else {
               TGRABANDPRINT("    IN SYNC newest:%ld oldest:%ld delta:%ld syncing took ", newest, oldest, (newest - oldest));
+              stats.AddFrames();
+              stats.AddBytes(size_bytes);
               return true;
           }
       } else {
+          if(grabbed_any) {
+              stats.AddFrames();
+              stats.AddBytes(size_bytes);
+          }
           return true;
       }
   }
@@ -359,30 +380,9 @@ std::vector<VideoInterface*>& JoinVideo::InputStreams()
     return src;
 }
 
-std::vector<std::string> SplitBrackets(const std::string src, char open = '{', char close = '}')
+VideoStats& JoinVideo::Stats()
 {
-    std::vector<std::string> splits;
-
-    int nesting = 0;
-    int begin = -1;
-
-    for(size_t i=0; i < src.length(); ++i) {
-        if(src[i] == open) {
-            if(nesting==0) {
-                begin = (int)i;
-            }
-            nesting++;
-        }else if(src[i] == close) {
-            nesting--;
-            if(nesting == 0) {
-                // matching close bracket.
-                int str_start = begin+1;
-                splits.push_back( src.substr(str_start, i-str_start) );
-            }
-        }
-    }
-
-    return splits;
+    return stats;
 }
 
 PANGOLIN_REGISTER_FACTORY(JoinVideo)
@@ -402,6 +402,20 @@ PANGOLIN_REGISTER_FACTORY(JoinVideo)
                 throw VideoException("No VideoSources found in join URL.", "Specify videos to join with curly braces, e.g. join://{test://}{test://}");
             }
 
+            // Logs played in the shared, ordered session are opened (and their
+            // indices parsed) together, rather than one child at a time.
+            std::map<size_t, std::vector<std::string>> ordered_logs;
+            for(const std::string& child_uri : uris) {
+                const Uri child = ParseUri(child_uri);
+                if(child.scheme == "pango" && child.Get<bool>("OrderedPlayback", false)) {
+                    const size_t read_ahead_bytes = child.Get<size_t>("read_ahead_mb", 0) * 1024 * 1024;
+                    ordered_logs[read_ahead_bytes].push_back(PathExpand(child.url));
+                }
+            }
+            for(const auto& logs : ordered_logs) {
+                PlaybackSession::Default()->OpenAll(logs.second, logs.first);
+            }
+
             std::vector<std::unique_ptr<VideoInterface>> src;
             for(size_t i=0; i<uris.size(); ++i) {
                 src.push_back( pangolin::OpenVideo(uris[i]) );
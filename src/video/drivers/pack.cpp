@@ -44,7 +44,7 @@ namespace pangolin
 {
 
 PackVideo::PackVideo(std::unique_ptr<VideoInterface> &src_, PixelFormat out_fmt)
-    : src(std::move(src_)), size_bytes(0), buffer(0)
+    : src(std::move(src_)), size_bytes(0), buffer(0), stats("pack")
 {
     if( !src || out_fmt.channels != 1) {
         throw VideoException("PackVideo: Only supports single channel input.");
@@ -159,6 +159,9 @@ void ConvertTo12bit(
 
 void PackVideo::Process(unsigned char* image, const unsigned char* buffer)
 {
+    VideoStats::Scope process_scope(stats, VideoStatsProcess);
+    stats.AddFrames();
+    stats.AddBytes(size_bytes);
     TSTART()
     for(size_t s=0; s<streams.size(); ++s) {
         const Image<unsigned char> img_in  = videoin[0]->Streams()[s].StreamImage(buffer);
@@ -210,6 +213,11 @@ std::vector<VideoInterface*>& PackVideo::InputStreams()
     return videoin;
 }
 
+VideoStats& PackVideo::Stats()
+{
+    return stats;
+}
+
 unsigned int PackVideo::AvailableFrames() const
 {
     BufferAwareVideoInterface* vpi = dynamic_cast<BufferAwareVideoInterface*>(videoin[0]);
@@ -40,33 +40,42 @@ namespace pangolin
 
 const std::string pango_video_type = "raw_video";
 
-PangoVideo::PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSession> playback_session)
+PangoVideo::PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSession> playback_session, size_t read_ahead_bytes, bool throughput, size_t read_ahead_frames)
     : _filename(filename),
       _playback_session(playback_session),
-      _reader(_playback_session->Open(filename)),
+      _reader(_playback_session->Open(filename, read_ahead_bytes)),
       _event_promise(_playback_session->Time()),
       _src_id(FindPacketStreamSource()),
-      _source(nullptr)
+      _source(nullptr),
+      _throughput(throughput),
+      _read_ahead_frames(throughput ? read_ahead_frames : 0),
+      _current_frame_id(0),
+      _read_ahead_run(false),
+      _stats("pango")
 {
     PANGO_ENSURE(_src_id != -1, "No appropriate video streams found in log.");
 
     _source = &_reader->Sources()[_src_id];
     SetupStreams(*_source);
+    _current_frame_id = _source->next_packet_id - 1;
 
     // Make sure we time-seek with other playback devices
     session_seek = _playback_session->Time().OnSeek.Connect(
         [&](SyncTime::TimePoint t){
-            _event_promise.Cancel();
-            _reader->Seek(_src_id, t);
-            _event_promise.WaitAndRenew(_source->NextPacketTime());
+            SeekReader([&](){ _reader->Seek(_src_id, t); });
         }
     );
 
-    _event_promise.WaitAndRenew(_source->NextPacketTime());
+    if(_throughput) {
+        StartReadAhead();
+    }else{
+        _event_promise.WaitAndRenew(_source->NextPacketTime());
+    }
 }
 
 PangoVideo::~PangoVideo()
 {
+    StopReadAhead();
 }
 
 size_t PangoVideo::SizeBytes() const
@@ -89,37 +98,79 @@ void PangoVideo::Stop()
 
 }
 
-bool PangoVideo::GrabNext(unsigned char* image, bool /*wait*/)
+void PangoVideo::ReadFrame(unsigned char* image, picojson::value& frame_properties, size_t& frame_id)
 {
-    try
-    {
-        Packet fi = _reader->NextFrame(_src_id);
-        _frame_properties = fi.meta;
+    VideoStats::Scope grab_scope(_stats, VideoStatsGrab);
+    Packet fi = _reader->NextFrame(_src_id);
+    frame_properties = fi.meta;
+    frame_id = fi.sequence_num;
 
-        if(_fixed_size) {
-            fi.Stream().read(reinterpret_cast<char*>(image), _size_bytes);
-        }else{
-            for(size_t s=0; s < _streams.size(); ++s) {
-                StreamInfo& si = _streams[s];
-                pangolin::Image<unsigned char> dst = si.StreamImage(image);
-
-                if(stream_decoder[s]) {
-                    pangolin::TypedImage img = stream_decoder[s](fi.Stream());
-                    PANGO_ENSURE(img.IsValid());
-
-                    // TODO: We can avoid this copy by decoding directly into img
-                    for(size_t row =0; row < dst.h; ++row) {
-                        std::memcpy(dst.RowPtr(row), img.RowPtr(row), si.RowBytes());
-                    }
-                }else{
-                    for(size_t row =0; row < dst.h; ++row) {
-                        fi.Stream().read((char*)dst.RowPtr(row), si.RowBytes());
-                    }
+    if(_fixed_size) {
+        fi.Stream().read(reinterpret_cast<char*>(image), _size_bytes);
+    }else{
+        for(size_t s=0; s < _streams.size(); ++s) {
+            StreamInfo& si = _streams[s];
+            pangolin::Image<unsigned char> dst = si.StreamImage(image);
+
+            if(stream_decoder[s]) {
+                pangolin::TypedImage img = stream_decoder[s](fi.Stream());
+                PANGO_ENSURE(img.IsValid());
+
+                // TODO: We can avoid this copy by decoding directly into img
+                for(size_t row =0; row < dst.h; ++row) {
+                    std::memcpy(dst.RowPtr(row), img.RowPtr(row), si.RowBytes());
+                }
+            }else{
+                for(size_t row =0; row < dst.h; ++row) {
+                    fi.Stream().read((char*)dst.RowPtr(row), si.RowBytes());
                 }
             }
         }
+    }
+    _stats.AddFrames();
+    _stats.AddBytes(_size_bytes);
+}
 
-        _event_promise.WaitAndRenew(_source->NextPacketTime());
+bool PangoVideo::GrabNext(unsigned char* image, bool wait)
+{
+    if(_read_ahead_frames) {
+        std::unique_lock<std::mutex> lock(_read_ahead_mutex);
+        if(!wait && _ready.empty()) {
+            return false;
+        }
+        if(_ready.empty()) {
+            VideoStats::Scope wait_scope(_stats, VideoStatsQueueWait);
+            _read_ahead_cond.wait(lock, [&](){ return !_ready.empty(); });
+        }
+
+        Frame& frame = _ready.front();
+        if(!frame.valid) {
+            // Leave the end marker for subsequent calls
+            _frame_properties = picojson::value();
+            return false;
+        }
+        std::memcpy(image, frame.data.data(), _size_bytes);
+        _frame_properties = std::move(frame.frame_properties);
+        _current_frame_id = frame.frame_id;
+        _free.push_back(std::move(frame.data));
+        _ready.pop_front();
+        lock.unlock();
+        _read_ahead_cond.notify_all();
+        return true;
+    }
+
+    try
+    {
+        size_t frame_id;
+        ReadFrame(image, _frame_properties, frame_id);
+        _current_frame_id = frame_id;
+
+        // Only once the packet (and its lock on the reader) is released
+        _playback_session->PacketRead(*_reader, _src_id, frame_id);
+
+        if(!_throughput) {
+            _event_promise.WaitAndRenew(_source->NextPacketTime());
+        }
         return true;
     }
     catch(...)
@@ -136,7 +187,7 @@ bool PangoVideo::GrabNewest( unsigned char* image, bool wait )
 
 size_t PangoVideo::GetCurrentFrameId() const
 {
-    return (int)(_reader->Sources()[_src_id].next_packet_id) - 1;
+    return _current_frame_id;
 }
 
 size_t PangoVideo::GetTotalFrames() const
@@ -148,11 +199,103 @@ size_t PangoVideo::Seek(size_t next_frame_id)
 {
     // Get time for seek
     if(next_frame_id < _source->index.size()) {
+        if(_throughput) {
+            // Playback isn't paced by the session clock, and reading ahead
+            // leaves the reader past _current_frame_id, so seek it directly.
+            SeekReader([&](){ _reader->Seek(_src_id, next_frame_id); });
+            return _current_frame_id + 1;
+        }
+
         const int64_t capture_time = _source->index[next_frame_id].capture_time;
         _playback_session->Time().Seek(SyncTime::TimePoint(std::chrono::microseconds(capture_time)));
-        return next_frame_id;
+
+        // The time seek finds the first of any frames sharing capture_time
+        if(_current_frame_id + 1 != next_frame_id) {
+            SeekReader([&](){ _reader->Seek(_src_id, next_frame_id); });
+        }
+        return _current_frame_id + 1;
+    }else{
+        return _current_frame_id + 1;
+    }
+}
+
+void PangoVideo::SeekReader(const std::function<void()>& seek)
+{
+    if(_throughput) {
+        StopReadAhead();
+        seek();
+        _current_frame_id = _source->next_packet_id - 1;
+        StartReadAhead();
     }else{
-        return _source->next_packet_id;
+        _event_promise.Cancel();
+        seek();
+        _current_frame_id = _source->next_packet_id - 1;
+        _event_promise.WaitAndRenew(_source->NextPacketTime());
+    }
+}
+
+void PangoVideo::StartReadAhead()
+{
+    if(!_read_ahead_frames) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+        _ready.clear();
+        _read_ahead_run = true;
+    }
+    _read_ahead_thread = std::thread(&PangoVideo::ReadAheadLoop, this);
+}
+
+void PangoVideo::StopReadAhead()
+{
+    if(!_read_ahead_thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+        _read_ahead_run = false;
+    }
+    _read_ahead_cond.notify_all();
+    _read_ahead_thread.join();
+
+    // Frames read ahead of a seek are discarded
+    std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+    for(Frame& f : _ready) {
+        if(f.valid) _free.push_back(std::move(f.data));
+    }
+    _ready.clear();
+}
+
+void PangoVideo::ReadAheadLoop()
+{
+    while(true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(_read_ahead_mutex);
+            _read_ahead_cond.wait(lock, [&](){ return !_read_ahead_run || _ready.size() < _read_ahead_frames; });
+            if(!_read_ahead_run) return;
+            if(!_free.empty()) {
+                frame.data = std::move(_free.back());
+                _free.pop_back();
+            }
+        }
+
+        frame.data.resize(_size_bytes);
+        try {
+            ReadFrame(frame.data.data(), frame.frame_properties, frame.frame_id);
+            frame.valid = true;
+            _playback_session->PacketRead(*_reader, _src_id, frame.frame_id);
+        }catch(...) {
+            frame.valid = false;
+        }
+
+        const bool end = !frame.valid;
+        {
+            std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+            _ready.push_back(std::move(frame));
+        }
+        _read_ahead_cond.notify_all();
+
+        if(end) return;
     }
 }
 
@@ -161,6 +304,11 @@ std::string PangoVideo::GetSourceUri()
     return _source_uri;
 }
 
+VideoStats& PangoVideo::Stats()
+{
+    return _stats;
+}
+
 int PangoVideo::FindPacketStreamSource()
 {
     for(const auto& src : _reader->Sources())
@@ -229,7 +377,10 @@ PANGOLIN_REGISTER_FACTORY(PangoVideo)
             const std::string path = PathExpand(uri.url);
 
             if( !uri.scheme.compare("pango") || FileType(uri.url) == ImageFileTypePango ) {
-                return std::unique_ptr<VideoInterface>(new PangoVideo(path.c_str(), PlaybackSession::ChooseFromParams(uri)));
+                const size_t read_ahead_bytes = uri.Get<size_t>("read_ahead_mb", 0) * 1024 * 1024;
+                const bool throughput = uri.Get<bool>("throughput", false);
+                const size_t read_ahead_frames = uri.Get<size_t>("read_ahead_frames", 4);
+                return std::unique_ptr<VideoInterface>(new PangoVideo(path.c_str(), PlaybackSession::ChooseFromParams(uri), read_ahead_bytes, throughput, read_ahead_frames));
             }
             return std::unique_ptr<VideoInterface>();
         }
@@ -31,9 +31,12 @@
 #include <pangolin/utils/picojson.h>
 #include <pangolin/utils/sigstate.h>
 #include <pangolin/utils/timer.h>
+#include <pangolin/utils/trace.h>
 #include <pangolin/video/drivers/pango_video_output.h>
 #include <pangolin/video/iostream_operators.h>
 #include <pangolin/video/video_interface.h>
+#include <pangolin/utils/log.h>
+#include <cstdio>
 #include <set>
 #include <future>
 
@@ -51,18 +54,48 @@ void SigPipeHandler(int sig)
     SigState::I().sig_callbacks.at(sig).value = true;
 }
 
-PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris)
+std::string PangoSegmentFilename(const std::string& filename, size_t index)
+{
+    const size_t slash = filename.find_last_of("/\\");
+    size_t dot = filename.find_last_of('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = filename.size();
+    }
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%06zu", index);
+    return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris, FileWriteMode write_mode, size_t sync_interval_bytes, const PangoSegmentOptions& segment_options, size_t encode_threads)
     : filename(filename),
+      packetstream(new PacketStreamWriter()),
       packetstream_buffer_size_bytes(buffer_size_bytes),
+      packetstream_write_mode(write_mode),
+      packetstream_sync_interval_bytes(sync_interval_bytes),
       packetstreamsrcid(-1),
       total_frame_size(0),
       is_pipe(pangolin::IsPipe(filename)),
       fixed_size(true),
-      stream_encoder_uris(stream_encoder_uris)
+      stream_encoder_uris(stream_encoder_uris),
+      encode_threads(encode_threads),
+      encode_run(false),
+      segment_options(segment_options),
+      segment_index(0),
+      segment_bytes(0),
+      segment_start_us(0),
+      stats("pango_output")
 {
-    if(!is_pipe)
+    if(segment_options.Enabled()) {
+        if(is_pipe) {
+            throw VideoException("PangoVideoOutput: segmented recording is not supported for pipes.");
+        }
+        packetstream = OpenSegment(segment_index);
+        next_segment = std::async(std::launch::async, [this](){ return OpenSegment(1); });
+    }
+    else if(!is_pipe)
     {
-        packetstream.Open(filename, packetstream_buffer_size_bytes);
+        packetstream->Open(filename, packetstream_buffer_size_bytes, packetstream_write_mode, packetstream_sync_interval_bytes);
     }
     else
     {
@@ -74,6 +107,119 @@ PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_si
 
 PangoVideoOutput::~PangoVideoOutput()
 {
+    StopEncoders();
+
+    if(next_segment.valid()) {
+        // Discard the segment opened ahead of time, which holds no frames.
+        try {
+            std::unique_ptr<PacketStreamWriter> unused = next_segment.get();
+            unused.reset();
+            std::remove(PangoSegmentFilename(filename, segment_index + 1).c_str());
+        }catch(const std::exception& e) {
+            pango_print_warn("PangoVideoOutput: %s\n", e.what());
+        }
+    }
+
+    try {
+        if(segment_options.Enabled()) {
+            FinishSegment(std::move(packetstream), PangoSegmentFilename(filename, segment_index), segment_options.max_segments);
+        }
+        if(closing_segment.valid()) {
+            closing_segment.get();
+        }
+    }catch(const std::exception& e) {
+        pango_print_warn("PangoVideoOutput: %s\n", e.what());
+    }
+}
+
+size_t PangoVideoOutput::NumSegments() const
+{
+    return segment_options.Enabled() ? segment_index + 1 : 1;
+}
+
+VideoStats& PangoVideoOutput::Stats()
+{
+    return stats;
+}
+
+std::unique_ptr<PacketStreamWriter> PangoVideoOutput::OpenSegment(size_t index) const
+{
+    std::unique_ptr<PacketStreamWriter> writer(new PacketStreamWriter());
+    writer->Open(PangoSegmentFilename(filename, index), packetstream_buffer_size_bytes, packetstream_write_mode, packetstream_sync_interval_bytes);
+    if(!writer->IsOpen()) {
+        throw VideoException("PangoVideoOutput: unable to open segment", PangoSegmentFilename(filename, index));
+    }
+    return writer;
+}
+
+void PangoVideoOutput::FinishSegment(std::unique_ptr<PacketStreamWriter> writer, const std::string& segment_filename, size_t keep)
+{
+    // Only one segment is closed at a time, which also orders retention.
+    if(closing_segment.valid()) {
+        closing_segment.get();
+    }
+
+    const bool retain_all = segment_options.max_segments == 0;
+    closing_segment = std::async(std::launch::async, [this, finished = std::move(writer), segment_filename, keep, retain_all]() mutable {
+        finished->Close();
+        finished.reset();
+
+        finished_segments.push_back(segment_filename);
+        while(!retain_all && finished_segments.size() > keep) {
+            std::remove(finished_segments.front().c_str());
+            finished_segments.pop_front();
+        }
+    });
+}
+
+void PangoVideoOutput::RotateSegment()
+{
+    // If opening ahead of time failed (or the future was consumed by an
+    // earlier failed rotation), open the segment now.
+    std::unique_ptr<PacketStreamWriter> next;
+    if(next_segment.valid()) {
+        try {
+            next = next_segment.get();
+        }catch(const std::exception& e) {
+            pango_print_warn("PangoVideoOutput: %s, retrying.\n", e.what());
+        }
+    }
+    if(!next) {
+        next = OpenSegment(segment_index + 1);
+    }
+    next->AddSource(packetstream_source);
+
+    std::swap(packetstream, next);
+    // The segment now being written counts towards those kept
+    const size_t keep = segment_options.max_segments > 0 ? segment_options.max_segments - 1 : 0;
+    FinishSegment(std::move(next), PangoSegmentFilename(filename, segment_index), keep);
+
+    ++segment_index;
+    segment_bytes = 0;
+    const size_t next_index = segment_index + 1;
+    next_segment = std::async(std::launch::async, [this, next_index](){ return OpenSegment(next_index); });
+}
+
+void PangoVideoOutput::WritePacket(const char* data, int64_t host_reception_time_us, size_t size, const picojson::value& frame_properties)
+{
+    if(segment_options.Enabled()) {
+        if(segment_bytes == 0) {
+            segment_start_us = host_reception_time_us;
+        }else if(
+            (segment_options.max_bytes > 0 && segment_bytes + size > segment_options.max_bytes) ||
+            (segment_options.max_us > 0 && host_reception_time_us - segment_start_us >= segment_options.max_us)
+        ) {
+            RotateSegment();
+            segment_start_us = host_reception_time_us;
+        }
+        segment_bytes += size;
+    }
+
+    VideoStats::Scope write_scope(stats, VideoStatsWrite);
+    PANGOLIN_TRACE_SCOPE("PangoVideoOutput::WritePacket", "video");
+    packetstream->WriteSourcePacket(packetstreamsrcid, data, host_reception_time_us, size, frame_properties);
+    stats.AddFrames();
+    stats.AddBytes(size);
 }
 
 const std::vector<StreamInfo>& PangoVideoOutput::Streams() const
@@ -81,6 +227,168 @@ const std::vector<StreamInfo>& PangoVideoOutput::Streams() const
     return streams;
 }
 
+void PangoVideoOutput::EncodeFrame(const unsigned char* data, std::vector<uint8_t>& encoded, bool parallel_streams)
+{
+    VideoStats::Scope process_scope(stats, VideoStatsProcess);
+    PANGOLIN_TRACE_SCOPE("PangoVideoOutput::EncodeFrame", "video");
+
+    // lambda encodes frame data i to the end of buf
+    auto encode_stream = [&](size_t i, memstreambuf& buf){
+        PANGOLIN_TRACE_SCOPE("PangoVideoOutput::EncodeStream", "video");
+        std::ostream encode_stream(&buf);
+
+        const StreamInfo& si = streams[i];
+        const Image<unsigned char> stream_image = si.StreamImage(data);
+
+        if(stream_encoders[i]) {
+            // Encode to buffer
+            stream_encoders[i](encode_stream, stream_image);
+        }else{
+            if(stream_image.IsContiguous()) {
+                encode_stream.write((char*)stream_image.ptr, streams[i].SizeBytes());
+            }else{
+                for(size_t row=0; row < stream_image.h; ++row) {
+                    encode_stream.write((char*)stream_image.RowPtr(row), si.RowBytes());
+                }
+            }
+        }
+        return true;
+    };
+
+    // Streams >0 encoded in other threads need their own buffers, appended
+    // once done. Everything else is encoded in order straight into
+    // 'encoded', reusing its capacity from previous frames.
+    const bool parallel = parallel_streams && streams.size() > 1;
+    std::vector<memstreambuf> other_stream_data;
+    std::vector<std::future<bool>> encode_finished;
+    if(parallel) {
+        other_stream_data.reserve(streams.size() - 1);
+        for(size_t i=1; i < streams.size(); ++i) {
+            other_stream_data.emplace_back(streams[i].SizeBytes());
+        }
+        for(size_t i=1; i < streams.size(); ++i) {
+            encode_finished.emplace_back(std::async(std::launch::async, [&,i](){
+                return encode_stream(i, other_stream_data[i-1]);
+            }));
+        }
+    }
+
+    memstreambuf frame_data(0);
+    frame_data.buffer.swap(encoded);
+    frame_data.clear();
+    frame_data.buffer.reserve(total_frame_size);
+
+    // Encode stream 0 in this thread
+    encode_stream(0, frame_data);
+
+    for(size_t i=1; i < streams.size(); ++i) {
+        if(parallel) {
+            encode_finished[i-1].get();
+            const std::vector<unsigned char>& b = other_stream_data[i-1].buffer;
+            frame_data.buffer.insert(frame_data.buffer.end(), b.begin(), b.end());
+        }else{
+            encode_stream(i, frame_data);
+        }
+    }
+
+    encoded.swap(frame_data.buffer);
+}
+
+void PangoVideoOutput::QueueEncode(const unsigned char* data, int64_t host_reception_time_us, const picojson::value& frame_properties)
+{
+    auto job = std::make_shared<EncodeJob>();
+    job->data.assign(data, data + total_frame_size);
+    job->host_reception_time_us = host_reception_time_us;
+    job->frame_properties = frame_properties;
+    job->claimed = false;
+    job->done = false;
+
+    std::unique_lock<std::mutex> lock(encode_mutex);
+    if(!encode_error.empty()) {
+        throw std::runtime_error(encode_error);
+    }
+    if(encode_jobs.size() >= 2 * encode_workers.size()) {
+        VideoStats::Scope wait_scope(stats, VideoStatsQueueWait);
+        PANGOLIN_TRACE_SCOPE("PangoVideoOutput::WaitForEncoder", "video");
+        while(encode_jobs.size() >= 2 * encode_workers.size()) {
+            encode_cond.wait(lock);
+        }
+    }
+    encode_jobs.push_back(job);
+    encode_cond.notify_all();
+}
+
+void PangoVideoOutput::EncodeLoop()
+{
+    TraceSetThreadName("PangoVideoOutput encoder");
+
+    while(true) {
+        std::shared_ptr<EncodeJob> job;
+        {
+            std::unique_lock<std::mutex> lock(encode_mutex);
+            while(true) {
+                for(auto& j : encode_jobs) {
+                    if(!j->claimed) {
+                        job = j;
+                        break;
+                    }
+                }
+                if(job || !encode_run) break;
+                encode_cond.wait(lock);
+            }
+            if(!job) return;
+            job->claimed = true;
+        }
+
+        std::string error;
+        try {
+            EncodeFrame(job->data.data(), job->encoded, false);
+        }catch(const std::exception& e) {
+            error = e.what();
+        }
+
+        std::unique_lock<std::mutex> lock(encode_mutex);
+        job->done = true;
+        if(!error.empty() && encode_error.empty()) {
+            encode_error = error;
+        }
+
+        // Write finished frames in the order they were queued
+        while(!encode_jobs.empty() && encode_jobs.front()->done) {
+            std::shared_ptr<EncodeJob> front = encode_jobs.front();
+            encode_jobs.pop_front();
+            if(encode_error.empty()) {
+                try {
+                    WritePacket(reinterpret_cast<const char*>(front->encoded.data()), front->host_reception_time_us, front->encoded.size(), front->frame_properties);
+                }catch(const std::exception& e) {
+                    encode_error = e.what();
+                }
+            }
+        }
+        encode_cond.notify_all();
+    }
+}
+
+void PangoVideoOutput::StopEncoders()
+{
+    {
+        std::unique_lock<std::mutex> lock(encode_mutex);
+        while(!encode_jobs.empty()) {
+            encode_cond.wait(lock);
+        }
+        encode_run = false;
+    }
+    encode_cond.notify_all();
+    for(std::thread& t : encode_workers) {
+        t.join();
+    }
+    encode_workers.clear();
+
+    if(!encode_error.empty()) {
+        pango_print_warn("PangoVideoOutput: %s\n", encode_error.c_str());
+    }
+}
+
 bool PangoVideoOutput::IsPipe() const
 {
     return is_pipe;
@@ -143,7 +451,15 @@ void PangoVideoOutput::SetStreams(const std::vector<StreamInfo>& st, const std::
         pss.data_size_bytes = fixed_size ? total_frame_size : 0;
         pss.data_definitions = "struct Frame{ uint8 stream_data[" + pangolin::Convert<std::string, size_t>::Do(total_frame_size) + "];};";
 
-        packetstreamsrcid = (int)packetstream.AddSource(pss);
+        packetstream_source = pss;
+        packetstreamsrcid = (int)packetstream->AddSource(pss);
+
+        if(!fixed_size && !is_pipe && encode_threads > 0) {
+            encode_run = true;
+            for(size_t t=0; t < encode_threads; ++t) {
+                encode_workers.emplace_back(&PangoVideoOutput::EncodeLoop, this);
+            }
+        }
     } else {
         throw std::runtime_error("Unable to add new streams");
     }
@@ -166,11 +482,11 @@ int PangoVideoOutput::WriteStreams(const unsigned char* data, const picojson::va
         // opening a file descriptor will fail and errno will be ENXIO.
         int fd = WritablePipeFileDescriptor(filename);
 
-        if (!packetstream.IsOpen())
+        if (!packetstream->IsOpen())
         {
             if (fd != -1)
             {
-                packetstream.Open(filename, packetstream_buffer_size_bytes);
+                packetstream->Open(filename, packetstream_buffer_size_bytes, packetstream_write_mode, packetstream_sync_interval_bytes);
                 close(fd);
             }
         }
@@ -185,7 +501,7 @@ int PangoVideoOutput::WriteStreams(const unsigned char* data, const picojson::va
             {
                 if (errno == ENXIO)
                 {
-                    packetstream.ForceClose();
+                    packetstream->ForceClose();
                     SigState::I().sig_callbacks.at(SIGPIPE).value = false;
 
                     // This should be unnecessary since per the man page,
@@ -196,67 +512,18 @@ int PangoVideoOutput::WriteStreams(const unsigned char* data, const picojson::va
             }
         }
 
-        if (!packetstream.IsOpen())
+        if (!packetstream->IsOpen())
             return 0;
     }
 #endif
 
-    if(!fixed_size) {
-        // TODO: Make this more efficient (without so many allocs and memcpy's)
-
-        std::vector<memstreambuf> encoded_stream_data;
-
-        // Create buffers for compressed data: the first will be reused for all the data later
-        encoded_stream_data.emplace_back(total_frame_size);
-        for(size_t i=1; i < streams.size(); ++i) {
-            encoded_stream_data.emplace_back(streams[i].SizeBytes());
-        }
-
-        // lambda encodes frame data i to encoded_stream_data[i]
-        auto encode_stream = [&](int i){
-            encoded_stream_data[i].clear();
-            std::ostream encode_stream(&encoded_stream_data[i]);
-
-            const StreamInfo& si = streams[i];
-            const Image<unsigned char> stream_image = si.StreamImage(data);
-
-            if(stream_encoders[i]) {
-                // Encode to buffer
-                stream_encoders[i](encode_stream, stream_image);
-            }else{
-                if(stream_image.IsContiguous()) {
-                    encode_stream.write((char*)stream_image.ptr, streams[i].SizeBytes());
-                }else{
-                    for(size_t row=0; row < stream_image.h; ++row) {
-                        encode_stream.write((char*)stream_image.RowPtr(row), si.RowBytes());
-                    }
-                }
-            }
-            return true;
-        };
-
-        // Compress each stream (>0 in another thread)
-        std::vector<std::future<bool>> encode_finished;
-        for(size_t i=1; i < streams.size(); ++i) {
-            encode_finished.emplace_back(std::async(std::launch::async, [&,i](){
-                return encode_stream(i);
-            }));
-        }
-        // Encode stream 0 in this thread
-        encode_stream(0);
-
-        // Reuse our first compression stream for the rest of the data too.
-        std::vector<uint8_t>& encoded = encoded_stream_data[0].buffer;
-
-        // Wait on all threads to finish and copy into data packet
-        for(size_t i=1; i < streams.size(); ++i) {
-            encode_finished[i-1].get();
-            encoded.insert(encoded.end(), encoded_stream_data[i].buffer.begin(), encoded_stream_data[i].buffer.end());
-        }
-
-        packetstream.WriteSourcePacket(packetstreamsrcid, reinterpret_cast<const char*>(encoded.data()), host_reception_time_us, encoded.size(), frame_properties);
+    if(!encode_workers.empty()) {
+        QueueEncode(data, host_reception_time_us, frame_properties);
+    }else if(!fixed_size) {
+        EncodeFrame(data, encode_buffer, true);
+        WritePacket(reinterpret_cast<const char*>(encode_buffer.data()), host_reception_time_us, encode_buffer.size(), frame_properties);
     }else{
-        packetstream.WriteSourcePacket(packetstreamsrcid, reinterpret_cast<const char*>(data), host_reception_time_us, total_frame_size, frame_properties);
+        WritePacket(reinterpret_cast<const char*>(data), host_reception_time_us, total_frame_size, frame_properties);
     }
 
     return 0;
@@ -268,8 +535,19 @@ PANGOLIN_REGISTER_FACTORY(PangoVideoOutput)
         std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
             const size_t mb = 1024*1024;
             const size_t buffer_size_bytes = uri.Get("buffer_size_mb", 100) * mb;
+            const size_t sync_interval_bytes = uri.Get("sync_interval_mb", 0) * mb;
+            const std::string write_mode_str = uri.Get<std::string>("write_mode", "sync");
             std::string filename = uri.url;
 
+            FileWriteMode write_mode = FileWriteModeSync;
+            if(write_mode_str == "direct") {
+                write_mode = FileWriteModeDirect;
+            }else if(write_mode_str == "buffered") {
+                write_mode = FileWriteModeBuffered;
+            }else if(write_mode_str != "sync") {
+                throw VideoException("PangoVideoOutput: unknown write_mode '" + write_mode_str + "', expected sync, direct or buffered.");
+            }
+
             if(uri.Contains("unique_filename")) {
                 filename = MakeUniqueFilename(filename);
             }
@@ -289,8 +567,18 @@ PANGOLIN_REGISTER_FACTORY(PangoVideoOutput)
                 stream_encoder_uris[i] = uri.Get<std::string>(encoder_key, default_encoder);
             }
 
+            // Rotate to a new file every segment_mb or segment_s, keeping
+            // only the latest keep_segments files if set.
+            PangoSegmentOptions segment_options;
+            segment_options.max_bytes = uri.Get<size_t>("segment_mb", 0) * mb;
+            segment_options.max_us = (int64_t)(uri.Get<double>("segment_s", 0.0) * 1e6);
+            segment_options.max_segments = uri.Get<size_t>("keep_segments", 0);
+
+            // Encode frames on a pool of threads when using stream encoders
+            const size_t encode_threads = uri.Get<size_t>("encode_threads", 0);
+
             return std::unique_ptr<VideoOutputInterface>(
-                new PangoVideoOutput(filename, buffer_size_bytes, stream_encoder_uris)
+                new PangoVideoOutput(filename, buffer_size_bytes, stream_encoder_uris, write_mode, sync_interval_bytes, segment_options, encode_threads)
             );
         }
     };
@@ -0,0 +1,216 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/video/drivers/resize.h>
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/video/iostream_operators.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace pangolin
+{
+
+ResizeVideo::ResizeVideo(std::unique_ptr<VideoInterface>& src_, const std::vector<Output>& outputs, size_t threads)
+    : src(std::move(src_)), outputs(outputs), workers(std::max<size_t>(1, threads) - 1), size_bytes(0), buffer(0), stats("resize")
+{
+    if( !src ) {
+        throw VideoException("ResizeVideo: VideoInterface in must not be null");
+    }
+
+    videoin.push_back(src.get());
+
+    for(size_t i=0; i < outputs.size(); ++i) {
+        const Output& o = outputs[i];
+        if(o.input >= src->Streams().size() || o.from_output >= (int)i) {
+            throw VideoException("ResizeVideo: Invalid output specification");
+        }
+        const PixelFormat fmt = src->Streams()[o.input].PixFormat();
+        if(!CanResizeImage(fmt)) {
+            throw VideoException("ResizeVideo: Unsupported pixel format", fmt.format);
+        }
+        if(o.w == 0 || o.h == 0) {
+            throw VideoException("ResizeVideo: Output must not be empty");
+        }
+
+        const size_t pitch = (o.w*fmt.bpp)/ 8;
+        streams.push_back(pangolin::StreamInfo( fmt, o.w, o.h, pitch, (unsigned char*)0 + size_bytes ));
+        size_bytes += o.h*pitch;
+    }
+
+    buffer = new unsigned char[src->SizeBytes()];
+}
+
+ResizeVideo::~ResizeVideo()
+{
+    delete[] buffer;
+}
+
+//! Implement VideoInput::Start()
+void ResizeVideo::Start()
+{
+    videoin[0]->Start();
+}
+
+//! Implement VideoInput::Stop()
+void ResizeVideo::Stop()
+{
+    videoin[0]->Stop();
+}
+
+//! Implement VideoInput::SizeBytes()
+size_t ResizeVideo::SizeBytes() const
+{
+    return size_bytes;
+}
+
+//! Implement VideoInput::Streams()
+const std::vector<StreamInfo>& ResizeVideo::Streams() const
+{
+    return streams;
+}
+
+void ResizeVideo::Process(unsigned char* image, const unsigned char* buffer)
+{
+    VideoStats::Scope process_scope(stats, VideoStatsProcess);
+    stats.AddFrames();
+    stats.AddBytes(size_bytes);
+    for(size_t i=0; i < outputs.size(); ++i) {
+        const Output& o = outputs[i];
+        const Image<unsigned char> img_in = o.from_output >= 0 ?
+            streams[o.from_output].StreamImage(image) :
+            videoin[0]->Streams()[o.input].StreamImage(buffer);
+        Image<unsigned char> img_out = streams[i].StreamImage(image);
+
+        if(img_in.w == img_out.w && img_in.h == img_out.h) {
+            const size_t row_bytes = img_out.w * streams[i].PixFormat().bpp / 8;
+            for(size_t y=0; y < img_out.h; ++y) {
+                std::memcpy(img_out.RowPtr(y), img_in.RowPtr(y), row_bytes);
+            }
+        }else{
+            ResizeImage(img_out, img_in, streams[i].PixFormat(), o.method, workers);
+        }
+    }
+}
+
+//! Implement VideoInput::GrabNext()
+bool ResizeVideo::GrabNext( unsigned char* image, bool wait )
+{
+    if(videoin[0]->GrabNext(buffer,wait)) {
+        Process(image,buffer);
+        return true;
+    }else{
+        return false;
+    }
+}
+
+//! Implement VideoInput::GrabNewest()
+bool ResizeVideo::GrabNewest( unsigned char* image, bool wait )
+{
+    if(videoin[0]->GrabNewest(buffer,wait)) {
+        Process(image,buffer);
+        return true;
+    }else{
+        return false;
+    }
+}
+
+std::vector<VideoInterface*>& ResizeVideo::InputStreams()
+{
+    return videoin;
+}
+
+VideoStats& ResizeVideo::Stats()
+{
+    return stats;
+}
+
+const picojson::value& ResizeVideo::DeviceProperties() const
+{
+    VideoPropertiesInterface* vpi = dynamic_cast<VideoPropertiesInterface*>(videoin[0]);
+    return vpi ? vpi->DeviceProperties() : null_properties;
+}
+
+const picojson::value& ResizeVideo::FrameProperties() const
+{
+    VideoPropertiesInterface* vpi = dynamic_cast<VideoPropertiesInterface*>(videoin[0]);
+    return vpi ? vpi->FrameProperties() : null_properties;
+}
+
+PANGOLIN_REGISTER_FACTORY(ResizeVideo)
+{
+    struct ResizeVideoFactory final : public FactoryInterface<VideoInterface> {
+        std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
+            std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
+            const bool pyramid = uri.scheme == "pyramid";
+            const ResizeMethod method = ResizeMethodFromString(uri.Get<std::string>("method", pyramid ? "box" : "area"));
+            const bool original = uri.Get<bool>("original", pyramid);
+            const size_t threads = uri.Get<size_t>("threads", DefaultWorkerThreads());
+
+            std::vector<ResizeVideo::Output> outputs;
+            for(size_t s=0; s < subvid->Streams().size(); ++s) {
+                const size_t w = subvid->Streams()[s].Width();
+                const size_t h = subvid->Streams()[s].Height();
+                if(original) {
+                    outputs.push_back({s, -1, w, h, method});
+                }
+
+                if(pyramid) {
+                    // Each level halves the one above, computed from it.
+                    const size_t levels = uri.Get<size_t>("levels", 3);
+                    int from = -1;
+                    size_t lw = w, lh = h;
+                    for(size_t l=0; l < levels && lw >= 2 && lh >= 2; ++l) {
+                        lw /= 2;
+                        lh /= 2;
+                        outputs.push_back({s, from, lw, lh, method});
+                        from = (int)outputs.size() - 1;
+                    }
+                }else{
+                    ImageDim dim;
+                    if(uri.Contains("size")) {
+                        dim = uri.Get<ImageDim>("size", ImageDim(w,h));
+                    }else{
+                        const double scale = uri.Get<double>("scale", 0.5);
+                        dim = ImageDim(std::max<size_t>(1, (size_t)std::lround(w*scale)), std::max<size_t>(1, (size_t)std::lround(h*scale)));
+                    }
+                    outputs.push_back({s, -1, dim.x, dim.y, method});
+                }
+            }
+
+            return std::unique_ptr<VideoInterface>( new ResizeVideo(subvid, outputs, threads) );
+        }
+    };
+
+    auto factory = std::make_shared<ResizeVideoFactory>();
+    FactoryRegistry<VideoInterface>::I().RegisterFactory(factory, 10, "resize");
+    FactoryRegistry<VideoInterface>::I().RegisterFactory(factory, 10, "pyramid");
+}
+
+}
@@ -2,24 +2,97 @@
 #include <pangolin/video/drivers/shared_memory.h>
 #include <pangolin/video/iostream_operators.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 using namespace std;
 
 namespace pangolin
 {
 
+// A blocking ring grab gives up after this many frame periods without a new
+// frame (the writer has stalled or exited), or the default before the frame
+// period is known.
+const int64_t ring_wait_periods = 10;
+const int64_t ring_wait_min_us = 100000;
+const int64_t ring_wait_default_us = 2000000;
+
+void SharedMemoryRingWait(SharedMemoryRingHeader& header, uint32_t expected, int64_t timeout_us)
+{
+  timespec ts;
+  ts.tv_sec = timeout_us / 1000000;
+  ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+  // Not FUTEX_PRIVATE_FLAG: waiters and waker live in different processes.
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header.futex), FUTEX_WAIT,
+    expected, timeout_us < 0 ? nullptr : &ts, nullptr, 0);
+}
+
+void SharedMemoryRingWake(SharedMemoryRingHeader& header)
+{
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header.futex), FUTEX_WAKE,
+    std::numeric_limits<int>::max(), nullptr, nullptr, 0);
+}
+
 SharedMemoryVideo::SharedMemoryVideo(size_t w, size_t h, std::string pix_fmt,
     const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
     const std::shared_ptr<ConditionVariableInterface>& buffer_full) :
     _fmt(PixelFormatFromString(pix_fmt)),
     _frame_size(w*h*_fmt.bpp/8),
     _shared_memory(shared_memory),
-    _buffer_full(buffer_full)
+    _buffer_full(buffer_full),
+    _ring(nullptr),
+    _last_seq(0),
+    _dropped(0),
+    _last_host_time_us(0),
+    _frame_period_us(0)
 {
     const size_t pitch = w * _fmt.bpp/8;
     const StreamInfo stream(_fmt, w, h, pitch, 0);
     _streams.push_back(stream);
 }
 
+SharedMemoryVideo::SharedMemoryVideo(const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory) :
+    _frame_size(0),
+    _shared_memory(shared_memory),
+    _ring(reinterpret_cast<SharedMemoryRingHeader*>(shared_memory->ptr())),
+    _last_seq(0),
+    _dropped(0),
+    _last_host_time_us(0),
+    _frame_period_us(0)
+{
+    if(_shared_memory->size() < SharedMemoryRingHeaderBytes() ||
+       _ring->magic.load(std::memory_order_acquire) != SharedMemoryRingMagic()) {
+        throw VideoException("SharedMemoryVideo: not a frame ring");
+    }
+    if(_ring->version != SHARED_MEMORY_RING_VERSION) {
+        throw VideoException("SharedMemoryVideo: unsupported frame ring version");
+    }
+    if(_ring->num_streams > SHARED_MEMORY_RING_MAX_STREAMS || _ring->num_slots == 0 ||
+       _shared_memory->size() < SharedMemoryRingHeaderBytes() + _ring->num_slots * _ring->slot_stride) {
+        throw VideoException("SharedMemoryVideo: corrupt frame ring header");
+    }
+
+    _frame_size = _ring->frame_bytes;
+    for(uint32_t i=0; i < _ring->num_streams; ++i) {
+        const SharedMemoryStreamDesc& d = _ring->streams[i];
+        const std::string fmt(d.fmt, strnlen(d.fmt, sizeof(d.fmt)));
+        _streams.push_back(StreamInfo(PixelFormatFromString(fmt), d.w, d.h, d.pitch, (unsigned char*)0 + d.offset));
+    }
+    if(!_streams.empty()) _fmt = _streams[0].PixFormat();
+
+    _device_properties["shmem_slots"] = picojson::value((int64_t)_ring->num_slots);
+
+    // Start from the newest frame already published
+    _last_seq = _ring->write_seq.load(std::memory_order_acquire);
+    if(_last_seq) --_last_seq;
+}
+
 SharedMemoryVideo::~SharedMemoryVideo()
 {
 }
@@ -43,6 +116,16 @@ const std::vector<StreamInfo>& SharedMemoryVideo::Streams() const
 }
 
 bool SharedMemoryVideo::GrabNext(unsigned char* image, bool wait)
+{
+    return _ring ? GrabRing(image, wait, false) : GrabLegacy(image, wait);
+}
+
+bool SharedMemoryVideo::GrabNewest(unsigned char* image, bool wait)
+{
+    return _ring ? GrabRing(image, wait, true) : GrabLegacy(image, wait);
+}
+
+bool SharedMemoryVideo::GrabLegacy(unsigned char* image, bool wait)
 {
     // If a condition variable exists, try waiting on it.
     if(_buffer_full) {
@@ -64,9 +147,86 @@ bool SharedMemoryVideo::GrabNext(unsigned char* image, bool wait)
     return true;
 }
 
-bool SharedMemoryVideo::GrabNewest(unsigned char* image, bool wait)
+bool SharedMemoryVideo::GrabRing(unsigned char* image, bool wait, bool newest)
 {
-    return GrabNext(image,wait);
+    unsigned char* base = _shared_memory->ptr();
+
+    const int64_t timeout_us = _frame_period_us > 0 ?
+        std::max(ring_wait_periods * _frame_period_us, ring_wait_min_us) : ring_wait_default_us;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+
+    while(true) {
+        // Load futex word before checking for frames, so that a publish in
+        // between is never slept through.
+        const uint32_t futex = _ring->futex.load(std::memory_order_acquire);
+        const uint64_t latest = _ring->write_seq.load(std::memory_order_acquire);
+
+        if(latest <= _last_seq) {
+            if(!wait) return false;
+            const int64_t remaining_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if(remaining_us <= 0) return false;
+            SharedMemoryRingWait(*_ring, futex, remaining_us);
+            continue;
+        }
+
+        // Frames more than num_slots-1 behind may be overwritten at any time.
+        uint64_t seq = _last_seq + 1;
+        const uint64_t oldest_safe = latest >= _ring->num_slots ? latest - _ring->num_slots + 2 : 1;
+        if(newest) {
+            seq = latest;
+        }else if(seq < oldest_safe) {
+            seq = oldest_safe;
+        }
+
+        SharedMemorySlotHeader* slot = SharedMemoryRingSlot(base, *_ring, seq);
+        const uint64_t s1 = slot->seq.load(std::memory_order_acquire);
+        if(s1 != 2*seq) {
+            // Overwritten before we started reading
+            continue;
+        }
+
+        memcpy(image, SharedMemorySlotData(slot), _frame_size);
+        const int64_t host_time_us = slot->host_reception_time_us;
+        const int64_t capture_time_us = slot->capture_time_us;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot->seq.load(std::memory_order_relaxed) != s1) {
+            // Overwritten whilst we were reading
+            continue;
+        }
+
+        if(_last_host_time_us && host_time_us > _last_host_time_us) {
+            _frame_period_us = (host_time_us - _last_host_time_us) / (int64_t)(seq - _last_seq);
+        }
+        _last_host_time_us = host_time_us;
+
+        _dropped += seq - _last_seq - 1;
+        _last_seq = seq;
+
+        _frame_properties = picojson::value(picojson::object_type, true);
+        _frame_properties["frame_seq"] = picojson::value((int64_t)seq);
+        _frame_properties[PANGO_HOST_RECEPTION_TIME_US] = picojson::value(host_time_us);
+        if(capture_time_us) {
+            _frame_properties[PANGO_CAPTURE_TIME_US] = picojson::value(capture_time_us);
+        }
+        return true;
+    }
+}
+
+const picojson::value& SharedMemoryVideo::DeviceProperties() const
+{
+    return _device_properties;
+}
+
+const picojson::value& SharedMemoryVideo::FrameProperties() const
+{
+    return _frame_properties;
+}
+
+uint64_t SharedMemoryVideo::DroppedFrames() const
+{
+    return _dropped;
 }
 
 PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
@@ -79,6 +239,13 @@ PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
             const std::string shmem_name = std::string("/") + uri.url;
             std::shared_ptr<SharedMemoryBufferInterface> shmem_buffer =
                 open_named_shared_memory_buffer(shmem_name, true);
+
+            // Frame rings describe their own format
+            if (shmem_buffer && shmem_buffer->size() >= SharedMemoryRingHeaderBytes() &&
+                reinterpret_cast<SharedMemoryRingHeader*>(shmem_buffer->ptr())->magic.load() == SharedMemoryRingMagic()) {
+                return std::unique_ptr<VideoInterface>(new SharedMemoryVideo(shmem_buffer));
+            }
+
             if (dim.x == 0 || dim.y == 0 || !shmem_buffer) {
                 throw VideoException("invalid shared memory parameters");
             }
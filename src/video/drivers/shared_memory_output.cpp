@@ -0,0 +1,131 @@
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/video/drivers/shared_memory_output.h>
+#include <pangolin/video/video_interface.h>
+#include <pangolin/utils/timer.h>
+
+namespace pangolin
+{
+
+SharedMemoryVideoOutput::SharedMemoryVideoOutput(const std::string& name, size_t num_slots) :
+    _name(name),
+    _num_slots(num_slots),
+    _ring(nullptr),
+    _seq(0)
+{
+    // Readers need at least one slot which is not being written
+    if(_num_slots < 2) {
+        throw VideoException("SharedMemoryVideoOutput: at least 2 slots required");
+    }
+}
+
+SharedMemoryVideoOutput::~SharedMemoryVideoOutput()
+{
+}
+
+const std::vector<StreamInfo>& SharedMemoryVideoOutput::Streams() const
+{
+    return _streams;
+}
+
+void SharedMemoryVideoOutput::SetStreams(const std::vector<StreamInfo>& streams, const std::string& /*uri*/, const picojson::value& properties)
+{
+    if(_shared_memory) {
+        throw VideoException("SharedMemoryVideoOutput: streams already set");
+    }
+    if(streams.size() > SHARED_MEMORY_RING_MAX_STREAMS) {
+        throw VideoException("SharedMemoryVideoOutput: too many streams");
+    }
+
+    size_t frame_bytes = 0;
+    for(const StreamInfo& si : streams) {
+        frame_bytes = std::max(frame_bytes, (size_t)(si.Offset() - (unsigned char*)0) + si.SizeBytes());
+    }
+
+    const size_t slot_stride = (SHARED_MEMORY_RING_ALIGN + frame_bytes + SHARED_MEMORY_RING_ALIGN - 1) / SHARED_MEMORY_RING_ALIGN * SHARED_MEMORY_RING_ALIGN;
+    const size_t total_bytes = SharedMemoryRingHeaderBytes() + _num_slots * slot_stride;
+
+    _shared_memory = create_named_shared_memory_buffer(_name, total_bytes);
+    if(!_shared_memory) {
+        throw VideoException("SharedMemoryVideoOutput: unable to create shared memory", _name);
+    }
+
+    // Invalidate any previous ring with this name before rewriting header
+    unsigned char* base = _shared_memory->ptr();
+    _ring = reinterpret_cast<SharedMemoryRingHeader*>(base);
+    _ring->magic.store(0, std::memory_order_release);
+
+    _ring->version = SHARED_MEMORY_RING_VERSION;
+    _ring->num_slots = (uint32_t)_num_slots;
+    _ring->num_streams = (uint32_t)streams.size();
+    _ring->reserved = 0;
+    _ring->slot_stride = slot_stride;
+    _ring->frame_bytes = frame_bytes;
+    for(size_t i=0; i < streams.size(); ++i) {
+        SharedMemoryStreamDesc& d = _ring->streams[i];
+        memset(d.fmt, 0, sizeof(d.fmt));
+        strncpy(d.fmt, streams[i].PixFormat().format.c_str(), sizeof(d.fmt)-1);
+        d.w = (uint32_t)streams[i].Width();
+        d.h = (uint32_t)streams[i].Height();
+        d.pitch = streams[i].Pitch();
+        d.offset = streams[i].Offset() - (unsigned char*)0;
+    }
+    _ring->write_seq.store(0, std::memory_order_relaxed);
+    _ring->futex.store(0, std::memory_order_relaxed);
+    for(size_t s=0; s < _num_slots; ++s) {
+        SharedMemoryRingSlot(base, *_ring, s+1)->seq.store(0, std::memory_order_relaxed);
+    }
+
+    _ring->magic.store(SharedMemoryRingMagic(), std::memory_order_release);
+    _streams = streams;
+
+    if(!properties.is<picojson::null>()) {
+        pango_print_warn("SharedMemoryVideoOutput: Ignoring attached video properties.\n");
+    }
+}
+
+int SharedMemoryVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
+{
+    if(!_ring) {
+        throw VideoException("SharedMemoryVideoOutput: SetStreams must be called first");
+    }
+
+    const uint64_t seq = ++_seq;
+    SharedMemorySlotHeader* slot = SharedMemoryRingSlot(_shared_memory->ptr(), *_ring, seq);
+
+    // Odd sequence marks slot as being written
+    slot->seq.store(2*seq - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->host_reception_time_us = frame_properties.get_value<int64_t>(PANGO_HOST_RECEPTION_TIME_US, Time_us(TimeNow()));
+    slot->capture_time_us = frame_properties.get_value<int64_t>(PANGO_CAPTURE_TIME_US, 0);
+    memcpy(SharedMemorySlotData(slot), data, _ring->frame_bytes);
+
+    slot->seq.store(2*seq, std::memory_order_release);
+    _ring->write_seq.store(seq, std::memory_order_release);
+    _ring->futex.fetch_add(1, std::memory_order_release);
+    SharedMemoryRingWake(*_ring);
+
+    return (int)(seq - 1);
+}
+
+bool SharedMemoryVideoOutput::IsPipe() const
+{
+    return false;
+}
+
+PANGOLIN_REGISTER_FACTORY(SharedMemoryVideoOutput)
+{
+    struct SharedMemoryVideoOutputFactory final : public FactoryInterface<VideoOutputInterface> {
+        std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
+            const size_t num_slots = uri.Get<size_t>("slots", 4);
+            const std::string shmem_name = std::string("/") + uri.url;
+            return std::unique_ptr<VideoOutputInterface>(
+                new SharedMemoryVideoOutput(shmem_name, num_slots)
+            );
+        }
+    };
+
+    FactoryRegistry<VideoOutputInterface>::I().RegisterFactory(std::make_shared<SharedMemoryVideoOutputFactory>(), 10, "shmem");
+}
+
+}
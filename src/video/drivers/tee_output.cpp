@@ -0,0 +1,312 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/utils/file_utils.h>
+#include <pangolin/utils/log.h>
+#include <pangolin/video/drivers/tee_output.h>
+#include <pangolin/video/video.h>
+
+#include <cstring>
+
+namespace pangolin
+{
+
+TeeDropPolicy TeeDropPolicyFromString(const std::string& str)
+{
+    if(str == "block") return TeeDropBlock;
+    if(str == "oldest") return TeeDropOldest;
+    if(str == "newest") return TeeDropNewest;
+    throw VideoException("TeeVideoOutput: unknown drop policy '" + str + "', expected block, oldest or newest.");
+}
+
+TeeVideoOutput::TeeVideoOutput(std::vector<Sink>&& sink_list)
+    : frame_bytes(0), max_free_buffers(1), should_run(true), stats("tee")
+{
+    if(sink_list.empty()) {
+        throw VideoException("TeeVideoOutput: at least one output required");
+    }
+
+    for(Sink& sink : sink_list) {
+        if(!sink.output) {
+            throw VideoException("TeeVideoOutput: null output");
+        }
+        sink.max_queued_frames = std::max<size_t>(1, sink.max_queued_frames);
+        max_free_buffers += sink.max_queued_frames + 1;
+
+        std::unique_ptr<SinkState> s(new SinkState);
+        s->sink = std::move(sink);
+        sinks.push_back(std::move(s));
+    }
+
+    for(auto& s : sinks) {
+        SinkState* ps = s.get();
+        s->worker = std::thread([this,ps](){ WorkerLoop(*ps); });
+    }
+}
+
+TeeVideoOutput::~TeeVideoOutput()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        should_run = false;
+    }
+
+    // Workers drain their queues before exiting
+    for(auto& s : sinks) {
+        s->cond_jobs.notify_all();
+    }
+    for(auto& s : sinks) {
+        if(s->worker.joinable()) s->worker.join();
+    }
+}
+
+const std::vector<StreamInfo>& TeeVideoOutput::Streams() const
+{
+    return streams;
+}
+
+void TeeVideoOutput::SetStreams(const std::vector<StreamInfo>& st, const std::string& uri, const picojson::value& device_properties)
+{
+    Flush();
+
+    streams = st;
+    frame_bytes = 0;
+    for(const StreamInfo& si : streams) {
+        frame_bytes = std::max(frame_bytes, (size_t)si.Offset() + si.SizeBytes());
+    }
+
+    for(auto& s : sinks) {
+        s->sink.output->SetStreams(streams, uri, device_properties);
+    }
+
+    std::unique_lock<std::mutex> lock(free_mutex);
+    free_buffers.clear();
+}
+
+std::shared_ptr<const TeeVideoOutput::Frame> TeeVideoOutput::MakeFrame(const unsigned char* data, const picojson::value& frame_properties)
+{
+    std::unique_ptr<Frame> frame(new Frame);
+    {
+        std::unique_lock<std::mutex> lock(free_mutex);
+        if(!free_buffers.empty()) {
+            frame->data = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+
+    frame->data.resize(frame_bytes);
+    std::memcpy(frame->data.data(), data, frame_bytes);
+    frame->frame_properties = frame_properties;
+
+    // Return the buffer to the pool once the last sink lets go of it
+    return std::shared_ptr<const Frame>(frame.release(), [this](const Frame* f) {
+        {
+            std::unique_lock<std::mutex> lock(free_mutex);
+            if(free_buffers.size() < max_free_buffers) {
+                free_buffers.push_back(std::move(const_cast<Frame*>(f)->data));
+            }
+        }
+        delete f;
+    });
+}
+
+int TeeVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
+{
+    if(streams.empty()) {
+        throw VideoException("TeeVideoOutput: SetStreams must be called before WriteStreams");
+    }
+
+    std::shared_ptr<const Frame> frame;
+    {
+        VideoStats::Scope process_scope(stats, VideoStatsProcess);
+        frame = MakeFrame(data, frame_properties);
+    }
+    stats.AddFrames();
+    stats.AddBytes(frame_bytes);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t active = 0;
+    for(auto& ps : sinks) {
+        SinkState& s = *ps;
+        if(s.failed) continue;
+
+        if(s.queue.size() >= s.sink.max_queued_frames) {
+            if(s.sink.drop == TeeDropBlock) {
+                VideoStats::Scope wait_scope(stats, VideoStatsQueueWait);
+                while(s.queue.size() >= s.sink.max_queued_frames && !s.failed) {
+                    cond_done.wait(lock);
+                }
+                if(s.failed) continue;
+            }else if(s.sink.drop == TeeDropOldest) {
+                s.queue.pop_front();
+                ++s.dropped;
+                stats.AddDropped();
+            }else{
+                ++s.dropped;
+                stats.AddDropped();
+                ++active;
+                continue;
+            }
+        }
+
+        s.queue.push_back(frame);
+        s.cond_jobs.notify_one();
+        ++active;
+    }
+
+    if(active == 0) {
+        throw VideoException("TeeVideoOutput: every output has failed");
+    }
+
+    return 0;
+}
+
+bool TeeVideoOutput::IsPipe() const
+{
+    for(const auto& s : sinks) {
+        if(s->sink.output->IsPipe()) return true;
+    }
+    return false;
+}
+
+size_t TeeVideoOutput::NumSinks() const
+{
+    return sinks.size();
+}
+
+VideoOutputInterface& TeeVideoOutput::SinkOutput(size_t i)
+{
+    return *sinks.at(i)->sink.output;
+}
+
+size_t TeeVideoOutput::Dropped(size_t i) const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return sinks.at(i)->dropped;
+}
+
+size_t TeeVideoOutput::Written(size_t i) const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return sinks.at(i)->written;
+}
+
+VideoStats& TeeVideoOutput::Stats()
+{
+    return stats;
+}
+
+void TeeVideoOutput::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for(auto& s : sinks) {
+        while(!s->queue.empty() || s->busy) {
+            cond_done.wait(lock);
+        }
+    }
+}
+
+void TeeVideoOutput::WorkerLoop(SinkState& s)
+{
+    while(true) {
+        std::shared_ptr<const Frame> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(s.queue.empty() && should_run) {
+                s.cond_jobs.wait(lock);
+            }
+            if(s.queue.empty()) return;
+            frame = std::move(s.queue.front());
+            s.queue.pop_front();
+            s.busy = true;
+        }
+
+        // Space freed for a blocked writer
+        cond_done.notify_all();
+
+        std::string error;
+        try {
+            VideoStats::Scope write_scope(stats, VideoStatsWrite);
+            s.sink.output->WriteStreams(frame->data.data(), frame->frame_properties);
+        }catch(const std::exception& e) {
+            error = e.what();
+        }
+        frame.reset();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            s.busy = false;
+            if(error.empty()) {
+                ++s.written;
+            }else{
+                s.failed = true;
+                s.dropped += s.queue.size() + 1;
+                stats.AddDropped(s.queue.size() + 1);
+                s.queue.clear();
+            }
+        }
+        cond_done.notify_all();
+
+        if(!error.empty()) {
+            pango_print_warn("TeeVideoOutput: disabling output after error: %s\n", error.c_str());
+        }
+    }
+}
+
+PANGOLIN_REGISTER_FACTORY(TeeVideoOutput)
+{
+    struct TeeVideoFactory final : public FactoryInterface<VideoOutputInterface> {
+        std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
+            const std::vector<std::string> uris = SplitBrackets(uri.url);
+            if(uris.empty()) {
+                throw VideoException("TeeVideoOutput: no outputs specified, use tee://{uri1}{uri2}...");
+            }
+
+            // Defaults for every output, overridden per output by queueN / dropN
+            const size_t queue = uri.Get<size_t>("queue", 8);
+            const std::string drop = uri.Get<std::string>("drop", "block");
+
+            std::vector<TeeVideoOutput::Sink> sinks;
+            for(size_t i=0; i < uris.size(); ++i) {
+                const std::string n = std::to_string(i);
+                TeeVideoOutput::Sink sink;
+                sink.max_queued_frames = uri.Get<size_t>("queue" + n, queue);
+                sink.drop = TeeDropPolicyFromString(uri.Get<std::string>("drop" + n, drop));
+                sink.output = OpenVideoOutput(uris[i]);
+                sinks.push_back(std::move(sink));
+            }
+
+            return std::unique_ptr<VideoOutputInterface>(new TeeVideoOutput(std::move(sinks)));
+        }
+    };
+
+    auto factory = std::make_shared<TeeVideoFactory>();
+    FactoryRegistry<VideoOutputInterface>::I().RegisterFactory(factory, 10, "tee");
+}
+
+}
@@ -27,29 +27,229 @@
 
 #include <pangolin/video/drivers/test.h>
 #include <pangolin/factory/factory_registry.h>
+#include <pangolin/utils/log.h>
+#include <pangolin/utils/timer.h>
 #include <pangolin/video/iostream_operators.h>
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 namespace pangolin
 {
 
-void setRandomData(unsigned char * arr, size_t size){
-  for(size_t i = 0 ; i < size;i++) {
-//      arr[i] = (unsigned char)(i * 255.0 / size);
-      arr[i] = (unsigned char)(rand()/(RAND_MAX/255.0));
-  }
+namespace {
+
+const size_t TEST_CHECKER_SIZE = 32;
+const size_t TEST_BAR_WIDTH = 16;
+const size_t TEST_BAR_STEP = 4;
+
+uint64_t SplitMix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+uint64_t HashKey(uint64_t seed, uint64_t a, uint64_t b)
+{
+    uint64_t x = seed;
+    x ^= SplitMix64(x) + a;
+    x ^= SplitMix64(x) + b;
+    return SplitMix64(x);
+}
+
+// Fill with xorshift64* output, interleaving four independent generators
+// so that successive words don't wait on each other's results.
+void FillRandom(unsigned char* dst, size_t bytes, uint64_t key)
+{
+    uint64_t s[4];
+    for(int l=0; l < 4; ++l) s[l] = SplitMix64(key) | 1;
+
+    uint64_t block[4];
+    auto next = [&]() {
+        for(int l=0; l < 4; ++l) {
+            s[l] ^= s[l] >> 12;
+            s[l] ^= s[l] << 25;
+            s[l] ^= s[l] >> 27;
+            block[l] = s[l] * 0x2545F4914F6CDD1Dull;
+        }
+    };
+
+    const size_t full = bytes / sizeof(block);
+    for(size_t i=0; i < full; ++i) {
+        next();
+        std::memcpy(dst + i*sizeof(block), block, sizeof(block));
+    }
+    const size_t tail = bytes - full*sizeof(block);
+    if(tail) {
+        next();
+        std::memcpy(dst + full*sizeof(block), block, tail);
+    }
+}
+
+// Row y of a w x h pattern as full scale 16 bit values, 'channels' per pixel.
+void PatternRow(TestVideoPattern pattern, size_t y, size_t w, size_t h, size_t channels, uint64_t frame, uint16_t* row)
+{
+    const size_t wm1 = std::max<size_t>(w, 2) - 1;
+    for(size_t x=0; x < w; ++x) {
+        for(size_t c=0; c < channels; ++c) {
+            uint16_t v = 0;
+            switch(pattern) {
+            case TestVideoPatternGradient:
+                // Offset each channel's ramp so that colour formats aren't grey.
+                v = uint16_t(((x + c*w/channels) % w) * 0xFFFF / wm1);
+                break;
+            case TestVideoPatternCheckerboard:
+                v = ((x / TEST_CHECKER_SIZE + y / TEST_CHECKER_SIZE) & 1) ? 0xFFFF : 0;
+                break;
+            case TestVideoPatternMovingBar: {
+                const size_t pos = (frame * TEST_BAR_STEP) % w;
+                v = ((x + w - pos) % w < TEST_BAR_WIDTH) ? 0xFFFF : 0x2000;
+                break;
+            }
+            case TestVideoPatternBayer: {
+                const bool even_x = !(x & 1), even_y = !(y & 1);
+                if(even_x && even_y) {
+                    v = uint16_t(x * 0xFFFF / wm1);
+                }else if(!even_x && !even_y) {
+                    v = uint16_t((wm1 - std::min(x, wm1)) * 0xFFFF / wm1);
+                }else{
+                    v = uint16_t(0x4000 + y * 0x7FFF / (std::max<size_t>(h, 2) - 1));
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            row[x*channels + c] = v;
+        }
+    }
+}
+
+// Convert one row of full scale 16 bit values into pixel format fmt.
+void WriteRow(const uint16_t* v, unsigned char* out, const PixelFormat& fmt, size_t w)
+{
+    const unsigned bits = fmt.channel_bits[0];
+    const size_t n = w * fmt.channels;
+    const bool is_float = !fmt.format.empty() && fmt.format.back() == 'F';
+
+    if(fmt.format == "YUYV422" || fmt.format == "UYVY422") {
+        const size_t yo = fmt.format == "YUYV422" ? 0 : 1;
+        for(size_t x=0; x < w; ++x) {
+            out[2*x + yo] = (unsigned char)(v[x*fmt.channels] >> 8);
+            out[2*x + 1 - yo] = 128;
+        }
+    }else if(is_float && bits == 32) {
+        float* o = (float*)out;
+        for(size_t i=0; i < n; ++i) o[i] = v[i] / 65535.0f;
+    }else if(is_float && bits == 64) {
+        double* o = (double*)out;
+        for(size_t i=0; i < n; ++i) o[i] = v[i] / 65535.0;
+    }else if(bits == 8) {
+        for(size_t i=0; i < n; ++i) out[i] = (unsigned char)(v[i] >> 8);
+    }else if(bits == 16) {
+        uint16_t* o = (uint16_t*)out;
+        const unsigned shift = 16 - std::min(16u, fmt.channel_bit_depth);
+        for(size_t i=0; i < n; ++i) o[i] = uint16_t(v[i] >> shift);
+    }else if(bits == 32) {
+        uint32_t* o = (uint32_t*)out;
+        for(size_t i=0; i < n; ++i) o[i] = uint32_t(v[i]) << 16;
+    }else if(bits == 10 || bits == 12) {
+        // 4 pixels in 5 bytes or 2 pixels in 3 bytes, little endian, as
+        // read by unpack://. A partial group at the end of the row is
+        // zero padded up to a whole byte.
+        const size_t group = bits == 10 ? 4 : 2;
+        const unsigned drop = 16 - bits;
+        for(size_t i=0; i < n; i += group) {
+            const size_t count = std::min(group, n - i);
+            uint64_t p = 0;
+            for(size_t k=0; k < count; ++k) p |= uint64_t(v[i+k] >> drop) << (bits*k);
+            const size_t bytes = (count*bits + 7) / 8;
+            for(size_t b=0; b < bytes; ++b) out[b] = (unsigned char)(p >> (8*b));
+            out += bytes;
+        }
+    }else{
+        throw VideoException("TestVideo: Unsupported pixel format for pattern", fmt.format);
+    }
+}
+
+// Render pattern into image, laid out as si (ignoring its offset).
+void RenderPattern(unsigned char* image, const StreamInfo& si, TestVideoPattern pattern, uint64_t frame)
+{
+    const PixelFormat& fmt = si.PixFormat();
+    std::vector<uint16_t> row(si.Width() * fmt.channels);
+    if(pattern == TestVideoPatternMovingBar) {
+        // Every row is the same, so render one and replicate it.
+        PatternRow(pattern, 0, si.Width(), si.Height(), fmt.channels, frame, row.data());
+        WriteRow(row.data(), image, fmt, si.Width());
+        for(size_t y=1; y < si.Height(); ++y) {
+            std::memcpy(image + y*si.Pitch(), image, si.Pitch());
+        }
+    }else{
+        for(size_t y=0; y < si.Height(); ++y) {
+            PatternRow(pattern, y, si.Width(), si.Height(), fmt.channels, frame, row.data());
+            WriteRow(row.data(), image + y*si.Pitch(), fmt, si.Width());
+        }
+    }
+}
+
+const char* PatternName(TestVideoPattern pattern)
+{
+    switch(pattern) {
+    case TestVideoPatternGradient: return "gradient";
+    case TestVideoPatternCheckerboard: return "checkerboard";
+    case TestVideoPatternMovingBar: return "bar";
+    case TestVideoPatternBayer: return "bayer";
+    default: return "noise";
+    }
+}
+
 }
 
-TestVideo::TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt)
+TestVideo::TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt,
+                     TestVideoPattern pattern, uint64_t seed, double fps, double jitter_us)
+    : pattern(pattern), seed(seed), fps(fps), jitter_us(jitter_us),
+      next_frame(0), start_time_us(-1)
 {
+    // Keep capture times strictly increasing: neighbouring frames may be
+    // pushed towards each other by up to 2*jitter_us, which must stay
+    // under one frame period including rounding to whole microseconds.
+    if(fps > 0.0) {
+        const double max_jitter_us = std::max(0.0, 0.5e6 / fps - 1.0);
+        if(this->jitter_us > max_jitter_us) {
+            pango_print_warn("TestVideo: jitter_us=%g limited to %g at %g fps.\n", this->jitter_us, max_jitter_us, fps);
+            this->jitter_us = max_jitter_us;
+        }
+    }
+
     const PixelFormat pfmt = PixelFormatFromString(pix_fmt);
 
+    if(pattern == TestVideoPatternBayer && pfmt.channels != 1) {
+        throw VideoException("TestVideo: bayer pattern requires a single channel format", pix_fmt);
+    }
+
     size_bytes = 0;
 
+    // Rows of packed formats end on a whole byte
+    const size_t pitch = (w*pfmt.bpp + 7) / 8;
     for(size_t c=0; c < n; ++c) {
-        const StreamInfo stream_info(pfmt, w, h, (w*pfmt.bpp)/8, 0);
+        const StreamInfo stream_info(pfmt, w, h, pitch, (unsigned char*)0 + size_bytes);
         streams.push_back(stream_info);
-        size_bytes += w*h*(pfmt.bpp)/8;
+        size_bytes += h*pitch;
     }
+
+    if(pattern != TestVideoPatternNoise && pattern != TestVideoPatternMovingBar && n > 0) {
+        static_frame.resize(h*pitch);
+        RenderPattern(static_frame.data(), streams[0], pattern, 0);
+    }
+
+    device_properties["pattern"] = picojson::value(PatternName(pattern));
+    device_properties["seed"] = picojson::value((int64_t)seed);
+    device_properties["fps"] = picojson::value(fps);
+    device_properties["jitter_us"] = picojson::value(this->jitter_us);
+    device_properties[PANGO_HAS_TIMING_DATA] = picojson::value(true);
 }
 
 TestVideo::~TestVideo()
@@ -81,17 +281,99 @@ const std::vector<StreamInfo>& TestVideo::Streams() const
     return streams;
 }
 
-//! Implement VideoInput::GrabNext()
-bool TestVideo::GrabNext( unsigned char* image, bool /*wait*/ )
+void TestVideo::RenderFrame(unsigned char* image, uint64_t frame) const
+{
+    for(size_t c=0; c < streams.size(); ++c) {
+        const StreamInfo& si = streams[c];
+        unsigned char* dst = image + (size_t)si.Offset();
+        if(pattern == TestVideoPatternNoise) {
+            FillRandom(dst, si.SizeBytes(), HashKey(seed, c, frame));
+        }else if(pattern == TestVideoPatternMovingBar) {
+            RenderPattern(dst, si, pattern, frame);
+        }else{
+            std::memcpy(dst, static_frame.data(), static_frame.size());
+        }
+    }
+}
+
+int64_t TestVideo::CaptureOffset_us(uint64_t frame) const
+{
+    int64_t t = (int64_t)(frame * 1e6 / fps + 0.5);
+    if(jitter_us > 0.0) {
+        const double u = (HashKey(seed, ~0ull, frame) >> 11) * (1.0 / 9007199254740992.0);
+        t += (int64_t)((2.0*u - 1.0) * jitter_us);
+    }
+    return t;
+}
+
+bool TestVideo::Grab(unsigned char* image, bool wait, bool newest)
 {
-    setRandomData(image, size_bytes);
+    int64_t capture_time_us;
+
+    if(fps > 0.0) {
+        int64_t now_us = Time_us(TimeNow());
+        if(start_time_us < 0) start_time_us = now_us;
+        const int64_t elapsed_us = now_us - start_time_us;
+
+        if(newest) {
+            // Skip to the most recent frame which is already due.
+            const uint64_t due = (uint64_t)std::max<int64_t>(0, (int64_t)(elapsed_us * fps / 1e6));
+            if(due > next_frame + 1) next_frame = due - 1;
+            while(CaptureOffset_us(next_frame + 1) <= elapsed_us) ++next_frame;
+        }
+
+        const int64_t offset_us = CaptureOffset_us(next_frame);
+        if(offset_us > elapsed_us) {
+            if(!wait) return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(offset_us - elapsed_us));
+        }
+        capture_time_us = start_time_us + offset_us;
+    }else{
+        capture_time_us = Time_us(TimeNow());
+    }
+
+    RenderFrame(image, next_frame);
+
+    frame_properties = picojson::value(picojson::object_type, false);
+    frame_properties["frame_id"] = picojson::value((int64_t)next_frame);
+    frame_properties[PANGO_CAPTURE_TIME_US] = picojson::value(capture_time_us);
+    frame_properties[PANGO_ESTIMATED_CENTER_CAPTURE_TIME_US] = picojson::value(capture_time_us);
+    frame_properties[PANGO_HOST_RECEPTION_TIME_US] = picojson::value(Time_us(TimeNow()));
+
+    ++next_frame;
     return true;
 }
 
+//! Implement VideoInput::GrabNext()
+bool TestVideo::GrabNext( unsigned char* image, bool wait )
+{
+    return Grab(image, wait, false);
+}
+
 //! Implement VideoInput::GrabNewest()
 bool TestVideo::GrabNewest( unsigned char* image, bool wait )
 {
-    return GrabNext(image,wait);
+    return Grab(image, wait, true);
+}
+
+const picojson::value& TestVideo::DeviceProperties() const
+{
+    return device_properties;
+}
+
+const picojson::value& TestVideo::FrameProperties() const
+{
+    return frame_properties;
+}
+
+TestVideoPattern TestVideo::PatternFromString(const std::string& str)
+{
+    if(!str.compare("noise")) return TestVideoPatternNoise;
+    else if(!str.compare("gradient")) return TestVideoPatternGradient;
+    else if(!str.compare("checkerboard")) return TestVideoPatternCheckerboard;
+    else if(!str.compare("bar")) return TestVideoPatternMovingBar;
+    else if(!str.compare("bayer")) return TestVideoPatternBayer;
+    else throw VideoException("Unknown test pattern", str);
 }
 
 PANGOLIN_REGISTER_FACTORY(TestVideo)
@@ -101,7 +383,11 @@ PANGOLIN_REGISTER_FACTORY(TestVideo)
             const ImageDim dim = uri.Get<ImageDim>("size", ImageDim(640,480));
             const int n = uri.Get<int>("n", 1);
             std::string fmt  = uri.Get<std::string>("fmt","RGB24");
-            return std::unique_ptr<VideoInterface>(new TestVideo(dim.x,dim.y,n,fmt));
+            const TestVideoPattern pattern = TestVideo::PatternFromString(uri.Get<std::string>("pattern","noise"));
+            const uint64_t seed = uri.Get<uint64_t>("seed", 0);
+            const double fps = uri.Get<double>("fps", 0.0);
+            const double jitter_us = uri.Get<double>("jitter_us", 0.0);
+            return std::unique_ptr<VideoInterface>(new TestVideo(dim.x,dim.y,n,fmt,pattern,seed,fps,jitter_us));
         }
     };
 
@@ -26,6 +26,7 @@
  */
 
 #include <pangolin/factory/factory_registry.h>
+#include <pangolin/utils/trace.h>
 #include <pangolin/video/drivers/thread.h>
 #include <pangolin/video/iostream_operators.h>
 
@@ -47,7 +48,7 @@ const uint64_t grab_fail_thread_sleep_us = 1000;
 const uint64_t capture_timout_ms = 5000;
 
 ThreadVideo::ThreadVideo(std::unique_ptr<VideoInterface> &src_, size_t num_buffers)
-    : src(std::move(src_)), quit_grab_thread(true)
+    : src(std::move(src_)), quit_grab_thread(true), stats("thread")
 {
     if(!src) {
         throw VideoException("ThreadVideo: VideoInterface in must not be null");
@@ -121,7 +122,9 @@ uint32_t ThreadVideo::AvailableFrames() const
 
 bool ThreadVideo::DropNFrames(uint32_t n)
 {
-    return queue.DropNFrames(n);
+    const bool success = queue.DropNFrames(n);
+    if(success) stats.AddDropped(n);
+    return success;
 }
 
 //! Implement VideoInput::GrabNext()
@@ -140,6 +143,8 @@ bool ThreadVideo::GrabNext( unsigned char* image, bool wait )
     }else{
         if(queue.AvailableFrames() == 0 && wait) {
             // Must return a frame so block on notification from grab thread.
+            VideoStats::Scope wait_scope(stats, VideoStatsQueueWait);
+            PANGOLIN_TRACE_SCOPE("ThreadVideo::WaitForFrame", "video");
             std::unique_lock<std::mutex> lk(cvMtx);
             DBGPRINT("GrabNext no available frames wait for notification.");
             if(cv.wait_for(lk, std::chrono::milliseconds(capture_timout_ms)) == std::cv_status::timeout)
@@ -176,6 +181,8 @@ bool ThreadVideo::GrabNewest( unsigned char* image, bool wait )
     }else{
         if(queue.AvailableFrames() == 0 && wait) {
             // Must return a frame so block on notification from grab thread.
+            VideoStats::Scope wait_scope(stats, VideoStatsQueueWait);
+            PANGOLIN_TRACE_SCOPE("ThreadVideo::WaitForFrame", "video");
             std::unique_lock<std::mutex> lk(cvMtx);
             DBGPRINT("GrabNewest no available frames wait for notification.");
             if(cv.wait_for(lk, std::chrono::milliseconds(capture_timout_ms)) == std::cv_status::timeout)
@@ -187,6 +194,8 @@ bool ThreadVideo::GrabNewest( unsigned char* image, bool wait )
 
         // At least one valid frame in queue, return it.
         DBGPRINT("GrabNewest at least one frame available.");
+        const size_t available = queue.AvailableFrames();
+        if(available > 1) stats.AddDropped(available - 1);
         GrabResult grab = queue.getNewest();
         const bool success = grab.return_status;
         if(success) {
@@ -203,6 +212,7 @@ bool ThreadVideo::GrabNewest( unsigned char* image, bool wait )
 void ThreadVideo::operator()()
 {
     DBGPRINT("Grab thread Started.")
+    TraceSetThreadName("ThreadVideo grab");
     // Spinning thread attempting to read from videoin[0] as fast as possible
     // relying on the videoin[0] blocking grab.
     while(!quit_grab_thread) {
@@ -213,6 +223,8 @@ void ThreadVideo::operator()()
 
             // Blocking grab (i.e. GrabNext with wait = true).
             try{
+                VideoStats::Scope grab_scope(stats, VideoStatsGrab);
+                PANGOLIN_TRACE_SCOPE("ThreadVideo::Grab", "video");
                 grab.return_status = videoin[0]->GrabNext(grab.buffer.get(), true);
             }catch(const VideoException& e) {
                 // User doesn't have the opportunity to catch exceptions here.
@@ -225,6 +237,8 @@ void ThreadVideo::operator()()
             }
 
             if(grab.return_status){
+                stats.AddFrames();
+                stats.AddBytes(videoin[0]->SizeBytes());
                 grab.frame_properties = GetVideoFrameProperties(videoin[0]);
             }else{
                 std::this_thread::sleep_for(std::chrono::microseconds(grab_fail_thread_sleep_us) );
@@ -249,6 +263,11 @@ std::vector<VideoInterface*>& ThreadVideo::InputStreams()
     return videoin;
 }
 
+VideoStats& ThreadVideo::Stats()
+{
+    return stats;
+}
+
 PANGOLIN_REGISTER_FACTORY(ThreadVideo)
 {
     struct ThreadVideoFactory final : public FactoryInterface<VideoInterface> {
@@ -44,7 +44,7 @@ namespace pangolin
 {
 
 UnpackVideo::UnpackVideo(std::unique_ptr<VideoInterface> &src_, PixelFormat out_fmt)
-    : src(std::move(src_)), size_bytes(0), buffer(0)
+    : src(std::move(src_)), size_bytes(0), buffer(0), stats("unpack")
 {
     if( !src || out_fmt.channels != 1) {
         throw VideoException("UnpackVideo: Only supports single channel output.");
@@ -158,6 +158,9 @@ void ConvertFrom12bit(
 
 void UnpackVideo::Process(unsigned char* image, const unsigned char* buffer)
 {
+    VideoStats::Scope process_scope(stats, VideoStatsProcess);
+    stats.AddFrames();
+    stats.AddBytes(size_bytes);
     TSTART()
     for(size_t s=0; s<streams.size(); ++s) {
         const Image<unsigned char> img_in  = videoin[0]->Streams()[s].StreamImage(buffer);
@@ -218,6 +221,11 @@ std::vector<VideoInterface*>& UnpackVideo::InputStreams()
     return videoin;
 }
 
+VideoStats& UnpackVideo::Stats()
+{
+    return stats;
+}
+
 unsigned int UnpackVideo::AvailableFrames() const
 {
     BufferAwareVideoInterface* vpi = dynamic_cast<BufferAwareVideoInterface*>(videoin[0]);
@@ -0,0 +1,143 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/video/video_stats.h>
+#include <pangolin/video/video_interface.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace pangolin
+{
+
+namespace
+{
+
+std::atomic<bool>& StatsEnabledFlag()
+{
+    static std::atomic<bool> enabled( [](){
+        const char* env = std::getenv("PANGOLIN_VIDEO_STATS");
+        return !(env && std::strcmp(env, "0") == 0);
+    }() );
+    return enabled;
+}
+
+}
+
+const char* VideoStatsStageName(VideoStatsStage stage)
+{
+    switch(stage) {
+    case VideoStatsGrab: return "grab";
+    case VideoStatsProcess: return "process";
+    case VideoStatsQueueWait: return "queue_wait";
+    case VideoStatsWrite: return "write";
+    default: return "unknown";
+    }
+}
+
+bool VideoStatsEnabled()
+{
+    return StatsEnabledFlag().load(std::memory_order_relaxed);
+}
+
+void SetVideoStatsEnabled(bool enabled)
+{
+    StatsEnabledFlag().store(enabled, std::memory_order_relaxed);
+}
+
+VideoStats::VideoStats(const std::string& name)
+    : name(name), frames(0), dropped(0), bytes(0)
+{
+}
+
+void VideoStats::Reset()
+{
+    frames.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    for(int s=0; s < VideoStatsNumStages; ++s) {
+        histograms[s].Reset();
+    }
+}
+
+picojson::value VideoStats::ToJson() const
+{
+    picojson::value json(picojson::object_type, true);
+    json["name"] = name;
+    json["frames"] = (double)Frames();
+    json["dropped"] = (double)Dropped();
+    json["bytes"] = (double)Bytes();
+
+    picojson::value stages(picojson::object_type, true);
+    for(int s=0; s < VideoStatsNumStages; ++s) {
+        const LatencyHistogram& h = histograms[s];
+        if(h.Count() == 0) continue;
+        picojson::value js(picojson::object_type, true);
+        js["count"] = (double)h.Count();
+        js["mean_us"] = h.MeanNs() * 1e-3;
+        js["p50_us"] = h.PercentileNs(0.50) * 1e-3;
+        js["p90_us"] = h.PercentileNs(0.90) * 1e-3;
+        js["p99_us"] = h.PercentileNs(0.99) * 1e-3;
+        js["max_us"] = h.MaxNs() * 1e-3;
+        stages[VideoStatsStageName((VideoStatsStage)s)] = js;
+    }
+    json["stages"] = stages;
+    return json;
+}
+
+picojson::value GetVideoStats(VideoInterface* video)
+{
+    picojson::value json(picojson::object_type, true);
+    VideoStatsInterface* si = dynamic_cast<VideoStatsInterface*>(video);
+    json["driver"] = si ? si->Stats().ToJson() : picojson::value();
+
+    VideoFilterInterface* fi = dynamic_cast<VideoFilterInterface*>(video);
+    if(fi) {
+        picojson::value inputs(picojson::array_type, true);
+        for(VideoInterface* in : fi->InputStreams()) {
+            inputs.push_back(GetVideoStats(in));
+        }
+        json["inputs"] = inputs;
+    }
+    return json;
+}
+
+void ResetVideoStats(VideoInterface* video)
+{
+    VideoStatsInterface* si = dynamic_cast<VideoStatsInterface*>(video);
+    if(si) si->Stats().Reset();
+
+    VideoFilterInterface* fi = dynamic_cast<VideoFilterInterface*>(video);
+    if(fi) {
+        for(VideoInterface* in : fi->InputStreams()) {
+            ResetVideoStats(in);
+        }
+    }
+}
+
+}
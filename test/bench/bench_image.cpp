@@ -0,0 +1,177 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <benchmark/benchmark.h>
+
+#include <pangolin/image/image_io.h>
+#include <pangolin/image/image_utils.h>
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+namespace {
+
+// Smooth gradient with mild noise, so that compression ratios resemble
+// camera imagery rather than best or worst case input.
+pangolin::TypedImage MakeBenchImage(size_t w, size_t h, const std::string& fmt)
+{
+    pangolin::TypedImage img(w, h, pangolin::PixelFormatFromString(fmt));
+    std::minstd_rand rng(0);
+    for(size_t y=0; y < img.h; ++y) {
+        unsigned char* row = img.RowPtr(y);
+        for(size_t x=0; x < img.pitch; ++x) {
+            row[x] = (unsigned char)((x + y) / 8 + rng() % 8);
+        }
+    }
+    return img;
+}
+
+void BM_SaveImage(benchmark::State& state, pangolin::ImageFileType file_type, const std::string& fmt)
+{
+    const pangolin::TypedImage img = MakeBenchImage(1280, 960, fmt);
+    size_t encoded_bytes = 0;
+
+    for(auto _ : state) {
+        std::ostringstream out;
+        try {
+            pangolin::SaveImage(img, img.fmt, out, file_type, true, 90.0f);
+        }catch(const std::exception& e) {
+            state.SkipWithError(e.what());
+            return;
+        }
+        encoded_bytes = out.tellp();
+    }
+
+    state.SetBytesProcessed(state.iterations() * img.SizeBytes());
+    state.counters["ratio"] = (double)img.SizeBytes() / std::max<size_t>(encoded_bytes, 1);
+}
+
+void BM_LoadImage(benchmark::State& state, pangolin::ImageFileType file_type, const std::string& fmt)
+{
+    const pangolin::TypedImage img = MakeBenchImage(1280, 960, fmt);
+    std::string encoded;
+    try {
+        std::ostringstream out;
+        pangolin::SaveImage(img, img.fmt, out, file_type, true, 90.0f);
+        encoded = out.str();
+    }catch(const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    for(auto _ : state) {
+        std::istringstream in(encoded);
+        try {
+            pangolin::TypedImage loaded = pangolin::LoadImage(in, file_type);
+            benchmark::DoNotOptimize(loaded.ptr);
+        }catch(const std::exception& e) {
+            state.SkipWithError(e.what());
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * img.SizeBytes());
+}
+
+#define PANGOLIN_BENCH_IMAGE_IO(name, type, fmt) \
+    BENCHMARK_CAPTURE(BM_SaveImage, name, type, std::string(fmt)); \
+    BENCHMARK_CAPTURE(BM_LoadImage, name, type, std::string(fmt))
+
+PANGOLIN_BENCH_IMAGE_IO(ppm_rgb24,   pangolin::ImageFileTypePpm,   "RGB24");
+PANGOLIN_BENCH_IMAGE_IO(ppm_gray16,  pangolin::ImageFileTypePpm,   "GRAY16LE");
+PANGOLIN_BENCH_IMAGE_IO(png_rgb24,   pangolin::ImageFileTypePng,   "RGB24");
+PANGOLIN_BENCH_IMAGE_IO(png_gray8,   pangolin::ImageFileTypePng,   "GRAY8");
+PANGOLIN_BENCH_IMAGE_IO(jpg_rgb24,   pangolin::ImageFileTypeJpg,   "RGB24");
+PANGOLIN_BENCH_IMAGE_IO(jpg_gray8,   pangolin::ImageFileTypeJpg,   "GRAY8");
+PANGOLIN_BENCH_IMAGE_IO(zstd_gray16, pangolin::ImageFileTypeZstd,  "GRAY16LE");
+PANGOLIN_BENCH_IMAGE_IO(lz4_gray16,  pangolin::ImageFileTypeLz4,   "GRAY16LE");
+PANGOLIN_BENCH_IMAGE_IO(p12b_gray16, pangolin::ImageFileTypeP12b,  "GRAY16LE");
+
+// Statistics used by ImageView auto-scaling, on the full 1280x960 frame.
+// The scalar variants time the generic template for comparison.
+pangolin::TypedImage MakeStatsImage(const std::string& fmt)
+{
+    pangolin::TypedImage img = MakeBenchImage(1280, 960, fmt);
+    if(img.fmt.format == "GRAY32F") {
+        for(size_t y=0; y < img.h; ++y) {
+            float* row = (float*)img.RowPtr(y);
+            for(size_t x=0; x < img.w; ++x) {
+                row[x] = (x + y) * 0.001f;
+            }
+        }
+    }
+    return img;
+}
+
+void BM_ImageMinMax(benchmark::State& state, const std::string& fmt)
+{
+    const pangolin::TypedImage img = MakeStatsImage(fmt);
+    const pangolin::GlPixFormat glfmt(img.fmt);
+    const pangolin::XYRangei roi(0, (int)img.w - 1, 0, (int)img.h - 1);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(pangolin::GetMinMax(img, roi, glfmt));
+    }
+    state.SetBytesProcessed(state.iterations() * img.SizeBytes());
+}
+
+void BM_ImageMinMaxScalar(benchmark::State& state, const std::string& fmt)
+{
+    const pangolin::TypedImage img = MakeStatsImage(fmt);
+    for(auto _ : state) {
+        if(img.fmt.format == "GRAY32F") {
+            benchmark::DoNotOptimize(pangolin::internal::GetMinMax<float>(img.UnsafeReinterpret<float>(), img.fmt.channels));
+        }else{
+            benchmark::DoNotOptimize(pangolin::internal::GetMinMax<unsigned short>(img.UnsafeReinterpret<unsigned short>(), img.fmt.channels));
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * img.SizeBytes());
+}
+
+void BM_ImagePercentileRange(benchmark::State& state, const std::string& fmt)
+{
+    const pangolin::TypedImage img = MakeStatsImage(fmt);
+    const pangolin::GlPixFormat glfmt(img.fmt);
+    const pangolin::XYRangei roi(0, (int)img.w - 1, 0, (int)img.h - 1);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(pangolin::GetPercentileRange(img, roi, glfmt, 0.01f, 0.99f));
+    }
+    state.SetBytesProcessed(state.iterations() * img.SizeBytes());
+}
+
+BENCHMARK_CAPTURE(BM_ImageMinMax, gray8,    std::string("GRAY8"));
+BENCHMARK_CAPTURE(BM_ImageMinMax, rgba32,   std::string("RGBA32"));
+BENCHMARK_CAPTURE(BM_ImageMinMax, gray16,   std::string("GRAY16LE"));
+BENCHMARK_CAPTURE(BM_ImageMinMax, gray32f,  std::string("GRAY32F"));
+BENCHMARK_CAPTURE(BM_ImageMinMaxScalar, gray16,  std::string("GRAY16LE"));
+BENCHMARK_CAPTURE(BM_ImageMinMaxScalar, gray32f, std::string("GRAY32F"));
+BENCHMARK_CAPTURE(BM_ImagePercentileRange, gray8,   std::string("GRAY8"));
+BENCHMARK_CAPTURE(BM_ImagePercentileRange, gray16,  std::string("GRAY16LE"));
+BENCHMARK_CAPTURE(BM_ImagePercentileRange, gray32f, std::string("GRAY32F"));
+
+}
@@ -0,0 +1,232 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <benchmark/benchmark.h>
+
+#include <pangolin/log/packetstream_writer.h>
+#include <pangolin/log/packetstream_reader.h>
+#include <pangolin/log/playback_session.h>
+
+#ifdef BUILD_PANGOLIN_GUI
+#  include <pangolin/plot/datalog.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const std::string bench_pango_file = "pangolin_bench.pango";
+
+// Write a log of num_frames fixed size packets, returning the source id.
+pangolin::PacketStreamSourceId WriteBenchLog(const std::string& filename, size_t packet_bytes, size_t num_frames)
+{
+    std::vector<char> data(packet_bytes, 0x5a);
+    pangolin::PacketStreamWriter writer(filename);
+    pangolin::PacketStreamSource pss;
+    pss.driver = "bench";
+    pss.uri = "bench://";
+    pss.data_size_bytes = packet_bytes;
+    const pangolin::PacketStreamSourceId id = writer.AddSource(pss);
+    for(size_t i=0; i < num_frames; ++i) {
+        writer.WriteSourcePacket(id, data.data(), (int64_t)i, packet_bytes);
+    }
+    return id;
+}
+
+// Sustained writer throughput for packets of range(0) bytes.
+void BM_PacketStreamWrite(benchmark::State& state)
+{
+    const size_t packet_bytes = state.range(0);
+    std::vector<char> data(packet_bytes, 0x5a);
+
+    {
+        pangolin::PacketStreamWriter writer(bench_pango_file);
+        pangolin::PacketStreamSource pss;
+        pss.driver = "bench";
+        pss.uri = "bench://";
+        pss.data_size_bytes = packet_bytes;
+        const pangolin::PacketStreamSourceId id = writer.AddSource(pss);
+
+        int64_t t = 0;
+        for(auto _ : state) {
+            writer.WriteSourcePacket(id, data.data(), t++, packet_bytes);
+        }
+    }
+    std::remove(bench_pango_file.c_str());
+
+    state.SetBytesProcessed(state.iterations() * packet_bytes);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PacketStreamWrite)->Arg(1<<10)->Arg(1<<16)->Arg(1<<20)->Arg(8<<20)->UseRealTime();
+
+// Small high rate packets (e.g. IMU), appended range(0) at a time through
+// PacketStreamBatch, or one at a time for range(0) == 1.
+void BM_PacketStreamWriteSmall(benchmark::State& state)
+{
+    const size_t batch_size = state.range(0);
+    const size_t packet_bytes = 48;
+    std::vector<char> data(packet_bytes, 0x5a);
+
+    {
+        pangolin::PacketStreamWriter writer(bench_pango_file);
+        pangolin::PacketStreamSource pss;
+        pss.driver = "bench";
+        pss.uri = "bench://";
+        pss.data_size_bytes = packet_bytes;
+        const pangolin::PacketStreamSourceId id = writer.AddSource(pss);
+
+        pangolin::PacketStreamBatch batch;
+        int64_t t = 0;
+        for(auto _ : state) {
+            if(batch_size == 1) {
+                writer.WriteSourcePacket(id, data.data(), t++, packet_bytes);
+            }else{
+                batch.Clear();
+                for(size_t i=0; i < batch_size; ++i) {
+                    batch.Add(id, data.data(), t++, packet_bytes);
+                }
+                writer.WriteBatch(batch);
+            }
+        }
+    }
+    std::remove(bench_pango_file.c_str());
+
+    state.SetBytesProcessed(state.iterations() * batch_size * packet_bytes);
+    state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+BENCHMARK(BM_PacketStreamWriteSmall)->Arg(1)->Arg(16)->Arg(256)->UseRealTime();
+
+// Sequential reader throughput for packets of range(0) bytes.
+void BM_PacketStreamRead(benchmark::State& state)
+{
+    const size_t packet_bytes = state.range(0);
+    const size_t num_frames = std::max<size_t>(8, (64<<20) / packet_bytes);
+    const pangolin::PacketStreamSourceId id = WriteBenchLog(bench_pango_file, packet_bytes, num_frames);
+    std::vector<char> data(packet_bytes);
+
+    {
+        pangolin::PacketStreamReader reader(bench_pango_file);
+        size_t frame = 0;
+        for(auto _ : state) {
+            if(frame == num_frames) {
+                state.PauseTiming();
+                reader.Seek(id, 0);
+                frame = 0;
+                state.ResumeTiming();
+            }
+            pangolin::Packet pkt = reader.NextFrame(id);
+            pkt.Stream().read(data.data(), pkt.BytesRemaining());
+            ++frame;
+        }
+    }
+    std::remove(bench_pango_file.c_str());
+
+    state.SetBytesProcessed(state.iterations() * packet_bytes);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PacketStreamRead)->Arg(1<<10)->Arg(1<<16)->Arg(1<<20)->Arg(8<<20)->UseRealTime();
+
+// Latency of random access through the packet index.
+void BM_PacketStreamSeek(benchmark::State& state)
+{
+    const size_t packet_bytes = 1<<16;
+    const size_t num_frames = state.range(0);
+    const pangolin::PacketStreamSourceId id = WriteBenchLog(bench_pango_file, packet_bytes, num_frames);
+
+    {
+        pangolin::PacketStreamReader reader(bench_pango_file);
+        size_t frame = 0;
+        for(auto _ : state) {
+            // Stride by a large prime to defeat sequential prefetch.
+            frame = (frame + 7919) % num_frames;
+            benchmark::DoNotOptimize(reader.Seek(id, frame));
+        }
+    }
+    std::remove(bench_pango_file.c_str());
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_PacketStreamSeek)->Arg(1000)->Arg(10000);
+
+// Opening range(0) logs into one session and merging their indices.
+void BM_PlaybackSessionOpen(benchmark::State& state)
+{
+    std::vector<std::string> files;
+    for(int64_t i=0; i < state.range(0); ++i) {
+        files.push_back("pangolin_bench_" + std::to_string(i) + ".pango");
+        WriteBenchLog(files.back(), 1<<12, 5000);
+    }
+
+    for(auto _ : state) {
+        auto session = std::make_shared<pangolin::PlaybackSession>();
+        session->OpenAll(files);
+        benchmark::DoNotOptimize(session->Index()->Size());
+    }
+
+    for(const std::string& f : files) {
+        std::remove(f.c_str());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_PlaybackSessionOpen)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+#ifdef BUILD_PANGOLIN_GUI
+// DataLog::Log for range(0) dimensional samples.
+void BM_DataLog(benchmark::State& state)
+{
+    const size_t dim = state.range(0);
+    std::vector<float> vals(dim, 1.0f);
+    pangolin::DataLog log;
+
+    size_t samples = 0;
+    for(auto _ : state) {
+        log.Log(dim, vals.data());
+        // Bound memory growth on long runs.
+        if(++samples == 1000000) {
+            state.PauseTiming();
+            log.Clear();
+            samples = 0;
+            state.ResumeTiming();
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_DataLog)->Arg(1)->Arg(4)->Arg(16);
+#endif
+
+}
@@ -0,0 +1,222 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <benchmark/benchmark.h>
+
+#include <pangolin/video/video.h>
+#include <pangolin/video/video_output.h>
+#include <pangolin/video/video_stats.h>
+#include <pangolin/utils/trace.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Grab frames from uri in a tight loop. Each filter below wraps test://,
+// so compare against the test:// baseline of the same size and format to
+// isolate the cost of the filter itself.
+void BM_VideoGrab(benchmark::State& state, const std::string& uri)
+{
+    std::unique_ptr<pangolin::VideoInterface> video;
+    try {
+        video = pangolin::OpenVideo(uri);
+    }catch(const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    std::vector<unsigned char> buffer(video->SizeBytes());
+    video->Start();
+    try {
+        for(auto _ : state) {
+            if(!video->GrabNext(buffer.data(), true)) {
+                state.SkipWithError("GrabNext failed");
+                break;
+            }
+            benchmark::DoNotOptimize(buffer.data());
+        }
+    }catch(const std::exception& e) {
+        state.SkipWithError(e.what());
+    }
+    video->Stop();
+
+    state.SetBytesProcessed(state.iterations() * video->SizeBytes());
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(BM_VideoGrab, test_rgb24,   std::string("test:[size=640x480,fmt=RGB24]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_gray8,   std::string("test:[size=1280x960,fmt=GRAY8]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_gray12,  std::string("test:[size=1280x960,fmt=GRAY12]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_gray16,  std::string("test:[size=1280x960,fmt=GRAY16LE]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_n2,      std::string("test:[size=640x480,fmt=GRAY8,n=2]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_grad,    std::string("test:[size=640x480,fmt=RGB24,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_bar,     std::string("test:[size=1280x960,fmt=GRAY8,pattern=bar]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, test_bayer12, std::string("test:[size=1280x960,fmt=GRAY12,pattern=bayer]//"));
+
+BENCHMARK_CAPTURE(BM_VideoGrab, debayer_downsample, std::string("debayer:[tile=rggb,method=downsample]//test:[size=1280x960,fmt=GRAY8]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, debayer_bilinear,   std::string("debayer:[tile=rggb,method=bilinear]//test:[size=1280x960,fmt=GRAY8]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, unpack_gray12,      std::string("unpack:[fmt=GRAY16LE]//test:[size=1280x960,fmt=GRAY12]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, mirror_flipx,       std::string("mirror:[stream0=FlipX]//test:[size=640x480,fmt=RGB24]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, mirror_flipy,       std::string("mirror:[stream0=FlipY]//test:[size=640x480,fmt=RGB24]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, mirror_rotatecw,    std::string("mirror:[stream0=RotateCW]//test:[size=640x480,fmt=RGB24]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, shift_gray16,       std::string("shift:[shift=8]//test:[size=1280x960,fmt=GRAY16LE]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, merge_n2,           std::string("merge:[size=1280x480,pos1=0x0,pos2=640x0]//test:[size=640x480,fmt=GRAY8,n=2]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, join_sync,          std::string("join:[sync_tolerance_us=1000]//{test:[size=640x480,fmt=GRAY8,pattern=bar]//}{test:[size=640x480,fmt=GRAY8,pattern=bar]//}"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_yuyv_rgb,   std::string("convert:[fmt=RGB24]//test:[size=1280x960,fmt=YUYV422,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_rgb_bgr,    std::string("convert:[fmt=BGR24]//test:[size=1280x960,fmt=RGB24,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_rgba_rgb,   std::string("convert:[fmt=RGB24]//test:[size=1280x960,fmt=RGBA32,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_gray16_8,   std::string("convert:[fmt=GRAY8]//test:[size=1280x960,fmt=GRAY16LE,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_gray8_f32,  std::string("convert:[fmt=GRAY32F,scale=0.00392157]//test:[size=1280x960,fmt=GRAY8,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, convert_rgb_gray,   std::string("convert:[fmt=GRAY8]//test:[size=1280x960,fmt=RGB24,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, resize_box_rgb,     std::string("resize:[method=box,threads=1]//test:[size=1280x960,fmt=RGB24,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, resize_area_gray,   std::string("resize:[method=area,scale=0.3,threads=1]//test:[size=1280x960,fmt=GRAY8,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, resize_bilinear,    std::string("resize:[method=bilinear,size=800x600,threads=1]//test:[size=1280x960,fmt=RGB24,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, pyramid_gray,       std::string("pyramid:[levels=4,threads=1]//test:[size=1280x960,fmt=GRAY8,pattern=gradient]//"));
+BENCHMARK_CAPTURE(BM_VideoGrab, pyramid_gray_mt,    std::string("pyramid:[levels=4,threads=4]//test:[size=1280x960,fmt=GRAY8,pattern=gradient]//"));
+
+// Producer / consumer handoff through ThreadVideo, for varying queue depth.
+void BM_ThreadVideo(benchmark::State& state)
+{
+    BM_VideoGrab(state, "thread:[num_buffers=" + std::to_string(state.range(0)) + "]//test:[size=640x480,fmt=RGB24]//");
+}
+
+BENCHMARK(BM_ThreadVideo)->Arg(2)->Arg(4)->Arg(16)->UseRealTime();
+
+// Cost of one instrumented stage, with stats enabled (1) or disabled (0).
+void BM_VideoStatsScope(benchmark::State& state)
+{
+    const bool was_enabled = pangolin::VideoStatsEnabled();
+    pangolin::SetVideoStatsEnabled(state.range(0) != 0);
+    pangolin::VideoStats stats("bench");
+    for(auto _ : state) {
+        pangolin::VideoStats::Scope scope(stats, pangolin::VideoStatsProcess);
+        benchmark::ClobberMemory();
+    }
+    pangolin::SetVideoStatsEnabled(was_enabled);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_VideoStatsScope)->Arg(0)->Arg(1);
+
+// Cost of one trace marker, with tracing disabled (0) or enabled (1).
+void BM_TraceScope(benchmark::State& state)
+{
+    const bool was_enabled = pangolin::TraceEnabled();
+    if(state.range(0)) pangolin::TraceStart();
+    for(auto _ : state) {
+        PANGOLIN_TRACE_SCOPE("bench");
+        benchmark::ClobberMemory();
+    }
+    if(state.range(0) && !was_enabled) pangolin::TraceStop();
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_TraceScope)->Arg(0)->Arg(1);
+
+// Filter chain with every stage instrumented, then exported to JSON
+void BM_VideoStatsExport(benchmark::State& state)
+{
+    std::unique_ptr<pangolin::VideoInterface> video = pangolin::OpenVideo("convert:[fmt=GRAY8]//unpack:[fmt=GRAY16LE]//test:[size=640x480,fmt=GRAY12]//");
+    std::vector<unsigned char> buffer(video->SizeBytes());
+    video->Start();
+    for(size_t i=0; i < 100; ++i) video->GrabNext(buffer.data(), true);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(pangolin::GetVideoStats(video.get()));
+    }
+    video->Stop();
+}
+
+BENCHMARK(BM_VideoStatsExport);
+
+
+// Record test:// frames through output uri, removing files afterwards.
+void BM_VideoWrite(benchmark::State& state, const std::string& uri, const std::vector<std::string>& files)
+{
+    std::unique_ptr<pangolin::VideoInterface> video = pangolin::OpenVideo("test:[size=640x480,fmt=RGB24,pattern=gradient]//");
+    std::vector<unsigned char> buffer(video->SizeBytes());
+    video->GrabNext(buffer.data());
+
+    {
+        pangolin::VideoOutput output(uri);
+        output.SetStreams(video->Streams());
+        for(auto _ : state) {
+            output.WriteStreams(buffer.data());
+        }
+    }
+    for(const std::string& f : files) {
+        std::remove(f.c_str());
+    }
+
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(BM_VideoWrite, pango, std::string("pango://bench_a.pango"), std::vector<std::string>{"bench_a.pango"})->UseRealTime();
+BENCHMARK_CAPTURE(BM_VideoWrite, tee_pango_x2, std::string("tee://{pango://bench_a.pango}{pango://bench_b.pango}"), std::vector<std::string>{"bench_a.pango","bench_b.pango"})->UseRealTime();
+BENCHMARK_CAPTURE(BM_VideoWrite, tee_pango_drop, std::string("tee:[queue=2,drop=oldest]//{pango://bench_a.pango}{pango://bench_b.pango}"), std::vector<std::string>{"bench_a.pango","bench_b.pango"})->UseRealTime();
+
+
+// Playback of a recorded log, rewinding at the end, for pango:[options].
+void BM_PangoPlayback(benchmark::State& state, const std::string& options)
+{
+    const std::string filename = "bench_playback.pango";
+    {
+        std::unique_ptr<pangolin::VideoInterface> video = pangolin::OpenVideo("test:[size=640x480,fmt=RGB24]//");
+        std::vector<unsigned char> buffer(video->SizeBytes());
+        pangolin::VideoOutput output("pango://" + filename);
+        output.SetStreams(video->Streams());
+        for(int i=0; i < 200; ++i) {
+            video->GrabNext(buffer.data());
+            output.WriteStreams(buffer.data());
+        }
+    }
+
+    {
+        std::unique_ptr<pangolin::VideoInterface> video = pangolin::OpenVideo("pango:" + options + "//" + filename);
+        pangolin::VideoPlaybackInterface* playback = dynamic_cast<pangolin::VideoPlaybackInterface*>(video.get());
+        std::vector<unsigned char> buffer(video->SizeBytes());
+        for(auto _ : state) {
+            if(!video->GrabNext(buffer.data())) {
+                state.PauseTiming();
+                playback->Seek(0);
+                state.ResumeTiming();
+            }
+        }
+        state.SetBytesProcessed(state.iterations() * buffer.size());
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::remove(filename.c_str());
+}
+
+BENCHMARK_CAPTURE(BM_PangoPlayback, paced,        std::string(""))->UseRealTime();
+BENCHMARK_CAPTURE(BM_PangoPlayback, throughput,   std::string("[throughput=1,read_ahead_frames=0]"))->UseRealTime();
+BENCHMARK_CAPTURE(BM_PangoPlayback, read_ahead_8, std::string("[throughput=1,read_ahead_frames=8]"))->UseRealTime();
+
+}
@@ -0,0 +1,181 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/geometry/geometry.h>
+#include <pangolin/geometry/geometry_cache.h>
+
+#include "test_check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace pangolin;
+
+namespace
+{
+
+std::string ReadFile(const std::string& filename)
+{
+    std::ifstream f(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+    f << contents;
+}
+
+bool SameElement(const Geometry::Element& a, const Geometry::Element& b)
+{
+    if(a.w != b.w || a.h != b.h || a.attributes.size() != b.attributes.size()) return false;
+    for(size_t y=0; y < a.h; ++y) {
+        if(std::memcmp(a.RowPtr(y), b.RowPtr(y), a.w)) return false;
+    }
+    for(const auto& attrib : a.attributes) {
+        if(!b.attributes.count(attrib.first)) return false;
+    }
+    return true;
+}
+
+bool SameGeometry(const Geometry& a, const Geometry& b)
+{
+    if(a.buffers.size() != b.buffers.size() || a.objects.size() != b.objects.size()) return false;
+    for(const auto& buf : a.buffers) {
+        const auto it = b.buffers.find(buf.first);
+        if(it == b.buffers.end() || !SameElement(buf.second, it->second)) return false;
+    }
+    for(auto ia = a.objects.begin(), ib = b.objects.begin(); ia != a.objects.end(); ++ia, ++ib) {
+        if(ia->first != ib->first || !SameElement(ia->second, ib->second)) return false;
+    }
+    return true;
+}
+
+// Rewrite filename, keeping its modification time
+void WriteFileKeepMTime(const std::string& filename, const std::string& contents)
+{
+    struct stat st;
+    stat(filename.c_str(), &st);
+    WriteFile(filename, contents);
+    const timespec times[2] = {st.st_atim, st.st_mtim};
+    utimensat(AT_FDCWD, filename.c_str(), times, 0);
+}
+
+void TestGeometryCache()
+{
+    const std::string source = "cache_test.obj";
+    const std::string contents = "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nv 2 1 0\nf 1 2 3\nf 2 4 3\nf 2 5 4\n";
+    WriteFile(source, contents);
+    const std::string octree_key = "BuildGeometryOctree 1";
+    const std::string cache = GeometryCacheFilename(source);
+    const std::string post_cache = GeometryCacheFilename(source, octree_key);
+    std::remove(cache.c_str());
+    std::remove(post_cache.c_str());
+    PANGO_CHECK(cache != post_cache);
+    PANGO_CHECK(post_cache != GeometryCacheFilename(source, "BuildGeometryOctree 2"));
+
+    // Loading with use_cache writes the plain cache, which round trips
+    const Geometry parsed = LoadGeometry(source, false);
+    LoadGeometry(source, true);
+    Geometry loaded;
+    PANGO_CHECK(TryLoadGeometryCache(loaded, cache, source));
+    PANGO_CHECK(SameGeometry(parsed, loaded));
+
+    // Caches made with different post processing are never confused
+    Geometry unused;
+    PANGO_CHECK(!TryLoadGeometryCache(unused, cache, source, octree_key));
+    Geometry post = LoadGeometry(source, false);
+    BuildGeometryOctree(post, 1);
+    SaveGeometryCache(post, post_cache, source, octree_key);
+    Geometry post_loaded;
+    PANGO_CHECK(TryLoadGeometryCache(post_loaded, post_cache, source, octree_key));
+    PANGO_CHECK(SameGeometry(post, post_loaded));
+    PANGO_CHECK(!TryLoadGeometryCache(unused, post_cache, source));
+    PANGO_CHECK(!TryLoadGeometryCache(unused, post_cache, source, "BuildGeometryOctree 2"));
+
+    // Octree nodes round trip field by field
+    for(const auto& buf : post.buffers) {
+        const GeometryOctree& a = buf.second.octree;
+        const GeometryOctree& b = post_loaded.buffers[buf.first].octree;
+        PANGO_CHECK(a.size() == b.size());
+        for(size_t i=0; i < a.size() && i < b.size(); ++i) {
+            PANGO_CHECK(!std::memcmp(a[i].min, b[i].min, sizeof(a[i].min)) && !std::memcmp(a[i].max, b[i].max, sizeof(a[i].max)));
+            PANGO_CHECK(a[i].first == b[i].first && a[i].count == b[i].count && a[i].skip == b[i].skip && a[i].leaf == b[i].leaf);
+        }
+    }
+
+    // Truncated or corrupted caches are rejected without throwing
+    const std::string good = ReadFile(post_cache);
+    const std::string bad = "cache_test.bad";
+    std::mt19937 rng(1);
+    for(size_t i=0; i < good.size() + 2000; ++i) {
+        std::string corrupt = good;
+        if(i < good.size()) {
+            corrupt.resize(i);
+        }else{
+            for(int k=0; k < 4; ++k) corrupt[rng() % corrupt.size()] = (char)rng();
+        }
+        WriteFile(bad, corrupt);
+        try {
+            Geometry g;
+            const bool ok = TryLoadGeometryCache(g, bad, source, octree_key);
+            PANGO_CHECK(i >= good.size() || !ok);
+        }catch(const std::exception& e) {
+            std::fprintf(stderr, "TryLoadGeometryCache threw: %s\n", e.what());
+            PANGO_CHECK(false);
+        }
+    }
+
+    // Touching the source keeps the cache valid
+    const timespec now[2] = {{0, UTIME_NOW}, {0, UTIME_NOW}};
+    utimensat(AT_FDCWD, source.c_str(), now, 0);
+    PANGO_CHECK(TryLoadGeometryCache(unused, cache, source));
+
+    // An edit invalidates it, even with the same size and modification time
+    std::string edited = contents;
+    edited.replace(edited.find("v 2 1 0"), 7, "v 3 1 0");
+    PANGO_CHECK(edited.size() == contents.size() && edited != contents);
+    WriteFileKeepMTime(source, edited);
+    PANGO_CHECK(!TryLoadGeometryCache(unused, cache, source));
+    PANGO_CHECK(!TryLoadGeometryCache(unused, post_cache, source, octree_key));
+}
+
+}
+
+int main()
+{
+    TestGeometryCache();
+    return pangolin_test::TestResult();
+}
@@ -0,0 +1,171 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_convert.h>
+
+#include "test_check.h"
+#include "test_image_util.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+using namespace pangolin;
+using namespace pangolin_test;
+
+// ConvertImage against per pixel references
+
+namespace
+{
+
+// ref(src, x, y, c) gives the expected value of channel c of dst pixel x,y.
+template<typename D>
+void CheckConvert(const std::string& src_name, const std::string& dst_name, size_t w, size_t h,
+                  const std::function<double(const Image<unsigned char>&, size_t, size_t, size_t)>& ref,
+                  double tolerance, bool finite_floats = false)
+{
+    const PixelFormat sf = PixelFormatFromString(src_name);
+    const PixelFormat df = PixelFormatFromString(dst_name);
+    ManagedImage<unsigned char> src = RandomImage(w, h, sf);
+    if(finite_floats) {
+        for(size_t y=0; y < h; ++y) {
+            float* row = (float*)src.RowPtr(y);
+            for(size_t i=0; i < w * sf.channels; ++i) row[i] = std::uniform_real_distribution<float>(-0.5f, 1.5f)(Rng());
+        }
+    }
+    ManagedImage<unsigned char> dst = RandomImage(w, h, df);
+    Image<unsigned char> s = Pixels(src), d = Pixels(dst);
+    ConvertImage(d, df, s, sf);
+
+    size_t bad = 0;
+    for(size_t y=0; y < h; ++y) {
+        for(size_t x=0; x < w; ++x) {
+            for(size_t c=0; c < df.channels; ++c) {
+                const double expected = ref(s, x, y, c);
+                const double actual = (double)Sample<D>(d, x, y, c, df.channels);
+                if(std::abs(expected - actual) > tolerance) ++bad;
+            }
+        }
+    }
+    if(bad) std::fprintf(stderr, "ConvertImage %s -> %s: %zu mismatches\n", src_name.c_str(), dst_name.c_str(), bad);
+    PANGO_CHECK(bad == 0);
+}
+
+void TestConvertImage()
+{
+    // Widths which leave tails after any vector width
+    for(size_t w : {1, 7, 37, 133}) {
+        const size_t h = 3;
+        CheckConvert<uint8_t>("RGB24", "BGR24", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t c) {
+            return (double)Sample<uint8_t>(s, x, y, 2 - c, 3);
+        }, 0.0);
+        CheckConvert<uint8_t>("RGBA32", "RGB24", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t c) {
+            return (double)Sample<uint8_t>(s, x, y, c, 4);
+        }, 0.0);
+        CheckConvert<uint8_t>("RGB24", "RGBA32", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t c) {
+            return c == 3 ? 255.0 : (double)Sample<uint8_t>(s, x, y, c, 3);
+        }, 0.0);
+        CheckConvert<uint8_t>("GRAY8", "RGB24", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return (double)Sample<uint8_t>(s, x, y, 0, 1);
+        }, 0.0);
+        CheckConvert<uint8_t>("RGB24", "GRAY8", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return Round(0.299*Sample<uint8_t>(s, x, y, 0, 3) + 0.587*Sample<uint8_t>(s, x, y, 1, 3) + 0.114*Sample<uint8_t>(s, x, y, 2, 3), 255.0);
+        }, 1.0);
+        CheckConvert<uint8_t>("GRAY16LE", "GRAY8", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return Round(Sample<uint16_t>(s, x, y, 0, 1) / 256.0, 255.0);
+        }, 1.0);
+        CheckConvert<uint16_t>("GRAY8", "GRAY16LE", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return Sample<uint8_t>(s, x, y, 0, 1) * 256.0;
+        }, 0.0);
+        CheckConvert<float>("GRAY8", "GRAY32F", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return (double)Sample<uint8_t>(s, x, y, 0, 1);
+        }, 1e-6);
+        CheckConvert<uint8_t>("GRAY32F", "GRAY8", w, h, [](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+            return Round(Sample<float>(s, x, y, 0, 1), 255.0);
+        }, 1.0, true);
+
+        // BT.601 studio range, through both the fast (RGB24) and generic
+        // (RGBA32) paths. Odd widths end on a pixel without its own V
+        // sample, which takes the chroma of the preceding pair.
+        for(const char* yuv : {"YUYV422", "UYVY422"}) {
+            const bool y_first = yuv[0] == 'Y';
+            const auto ref = [y_first, w](const Image<unsigned char>& s, size_t x, size_t y, size_t c) {
+                const uint8_t* row = s.RowPtr(y);
+                const size_t px = (x % 2 == 0 && x + 1 == w && x >= 2) ? x - 2 : x;
+                const uint8_t* pair = row + 4*(px/2);
+                const double Y = row[4*(x/2) + (y_first ? 0 : 1) + 2*(x%2)] - 16.0;
+                const double U = pair[y_first ? 1 : 0] - 128.0;
+                const double V = (x + 1 == w && w == 1) ? 0.0 : pair[y_first ? 3 : 2] - 128.0;
+                const double rgba[4] = {
+                    1.164*Y + 1.596*V,
+                    1.164*Y - 0.392*U - 0.813*V,
+                    1.164*Y + 2.017*U,
+                    255.0
+                };
+                return Round(rgba[c], 255.0);
+            };
+            CheckConvert<uint8_t>(yuv, "RGB24", w, h, ref, 2.0);
+            CheckConvert<uint8_t>(yuv, "RGBA32", w, h, ref, 2.0);
+        }
+
+        // Packed formats are a little endian bit stream of pixels
+        for(const char* packed : {"GRAY10", "GRAY12"}) {
+            const int bits = packed[5] == '0' ? 10 : 12;
+            CheckConvert<uint16_t>(packed, "GRAY16LE", w, h, [bits](const Image<unsigned char>& s, size_t x, size_t y, size_t) {
+                const uint8_t* row = s.RowPtr(y);
+                uint32_t v = 0;
+                for(int b=0; b < bits; ++b) {
+                    const size_t bit = x * bits + b;
+                    v |= uint32_t((row[bit / 8] >> (bit % 8)) & 1) << b;
+                }
+                return (double)v * (1 << (16 - bits));
+            }, 0.0);
+        }
+    }
+
+    // Unsupported pairs throw rather than write garbage
+    bool threw = false;
+    try {
+        ManagedImage<unsigned char> a(8, 2), b(16, 2);
+        Image<unsigned char> ia = Pixels(a), ib(b.ptr, 8, 2, b.pitch);
+        ConvertImage(ib, PixelFormatFromString("YUYV422"), ia, PixelFormatFromString("GRAY8"));
+    }catch(const std::runtime_error&) {
+        threw = true;
+    }
+    PANGO_CHECK(threw);
+}
+
+}
+
+int main()
+{
+    TestConvertImage();
+    return pangolin_test::TestResult();
+}
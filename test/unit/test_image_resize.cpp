@@ -0,0 +1,158 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_resize.h>
+
+#include "test_check.h"
+#include "test_image_util.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace pangolin;
+using namespace pangolin_test;
+
+// ResizeImage against a separable double precision reference, and with
+// workers against a single thread.
+
+namespace
+{
+
+struct Tap { size_t index; double weight; };
+
+std::vector<std::vector<Tap>> ReferenceTaps(size_t src_n, size_t dst_n, ResizeMethod method)
+{
+    // Box falls back to area when dst_n isn't src_n / f, and area to
+    // bilinear when enlarging
+    if(method == ResizeMethodBox && (dst_n > src_n || src_n % dst_n >= src_n / dst_n)) method = ResizeMethodArea;
+    if(method == ResizeMethodArea && dst_n > src_n) method = ResizeMethodBilinear;
+
+    std::vector<std::vector<Tap>> taps(dst_n);
+    const double ratio = double(src_n) / double(dst_n);
+    for(size_t i=0; i < dst_n; ++i) {
+        if(method == ResizeMethodBox) {
+            const size_t f = src_n / dst_n;
+            for(size_t k=0; k < f; ++k) taps[i].push_back({i*f + k, 1.0 / f});
+        }else if(method == ResizeMethodArea) {
+            const double a = i * ratio, b = (i + 1) * ratio;
+            for(size_t k = (size_t)a; k < src_n && k < b; ++k) {
+                const double overlap = std::min(b, k + 1.0) - std::max(a, (double)k);
+                if(overlap > 0.0) taps[i].push_back({k, overlap / ratio});
+            }
+        }else{
+            const double s = std::max(0.0, (i + 0.5) * ratio - 0.5);
+            const size_t k0 = std::min<size_t>((size_t)s, src_n - 1);
+            const size_t k1 = std::min<size_t>(k0 + 1, src_n - 1);
+            const double f = s - k0;
+            taps[i].push_back({k0, 1.0 - f});
+            taps[i].push_back({k1, f});
+        }
+    }
+    return taps;
+}
+
+template<typename T>
+void CheckResize(const std::string& fmt_name, size_t sw, size_t sh, size_t dw, size_t dh, ResizeMethod method, double tolerance)
+{
+    const PixelFormat fmt = PixelFormatFromString(fmt_name);
+    const size_t c = fmt.channels;
+    ManagedImage<unsigned char> src = RandomImage(sw, sh, fmt);
+    if(std::is_floating_point<T>::value) {
+        for(size_t y=0; y < sh; ++y) {
+            T* row = (T*)src.RowPtr(y);
+            for(size_t i=0; i < sw * c; ++i) row[i] = (T)std::uniform_real_distribution<double>(0.0, 1.0)(Rng());
+        }
+    }
+    Image<unsigned char> s = Pixels(src);
+
+    const auto tx = ReferenceTaps(sw, dw, method);
+    const auto ty = ReferenceTaps(sh, dh, method);
+    const double maxv = std::numeric_limits<T>::is_integer ? (double)std::numeric_limits<T>::max() : std::numeric_limits<double>::max();
+    std::vector<double> expected(dw * dh * c);
+    for(size_t y=0; y < dh; ++y) {
+        for(size_t x=0; x < dw; ++x) {
+            for(size_t k=0; k < c; ++k) {
+                double v = 0.0;
+                for(const Tap& a : ty[y]) {
+                    for(const Tap& b : tx[x]) {
+                        v += a.weight * b.weight * Sample<T>(s, b.index, a.index, k, c);
+                    }
+                }
+                expected[(y*dw + x)*c + k] = std::numeric_limits<T>::is_integer ? Round(v, maxv) : v;
+            }
+        }
+    }
+
+    ManagedImage<unsigned char> single = RandomImage(dw, dh, fmt);
+    ManagedImage<unsigned char> pooled = RandomImage(dw, dh, fmt);
+    Image<unsigned char> d1 = Pixels(single), d2 = Pixels(pooled);
+    ResizeImage(d1, s, fmt, method, 1);
+    WorkerPool workers(3);
+    ResizeImage(d2, s, fmt, method, workers);
+
+    size_t bad = 0, differ = 0;
+    for(size_t y=0; y < dh; ++y) {
+        if(std::memcmp(d1.RowPtr(y), d2.RowPtr(y), dw * fmt.bpp / 8)) ++differ;
+        for(size_t x=0; x < dw; ++x) {
+            for(size_t k=0; k < c; ++k) {
+                if(std::abs(expected[(y*dw + x)*c + k] - Sample<T>(d1, x, y, k, c)) > tolerance) ++bad;
+            }
+        }
+    }
+    if(bad || differ) {
+        std::fprintf(stderr, "ResizeImage %s %zux%zu -> %zux%zu method %d: %zu mismatches, %zu rows differ with workers\n",
+                     fmt_name.c_str(), sw, sh, dw, dh, (int)method, bad, differ);
+    }
+    PANGO_CHECK(bad == 0);
+    PANGO_CHECK(differ == 0);
+}
+
+void TestResizeImage()
+{
+    for(ResizeMethod method : {ResizeMethodBox, ResizeMethodArea, ResizeMethodBilinear}) {
+        CheckResize<uint8_t>("RGB24", 160, 120, 80, 60, method, 1.0);
+        CheckResize<uint8_t>("GRAY8", 161, 121, 80, 60, method, 1.0);
+        CheckResize<uint8_t>("RGBA32", 150, 100, 37, 23, method, 1.0);
+        CheckResize<uint16_t>("GRAY16LE", 99, 70, 33, 35, method, 1.0);
+        CheckResize<float>("GRAY32F", 64, 48, 21, 16, method, 1e-4);
+        CheckResize<uint8_t>("RGB24", 40, 30, 97, 61, method, 1.0);
+    }
+}
+
+}
+
+int main()
+{
+    TestResizeImage();
+    return pangolin_test::TestResult();
+}
@@ -0,0 +1,111 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/image/image_utils.h>
+
+#include "test_check.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace pangolin;
+
+// Vectorised GetMinMax / GetHistogram against their generic templates
+
+namespace
+{
+
+std::mt19937 rng(42);
+
+template<typename T>
+void CheckStats(size_t w, size_t h, size_t channels, bool with_nan)
+{
+    ManagedImage<T> img(w + 5, h);
+    for(size_t y=0; y < h; ++y) {
+        for(size_t i=0; i < (w + 5); ++i) {
+            T& v = img.RowPtr(y)[i];
+            if(std::is_floating_point<T>::value) {
+                v = (T)std::uniform_real_distribution<double>(-10.0, 10.0)(rng);
+                if(with_nan && rng() % 7 == 0) v = std::numeric_limits<T>::quiet_NaN();
+            }else{
+                v = (T)rng();
+            }
+        }
+    }
+    // Exclude the padding columns, which hold the extremes
+    const size_t pw = w / channels;
+    for(size_t y=0; y < h; ++y) {
+        for(size_t i = pw * channels; i < w + 5; ++i) {
+            img.RowPtr(y)[i] = (i % 2) ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest();
+        }
+    }
+    const Image<T> view(img.ptr, pw, h, img.pitch);
+
+    const std::pair<float,float> simd = internal::GetMinMax(view, channels);
+    const std::pair<float,float> ref = internal::GetMinMax<T>(view, channels);
+    PANGO_CHECK(simd.first == ref.first);
+    PANGO_CHECK(simd.second == ref.second);
+
+    for(size_t nbins : {1, 7, 256}) {
+        std::vector<size_t> bins_simd(nbins, 0), bins_ref(nbins, 0);
+        internal::GetHistogram(view, channels, ref.first, ref.second, bins_simd);
+        internal::GetHistogram<T>(view, channels, ref.first, ref.second, bins_ref);
+        PANGO_CHECK(bins_simd == bins_ref);
+
+        // Range narrower than the data puts outliers in the end bins
+        std::fill(bins_simd.begin(), bins_simd.end(), 0);
+        std::fill(bins_ref.begin(), bins_ref.end(), 0);
+        const float mid = (ref.first + ref.second) / 2;
+        internal::GetHistogram(view, channels, mid - 1, mid + 1, bins_simd);
+        internal::GetHistogram<T>(view, channels, mid - 1, mid + 1, bins_ref);
+        PANGO_CHECK(bins_simd == bins_ref);
+    }
+}
+
+void TestImageStats()
+{
+    for(size_t channels : {1, 2, 3, 4}) {
+        for(size_t w : {channels, 17 * channels, 64 * channels, 301 * channels}) {
+            CheckStats<unsigned char>(w, 5, channels, false);
+            CheckStats<unsigned short>(w, 5, channels, false);
+            CheckStats<float>(w, 5, channels, false);
+            CheckStats<float>(w, 5, channels, true);
+        }
+    }
+}
+
+}
+
+int main()
+{
+    TestImageStats();
+    return pangolin_test::TestResult();
+}
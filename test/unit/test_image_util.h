@@ -0,0 +1,77 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <pangolin/image/image.h>
+#include <pangolin/image/managed_image.h>
+#include <pangolin/image/pixel_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Helpers for tests comparing image kernels against scalar references.
+
+namespace pangolin_test
+{
+
+inline std::mt19937& Rng()
+{
+    static std::mt19937 rng(42);
+    return rng;
+}
+
+// Image of random bytes, with padding at the end of each row so that
+// kernels can't assume a packed layout.
+inline pangolin::ManagedImage<unsigned char> RandomImage(size_t w, size_t h, const pangolin::PixelFormat& fmt)
+{
+    const size_t row_bytes = (w * fmt.bpp + 7) / 8;
+    pangolin::ManagedImage<unsigned char> img(row_bytes + 13, h);
+    for(size_t i=0; i < img.pitch * h; ++i) img.ptr[i] = (unsigned char)Rng()();
+    img.w = w;
+    return img;
+}
+
+inline pangolin::Image<unsigned char> Pixels(pangolin::ManagedImage<unsigned char>& img)
+{
+    return pangolin::Image<unsigned char>(img.ptr, img.w, img.h, img.pitch);
+}
+
+template<typename T>
+T Sample(const pangolin::Image<unsigned char>& img, size_t x, size_t y, size_t c, size_t channels)
+{
+    return ((const T*)img.RowPtr(y))[x*channels + c];
+}
+
+inline double Round(double v, double maxv)
+{
+    return std::floor(std::min(std::max(v, 0.0), maxv) + 0.5);
+}
+
+}
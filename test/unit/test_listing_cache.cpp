@@ -0,0 +1,174 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/file_utils.h>
+
+#include "test_check.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace pangolin;
+
+namespace
+{
+
+std::string ReadFile(const std::string& filename)
+{
+    std::ifstream f(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+    f << contents;
+}
+
+void SetMTime(const std::string& path, time_t t)
+{
+    struct timeval times[2] = {{t, 0}, {t, 0}};
+    PANGO_CHECK(utimes(path.c_str(), times) == 0);
+}
+
+std::vector<std::string> DirEntries(const std::string& dir)
+{
+    std::vector<std::string> entries;
+    if(DIR* d = opendir(dir.c_str())) {
+        while(dirent* e = readdir(d)) {
+            if(e->d_name[0] != '.') entries.push_back(dir + "/" + e->d_name);
+        }
+        closedir(d);
+    }
+    return entries;
+}
+
+size_t CountCached(const std::string& wildcard, const std::string& cache_dir)
+{
+    std::vector<std::string> files;
+    FilesMatchingWildcardCached(wildcard, files, cache_dir);
+    return files.size();
+}
+
+void TestListingCache()
+{
+    char cwd[4096];
+    PANGO_CHECK(getcwd(cwd, sizeof(cwd)) != nullptr);
+    const std::string root = std::string(cwd) + "/listing_test";
+    const std::string cache_dir = root + "_cache";
+    const std::string a = root + "/a", b = root + "/b";
+    for(const std::string& d : {root, a, b, a + "/deep", cache_dir}) {
+        mkdir(d.c_str(), 0755);
+    }
+    for(const std::string& f : DirEntries(cache_dir)) unlink(f.c_str());
+    for(const std::string& f : {b + "/cfg.txt", b + "/deep/cfg.txt"}) unlink(f.c_str());
+    rmdir((b + "/deep").c_str());
+    WriteFile(a + "/cfg.txt", "a");
+    WriteFile(a + "/deep/cfg.txt", "a");
+
+    const time_t old = time(nullptr) - 3600;
+    for(const std::string& d : {root, a, b, a + "/deep"}) SetMTime(d, old);
+
+    const std::string wildcard = root + "/*/cfg.txt";
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 1);
+    PANGO_CHECK(DirEntries(cache_dir).size() == 1);
+
+    // A change hidden from directory mtimes shows the listing is reused
+    WriteFile(b + "/cfg.txt", "b");
+    SetMTime(b, old);
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 1);
+
+    // Any change to a directory's mtime invalidates it
+    SetMTime(b, old + 1);
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 2);
+
+    // Directories modified around the time of listing may change again
+    // within their mtime resolution, so such a listing isn't reused
+    unlink((b + "/cfg.txt").c_str());
+    struct stat st;
+    PANGO_CHECK(stat(b.c_str(), &st) == 0);
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 1);
+    WriteFile(b + "/cfg.txt", "b");
+    const struct timespec times[2] = {st.st_atim, st.st_mtim};
+    PANGO_CHECK(utimensat(AT_FDCWD, b.c_str(), times, 0) == 0);
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 2);
+
+    // Creating a missing literal path component changes its parent
+    const std::string deep_wildcard = root + "/*/deep/cfg.txt";
+    SetMTime(b, old);
+    PANGO_CHECK(CountCached(deep_wildcard, cache_dir) == 1);
+    mkdir((b + "/deep").c_str(), 0755);
+    WriteFile(b + "/deep/cfg.txt", "b");
+    SetMTime(b + "/deep", old);
+    SetMTime(b, old + 2);
+    PANGO_CHECK(CountCached(deep_wildcard, cache_dir) == 2);
+
+    // Corrupt listings are ignored
+    SetMTime(b, old + 3);
+    PANGO_CHECK(CountCached(wildcard, cache_dir) == 2);
+    std::string cache_file;
+    for(const std::string& f : DirEntries(cache_dir)) {
+        if(f.find("listing_") != std::string::npos && ReadFile(f).find(wildcard) != std::string::npos) cache_file = f;
+    }
+    PANGO_CHECK(!cache_file.empty());
+    const std::string good = ReadFile(cache_file);
+    std::mt19937 rng(3);
+    for(size_t i=0; i < good.size() + 1000 && !cache_file.empty(); ++i) {
+        std::string contents = good;
+        if(i < good.size()) {
+            contents.resize(i);
+        }else{
+            for(int k=0; k < 3; ++k) contents[rng() % contents.size()] = (char)rng();
+        }
+        WriteFile(cache_file, contents);
+        try {
+            PANGO_CHECK(CountCached(wildcard, cache_dir) == 2);
+        }catch(const std::exception& e) {
+            std::fprintf(stderr, "FilesMatchingWildcardCached threw: %s\n", e.what());
+            PANGO_CHECK(false);
+        }
+    }
+}
+
+}
+
+int main()
+{
+    TestListingCache();
+    return pangolin_test::TestResult();
+}
@@ -0,0 +1,166 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/file_utils.h>
+#include <pangolin/video/drivers/pango_video_output.h>
+#include <pangolin/video/video.h>
+
+#include "test_check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace pangolin;
+
+// Segmented recording: rotation, retention of the latest segments and
+// recovery when a segment can't be opened ahead of time.
+
+namespace
+{
+
+const size_t frame_w = 32, frame_h = 4;
+const size_t frame_bytes = frame_w * frame_h;
+
+std::vector<unsigned char> MakeFrame(size_t index)
+{
+    std::vector<unsigned char> frame(frame_bytes);
+    for(size_t i=0; i < frame.size(); ++i) frame[i] = (unsigned char)(index * 5 + i);
+    std::memcpy(frame.data(), &index, sizeof(index));
+    return frame;
+}
+
+std::unique_ptr<PangoVideoOutput> OpenOutput(const std::string& filename, size_t frames_per_segment, size_t keep)
+{
+    PangoSegmentOptions options;
+    options.max_bytes = frames_per_segment * frame_bytes;
+    options.max_segments = keep;
+    std::unique_ptr<PangoVideoOutput> out(new PangoVideoOutput(filename, 1 << 20, {}, FileWriteModeBuffered, 0, options));
+    VideoOutputInterface& video = *out;
+    video.SetStreams({StreamInfo(PixelFormatFromString("GRAY8"), frame_w, frame_h, frame_w)});
+    return out;
+}
+
+std::vector<std::vector<unsigned char>> ReadFrames(const std::string& filename)
+{
+    std::vector<std::vector<unsigned char>> frames;
+    std::unique_ptr<VideoInterface> video = OpenVideo("pango://" + filename);
+    std::vector<unsigned char> frame(video->SizeBytes());
+    while(video->GrabNext(frame.data(), true)) {
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+void TestKeepSegments()
+{
+    const std::string filename = "segments_keep.pango";
+    const size_t frames_per_segment = 2, num_frames = 20, keep = 3;
+    const size_t num_segments = num_frames / frames_per_segment;
+    for(size_t i=0; i <= num_segments; ++i) {
+        std::remove(PangoSegmentFilename(filename, i).c_str());
+    }
+
+    {
+        std::unique_ptr<PangoVideoOutput> out = OpenOutput(filename, frames_per_segment, keep);
+        VideoOutputInterface& video = *out;
+        for(size_t i=0; i < num_frames; ++i) {
+            video.WriteStreams(MakeFrame(i).data());
+        }
+        PANGO_CHECK(out->NumSegments() == num_segments);
+    }
+
+    // Only the latest segments remain, and the segment opened ahead of
+    // time is discarded.
+    for(size_t s=0; s <= num_segments; ++s) {
+        const bool kept = s + keep >= num_segments && s < num_segments;
+        PANGO_CHECK(FileExists(PangoSegmentFilename(filename, s)) == kept);
+    }
+
+    size_t next_frame = num_frames - keep * frames_per_segment;
+    for(size_t s=num_segments - keep; s < num_segments; ++s) {
+        const std::vector<std::vector<unsigned char>> frames = ReadFrames(PangoSegmentFilename(filename, s));
+        PANGO_CHECK(frames.size() == frames_per_segment);
+        for(const auto& frame : frames) {
+            PANGO_CHECK(frame == MakeFrame(next_frame));
+            ++next_frame;
+        }
+    }
+    PANGO_CHECK(next_frame == num_frames);
+}
+
+void TestOpenFailure()
+{
+    const std::string filename = "segments_fail.pango";
+    const std::string blocked = PangoSegmentFilename(filename, 1);
+    std::remove(PangoSegmentFilename(filename, 0).c_str());
+    std::remove(PangoSegmentFilename(filename, 2).c_str());
+    std::remove(blocked.c_str());
+
+    // A directory in place of the next segment makes opening it fail,
+    // both ahead of time and when rotating.
+    mkdir(blocked.c_str(), 0755);
+    {
+        std::unique_ptr<PangoVideoOutput> out = OpenOutput(filename, 1, 0);
+        VideoOutputInterface& video = *out;
+        video.WriteStreams(MakeFrame(0).data());
+
+        bool threw = false;
+        try {
+            video.WriteStreams(MakeFrame(1).data());
+        }catch(const std::exception&) {
+            threw = true;
+        }
+        PANGO_CHECK(threw);
+
+        // Once the path is usable, rotation recovers.
+        rmdir(blocked.c_str());
+        video.WriteStreams(MakeFrame(1).data());
+        video.WriteStreams(MakeFrame(2).data());
+        PANGO_CHECK(out->NumSegments() == 3);
+    }
+
+    for(size_t s=0; s < 3; ++s) {
+        const std::vector<std::vector<unsigned char>> frames = ReadFrames(PangoSegmentFilename(filename, s));
+        PANGO_CHECK(frames.size() == 1 && frames[0] == MakeFrame(s));
+    }
+}
+
+}
+
+int main()
+{
+    TestKeepSegments();
+    TestOpenFailure();
+    return pangolin_test::TestResult();
+}
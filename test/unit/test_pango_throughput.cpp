@@ -0,0 +1,129 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/log/playback_session.h>
+#include <pangolin/video/video.h>
+#include <pangolin/video/video_interface.h>
+
+#include "test_check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace pangolin;
+
+// Seeking a .pango file opened in throughput mode, where frames are read
+// ahead on a background thread.
+
+namespace
+{
+
+const size_t frame_w = 32, frame_h = 4;
+const size_t num_frames = 50;
+
+std::vector<unsigned char> MakeFrame(size_t index)
+{
+    std::vector<unsigned char> frame(frame_w * frame_h);
+    for(size_t i=0; i < frame.size(); ++i) frame[i] = (unsigned char)(index * 3 + i);
+    std::memcpy(frame.data(), &index, sizeof(index));
+    return frame;
+}
+
+void WriteInput(const std::string& filename)
+{
+    std::unique_ptr<VideoOutputInterface> out = OpenVideoOutput("pango://" + filename);
+    out->SetStreams({StreamInfo(PixelFormatFromString("GRAY8"), frame_w, frame_h, frame_w)});
+    for(size_t i=0; i < num_frames; ++i) {
+        out->WriteStreams(MakeFrame(i).data());
+    }
+}
+
+// Grab one frame and check it is frame expected
+void CheckNext(VideoInterface& video, VideoPlaybackInterface& playback, size_t expected)
+{
+    std::vector<unsigned char> frame(video.SizeBytes());
+    const bool grabbed = video.GrabNext(frame.data(), true);
+    PANGO_CHECK(grabbed);
+    if(!grabbed) return;
+    PANGO_CHECK(frame == MakeFrame(expected));
+    PANGO_CHECK(playback.GetCurrentFrameId() == expected);
+}
+
+void TestSeek(size_t read_ahead_frames)
+{
+    // The default session shares readers by filename, so use a file each
+    std::fprintf(stderr, "  read_ahead_frames %zu\n", read_ahead_frames);
+    const std::string filename = "throughput_seek_" + std::to_string(read_ahead_frames) + ".pango";
+    WriteInput(filename);
+
+    std::unique_ptr<VideoInterface> video = OpenVideo(
+        "pango:[OrderedPlayback=1,throughput=1,read_ahead_frames=" + std::to_string(read_ahead_frames) + "]//" + filename
+    );
+    VideoPlaybackInterface* playback = FindFirstMatchingVideoInterface<VideoPlaybackInterface>(*video);
+    PANGO_CHECK(playback != nullptr);
+    if(!playback) return;
+    PANGO_CHECK(playback->GetTotalFrames() == num_frames);
+
+    // Seeks in throughput mode leave the shared session clock alone
+    size_t session_seeks = 0;
+    auto seek_reg = PlaybackSession::Default()->Time().OnSeek.Connect(
+        [&](SyncTime::TimePoint){ ++session_seeks; }
+    );
+
+    for(size_t i=0; i < 10; ++i) CheckNext(*video, *playback, i);
+
+    // Forwards, to the frame that follows anyway, and backwards, all while
+    // frames past the current one are already read ahead.
+    const size_t seeks[] = {30, 31, 5, 10, 0, num_frames - 1};
+    for(size_t target : seeks) {
+        playback->Seek(target);
+        CheckNext(*video, *playback, target);
+        if(target + 1 < num_frames) CheckNext(*video, *playback, target + 1);
+    }
+
+    // Seeking back after reaching the end resumes playback
+    std::vector<unsigned char> frame(video->SizeBytes());
+    PANGO_CHECK(!video->GrabNext(frame.data(), true));
+    playback->Seek(40);
+    for(size_t i=40; i < num_frames; ++i) CheckNext(*video, *playback, i);
+    PANGO_CHECK(!video->GrabNext(frame.data(), true));
+    PANGO_CHECK(session_seeks == 0);
+}
+
+}
+
+int main()
+{
+    TestSeek(0);
+    TestSeek(1);
+    TestSeek(4);
+    return pangolin_test::TestResult();
+}
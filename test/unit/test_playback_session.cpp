@@ -0,0 +1,145 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/log/playback_session.h>
+#include <pangolin/log/playback_session_index.h>
+#include <pangolin/video/video.h>
+
+#include "test_check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace pangolin;
+
+// Two logs with interleaved and coincident timestamps, merged by
+// PlaybackSessionIndex and played back together through join://.
+
+namespace
+{
+
+const size_t frame_w = 16, frame_h = 2;
+const size_t num_frames = 30;
+
+// Log 0 every 10us, log 1 offset by 5us except every third frame, which
+// coincides with log 0. Zero is not a valid event time.
+int64_t FrameTime(size_t log, size_t i)
+{
+    return 1000 + 10 * (int64_t)i + ((log == 1 && i % 3) ? 5 : 0);
+}
+
+std::vector<unsigned char> MakeFrame(size_t log, size_t i)
+{
+    std::vector<unsigned char> frame(frame_w * frame_h, (unsigned char)log);
+    std::memcpy(frame.data() + 1, &i, sizeof(i));
+    return frame;
+}
+
+void WriteLog(const std::string& filename, size_t log)
+{
+    std::unique_ptr<VideoOutputInterface> out = OpenVideoOutput("pango://" + filename);
+    out->SetStreams({StreamInfo(PixelFormatFromString("GRAY8"), frame_w, frame_h, frame_w)});
+    for(size_t i=0; i < num_frames; ++i) {
+        picojson::value props(picojson::object_type, true);
+        props[PANGO_HOST_RECEPTION_TIME_US] = picojson::value(FrameTime(log, i));
+        out->WriteStreams(MakeFrame(log, i).data(), props);
+    }
+}
+
+void TestIndex(const std::vector<std::string>& logs)
+{
+    PlaybackSession session;
+    const std::vector<std::shared_ptr<PacketStreamReader>> readers = session.OpenAll(logs);
+    PANGO_CHECK(readers.size() == logs.size());
+    for(size_t r=0; r < logs.size(); ++r) {
+        PANGO_CHECK(session.Open(logs[r]) == readers[r]);
+    }
+
+    PlaybackSessionIndex idx;
+    idx.Build(readers);
+    PANGO_CHECK(idx.Size() == logs.size() * num_frames);
+
+    // Time ordered, each source in its own order, and Find inverts it
+    std::vector<size_t> next(logs.size(), 0);
+    for(size_t i=0; i < idx.Size(); ++i) {
+        const PlaybackSessionIndex::Entry& e = idx[i];
+        PANGO_CHECK(i == 0 || idx[i-1].capture_time <= e.capture_time);
+        PANGO_CHECK(e.reader < logs.size() && e.src == 0);
+        if(e.reader >= logs.size()) continue;
+        PANGO_CHECK(e.frame == next[e.reader]);
+        PANGO_CHECK(e.capture_time == FrameTime(e.reader, e.frame));
+        PANGO_CHECK(idx.Find(e.reader, e.src, e.frame) == i);
+        ++next[e.reader];
+    }
+
+    const size_t first_of_1 = idx.LowerBound(FrameTime(1, 1));
+    PANGO_CHECK(first_of_1 < idx.Size() && idx[first_of_1].capture_time == FrameTime(1, 1));
+    PANGO_CHECK(first_of_1 > 0 && idx[first_of_1 - 1].capture_time < FrameTime(1, 1));
+    PANGO_CHECK(idx.LowerBound(FrameTime(1, num_frames - 1) + 1) == idx.Size());
+    PANGO_CHECK(idx.Find(0, 0, num_frames) == PlaybackSessionIndex::npos);
+}
+
+// join:// opens ordered children together through OpenAll, and each
+// joined frame pairs the logs' frames in order.
+void TestJoin(const std::vector<std::string>& logs)
+{
+    std::unique_ptr<VideoInterface> video = OpenVideo(
+        "join://{pango:[OrderedPlayback=1]//" + logs[0] + "}{pango:[OrderedPlayback=1]//" + logs[1] + "}"
+    );
+    PANGO_CHECK(PlaybackSession::Default()->Index()->Size() == logs.size() * num_frames);
+
+    const size_t frame_bytes = frame_w * frame_h;
+    PANGO_CHECK(video->SizeBytes() == logs.size() * frame_bytes);
+    std::vector<unsigned char> image(video->SizeBytes());
+    size_t grabbed = 0;
+    while(grabbed < num_frames && video->GrabNext(image.data(), true)) {
+        for(size_t log=0; log < logs.size(); ++log) {
+            const std::vector<unsigned char> expected = MakeFrame(log, grabbed);
+            PANGO_CHECK(std::memcmp(image.data() + log * frame_bytes, expected.data(), frame_bytes) == 0);
+        }
+        ++grabbed;
+    }
+    PANGO_CHECK(grabbed == num_frames);
+}
+
+}
+
+int main()
+{
+    const std::vector<std::string> logs = {"session_0.pango", "session_1.pango"};
+    for(size_t log=0; log < logs.size(); ++log) {
+        WriteLog(logs[log], log);
+    }
+
+    TestIndex(logs);
+    TestJoin(logs);
+    return pangolin_test::TestResult();
+}
@@ -0,0 +1,229 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/video/drivers/tee_output.h>
+
+#include "test_check.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace pangolin;
+
+// Drop policies and buffer sharing of TeeVideoOutput, using sinks which
+// can be held up on demand.
+
+namespace
+{
+
+const size_t frame_w = 16, frame_h = 4;
+
+// Records the index and buffer address of each frame written. A gated sink
+// blocks in WriteStreams until Open() is called.
+struct SlowSink : public VideoOutputInterface
+{
+    SlowSink(bool gated) : gated(gated), entered(0) {}
+
+    const std::vector<StreamInfo>& Streams() const override { return streams; }
+
+    void SetStreams(const std::vector<StreamInfo>& st, const std::string&, const picojson::value&) override
+    {
+        streams = st;
+    }
+
+    int WriteStreams(const unsigned char* data, const picojson::value&) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++entered;
+        cond.notify_all();
+        cond.wait(lock, [&](){ return !gated; });
+
+        size_t index;
+        std::memcpy(&index, data, sizeof(index));
+        frames.push_back(index);
+        buffers.push_back(data);
+        return 0;
+    }
+
+    bool IsPipe() const override { return false; }
+
+    // Wait until WriteStreams has been entered n times
+    void WaitEntered(size_t n)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&](){ return entered >= n; });
+    }
+
+    void Open()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        gated = false;
+        cond.notify_all();
+    }
+
+    std::vector<StreamInfo> streams;
+    bool gated;
+    size_t entered;
+    std::vector<size_t> frames;
+    std::vector<const unsigned char*> buffers;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+std::vector<unsigned char> MakeFrame(size_t index)
+{
+    std::vector<unsigned char> frame(frame_w * frame_h, (unsigned char)index);
+    std::memcpy(frame.data(), &index, sizeof(index));
+    return frame;
+}
+
+std::unique_ptr<TeeVideoOutput> MakeTee(std::vector<SlowSink*>& outputs, const std::vector<std::pair<size_t,TeeDropPolicy>>& policies, bool gated)
+{
+    std::vector<TeeVideoOutput::Sink> sinks;
+    for(const auto& p : policies) {
+        SlowSink* output = new SlowSink(gated);
+        outputs.push_back(output);
+        TeeVideoOutput::Sink sink;
+        sink.output.reset(output);
+        sink.max_queued_frames = p.first;
+        sink.drop = p.second;
+        sinks.push_back(std::move(sink));
+    }
+    std::unique_ptr<TeeVideoOutput> tee(new TeeVideoOutput(std::move(sinks)));
+    VideoOutputInterface& video = *tee;
+    video.SetStreams({StreamInfo(PixelFormatFromString("GRAY8"), frame_w, frame_h, frame_w)});
+    return tee;
+}
+
+void Write(TeeVideoOutput& tee, size_t index)
+{
+    VideoOutputInterface& video = tee;
+    video.WriteStreams(MakeFrame(index).data());
+}
+
+// With the sink stuck on frame 0 and room for two queued frames, frames
+// 1 to 5 overflow its queue three times.
+void TestDropPolicy(TeeDropPolicy policy, const std::vector<size_t>& expected_frames)
+{
+    std::vector<SlowSink*> outputs;
+    std::unique_ptr<TeeVideoOutput> tee = MakeTee(outputs, {{2, policy}, {8, TeeDropBlock}}, true);
+    SlowSink& slow = *outputs[0];
+    SlowSink& fast = *outputs[1];
+    fast.Open();
+
+    Write(*tee, 0);
+    slow.WaitEntered(1);
+    for(size_t i=1; i <= 5; ++i) Write(*tee, i);
+    PANGO_CHECK(tee->Dropped(0) == 6 - expected_frames.size());
+
+    slow.Open();
+    tee->Flush();
+    PANGO_CHECK(slow.frames == expected_frames);
+    PANGO_CHECK(tee->Written(0) == expected_frames.size());
+
+    // The other sink is unaffected
+    PANGO_CHECK(fast.frames == std::vector<size_t>({0, 1, 2, 3, 4, 5}));
+    PANGO_CHECK(tee->Dropped(1) == 0 && tee->Written(1) == 6);
+}
+
+// The writer waits for the slow sink, and never gets more than the queue
+// ahead of it.
+void TestBlock()
+{
+    std::vector<SlowSink*> outputs;
+    std::unique_ptr<TeeVideoOutput> tee = MakeTee(outputs, {{2, TeeDropBlock}}, true);
+    SlowSink& slow = *outputs[0];
+
+    std::mutex mutex;
+    size_t returned = 0;
+    std::thread writer([&](){
+        for(size_t i=0; i <= 5; ++i) {
+            Write(*tee, i);
+            std::lock_guard<std::mutex> lock(mutex);
+            ++returned;
+        }
+    });
+
+    // Frame 0 in the sink and frames 1, 2 queued, frame 3 blocked
+    slow.WaitEntered(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PANGO_CHECK(returned <= 3);
+    }
+
+    slow.Open();
+    writer.join();
+    tee->Flush();
+    PANGO_CHECK(slow.frames == std::vector<size_t>({0, 1, 2, 3, 4, 5}));
+    PANGO_CHECK(tee->Dropped(0) == 0);
+}
+
+// Each frame is copied once into a buffer shared by every sink, and
+// buffers are recycled once every sink has released them.
+void TestBufferReuse()
+{
+    std::vector<SlowSink*> outputs;
+    std::unique_ptr<TeeVideoOutput> tee = MakeTee(outputs, {{4, TeeDropBlock}, {4, TeeDropBlock}}, false);
+
+    const size_t num_frames = 100;
+    for(size_t i=0; i < num_frames; ++i) {
+        Write(*tee, i);
+        tee->Flush();
+    }
+
+    const SlowSink& a = *outputs[0];
+    const SlowSink& b = *outputs[1];
+    PANGO_CHECK(a.frames.size() == num_frames && b.frames.size() == num_frames);
+    PANGO_CHECK(a.buffers == b.buffers);
+    const std::set<const unsigned char*> distinct(a.buffers.begin(), a.buffers.end());
+    PANGO_CHECK(distinct.size() == 1);
+
+    // Without waiting, buffers in flight are bounded by the queues
+    for(size_t i=0; i < num_frames; ++i) Write(*tee, num_frames + i);
+    tee->Flush();
+    const std::set<const unsigned char*> in_flight(a.buffers.begin() + num_frames, a.buffers.end());
+    PANGO_CHECK(in_flight.size() <= 2 * (4 + 1) + 1);
+}
+
+}
+
+int main()
+{
+    TestDropPolicy(TeeDropOldest, {0, 4, 5});
+    TestDropPolicy(TeeDropNewest, {0, 1, 2});
+    TestBlock();
+    TestBufferReuse();
+    return pangolin_test::TestResult();
+}
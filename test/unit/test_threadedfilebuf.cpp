@@ -0,0 +1,120 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/threadedfilebuf.h>
+
+#include "test_check.h"
+
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace pangolin;
+
+namespace
+{
+
+const char* ModeName(FileWriteMode mode)
+{
+    switch(mode) {
+    case FileWriteModeSync: return "sync";
+    case FileWriteModeDirect: return "direct";
+    default: return "buffered";
+    }
+}
+
+// Write a small header then frames of the given sizes, alternating between
+// the stream interface and write_segments, and check the file matches.
+void TestWrite(FileWriteMode mode, size_t buffer_size, const std::vector<size_t>& frame_sizes)
+{
+    const std::string filename = std::string("threadedfilebuf_") + ModeName(mode) + ".bin";
+    std::mt19937 rng((unsigned)buffer_size);
+    std::vector<char> expected;
+
+    auto random_bytes = [&](size_t n) {
+        std::vector<char> data(n);
+        for(char& c : data) c = (char)rng();
+        return data;
+    };
+
+    {
+        threadedfilebuf buf(filename, buffer_size, mode);
+        std::ostream os(&buf);
+
+        const std::vector<char> header = random_bytes(100);
+        os.write(header.data(), header.size());
+        expected.insert(expected.end(), header.begin(), header.end());
+
+        for(size_t i=0; i < frame_sizes.size(); ++i) {
+            const std::vector<char> frame = random_bytes(frame_sizes[i]);
+            if(i % 2) {
+                const std::vector<char> tag = random_bytes(7);
+                const threadedfilebuf::Segment segments[2] = {
+                    {tag.data(), (std::streamsize)tag.size()},
+                    {frame.data(), (std::streamsize)frame.size()}
+                };
+                buf.write_segments(segments, 2);
+                expected.insert(expected.end(), tag.begin(), tag.end());
+            }else{
+                os.write(frame.data(), frame.size());
+            }
+            expected.insert(expected.end(), frame.begin(), frame.end());
+        }
+        os.flush();
+        buf.close();
+        PANGO_CHECK(buf.GetStats().bytes_written == expected.size());
+    }
+
+    std::ifstream f(filename, std::ios::binary);
+    const std::vector<char> written((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    PANGO_CHECK(written.size() == expected.size());
+    PANGO_CHECK(written == expected);
+    if(written != expected) {
+        std::fprintf(stderr, "  mode %s, buffer %zu bytes\n", ModeName(mode), buffer_size);
+    }
+}
+
+}
+
+int main()
+{
+    const size_t buffer_size = 64 * 1024;
+    for(FileWriteMode mode : {FileWriteModeSync, FileWriteModeDirect, FileWriteModeBuffered}) {
+        // Frames smaller than the buffer, and not multiples of the block size
+        TestWrite(mode, buffer_size, std::vector<size_t>(200, 4099));
+        // Frames larger than the buffer straight after a small header, which
+        // must grow the queue rather than wait for a full block
+        TestWrite(mode, buffer_size, std::vector<size_t>(20, 3 * buffer_size + 17));
+        // Mixed sizes
+        TestWrite(mode, buffer_size, {1, 70000, 5, 4096, 1 << 20, 3, 65536, 12345});
+    }
+    return pangolin_test::TestResult();
+}
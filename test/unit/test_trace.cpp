@@ -0,0 +1,153 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/utils/picojson.h>
+#include <pangolin/utils/trace.h>
+
+#include "test_check.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace pangolin;
+
+// Records from named threads and checks the written Chrome trace JSON,
+// including rows handed on to later threads.
+
+namespace
+{
+
+const size_t events_per_thread = 100;
+
+struct Row
+{
+    std::vector<std::string> names;  // thread_name metadata
+    std::map<std::string, size_t> events;
+};
+
+// Rows of a written trace, by tid
+std::map<int64_t, Row> ReadTrace(const std::string& filename)
+{
+    std::map<int64_t, Row> rows;
+    std::ifstream f(filename);
+    picojson::value json;
+    const std::string err = picojson::parse(json, f);
+    PANGO_CHECK(err.empty());
+    if(!err.empty() || !json.contains("traceEvents")) return rows;
+
+    for(const picojson::value& e : json["traceEvents"].get<picojson::array>()) {
+        Row& row = rows[e["tid"].get<int64_t>()];
+        const std::string ph = e["ph"].get<std::string>();
+        if(ph == "M") {
+            PANGO_CHECK(e["name"].get<std::string>() == "thread_name");
+            row.names.push_back(e["args"]["name"].get<std::string>());
+        }else{
+            PANGO_CHECK(ph == "X" && e["dur"].get<double>() >= 0.0);
+            ++row.events[e["name"].get<std::string>()];
+        }
+    }
+    return rows;
+}
+
+void Record(const char* thread_name, const char* event_name)
+{
+    if(thread_name) TraceSetThreadName(thread_name);
+    for(size_t i=0; i < events_per_thread; ++i) {
+        TraceScope scope(event_name, "test");
+    }
+}
+
+// The tid of the row named name, or -1
+int64_t RowNamed(const std::map<int64_t, Row>& rows, const std::string& name)
+{
+    for(const auto& r : rows) {
+        for(const std::string& n : r.second.names) {
+            if(n == name) return r.first;
+        }
+    }
+    return -1;
+}
+
+}
+
+int main()
+{
+    const std::string filename = "trace_test.json";
+
+    // Two named threads, recording concurrently
+    TraceStart();
+    {
+        std::thread a(Record, "alpha", "alpha_event");
+        std::thread b(Record, "beta", "beta_event");
+        a.join();
+        b.join();
+    }
+    PANGO_CHECK(TraceEventCount() == 2 * events_per_thread);
+    PANGO_CHECK(TraceWrite(filename));
+    std::map<int64_t, Row> rows = ReadTrace(filename);
+    const int64_t alpha = RowNamed(rows, "alpha");
+    const int64_t beta = RowNamed(rows, "beta");
+    PANGO_CHECK(alpha >= 0 && beta >= 0 && alpha != beta);
+    for(const auto& r : rows) {
+        PANGO_CHECK(r.second.names.size() == 1);
+    }
+    PANGO_CHECK(rows[alpha].events.size() == 1 && rows[alpha].events["alpha_event"] == events_per_thread);
+    PANGO_CHECK(rows[beta].events.size() == 1 && rows[beta].events["beta_event"] == events_per_thread);
+
+    // After a restart, a new "alpha" thread reuses the first one's row, an
+    // unnamed thread gets its own, and beta's stale row is left out.
+    TraceStart();
+    {
+        std::thread a(Record, "alpha", "alpha_again");
+        a.join();
+        std::thread u(Record, nullptr, "unnamed_event");
+        u.join();
+    }
+    PANGO_CHECK(TraceEventCount() == 2 * events_per_thread);
+    PANGO_CHECK(TraceWrite(filename));
+    rows = ReadTrace(filename);
+    PANGO_CHECK(RowNamed(rows, "alpha") == alpha);
+    PANGO_CHECK(RowNamed(rows, "beta") == -1);
+    PANGO_CHECK(rows.count(beta) == 0);
+    PANGO_CHECK(rows[alpha].names.size() == 1);
+    PANGO_CHECK(rows[alpha].events.size() == 1 && rows[alpha].events["alpha_again"] == events_per_thread);
+    PANGO_CHECK(rows.size() == 2);
+    for(const auto& r : rows) {
+        if(r.first == alpha) continue;
+        PANGO_CHECK(r.second.names.empty());
+        PANGO_CHECK(r.second.events.size() == 1 && r.second.events.count("unnamed_event") == 1);
+    }
+
+    TraceStop();
+    std::remove(filename.c_str());
+    return pangolin_test::TestResult();
+}
@@ -0,0 +1,175 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/log/packetstream_reader.h>
+#include <pangolin/utils/file_utils.h>
+#include <pangolin/video/drivers/pango_video_output.h>
+#include <pangolin/video/video.h>
+
+#include "test_check.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace pangolin;
+
+// Runs the VideoConvert tool given as argv[1] over a .pango input split
+// into chunks across several readers, and resumes partial outputs.
+
+namespace
+{
+
+const size_t frame_w = 32, frame_h = 4;
+const size_t num_frames = 100;
+
+std::vector<unsigned char> MakeFrame(size_t index)
+{
+    std::vector<unsigned char> frame(frame_w * frame_h);
+    for(size_t i=0; i < frame.size(); ++i) frame[i] = (unsigned char)(index * 7 + i);
+    std::memcpy(frame.data(), &index, std::min(sizeof(index), frame.size()));
+    return frame;
+}
+
+void WriteInput(const std::string& filename, size_t frames)
+{
+    std::unique_ptr<VideoOutputInterface> out = OpenVideoOutput("pango://" + filename);
+    out->SetStreams({StreamInfo(PixelFormatFromString("GRAY8"), frame_w, frame_h, frame_w)});
+    for(size_t i=0; i < frames; ++i) {
+        out->WriteStreams(MakeFrame(i).data());
+    }
+}
+
+// Append the frames of a .pango file to frames
+void ReadFrames(const std::string& filename, std::vector<std::vector<unsigned char>>& frames)
+{
+    std::unique_ptr<VideoInterface> video = OpenVideo("pango://" + filename);
+    std::vector<unsigned char> frame(video->SizeBytes());
+    while(video->GrabNext(frame.data(), true)) {
+        frames.push_back(frame);
+    }
+}
+
+bool FramesInOrder(const std::vector<std::vector<unsigned char>>& frames)
+{
+    if(frames.size() != num_frames) {
+        std::fprintf(stderr, "Expected %zu frames, got %zu\n", num_frames, frames.size());
+        return false;
+    }
+    for(size_t i=0; i < frames.size(); ++i) {
+        if(frames[i] != MakeFrame(i)) {
+            std::fprintf(stderr, "Frame %zu is wrong\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int Run(const std::string& command)
+{
+    std::fprintf(stderr, "%s\n", command.c_str());
+    return std::system(command.c_str());
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2) {
+        std::fprintf(stderr, "Usage: %s path/to/VideoConvert\n", argv[0]);
+        return 1;
+    }
+    const std::string tool = std::string("\"") + argv[1] + "\"";
+    const std::string input = "video_convert_in.pango";
+    const std::string output = "video_convert_out.pango";
+    const std::string partial = "video_convert_partial.pango";
+    const std::string whole = "video_convert_whole.pango";
+    for(const std::string& f : {output, partial, PangoSegmentFilename(partial, 1), PangoSegmentFilename(partial, 2), whole, PangoSegmentFilename(whole, 1)}) {
+        unlink(f.c_str());
+    }
+    WriteInput(input, num_frames);
+
+    // Chunks claimed by several readers are written in order
+    PANGO_CHECK(Run(tool + " --threads=3 --chunk=7 " + input + " pango://" + output) == 0);
+    std::vector<std::vector<unsigned char>> frames;
+    ReadFrames(output, frames);
+    PANGO_CHECK(FramesInOrder(frames));
+
+    // Cut a partial output part way through its last packet, as if the
+    // conversion had been killed
+    WriteInput(partial, 40);
+    int64_t last_packet = -1;
+    {
+        PacketStreamReader reader(partial);
+        for(const auto& src : reader.Sources()) {
+            if(!src.index.empty()) last_packet = std::max<int64_t>(last_packet, src.index.back().pos);
+        }
+    }
+    PANGO_CHECK(last_packet > 0);
+    PANGO_CHECK(truncate(partial.c_str(), last_packet + 20) == 0);
+
+    // Resuming keeps the 39 whole frames and writes the rest to a new part
+    PANGO_CHECK(Run(tool + " --threads=2 --chunk=5 --resume " + input + " pango://" + partial) == 0);
+    PANGO_CHECK(FileExists(PangoSegmentFilename(partial, 1)));
+    frames.clear();
+    ReadFrames(partial, frames);
+    PANGO_CHECK(frames.size() == 39);
+    ReadFrames(PangoSegmentFilename(partial, 1), frames);
+    PANGO_CHECK(FramesInOrder(frames));
+
+    // Nothing is left to do once complete
+    PANGO_CHECK(Run(tool + " --resume " + input + " pango://" + partial) == 0);
+    PANGO_CHECK(!FileExists(PangoSegmentFilename(partial, 2)));
+
+    // Cut an output just after its last packet, part way through the
+    // index which follows. Packets are all the same size here.
+    WriteInput(whole, 40);
+    int64_t packet_end = -1;
+    {
+        PacketStreamReader reader(whole);
+        const auto& index = reader.Sources()[0].index;
+        PANGO_CHECK(index.size() == 40);
+        packet_end = index[39].pos + (index[39].pos - index[38].pos);
+    }
+    PANGO_CHECK(truncate(whole.c_str(), packet_end + 3) == 0);
+
+    // Resuming keeps every complete packet
+    PANGO_CHECK(Run(tool + " --resume " + input + " pango://" + whole) == 0);
+    frames.clear();
+    ReadFrames(whole, frames);
+    PANGO_CHECK(frames.size() == 40);
+    ReadFrames(PangoSegmentFilename(whole, 1), frames);
+    PANGO_CHECK(FramesInOrder(frames));
+
+    return pangolin_test::TestResult();
+}
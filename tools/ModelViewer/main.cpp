@@ -6,6 +6,7 @@
 #include <pangolin/geometry/geometry.h>
 #include <pangolin/gl/glsl.h>
 #include <pangolin/gl/glvbo.h>
+#include <pangolin/gl/glfont.h>
 
 #include <pangolin/utils/file_utils.h>
 
@@ -38,6 +39,7 @@ int main( int argc, char** argv )
         { "bounds", {"--aabb"}, "Show axis-aligned bounding-box", 0},
         { "cull_backfaces", {"--cull"}, "Enable backface culling", 0},
         { "spin", {"--spin"}, "Spin models around an axis {none, negx, x, negy, y, negz, z}", 1},
+        { "cache", {"--cache"}, "Read / write a binary cache next to each model for faster reloads", 0},
     }};
 
     argagg::parser_results args = argparser.parse(argc, argv);
@@ -85,13 +87,14 @@ int main( int argc, char** argv )
             .SetBounds(0.0, 1.0, 0.0, 1.0, -w/h)
             .SetHandler(&handler);
 
-    // Load Geometry asynchronously
-    std::vector<std::future<pangolin::Geometry>> geom_to_load;
+    // Load Geometry asynchronously, spatially sorting for frustum culling
+    std::vector<std::unique_ptr<pangolin::GlGeometryLoader>> geom_to_load;
     for(const auto& f : ExpandGlobOption(args["model"]))
     {
-        geom_to_load.emplace_back( std::async(std::launch::async,[f](){
-            return pangolin::LoadGeometry(f);
-        }) );
+        const size_t max_rows_per_leaf = 1 << 15;
+        geom_to_load.emplace_back(new pangolin::GlGeometryLoader(f, [max_rows_per_leaf](pangolin::Geometry& geom){
+            pangolin::BuildGeometryOctree(geom, max_rows_per_leaf);
+        }, args.has_option("cache"), "BuildGeometryOctree " + std::to_string(max_rows_per_leaf)));
     }
 
     // Render tree for holding object position
@@ -106,26 +109,38 @@ int main( int argc, char** argv )
         }
     };
 
-    // Pull one piece of loaded geometry onto the GPU if ready
+    // Upload a slice of loaded geometry to the GPU each frame so that
+    // rendering stays interactive whilst large models stream in.
+    const size_t upload_bytes_per_frame = 64 << 20;
     Eigen::AlignedBox3f total_aabb;
-    auto LoadGeometryToGpu = [&]()
+    auto LoadGeometryToGpu = [&]() -> float
     {
-        for(auto& future_geom : geom_to_load) {
-            if( future_geom.valid() && is_ready(future_geom) ) {
-                auto geom = future_geom.get();
-                auto aabb = pangolin::GetAxisAlignedBox(geom);
-                total_aabb.extend(aabb);
-                const Eigen::Vector3f center = total_aabb.center();
-                const Eigen::Vector3f view = center + Eigen::Vector3f(1.2f,1.2f,1.2f) * std::max( (total_aabb.max() - center).norm(), (center - total_aabb.min()).norm());
-                const auto mvm = pangolin::ModelViewLookAt(view[0], view[1], view[2], center[0], center[1], center[2], pangolin::AxisY);
-                s_cam.SetModelViewMatrix(mvm);
-                auto renderable = std::make_shared<GlGeomRenderable>(pangolin::ToGlGeometry(geom), aabb);
-                renderables.push_back(renderable);
-                RenderNode::Edge edge = { spin_transform, { renderable, {} } };
-                root.edges.emplace_back(std::move(edge));
-                break;
+        for(auto& loader : geom_to_load) {
+            if(!loader) continue;
+            try {
+                if(loader->Upload(upload_bytes_per_frame)) {
+                    const auto& geom = loader->GetGeometry();
+                    auto aabb = pangolin::GetAxisAlignedBox(geom);
+                    total_aabb.extend(aabb);
+                    const Eigen::Vector3f center = total_aabb.center();
+                    const Eigen::Vector3f view = center + Eigen::Vector3f(1.2f,1.2f,1.2f) * std::max( (total_aabb.max() - center).norm(), (center - total_aabb.min()).norm());
+                    const auto mvm = pangolin::ModelViewLookAt(view[0], view[1], view[2], center[0], center[1], center[2], pangolin::AxisY);
+                    s_cam.SetModelViewMatrix(mvm);
+                    auto renderable = std::make_shared<GlGeomRenderable>(std::move(loader->GetGlGeometry()), aabb);
+                    renderables.push_back(renderable);
+                    RenderNode::Edge edge = { spin_transform, { renderable, {} } };
+                    root.edges.emplace_back(std::move(edge));
+                    loader.reset();
+                    break;
+                }else if(loader->GetState() == pangolin::GlGeometryLoader::Uploading) {
+                    return loader->Progress();
+                }
+            }catch(const std::exception& e) {
+                pango_print_error("Unable to load geometry: %s\n", e.what());
+                loader.reset();
             }
         }
+        return -1.0f;
     };
 
     // Load Any matcap materials
@@ -202,7 +217,7 @@ int main( int argc, char** argv )
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Load any pending geometry to the GPU.
-        LoadGeometryToGpu();
+        const float upload_progress = LoadGeometryToGpu();
 
 
         if(d_cam.IsShown()) {
@@ -261,6 +276,12 @@ int main( int argc, char** argv )
             if(show_axis) pangolin::glDrawAxis(10.0);
 
             glDisable(GL_CULL_FACE);
+
+            if(upload_progress >= 0.0f) {
+                pangolin::GlFont::I().Text("Uploading %d%%", (int)(100 * upload_progress)).DrawWindow(
+                    d_cam.v.l + 10.0f, d_cam.v.b + 10.0f
+                );
+            }
         }
 
         pangolin::FinishFrame();
@@ -1,64 +1,420 @@
 #include <pangolin/pangolin.h>
-#include <pangolin/video/video_input.h>
+#include <pangolin/log/packetstream_reader.h>
+#include <pangolin/video/drivers/pango_video_output.h>
+#include <pangolin/video/video_output.h>
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/utils/timer.h>
 
-void VideoViewer(const std::string& input_uri, const std::string& output_uri)
+#include <atomic>
+#include <fstream>
+#include <condition_variable>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN_
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+struct ConvertOptions
 {
-    pangolin::Var<bool> video_wait("video.wait", true);
-    pangolin::Var<bool> video_newest("video.newest", false);
+    std::string input_uri;
+    std::string output_uri;
+    size_t threads = 1;
+    size_t chunk_frames = 64;
+    size_t queue_frames = 0;
+    bool resume = false;
+};
 
-    // Open Video by URI
-    pangolin::VideoInput video(input_uri, output_uri);
-    const size_t num_streams = video.Streams().size();
+// Frames read (possibly out of order) by the reader threads, handed to the
+// writer in order. Readers block while their frame is more than
+// queue_frames ahead of the writer, which bounds memory use.
+class FrameQueue
+{
+public:
+    struct Frame
+    {
+        std::vector<unsigned char> data;
+        picojson::value properties;
+    };
+
+    FrameQueue(size_t first_frame, size_t end_frame, size_t queue_frames, size_t frame_bytes)
+        : next_write(first_frame), end(end_frame), queue_frames(std::max<size_t>(1,queue_frames)), frame_bytes(frame_bytes)
+    {
+    }
+
+    // Wait until frame index may be read, returning a buffer to read it
+    // into, or false once the conversion is over.
+    bool Reserve(size_t index, std::vector<unsigned char>& buffer)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&](){ return !error.empty() || index >= end || index < next_write + queue_frames; });
+        if(!error.empty() || index >= end) return false;
+        if(!free_buffers.empty()) {
+            buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+        buffer.resize(frame_bytes);
+        return true;
+    }
 
-    pangolin::VideoPlaybackInterface* playback = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPlaybackInterface>(video);
+    void Push(size_t index, Frame&& frame)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[index] = std::move(frame);
+        }
+        cond.notify_all();
+    }
+
+    // The input ended before frame index
+    void EndAt(size_t index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            end = std::min(end, index);
+        }
+        cond.notify_all();
+    }
+
+    void Fail(const std::string& message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(error.empty()) error = message;
+        }
+        cond.notify_all();
+    }
+
+    // Wait for the next frame in order. Returns false at the end of input.
+    bool Pop(Frame& frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&](){ return !error.empty() || next_write >= end || ready.count(next_write); });
+        if(!error.empty()) throw std::runtime_error(error);
+        if(next_write >= end) return false;
+        auto it = ready.find(next_write);
+        if(!frame.data.empty()) free_buffers.push_back(std::move(frame.data));
+        frame = std::move(it->second);
+        ready.erase(it);
+        ++next_write;
+        lock.unlock();
+        cond.notify_all();
+        return true;
+    }
+
+private:
+    size_t next_write;
+    size_t end;
+    size_t queue_frames;
+    size_t frame_bytes;
+    std::map<size_t, Frame> ready;
+    std::vector<std::vector<unsigned char>> free_buffers;
+    std::string error;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+// True if filename ends with the footer written when a log is closed.
+bool HasPangoFooter(const std::string& filename)
+{
+    std::ifstream f(filename, std::ios::binary);
+    f.seekg(-(std::streamoff)(sizeof(uint64_t) + pangolin::TAG_LENGTH), std::ios::end);
+    pangolin::pangoTagType tag = 0;
+    f.read(reinterpret_cast<char*>(&tag), pangolin::TAG_LENGTH);
+    return f.good() && tag == pangolin::TAG_PANGO_FOOTER;
+}
+
+#ifndef _WIN_
+// Length of the prefix of a footerless .pango file holding only whole
+// packets, or -1 if it has none. The last indexed packet is kept if its
+// header parses and its data fits in the file as it was found.
+int64_t CompletePacketBytes(const std::string& filename)
+{
+    // Before the reader appends a rebuilt index
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0) return -1;
+
+    pangolin::PacketStreamReader reader(filename);
+    int64_t last_pos = -1;
+    pangolin::PacketStreamSourceId last_src = 0;
+    for(const auto& src : reader.Sources()) {
+        if(!src.index.empty() && src.index.back().pos > last_pos) {
+            last_pos = src.index.back().pos;
+            last_src = src.id;
+        }
+    }
+    if(last_pos < 0) return -1;
+
+    try {
+        const size_t last_frame = reader.Sources()[last_src].index.size() - 1;
+        if(reader.Seek(last_src, last_frame) != last_frame) return last_pos;
+        pangolin::Packet packet = reader.NextFrame(last_src);
+        const int64_t data_end = (int64_t)packet.Stream().tellg() + (int64_t)packet.size;
+        if(packet.frame_streampos == last_pos && packet.Stream().good() && data_end <= (int64_t)st.st_size) {
+            return data_end;
+        }
+    }catch(const std::exception&) {
+        // Header cut short
+    }
+    return last_pos;
+}
+#endif
+
+// Number of frames already written to a .pango output (including any
+// continuation parts from earlier resumes), and the file the remaining
+// frames should go to.
+size_t RecordedFrames(const std::string& filename, std::string& continuation)
+{
+    size_t frames = 0;
+    for(size_t part = 0; ; ++part) {
+        const std::string part_filename = part ? pangolin::PangoSegmentFilename(filename, part) : filename;
+        if(!pangolin::FileExists(part_filename)) {
+            continuation = part_filename;
+            return frames;
+        }
+
+#ifndef _WIN_
+        // A log cut short has no footer, and may end part way through its
+        // last packet. Cut the file back to the end of the last complete
+        // packet, so that the reader below indexes only whole frames.
+        if(!HasPangoFooter(part_filename)) {
+            const int64_t complete_bytes = CompletePacketBytes(part_filename);
+            if(complete_bytes >= 0 && truncate(part_filename.c_str(), complete_bytes) != 0) {
+                throw pangolin::VideoException("VideoConvert: unable to truncate partial output", part_filename);
+            }
+        }
+#endif
+
+        pangolin::PacketStreamReader reader(part_filename);
+        for(const auto& src : reader.Sources()) {
+            if(src.driver == "raw_video") frames += src.index.size();
+        }
+    }
+}
+
+// Read frames [first, end) of a seekable input in chunks claimed from
+// next_chunk, so that several readers can decode in parallel.
+void ReadChunks(pangolin::VideoInterface* video, pangolin::VideoPlaybackInterface* playback, size_t first, size_t end, size_t chunk_frames, std::atomic<size_t>& next_chunk, FrameQueue& queue)
+{
+    try {
+        while(true) {
+            const size_t begin = first + chunk_frames * next_chunk++;
+            if(begin >= end) return;
+
+            if(playback->Seek(begin) != begin) {
+                queue.EndAt(begin);
+                return;
+            }
+
+            for(size_t i = begin; i < std::min(begin + chunk_frames, end); ++i) {
+                FrameQueue::Frame frame;
+                if(!queue.Reserve(i, frame.data)) return;
+                if(!video->GrabNext(frame.data.data(), true)) {
+                    queue.EndAt(i);
+                    return;
+                }
+                if(i == begin && playback->GetCurrentFrameId() != begin) {
+                    // Seek landed elsewhere; writing this chunk would misplace frames
+                    throw std::runtime_error(
+                        "Seek to frame " + std::to_string(begin) + " returned frame " +
+                        std::to_string(playback->GetCurrentFrameId()) + "."
+                    );
+                }
+                frame.properties = pangolin::GetVideoFrameProperties(video);
+                queue.Push(i, std::move(frame));
+            }
+        }
+    }catch(const std::exception& e) {
+        queue.Fail(e.what());
+    }
+}
+
+// Read frames in order from an input which can't seek, skipping the first.
+void ReadSequential(pangolin::VideoInterface* video, size_t first, FrameQueue& queue)
+{
+    try {
+        std::vector<unsigned char> skip(video->SizeBytes());
+        for(size_t i = 0; i < first; ++i) {
+            if(!video->GrabNext(skip.data(), true)) {
+                queue.EndAt(i);
+                return;
+            }
+        }
+        for(size_t i = first; ; ++i) {
+            FrameQueue::Frame frame;
+            if(!queue.Reserve(i, frame.data)) return;
+            if(!video->GrabNext(frame.data.data(), true)) {
+                queue.EndAt(i);
+                return;
+            }
+            frame.properties = pangolin::GetVideoFrameProperties(video);
+            queue.Push(i, std::move(frame));
+        }
+    }catch(const std::exception& e) {
+        queue.Fail(e.what());
+    }
+}
+
+void VideoConvert(const ConvertOptions& opts)
+{
+    // Open Video by URI
+    std::vector<std::unique_ptr<pangolin::VideoInterface>> videos;
+    videos.push_back(pangolin::OpenVideo(opts.input_uri));
+    pangolin::VideoInterface* video = videos[0].get();
+    const size_t num_streams = video->Streams().size();
 
     // Output details of video stream
     for(size_t s = 0; s < num_streams; ++s)
     {
-        const pangolin::StreamInfo& si = video.Streams()[s];
+        const pangolin::StreamInfo& si = video->Streams()[s];
         std::cout << "Stream " << s << ": " << si.Width() << " x " << si.Height()
                   << " " << si.PixFormat().format << " (pitch: " << si.Pitch() << " bytes)" << std::endl;
     }
 
-    // Image buffers
-    std::vector<pangolin::Image<unsigned char> > images;
-    std::vector<unsigned char> buffer;
-    buffer.resize(video.SizeBytes()+1);
+    pangolin::VideoPlaybackInterface* playback = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPlaybackInterface>(*video);
+    const size_t total_frames = playback ? playback->GetTotalFrames() : 0;
+    const bool seekable = playback && total_frames > 0 && total_frames != std::numeric_limits<size_t>::max();
+
+    // Continue a partial .pango output in a new part file
+    pangolin::Uri output_uri = pangolin::ParseUri(opts.output_uri);
+    size_t first_frame = 0;
+    if(opts.resume) {
+        if(output_uri.scheme != "pango" && output_uri.scheme != "file") {
+            throw pangolin::VideoException("VideoConvert: --resume is only supported for pango outputs.");
+        }
+        std::string continuation;
+        first_frame = RecordedFrames(pangolin::PathExpand(output_uri.url), continuation);
+        if(first_frame > 0) {
+            std::cout << "Resuming at frame " << first_frame << ", writing to " << continuation << std::endl;
+            output_uri.url = continuation;
+        }
+    }
+    const size_t end_frame = seekable ? total_frames : std::numeric_limits<size_t>::max();
+    if(first_frame >= end_frame) {
+        std::cout << "Nothing to do: all " << total_frames << " frames are already converted." << std::endl;
+        return;
+    }
+
+    std::unique_ptr<pangolin::VideoOutputInterface> output = pangolin::OpenVideoOutput(output_uri);
+    output->SetStreams(video->Streams(), opts.input_uri, pangolin::GetVideoDeviceProperties(video));
 
-    // Record all frames
-    video.Record();
+    // Reader stage: split seekable inputs by frame range across several
+    // instances, each with their own reader and decoders.
+    const size_t num_readers = seekable ? std::max<size_t>(1, opts.threads) : 1;
+    for(size_t r = 1; r < num_readers; ++r) {
+        videos.push_back(pangolin::OpenVideo(opts.input_uri));
+    }
 
-    // Stream and display video
-    while(true)
-    {
-        if( !video.Grab(&buffer[0], images, video_wait, video_newest) ) {
-            break;
+    const size_t queue_frames = opts.queue_frames ? opts.queue_frames : 2 * num_readers * opts.chunk_frames;
+    FrameQueue queue(first_frame, end_frame, queue_frames, video->SizeBytes());
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> readers;
+    for(size_t r = 0; r < num_readers; ++r) {
+        pangolin::VideoInterface* v = videos[r].get();
+        if(seekable) {
+            pangolin::VideoPlaybackInterface* p = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPlaybackInterface>(*v);
+            readers.emplace_back(ReadChunks, v, p, first_frame, end_frame, opts.chunk_frames, std::ref(next_chunk), std::ref(queue));
+        }else{
+            readers.emplace_back(ReadSequential, v, first_frame, std::ref(queue));
         }
-        if( playback ) {
-            std::cout << "Frames complete: " << playback->GetCurrentFrameId() << " / " << playback->GetTotalFrames() << '\r';
-            std::cout.flush();
+    }
+
+    // Writer stage, in frame order.
+    const pangolin::basetime start = pangolin::TimeNow();
+    pangolin::basetime last_report = start;
+    size_t frames_written = 0;
+    FrameQueue::Frame frame;
+    std::string error;
+
+    auto report = [&](){
+        const double elapsed = std::max(1e-6, pangolin::TimeDiff_us(start, pangolin::TimeNow()) * 1e-6);
+        const double fps = frames_written / elapsed;
+        std::cout << "Frames complete: " << first_frame + frames_written;
+        if(seekable) std::cout << " / " << total_frames;
+        std::cout << std::fixed << std::setprecision(1) << "  " << fps << " fps  "
+                  << fps * video->SizeBytes() / (1024.0*1024.0) << " MB/s";
+        if(seekable && fps > 0) {
+            std::cout << "  ETA " << (size_t)((total_frames - first_frame - frames_written) / fps) << " s";
         }
-   }
-}
+        std::cout << "    \r";
+        std::cout.flush();
+    };
+
+    try {
+        while(queue.Pop(frame)) {
+            output->WriteStreams(frame.data.data(), frame.properties);
+            ++frames_written;
+            if(pangolin::TimeDiff_us(last_report, pangolin::TimeNow()) > 500000) {
+                last_report = pangolin::TimeNow();
+                report();
+            }
+        }
+    }catch(const std::exception& e) {
+        error = e.what();
+        queue.Fail(error);
+    }
+
+    for(std::thread& t : readers) {
+        t.join();
+    }
+    output.reset();
 
+    report();
+    std::cout << std::endl;
+
+    if(!error.empty()) {
+        throw pangolin::VideoException(error);
+    }
+}
 
 int main( int argc, char* argv[] )
 {
     const std::string dflt_output_uri = "pango:[unique_filename]//video.pango";
 
-    if( argc > 1 ) {
-        const std::string input_uri = std::string(argv[1]);
-        const std::string output_uri = (argc > 2) ? std::string(argv[2]) : dflt_output_uri;
+    ConvertOptions opts;
+    opts.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::string> positional;
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        const std::string key = arg.substr(0, eq);
+        const std::string val = eq == std::string::npos ? "" : arg.substr(eq+1);
+        if(key == "--threads") {
+            opts.threads = std::stoul(val);
+        }else if(key == "--chunk") {
+            opts.chunk_frames = std::max<size_t>(1, std::stoul(val));
+        }else if(key == "--queue") {
+            opts.queue_frames = std::stoul(val);
+        }else if(key == "--resume") {
+            opts.resume = true;
+        }else{
+            positional.push_back(arg);
+        }
+    }
+
+    if( positional.size() > 0 ) {
+        opts.input_uri = positional[0];
+        opts.output_uri = (positional.size() > 1) ? positional[1] : dflt_output_uri;
         try{
-            VideoViewer(input_uri, output_uri);
-        } catch (const pangolin::VideoException& e) {
+            VideoConvert(opts);
+        } catch (const std::exception& e) {
             std::cout << e.what() << std::endl;
+            return 1;
         }
     }else{
-        std::cout << "Usage  : VideoConvert [video-in-uri] [video-out-uri]" << std::endl << std::endl;
+        std::cout << "Usage  : VideoConvert [options] [video-in-uri] [video-out-uri]" << std::endl << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout << "\t--threads=N  Decode seekable inputs (e.g. .pango) with N readers, each taking" << std::endl;
+        std::cout << "\t             --chunk=M frames at a time (default: one per core, 64)" << std::endl;
+        std::cout << "\t--queue=N    Frames read ahead of the writer (default: 2 * threads * chunk)" << std::endl;
+        std::cout << "\t--resume     Skip frames already in a partial pango output, and write the" << std::endl;
+        std::cout << "\t             rest to the next part, <name>_000001.pango etc." << std::endl << std::endl;
         std::cout << "Where video-in-uri describes a stream or file resource, e.g." << std::endl;
+        std::cout << "\tpango:[throughput=1]///home/user/video/movie.pango" << std::endl;
         std::cout << "\tfile:[realtime=1]///home/user/video/movie.pvn" << std::endl;
         std::cout << "\tfile:///home/user/video/movie.avi" << std::endl;
         std::cout << "\tfiles:///home/user/seqiemce/foo*.jpeg" << std::endl;
@@ -69,6 +425,9 @@ int main( int argc, char* argv[] )
         std::cout << "\tmjpeg://http://127.0.0.1/?action=stream" << std::endl;
         std::cout << "\topenni:[img1=rgb]//" << std::endl;
         std::cout << std::endl;
+        std::cout << "and video-out-uri a destination, e.g." << std::endl;
+        std::cout << "\tpango:[encoder=png,encode_threads=8]///home/user/video/movie_png.pango" << std::endl;
+        std::cout << std::endl;
     }
 
     return 0;